@@ -0,0 +1,38 @@
+/** @file VIBImports.h
+ *
+ * VIB Class Library
+ * Runtime lookup of newer VisualIB entry points
+ * @author James Haley
+ *
+ * @warning This code is for internal library use; do not include in user code.
+ */
+
+#ifndef VIBIMPORTS_H__
+#define VIBIMPORTS_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+//
+// Entry points added to VisualIB.dll after the prebuilt import library are
+// looked up in the loaded DLL instead of being linked, so the wrappers still
+// link and run against an older DLL. The result is null when the DLL lacks
+// the entry point, and callers fall back on the older exports.
+//
+template<typename F> static inline F VIBImportProc(const char *name)
+{
+   HMODULE mod = GetModuleHandleA("VisualIB.dll");
+   return mod ? reinterpret_cast<F>(GetProcAddress(mod, name)) : nullptr;
+}
+
+// C++Builder exports cdecl functions with a leading underscore.
+#define VIBIMPORT(func) VIBImportProc<decltype(&func)>("_" #func)
+
+#endif
+
+// EOF
@@ -7,13 +7,27 @@
 #pragma warning(disable : 4800 4355)
 #endif
 
+#include <algorithm>
+#include <string.h>
+
 #include "../vibdatabase.h"
 #include "../vibdataset.h"
 
 #include "classVIBDataSet.h"
+#include "VIBImports.h"
 #include "VIBInternalErrors.h"
 #include "VIBUtils.h"
 
+//
+// FetchBlock
+//
+
+VIB::FetchBlock::FetchBlock(int pRowCapacity, size_t arenaSize)
+   : rowCapacity(pRowCapacity > 0 ? pRowCapacity : 1), numRows(0), numCols(0),
+     arena(arenaSize > 0 ? arenaSize : 1), offsets(), lengths(), nulls(), types()
+{
+}
+
 //
 // Property class implementations
 //
@@ -97,7 +111,7 @@ void VIB::DataSet::SelectSQLClass::Add(const std::string &str)
 //
 VIB::DataSet::DataSet(VIBDataSet *pvds)
    : fbnc(this), fc(this), sql(this),
-     Database(), FieldCount(), Fields(), SelectSQL(), Transaction(), UniDirectional()
+     Database(), FieldCount(), Fields(), Prepared(), SelectSQL(), Transaction(), UniDirectional()
 {
    if(pvds)
       vds = pvds;
@@ -121,6 +135,13 @@ VIB::DataSet::DataSet(VIBDataSet *pvds)
       [=] ()                        { return &fc; },
       [=] (FieldsClass *const &pfc) { throw Error("Cannot set Fields"); });
 
+   // Prepared; with an older VisualIB.dll, go by the plan, which IBX only
+   // reports for a prepared query
+   static auto preparedProc = VIBIMPORT(VIBDataSet_Prepared);
+   Prepared.initCallbacks(
+      [=] ()              { return preparedProc ? !!preparedProc(vds) : !Plan().empty(); },
+      [=] (const bool &b) { throw Error("Cannot set Prepared"); });
+
    // SelectSQL
    SelectSQL.initCallbacks(
       [=] ()                            { return &sql; },
@@ -184,6 +205,91 @@ std::string VIB::DataSet::Plan()
    return ElideVIBString(VIBDataSet_Plan(vds));
 }
 
+int VIB::DataSet::fetchBlock(FetchBlock &block)
+{
+   static auto fetchBlockProc = VIBIMPORT(VIBDataSet_FetchBlock);
+
+   int numCols = VIBDataSet_Fields_Count(vds);
+   size_t numCells = static_cast<size_t>(block.rowCapacity) * numCols;
+
+   if(block.offsets.size() < numCells)
+   {
+      block.offsets.resize(numCells);
+      block.lengths.resize(numCells);
+      block.nulls.resize((numCells + 7) / 8);
+   }
+   if(block.types.size() < static_cast<size_t>(numCols))
+      block.types.resize(numCols);
+
+   if(!fetchBlockProc)
+      return fetchBlockByField(block, numCols);
+
+   VIBFetchBlock vfb;
+   vfb.rowCapacity = block.rowCapacity;
+   vfb.colCapacity = numCols;
+   vfb.offsets     = block.offsets.data();
+   vfb.lengths     = block.lengths.data();
+   vfb.nulls       = block.nulls.data();
+   vfb.types       = block.types.data();
+
+   for(;;)
+   {
+      vfb.arena     = block.arena.data();
+      vfb.arenaSize = static_cast<unsigned int>(block.arena.size());
+
+      VIBSAFECALL(fetchBlockProc(vds, block.rowCapacity, &vfb));
+
+      // a single record too large for the arena? grow it and try again.
+      if(vfb.numRows == 0 && vfb.arenaFull)
+         block.arena.resize(block.arena.size() * 2);
+      else
+         break;
+   }
+
+   block.numRows = vfb.numRows;
+   block.numCols = vfb.numCols;
+   return vfb.numRows;
+}
+
+//
+// Older DLLs have no way to tell a NULL field from an empty one, so no cell
+// is flagged as NULL here.
+//
+int VIB::DataSet::fetchBlockByField(FetchBlock &block, int numCols)
+{
+   size_t used = 0;
+   int    row  = 0;
+
+   for(int col = 0; col < numCols; col++)
+      block.types[col] = VIBDataSet_Fields_DataType(vds, col);
+   std::fill(block.nulls.begin(), block.nulls.end(), 0);
+
+   while(row < block.rowCapacity && !VIBDataSet_Eof(vds))
+   {
+      for(int col = 0; col < numCols; col++)
+      {
+         std::string str  = ElideVIBString(VIBDataSet_Fields_AsString(vds, col));
+         size_t      len  = str.length();
+         int         cell = block.cellIndex(row, col);
+
+         if(block.arena.size() - used < len + 1)
+            block.arena.resize(std::max(block.arena.size() * 2, used + len + 1));
+
+         block.offsets[cell] = static_cast<unsigned int>(used);
+         block.lengths[cell] = static_cast<unsigned int>(len);
+         memcpy(&block.arena[used], str.c_str(), len + 1);
+         used += len + 1;
+      }
+
+      ++row;
+      VIBSAFECALL(VIBDataSet_Next(vds));
+   }
+
+   block.numRows = row;
+   block.numCols = numCols;
+   return row;
+}
+
 VIB::DataSet::FieldByNameClass *VIB::DataSet::FieldByName(const std::string &fieldname)
 {
    fbnc.fieldname = fieldname;
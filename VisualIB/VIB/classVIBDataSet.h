@@ -8,6 +8,7 @@
 #define CLASSVIBDATASET_H__
 
 #include <string>
+#include <vector>
 #include "VIBProperties.h"
 
 struct VIBDataSet;
@@ -19,6 +20,61 @@ namespace VIB
    class Database;
    class Transaction;
 
+   /**
+    * Columnar block of records filled by VIB::DataSet::fetchBlock. Storage is
+    * retained between fetches, so a single block may be reused for an entire
+    * result set without further allocation once it has reached its working
+    * size.
+    */
+   class FetchBlock
+   {
+   protected:
+      friend class DataSet;
+
+      int rowCapacity;                    //!< Maximum rows per fetch
+      int numRows;                        //!< Rows stored by the last fetch
+      int numCols;                        //!< Columns stored by the last fetch
+      std::vector<char>          arena;   //!< NUL-terminated cell text
+      std::vector<unsigned int>  offsets; //!< Offset of each cell's text in arena
+      std::vector<unsigned int>  lengths; //!< Length of each cell's text
+      std::vector<unsigned char> nulls;   //!< Null bitmap, one bit per cell
+      std::vector<VIBFieldType>  types;   //!< Type tag of each column
+
+      int cellIndex(int row, int col) const { return col * rowCapacity + row; }
+
+   public:
+      /**
+       * Construct a FetchBlock.
+       * @param[in] pRowCapacity Maximum number of rows to fetch per call.
+       * @param[in] arenaSize Initial size of the cell text arena in bytes. The
+       *   arena grows on demand if a single record will not fit.
+       */
+      FetchBlock(int pRowCapacity = 256, size_t arenaSize = 64*1024);
+
+      /** Number of rows stored by the last fetch. */
+      int Rows() const { return numRows; }
+      /** Number of columns stored by the last fetch. */
+      int Cols() const { return numCols; }
+      /** Returns true if the given cell was NULL. */
+      bool IsNull(int row, int col) const
+      {
+         int cell = cellIndex(row, col);
+         return (nulls[cell >> 3] & (1 << (cell & 7))) != 0;
+      }
+      /** Pointer to the NUL-terminated text of a cell; valid until the next fetch. */
+      const char *CStr(int row, int col) const { return &arena[offsets[cellIndex(row, col)]]; }
+      /** Length of the text of a cell, not counting the NUL terminator. */
+      unsigned int Length(int row, int col) const { return lengths[cellIndex(row, col)]; }
+      /** Copy the text of a cell into a std::string. */
+      std::string AsString(int row, int col) const 
+      { 
+         int cell = cellIndex(row, col);
+         return std::string(&arena[offsets[cell]], lengths[cell]);
+      }
+      /** Type tag of a column. */
+      VIBFieldType DataType(int col) const { return types[col]; }
+   };
+
    /**
     * VIB::DataSet wraps the VisualIB VIBDataSet C structure to provide a C++11
     * object with semantics compatible with those of Borland TIBDataSet.
@@ -28,6 +84,12 @@ namespace VIB
    protected:
       VIBDataSet *vds; //!< Pointer to the wrapped VIBDataSet instance.
 
+      /**
+       * fetchBlock for a VisualIB.dll without VIBDataSet_FetchBlock; fills
+       * the block one field at a time.
+       */
+      int fetchBlockByField(FetchBlock &block, int numCols);
+
    public:
       /**
        * Construct a VIB::DataSet instance.
@@ -82,6 +144,15 @@ namespace VIB
        * @returns The SQL query plan for the SelectSQL statement?
        */
       std::string Plan();
+      /**
+       * Fetch up to block's row capacity of records, starting with the current
+       * record, into a columnar FetchBlock in one call. The cursor is left on
+       * the first record not fetched.
+       * @param[in,out] block Destination block; its previous contents are replaced.
+       * @returns Number of records fetched; zero once the dataset is at Eof.
+       * @note API Extension - Not present in TIBDataSet.
+       */
+      int fetchBlock(FetchBlock &block);
 
       // Property classes
 
@@ -294,6 +365,13 @@ namespace VIB
        * @note Reimplements TDataSet\::Fields
        */
       Property<FieldsClass *>      Fields;
+      /**
+       * Indicates whether or not the query has been prepared. IBX unprepares
+       * the query whenever its transaction ends or is changed.
+       * @note Read-only property.
+       * @note Reimplements TIBDataSet\::Prepared
+       */
+      Property<bool>               Prepared;
       /**
        * Provides the ability to directly access the SQL object encapsulating the SelectSQL
        * statement.
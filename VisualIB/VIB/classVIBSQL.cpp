@@ -7,10 +7,29 @@
 #pragma warning(disable : 4800 4355)
 #endif
 
+#include <algorithm>
+#include <stdio.h>
+
 #include "classVIBSQL.h"
+#include "VIBImports.h"
 #include "VIBInternalErrors.h"
 #include "VIBUtils.h"
 
+//
+// Indexed parameter access is newer than the prebuilt VisualIB.dll. Without
+// it, IndexOf and ByName number the parameter names they are given, and the
+// ordinal methods bind through the by-name exports instead.
+//
+static auto paramsCountProc        = VIBIMPORT(VIBSQL_Params_Count);
+static auto paramsIndexOfProc      = VIBIMPORT(VIBSQL_Params_IndexOf);
+static auto paramsGetSQLTypeProc   = VIBIMPORT(VIBSQL_Params_GetSQLType);
+static auto paramsSetIsNullProc    = VIBIMPORT(VIBSQL_Params_SetIsNull);
+static auto paramsSetAsStringProc  = VIBIMPORT(VIBSQL_Params_SetAsString);
+static auto paramsSetInt64Proc     = VIBIMPORT(VIBSQL_Params_SetInt64);
+static auto paramsSetDoubleProc    = VIBIMPORT(VIBSQL_Params_SetDouble);
+static auto paramsSetTimestampProc = VIBIMPORT(VIBSQL_Params_SetTimestamp);
+static auto paramsSetBytesProc     = VIBIMPORT(VIBSQL_Params_SetBytes);
+
 // Property class implementations
 
 VIB::SQL::SQLClass::SQLClass(SQL *pParent)
@@ -19,7 +38,11 @@ VIB::SQL::SQLClass::SQLClass(SQL *pParent)
    // Init properties
    Text.initCallbacks(
       [=] ()                     { return ElideVIBString(VIBSQL_SQL_GetText(parent->vsql)); },
-      [=] (const std::string &s) { VIBSAFECALL(VIBSQL_SQL_SetText(parent->vsql, s.c_str())); });
+      [=] (const std::string &s) 
+      { 
+         VIBSAFECALL(VIBSQL_SQL_SetText(parent->vsql, s.c_str())); 
+         parent->paramNames.clear();
+      });
 }
 
 VIB::SQL::ParamClass::ParamClass(SQL *pParent)
@@ -42,12 +65,127 @@ VIB::SQL::ParamClass::ParamClass(SQL *pParent)
       [=] (const int &i) { throw Error("Cannot set SQLType"); });
 }
 
+int VIB::SQL::ParamsSetClass::nameIndex(const std::string &name)
+{
+   std::vector<std::string> &names = parent->paramNames;
+   std::vector<std::string>::iterator itr = std::find(names.begin(), names.end(), name);
+
+   if(itr != names.end())
+      return static_cast<int>(itr - names.begin());
+
+   names.push_back(name);
+   return static_cast<int>(names.size() - 1);
+}
+
+const char *VIB::SQL::ParamsSetClass::nameAt(int idx)
+{
+   if(idx < 0 || static_cast<size_t>(idx) >= parent->paramNames.size())
+      throw Error("Parameter index out of range");
+   return parent->paramNames[idx].c_str();
+}
+
 auto VIB::SQL::ParamsSetClass::ByName(const std::string &str) -> ParamClass *
 {
+   // remember it, so that Count covers every parameter given a value
+   if(!paramsIndexOfProc)
+      nameIndex(str);
+
    pc.name = str;
    return &pc;
 }
 
+int VIB::SQL::ParamsSetClass::Count()
+{
+   if(!paramsCountProc)
+      return static_cast<int>(parent->paramNames.size());
+   return paramsCountProc(parent->vsql);
+}
+
+int VIB::SQL::ParamsSetClass::IndexOf(const std::string &name)
+{
+   if(!paramsIndexOfProc)
+      return nameIndex(name);
+
+   int idx = -1;
+   VIBSAFECALL(paramsIndexOfProc(parent->vsql, name.c_str(), &idx));
+   return idx;
+}
+
+int VIB::SQL::ParamsSetClass::GetSQLType(int idx)
+{
+   if(!paramsGetSQLTypeProc)
+      return VIBSQL_Params_ByName_GetSQLType(parent->vsql, nameAt(idx));
+   return paramsGetSQLTypeProc(parent->vsql, idx);
+}
+
+void VIB::SQL::ParamsSetClass::SetIsNull(int idx, bool isNull)
+{
+   if(!paramsSetIsNullProc)
+      VIBSAFECALL(VIBSQL_Params_ByName_SetIsNull(parent->vsql, nameAt(idx), isNull));
+   else
+      VIBSAFECALL(paramsSetIsNullProc(parent->vsql, idx, isNull));
+}
+
+void VIB::SQL::ParamsSetClass::SetAsString(int idx, const std::string &str)
+{
+   if(!paramsSetAsStringProc)
+      VIBSAFECALL(VIBSQL_Params_ByName_SetAsString(parent->vsql, nameAt(idx), str.c_str()));
+   else
+      VIBSAFECALL(paramsSetAsStringProc(parent->vsql, idx, str.c_str()));
+}
+
+void VIB::SQL::ParamsSetClass::SetAsString(int idx, const char *str, size_t len)
+{
+   if(!paramsSetBytesProc)
+      SetAsString(idx, std::string(str, len));
+   else
+      VIBSAFECALL(paramsSetBytesProc(parent->vsql, idx, str, static_cast<unsigned int>(len)));
+}
+
+void VIB::SQL::ParamsSetClass::SetInt64(int idx, long long value)
+{
+   if(!paramsSetInt64Proc)
+   {
+      char buf[32];
+      sprintf(buf, "%lld", value);
+      SetAsString(idx, buf);
+   }
+   else
+      VIBSAFECALL(paramsSetInt64Proc(parent->vsql, idx, value));
+}
+
+void VIB::SQL::ParamsSetClass::SetDouble(int idx, double value)
+{
+   if(!paramsSetDoubleProc)
+   {
+      char buf[32];
+      sprintf(buf, "%.17g", value);
+      SetAsString(idx, buf);
+   }
+   else
+      VIBSAFECALL(paramsSetDoubleProc(parent->vsql, idx, value));
+}
+
+void VIB::SQL::ParamsSetClass::SetTimestamp(int idx, int year, int month, int day,
+                                            int hour, int minute, int second, int msec)
+{
+   // IBX parses timestamp strings by the current locale, so there is no
+   // safe way to send one through the older exports
+   if(!paramsSetTimestampProc)
+      throw Error("SetTimestamp requires a newer VisualIB.dll");
+
+   VIBSAFECALL(paramsSetTimestampProc(parent->vsql, idx, year, month, day, 
+                                      hour, minute, second, msec));
+}
+
+void VIB::SQL::ParamsSetClass::SetBytes(int idx, const void *data, size_t size)
+{
+   if(!paramsSetBytesProc)
+      SetAsString(idx, static_cast<const char *>(data), size);
+   else
+      VIBSAFECALL(paramsSetBytesProc(parent->vsql, idx, data, static_cast<unsigned int>(size)));
+}
+
 //
 // Constructor
 //
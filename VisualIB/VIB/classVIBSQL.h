@@ -7,6 +7,9 @@
 #ifndef CLASSVIBSQL_H__
 #define CLASSVIBSQL_H__
 
+#include <string>
+#include <vector>
+
 #include "../vibsql.h"
 #include "VIBProperties.h"
 
@@ -26,6 +29,7 @@ namespace VIB
    {
    protected:
       VIBSQL *vsql; //!< Pointer to the wrapped VIBSQL instance.
+      std::vector<std::string> paramNames; //!< Ordinals handed out without indexed Params exports
 
    public:
       /**
@@ -155,6 +159,9 @@ namespace VIB
       protected:
          SQL *parent;   //!< Pointer to parent VIB::SQL instance
          ParamClass pc; //!< Instance of ParamClass
+
+         int nameIndex(const std::string &name);
+         const char *nameAt(int idx);
       public:
          /**
           * Construct a Params property wrapper object.
@@ -168,6 +175,33 @@ namespace VIB
           * @returns Pointer to a ParamClass instance.
           */
          ParamClass *ByName(const std::string &name);
+
+         /** Number of parameters in the prepared query. */
+         int Count();
+         /**
+          * Find a parameter's ordinal by name. Resolve once after Prepare and
+          * bind each execution by ordinal to avoid repeated name lookups.
+          * @param[in] name Name of the parameter to find.
+          * @returns Ordinal of the parameter.
+          */
+         int IndexOf(const std::string &name);
+         /** Obtain the InterBase SQLType value for the parameter at an ordinal. */
+         int  GetSQLType(int idx);
+         /** Set or clear the null state of the parameter at an ordinal. */
+         void SetIsNull(int idx, bool isNull);
+         /** Set the parameter at an ordinal from a string. */
+         void SetAsString(int idx, const std::string &str);
+         /** Set the parameter at an ordinal from a C string of known length. */
+         void SetAsString(int idx, const char *str, size_t len);
+         /** Set the parameter at an ordinal to a 64-bit integer. */
+         void SetInt64(int idx, long long value);
+         /** Set the parameter at an ordinal to a double. */
+         void SetDouble(int idx, double value);
+         /** Set the parameter at an ordinal to a timestamp. */
+         void SetTimestamp(int idx, int year, int month, int day, 
+                           int hour = 0, int minute = 0, int second = 0, int msec = 0);
+         /** Set the parameter at an ordinal to a run of bytes; loads blobs directly. */
+         void SetBytes(int idx, const void *data, size_t size);
       };
 
    protected:
@@ -6,6 +6,8 @@
  *
  */
 
+#include <string.h>
+#include <vector>
 #include "vibinlines.h"
 
 #include "vibstring.h"
@@ -168,6 +170,27 @@ VIBBOOL VIBCALL VIBDataSet_GetUniDirectional(VIBDataSet *vds)
    return res;
 }
 
+//
+// VIBDataSet_Prepared
+//
+// Read-only property
+//
+VIBBOOL VIBCALL VIBDataSet_Prepared(VIBDataSet *vds)
+{
+   TIBDataSet *tds = TDSForVDS(vds);
+   VIBBOOL res = VIBFALSE;
+
+   try
+   {
+      bool cppres = tds->Prepared;
+
+      res = (cppres ? VIBTRUE : VIBFALSE);
+   }
+   CATCH_EIBERROR
+
+   return res;
+}
+
 //
 // VIBDataSet_SelectSQL_Clear
 //
@@ -444,6 +467,58 @@ int VIBCALL VIBDataSet_FieldCount(VIBDataSet *vds)
    return count;
 }
 
+//
+// VIBFieldTypeForTFieldType
+//
+// Translate a VCL TFieldType into the portable VIBFieldType enumeration.
+//
+static VIBFieldType VIBFieldTypeForTFieldType(TFieldType tft)
+{
+   VIBFieldType fieldType = vib_ftUnknown;
+
+   switch(tft)
+   {
+   case ftUnknown:     fieldType = vib_ftUnknown;     break;
+   case ftString:      fieldType = vib_ftString;      break;
+   case ftSmallint:    fieldType = vib_ftSmallint;    break;
+   case ftInteger:     fieldType = vib_ftInteger;     break;
+   case ftWord:        fieldType = vib_ftWord;        break;
+   case ftBoolean:     fieldType = vib_ftBoolean;     break;
+   case ftFloat:       fieldType = vib_ftFloat;       break;
+   case ftCurrency:    fieldType = vib_ftCurrency;    break;
+   case ftBCD:         fieldType = vib_ftBCD;         break;
+   case ftDate:        fieldType = vib_ftDate;        break;
+   case ftTime:        fieldType = vib_ftTime;        break;
+   case ftDateTime:    fieldType = vib_ftDateTime;    break;
+   case ftBytes:       fieldType = vib_ftBytes;       break;
+   case ftVarBytes:    fieldType = vib_ftVarBytes;    break;
+   case ftAutoInc:     fieldType = vib_ftAutoInc;     break;
+   case ftBlob:        fieldType = vib_ftBlob;        break;
+   case ftMemo:        fieldType = vib_ftMemo;        break;
+   case ftGraphic:     fieldType = vib_ftGraphic;     break;
+   case ftFmtMemo:     fieldType = vib_ftFmtMemo;     break;
+   case ftParadoxOle:  fieldType = vib_ftParadoxOle;  break;
+   case ftDBaseOle:    fieldType = vib_ftDBaseOle;    break;
+   case ftTypedBinary: fieldType = vib_ftTypedBinary; break;
+   case ftCursor:      fieldType = vib_ftCursor;      break;
+   case ftFixedChar:   fieldType = vib_ftFixedChar;   break;
+   case ftWideString:  fieldType = vib_ftWideString;  break;
+   case ftLargeint:    fieldType = vib_ftLargeint;    break;
+   case ftADT:         fieldType = vib_ftADT;         break;
+   case ftArray:       fieldType = vib_ftArray;       break;
+   case ftReference:   fieldType = vib_ftReference;   break;
+   case ftDataSet:     fieldType = vib_ftDataSet;     break;
+   case ftOraBlob:     fieldType = vib_ftOraBlob;     break;
+   case ftOraClob:     fieldType = vib_ftOraClob;     break;
+   case ftVariant:     fieldType = vib_ftVariant;     break;
+   case ftInterface:   fieldType = vib_ftInterface;   break;
+   case ftIDispatch:   fieldType = vib_ftIDispatch;   break;
+   case ftGuid:        fieldType = vib_ftGuid;        break;
+   }
+
+   return fieldType;
+}
+
 //
 // VIBDataSet_Fields_DataType
 //
@@ -453,47 +528,7 @@ VIBFieldType VIBCALL VIBDataSet_Fields_DataType(VIBDataSet *vds, int Idx)
 
    try
    {
-      TFieldType tft = TDSForVDS(vds)->Fields->Fields[Idx]->DataType;
-
-      switch(tft)
-      {
-      case ftUnknown:     fieldType = vib_ftUnknown;     break;
-      case ftString:      fieldType = vib_ftString;      break;
-      case ftSmallint:    fieldType = vib_ftSmallint;    break;
-      case ftInteger:     fieldType = vib_ftInteger;     break;
-      case ftWord:        fieldType = vib_ftWord;        break;
-      case ftBoolean:     fieldType = vib_ftBoolean;     break;
-      case ftFloat:       fieldType = vib_ftFloat;       break;
-      case ftCurrency:    fieldType = vib_ftCurrency;    break;
-      case ftBCD:         fieldType = vib_ftBCD;         break;
-      case ftDate:        fieldType = vib_ftDate;        break;
-      case ftTime:        fieldType = vib_ftTime;        break;
-      case ftDateTime:    fieldType = vib_ftDateTime;    break;
-      case ftBytes:       fieldType = vib_ftBytes;       break;
-      case ftVarBytes:    fieldType = vib_ftVarBytes;    break;
-      case ftAutoInc:     fieldType = vib_ftAutoInc;     break;
-      case ftBlob:        fieldType = vib_ftBlob;        break;
-      case ftMemo:        fieldType = vib_ftMemo;        break;
-      case ftGraphic:     fieldType = vib_ftGraphic;     break;
-      case ftFmtMemo:     fieldType = vib_ftFmtMemo;     break;
-      case ftParadoxOle:  fieldType = vib_ftParadoxOle;  break;
-      case ftDBaseOle:    fieldType = vib_ftDBaseOle;    break;
-      case ftTypedBinary: fieldType = vib_ftTypedBinary; break;
-      case ftCursor:      fieldType = vib_ftCursor;      break;
-      case ftFixedChar:   fieldType = vib_ftFixedChar;   break;
-      case ftWideString:  fieldType = vib_ftWideString;  break;
-      case ftLargeint:    fieldType = vib_ftLargeint;    break;
-      case ftADT:         fieldType = vib_ftADT;         break;
-      case ftArray:       fieldType = vib_ftArray;       break;
-      case ftReference:   fieldType = vib_ftReference;   break;
-      case ftDataSet:     fieldType = vib_ftDataSet;     break;
-      case ftOraBlob:     fieldType = vib_ftOraBlob;     break;
-      case ftOraClob:     fieldType = vib_ftOraClob;     break;
-      case ftVariant:     fieldType = vib_ftVariant;     break;
-      case ftInterface:   fieldType = vib_ftInterface;   break;
-      case ftIDispatch:   fieldType = vib_ftIDispatch;   break;
-      case ftGuid:        fieldType = vib_ftGuid;        break;
-      }
+      fieldType = VIBFieldTypeForTFieldType(TDSForVDS(vds)->Fields->Fields[Idx]->DataType);
    }
    CATCH_EIBERROR
 
@@ -524,5 +559,97 @@ VIBFieldKind VIBCALL VIBDataSet_Fields_FieldKind(VIBDataSet *vds, int Idx)
    return kind;
 }
 
+//
+// VIBDataSet_FetchBlock
+//
+// Fields are resolved to TField pointers once per call, and cell text is
+// copied straight into the caller's arena, so that a whole batch of records
+// crosses the DLL boundary without any per-cell VIBString allocations.
+//
+VIBBOOL VIBCALL VIBDataSet_FetchBlock(VIBDataSet *vds, int maxRows, VIBFetchBlock *block)
+{
+   TIBDataSet *tds = TDSForVDS(vds);
+
+   block->numRows   = 0;
+   block->numCols   = 0;
+   block->arenaUsed = 0;
+   block->arenaFull = VIBFALSE;
+
+   if(maxRows > block->rowCapacity)
+      maxRows = block->rowCapacity;
+
+   try
+   {
+      int numCols = tds->Fields->Count;
+
+      if(numCols > block->colCapacity)
+      {
+         VIBError_Report("VIBFetchBlock column capacity is too small", 0, 0);
+         return VIBFALSE;
+      }
+
+      std::vector<TField *> fields(numCols);
+      for(int col = 0; col < numCols; col++)
+      {
+         fields[col] = tds->Fields->Fields[col];
+         block->types[col] = VIBFieldTypeForTFieldType(fields[col]->DataType);
+      }
+      block->numCols = numCols;
+
+      int row = 0;
+      while(row < maxRows && !tds->Eof)
+      {
+         unsigned int rowStart = block->arenaUsed;
+         bool         rowFits  = true;
+
+         for(int col = 0; col < numCols; col++)
+         {
+            int            cell = col * block->rowCapacity + row;
+            unsigned char  bit  = static_cast<unsigned char>(1 << (cell & 7));
+            TField        *fld  = fields[col];
+
+            if(fld->IsNull)
+            {
+               block->nulls[cell >> 3] |= bit;
+               block->offsets[cell] = block->arenaUsed;
+               block->lengths[cell] = 0;
+               continue;
+            }
+
+            AnsiString   str = fld->AsString;
+            unsigned int len = static_cast<unsigned int>(str.Length());
+
+            if(block->arenaSize - block->arenaUsed < len + 1)
+            {
+               rowFits = false;
+               break;
+            }
+
+            block->nulls[cell >> 3] &= static_cast<unsigned char>(~bit);
+            block->offsets[cell] = block->arenaUsed;
+            block->lengths[cell] = len;
+            memcpy(block->arena + block->arenaUsed, str.c_str(), len + 1);
+            block->arenaUsed += len + 1;
+         }
+
+         if(!rowFits)
+         {
+            // leave this record current so that it can be fetched again
+            block->arenaUsed = rowStart;
+            block->arenaFull = VIBTRUE;
+            break;
+         }
+
+         ++row;
+         tds->Next();
+      }
+
+      block->numRows = row;
+   }
+   CATCH_EIBERROR_RF
+
+   return VIBTRUE;
+}
+
 // EOF
 
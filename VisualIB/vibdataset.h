@@ -25,6 +25,28 @@ struct VIBDataSet
    void    *opaque; //!< Opaque pointer to TIBDataSet instance
 };
 
+/**
+ * Caller-supplied columnar buffer for VIBDataSet_FetchBlock.
+ * All arrays are allocated and owned by the caller. Cell (row, col) lives at
+ * index col * rowCapacity + row of the offsets, lengths, and nulls arrays, so
+ * each column's cells are contiguous.
+ */
+struct VIBFetchBlock
+{
+   int            rowCapacity; //!< [in]  Number of rows the cell arrays can hold
+   int            colCapacity; //!< [in]  Number of columns the cell arrays can hold
+   char          *arena;       //!< [in]  Buffer receiving the NUL-terminated text of every cell
+   unsigned int   arenaSize;   //!< [in]  Size of arena in bytes
+   unsigned int  *offsets;     //!< [in]  rowCapacity * colCapacity offsets of cell text into arena
+   unsigned int  *lengths;     //!< [in]  rowCapacity * colCapacity cell text lengths, not counting the NUL
+   unsigned char *nulls;       //!< [in]  Bitmap of (rowCapacity * colCapacity + 7) / 8 bytes; a set bit means NULL
+   VIBFieldType  *types;       //!< [in]  colCapacity column type tags
+   int            numRows;     //!< [out] Number of rows stored in the block
+   int            numCols;     //!< [out] Number of columns stored in the block
+   unsigned int   arenaUsed;   //!< [out] Number of arena bytes consumed
+   VIBBOOL        arenaFull;   //!< [out] Fetching stopped early because the next row did not fit in arena
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -51,6 +73,8 @@ VIBDLLFUNC VIBTransaction *VIBCALL VIBDataSet_GetTransaction(VIBDataSet *vds);
 VIBDLLFUNC VIBBOOL         VIBCALL VIBDataSet_SetUniDirectional(VIBDataSet *vds, VIBBOOL UniDirectional);
 /** Get the UniDirectional property */
 VIBDLLFUNC VIBBOOL         VIBCALL VIBDataSet_GetUniDirectional(VIBDataSet *vds);
+/** Test if the dataset's query is prepared */
+VIBDLLFUNC VIBBOOL         VIBCALL VIBDataSet_Prepared(VIBDataSet *vds);
 /** Clear the SelectSQL statement list */
 VIBDLLFUNC VIBBOOL         VIBCALL VIBDataSet_SelectSQL_Clear(VIBDataSet *vds);
 /** Add a string to the SelectSQL statement list */
@@ -102,6 +126,15 @@ VIBDLLFUNC int             VIBCALL VIBDataSet_FieldCount(VIBDataSet *vds);
 VIBDLLFUNC VIBFieldType    VIBCALL VIBDataSet_Fields_DataType(VIBDataSet *vds, int Idx);
 /** Get the kind of a specific field in the data set. */
 VIBDLLFUNC VIBFieldKind    VIBCALL VIBDataSet_Fields_FieldKind(VIBDataSet *vds, int Idx);
+/**
+ * Copy up to maxRows records, starting at the current record, into a columnar
+ * block in a single call. The dataset is advanced past every record stored.
+ * Fetching stops at Eof, after maxRows records, or when the next record will
+ * not fit into the arena; in the last case arenaFull is set and that record
+ * remains current so it can be fetched again into a larger arena.
+ * @pre The block's colCapacity must be at least the dataset's field count.
+ */
+VIBDLLFUNC VIBBOOL         VIBCALL VIBDataSet_FetchBlock(VIBDataSet *vds, int maxRows, VIBFetchBlock *block);
 
 #ifdef __cplusplus
 }
@@ -335,6 +335,162 @@ int VIBCALL VIBSQL_Params_ByName_GetSQLType(VIBSQL *vsql, const char *name)
    return ret;
 }
 
+//
+// VIBSQL_Params_Count
+//
+int VIBCALL VIBSQL_Params_Count(VIBSQL *vsql)
+{
+   int ret = 0;
+
+   try
+   {
+      ret = TSQLForVSQL(vsql)->Params->Count;
+   }
+   CATCH_EIBERROR
+
+   return ret;
+}
+
+//
+// VIBSQL_Params_IndexOf
+//
+VIBBOOL VIBCALL VIBSQL_Params_IndexOf(VIBSQL *vsql, const char *name, int *ret)
+{
+   try
+   {
+      *ret = TSQLForVSQL(vsql)->Params->ByName(name)->Index;
+   }
+   CATCH_EIBERROR_RF
+
+   return VIBTRUE;
+}
+
+//
+// VIBSQL_Params_GetSQLType
+//
+int VIBCALL VIBSQL_Params_GetSQLType(VIBSQL *vsql, int idx)
+{
+   int ret = 0;
+
+   try
+   {
+      ret = TSQLForVSQL(vsql)->Params->Vars[idx]->SQLType;
+   }
+   CATCH_EIBERROR
+
+   return ret;
+}
+
+//
+// VIBSQL_Params_SetIsNull
+//
+VIBBOOL VIBCALL VIBSQL_Params_SetIsNull(VIBSQL *vsql, int idx, VIBBOOL IsNull)
+{
+   try
+   {
+      bool cppIsNull = (IsNull ? true : false);
+      TSQLForVSQL(vsql)->Params->Vars[idx]->IsNull = cppIsNull;
+   }
+   CATCH_EIBERROR_RF
+
+   return VIBTRUE;
+}
+
+//
+// VIBSQL_Params_SetAsString
+//
+VIBBOOL VIBCALL VIBSQL_Params_SetAsString(VIBSQL *vsql, int idx, const char *str)
+{
+   try
+   {
+      TSQLForVSQL(vsql)->Params->Vars[idx]->AsString = str;
+   }
+   CATCH_EIBERROR_RF
+
+   return VIBTRUE;
+}
+
+//
+// VIBSQL_Params_SetInt64
+//
+// The parameter takes on an unscaled INT64 type; the server converts the
+// value to the column's declared type, including scaled NUMERICs.
+//
+VIBBOOL VIBCALL VIBSQL_Params_SetInt64(VIBSQL *vsql, int idx, long long value)
+{
+   try
+   {
+      TSQLForVSQL(vsql)->Params->Vars[idx]->AsInt64 = value;
+   }
+   CATCH_EIBERROR_RF
+
+   return VIBTRUE;
+}
+
+//
+// VIBSQL_Params_SetDouble
+//
+VIBBOOL VIBCALL VIBSQL_Params_SetDouble(VIBSQL *vsql, int idx, double value)
+{
+   try
+   {
+      TSQLForVSQL(vsql)->Params->Vars[idx]->AsDouble = value;
+   }
+   CATCH_EIBERROR_RF
+
+   return VIBTRUE;
+}
+
+//
+// VIBSQL_Params_SetTimestamp
+//
+VIBBOOL VIBCALL VIBSQL_Params_SetTimestamp(VIBSQL *vsql, int idx, int year, int month, int day,
+                                           int hour, int minute, int second, int msec)
+{
+   try
+   {
+      TDateTime date(static_cast<unsigned short>(year),  static_cast<unsigned short>(month),
+                     static_cast<unsigned short>(day));
+      TDateTime time(static_cast<unsigned short>(hour),   static_cast<unsigned short>(minute),
+                     static_cast<unsigned short>(second), static_cast<unsigned short>(msec));
+
+      TSQLForVSQL(vsql)->Params->Vars[idx]->AsDateTime = date + time;
+   }
+   CATCH_EIBERROR_RF
+
+   return VIBTRUE;
+}
+
+//
+// VIBSQL_Params_SetBytes
+//
+VIBBOOL VIBCALL VIBSQL_Params_SetBytes(VIBSQL *vsql, int idx, const void *data, unsigned int size)
+{
+   TMemoryStream *stream = NULL;
+   VIBBOOL        res    = VIBFALSE;
+
+   try
+   {
+      TIBXSQLVAR *var = TSQLForVSQL(vsql)->Params->Vars[idx];
+
+      if((var->SQLType & ~1) == VIB_SQL_BLOB)
+      {
+         stream = new TMemoryStream();
+         stream->WriteBuffer(data, size);
+         stream->Position = 0;
+         var->LoadFromStream(stream);
+      }
+      else
+         var->AsString = AnsiString(static_cast<const char *>(data), size);
+
+      res = VIBTRUE;
+   }
+   CATCH_EIBERROR
+
+   delete stream;
+   return res;
+}
+
 // TODO: Additional support for VIBSQL::Params
 
 //
@@ -67,6 +67,32 @@ VIBDLLFUNC VIBBOOL         VIBCALL VIBSQL_Params_ByName_SetIsNull(VIBSQL *vsql,
 VIBDLLFUNC VIBBOOL         VIBCALL VIBSQL_Params_ByName_SetAsString(VIBSQL *vsql, const char *name, const char *str);
 /** Find a SQL parameter by name and retrieve its InterBase SQL type. */
 VIBDLLFUNC int             VIBCALL VIBSQL_Params_ByName_GetSQLType(VIBSQL *vsql, const char *name);
+/** Get the number of parameters in the prepared query. */
+VIBDLLFUNC int             VIBCALL VIBSQL_Params_Count(VIBSQL *vsql);
+/**
+ * Find a SQL parameter by name and return its ordinal in *ret.
+ * Resolve ordinals once after preparing the query, then bind every execution
+ * through the ordinal-based VIBSQL_Params_Set* functions.
+ */
+VIBDLLFUNC VIBBOOL         VIBCALL VIBSQL_Params_IndexOf(VIBSQL *vsql, const char *name, int *ret);
+/** Retrieve the InterBase SQL type of the parameter at an ordinal. */
+VIBDLLFUNC int             VIBCALL VIBSQL_Params_GetSQLType(VIBSQL *vsql, int idx);
+/** Set the IsNull property of the parameter at an ordinal. */
+VIBDLLFUNC VIBBOOL         VIBCALL VIBSQL_Params_SetIsNull(VIBSQL *vsql, int idx, VIBBOOL IsNull);
+/** Set the value of the parameter at an ordinal using AsString. */
+VIBDLLFUNC VIBBOOL         VIBCALL VIBSQL_Params_SetAsString(VIBSQL *vsql, int idx, const char *str);
+/** Set the value of the parameter at an ordinal to a 64-bit integer. */
+VIBDLLFUNC VIBBOOL         VIBCALL VIBSQL_Params_SetInt64(VIBSQL *vsql, int idx, long long value);
+/** Set the value of the parameter at an ordinal to a double. */
+VIBDLLFUNC VIBBOOL         VIBCALL VIBSQL_Params_SetDouble(VIBSQL *vsql, int idx, double value);
+/** Set the value of the parameter at an ordinal to a timestamp. */
+VIBDLLFUNC VIBBOOL         VIBCALL VIBSQL_Params_SetTimestamp(VIBSQL *vsql, int idx, int year, int month, int day,
+                                                              int hour, int minute, int second, int msec);
+/** 
+ * Set the value of the parameter at an ordinal to a run of bytes. Blob
+ * parameters are loaded directly; other parameters receive the bytes as text.
+ */
+VIBDLLFUNC VIBBOOL         VIBCALL VIBSQL_Params_SetBytes(VIBSQL *vsql, int idx, const void *data, unsigned int size);
 /** 
  * Obtain a plan for the SQL query.
  * @pre The query must be prepared first.
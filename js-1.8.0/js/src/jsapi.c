@@ -2580,6 +2580,20 @@ JS_SetGCParameter(JSRuntime *rt, JSGCParamKey key, uint32 value)
     }
 }
 
+JS_PUBLIC_API(uint32)
+JS_GetGCParameter(JSRuntime *rt, JSGCParamKey key)
+{
+    switch (key) {
+      case JSGC_MAX_BYTES:
+        return rt->gcMaxBytes;
+      case JSGC_MAX_MALLOC_BYTES:
+        return rt->gcMaxMallocBytes;
+      case JSGC_STACKPOOL_LIFESPAN:
+        return rt->gcStackPoolLifespan;
+    }
+    return 0;
+}
+
 JS_PUBLIC_API(intN)
 JS_AddExternalStringFinalizer(JSStringFinalizeOp finalizer)
 {
@@ -1128,6 +1128,32 @@ typedef enum JSGCParamKey {
 extern JS_PUBLIC_API(void)
 JS_SetGCParameter(JSRuntime *rt, JSGCParamKey key, uint32 value);
 
+extern JS_PUBLIC_API(uint32)
+JS_GetGCParameter(JSRuntime *rt, JSGCParamKey key);
+
+/*
+ * Heap statistics for embeddings sizing their runtimes. Arena counts are
+ * taken by walking the arena lists, so they are available without
+ * JS_GCMETER.
+ */
+#define JS_GC_HEAP_STATS_LISTS  10
+
+typedef struct JSGCHeapStats {
+    uint32  number;         /* number of collections so far */
+    uint32  bytes;          /* bytes in GC arenas */
+    uint32  lastBytes;      /* bytes in GC arenas after the last collection */
+    uint32  maxBytes;       /* JSGC_MAX_BYTES */
+    uint32  mallocBytes;    /* JS_malloc bytes since the last collection */
+    uint32  maxMallocBytes; /* JSGC_MAX_MALLOC_BYTES */
+    uint32  arenaSize;      /* bytes per arena */
+    uint32  doubleArenas;   /* arenas holding doubles */
+    uint32  thingSize[JS_GC_HEAP_STATS_LISTS]; /* thing size of each free list */
+    uint32  arenas[JS_GC_HEAP_STATS_LISTS];    /* arenas allocated to each list */
+} JSGCHeapStats;
+
+extern JS_PUBLIC_API(void)
+JS_GetGCHeapStats(JSRuntime *rt, JSGCHeapStats *stats);
+
 /*
  * Add a finalizer for external strings created by JS_NewExternalString (see
  * below) using a type-code returned from this function, and that understands
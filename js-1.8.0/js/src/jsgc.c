@@ -1402,6 +1402,36 @@ js_DumpGCStats(JSRuntime *rt, FILE *fp)
 }
 #endif
 
+JS_STATIC_ASSERT(GC_NUM_FREELISTS == JS_GC_HEAP_STATS_LISTS);
+
+JS_PUBLIC_API(void)
+JS_GetGCHeapStats(JSRuntime *rt, JSGCHeapStats *stats)
+{
+    uintN i;
+    JSGCArenaInfo *a;
+
+    JS_LOCK_GC(rt);
+    stats->number = rt->gcNumber;
+    stats->bytes = rt->gcBytes;
+    stats->lastBytes = rt->gcLastBytes;
+    stats->maxBytes = rt->gcMaxBytes;
+    stats->mallocBytes = rt->gcMallocBytes;
+    stats->maxMallocBytes = rt->gcMaxMallocBytes;
+    stats->arenaSize = GC_ARENA_SIZE;
+
+    for (i = 0; i < GC_NUM_FREELISTS; i++) {
+        stats->thingSize[i] = GC_FREELIST_NBYTES(i);
+        stats->arenas[i] = 0;
+        for (a = rt->gcArenaList[i].last; a; a = a->prev)
+            stats->arenas[i]++;
+    }
+
+    stats->doubleArenas = 0;
+    for (a = rt->gcDoubleArenaList.first; a; a = a->prev)
+        stats->doubleArenas++;
+    JS_UNLOCK_GC(rt);
+}
+
 #ifdef DEBUG
 static void
 CheckLeakedRoots(JSRuntime *rt);
@@ -170,7 +170,10 @@ static std::string DATEToString(DATE &date)
       stamp.millisecond = st.wMilliseconds;
 
       if(stamp.IsValidStamp())
-         return stamp.OutStamp(global_mode);
+      {
+         char buf[outstamp_size];
+         return std::string(buf, stamp.OutStamp(buf, global_mode));
+      }
    }
 
    return "null";
@@ -0,0 +1,445 @@
+/*
+
+  Batch Server
+
+  vibconsole -serve <name> keeps one warm process running and executes the
+  scripts sent to it over the named pipe \\.\pipe\<name>, so that a
+  scheduler running many short jobs does not pay for options.ini, a new
+  runtime, extensions.js and fresh database connections on every launch.
+  Each job runs in a pooled sandbox parented to the main global, so anything
+  autoexec.js or a loaded module keeps there, such as connection pools and
+  lookup caches, carries over from one job to the next, while variables the
+  job declares do not.
+
+  Protocol: the client writes one line holding the script path followed by
+  its arguments, separated by tabs. The server replies with a line holding
+  the job's exit code and the length in bytes of its output, separated by a
+  space, followed by everything the job wrote to the console. The client
+  closes the connection once it has read that much, which lets the server
+  move on to the next. vibconsole -submit <name> <script> [args...] is such
+  a client, and exits with the job's code.
+
+  A job sees its arguments as the array scriptArgs and its path as
+  scriptFile; relative paths are taken from the server's working directory.
+  As with -file, the exit code is the script's completion value converted to
+  an integer, or 1 if the script failed; Core.exit does not stop the server.
+  Jobs run one at a time on the main thread, between timer and Worker events;
+  timers a job leaves behind run later, with their output going to the
+  server's console.
+
+  There are no UNIX domain sockets on our Windows targets, so this uses a
+  local-only named pipe instead.
+
+*/
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef VIBC_NO_WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+#include "batchserver.h"
+#include "conlog.h"
+#include "jsengine2.h"
+#include "main.h"
+
+#ifndef VIBC_NO_WIN32
+
+#define BATCHSERVER_BUFFER_SIZE 65536
+#define BATCHSERVER_MAX_REQUEST 65536
+#define BATCHSERVER_TIMEOUT     10000 // ms to wait on a client mid-request
+
+static HANDLE     pipeHandle = INVALID_HANDLE_VALUE;
+static HANDLE     connectEvent;
+static HANDLE     ioEvent;
+static OVERLAPPED connectOverlapped;
+
+static std::string BatchServer_PipeName(const char *name)
+{
+   std::string path(name);
+
+   if(path.compare(0, 2, "\\\\"))
+      path = "\\\\.\\pipe\\" + path;
+
+   return path;
+}
+
+//
+// Wait for the next client; connectEvent is set when one arrives.
+//
+static bool BatchServer_Listen()
+{
+   ZeroMemory(&connectOverlapped, sizeof(connectOverlapped));
+   connectOverlapped.hEvent = connectEvent;
+
+   if(ConnectNamedPipe(pipeHandle, &connectOverlapped))
+      return true;
+
+   switch(GetLastError())
+   {
+   case ERROR_IO_PENDING:
+      return true;
+   case ERROR_PIPE_CONNECTED: // connected between create and connect
+      SetEvent(connectEvent);
+      return true;
+   default:
+      return false;
+   }
+}
+
+//
+// Run one read or write on the pipe with the engine lock released, giving
+// up if the client takes longer than the timeout.
+//
+static bool BatchServer_IO(bool write, void *buf, DWORD len, DWORD &done)
+{
+   OVERLAPPED ov;
+   BOOL       ok;
+
+   ZeroMemory(&ov, sizeof(ov));
+   ov.hEvent = ioEvent;
+   done      = 0;
+
+   if(write)
+      ok = WriteFile(pipeHandle, buf, len, nullptr, &ov);
+   else
+      ok = ReadFile(pipeHandle, buf, len, nullptr, &ov);
+
+   if(!ok && GetLastError() != ERROR_IO_PENDING)
+      return false;
+
+   JSEngineUnlocked unlocked;
+
+   if(WaitForSingleObject(ioEvent, BATCHSERVER_TIMEOUT) != WAIT_OBJECT_0)
+   {
+      CancelIo(pipeHandle);
+      GetOverlappedResult(pipeHandle, &ov, &done, TRUE);
+      return false;
+   }
+
+   return GetOverlappedResult(pipeHandle, &ov, &done, FALSE) && (write || done);
+}
+
+static bool BatchServer_ReadRequest(std::string &request)
+{
+   char  buf[4096];
+   DWORD got;
+
+   while(request.size() < BATCHSERVER_MAX_REQUEST && BatchServer_IO(false, buf, sizeof(buf), got))
+   {
+      request.append(buf, got);
+
+      size_t eol = request.find('\n');
+      if(eol != std::string::npos)
+      {
+         request.resize(eol);
+         if(!request.empty() && request[request.size() - 1] == '\r')
+            request.resize(request.size() - 1);
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static bool BatchServer_WriteResponse(std::string &response)
+{
+   size_t pos = 0;
+   DWORD  put;
+
+   while(pos < response.size())
+   {
+      DWORD len = static_cast<DWORD>(std::min<size_t>(response.size() - pos, BATCHSERVER_BUFFER_SIZE));
+
+      if(!BatchServer_IO(true, &response[pos], len, put))
+         return false;
+      pos += put;
+   }
+
+   return true;
+}
+
+//
+// Run a job's script in a fresh sandbox and return its exit code, collecting
+// its console output.
+//
+static int BatchServer_RunJob(const std::string &request, std::string &output)
+{
+   std::vector<std::string> fields;
+   size_t start = 0, tab;
+
+   while((tab = request.find('\t', start)) != std::string::npos)
+   {
+      fields.push_back(request.substr(start, tab - start));
+      start = tab + 1;
+   }
+   fields.push_back(request.substr(start));
+
+   if(fields[0].empty())
+   {
+      output = "No script given\n";
+      return 1;
+   }
+
+   int code = 1;
+
+   ConLog_SetCapture(&output);
+
+   try
+   {
+      JSContext *cx     = JSEngine_GetGlobalContext()->getContext();
+      JSObject  *inject = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+      AutoNamedRoot root(cx, inject, "BatchServer_RunJob");
+
+      JSObject *args = AssertJSNewArrayObject(cx, 0, nullptr);
+      AssertJSDefineProperty(cx, inject, "scriptArgs", OBJECT_TO_JSVAL(args), nullptr, nullptr, 0);
+
+      for(size_t i = 1; i < fields.size(); i++)
+      {
+         jsval v = STRING_TO_JSVAL(AssertJSNewStringCopyZ(cx, fields[i].c_str()));
+         if(!JS_SetElement(cx, args, jsint(i - 1), &v))
+            throw JSEngineError("Out of memory");
+      }
+
+      JSString *file = AssertJSNewStringCopyZ(cx, fields[0].c_str());
+      AssertJSDefineProperty(cx, inject, "scriptFile", STRING_TO_JSVAL(file), nullptr, nullptr, 0);
+
+      AutoPooledContext ecx(JSEngine_AcquireSandbox(inject, true, false));
+      jsval rval = JSVAL_VOID;
+
+      if(!ecx.get())
+         output += "Could not create a sandbox\n";
+      else if(JSEngine_EvaluateFileInContext(ecx.get(), fields[0].c_str(), &rval))
+         code = JSEngine_ValueToInteger(&rval);
+
+      JSEngine_RunMicrotasks();
+   }
+   catch(const JSEngineError &err)
+   {
+      output += err.what();
+      output += '\n';
+      code = 1;
+   }
+
+   ConLog_SetCapture(nullptr);
+
+   // Core.exit stops the main loop; keep serving
+   MainLoopRunning = true;
+
+   return code;
+}
+
+//
+// Serve the connected client, then wait for the next.
+//
+static void BatchServer_Serve()
+{
+   std::string request, response;
+
+   if(BatchServer_ReadRequest(request))
+   {
+      std::string output;
+      char        header[32];
+      int         code = BatchServer_RunJob(request, output);
+
+      sprintf(header, "%d %lu\n", code, static_cast<unsigned long>(output.size()));
+      response = header + output;
+
+      // disconnecting discards anything still unread, so wait for the
+      // client to close its end once it has the whole response
+      DWORD got;
+      char  dummy;
+      if(BatchServer_WriteResponse(response))
+         BatchServer_IO(false, &dummy, 1, got);
+   }
+
+   DisconnectNamedPipe(pipeHandle);
+   if(!BatchServer_Listen())
+   {
+      CloseHandle(pipeHandle);
+      pipeHandle = INVALID_HANDLE_VALUE;
+   }
+}
+
+static void BatchServer_Stop()
+{
+   if(pipeHandle != INVALID_HANDLE_VALUE)
+   {
+      CancelIo(pipeHandle);
+      DisconnectNamedPipe(pipeHandle);
+      CloseHandle(pipeHandle);
+      pipeHandle = INVALID_HANDLE_VALUE;
+   }
+   if(connectEvent)
+   {
+      CloseHandle(connectEvent);
+      connectEvent = nullptr;
+   }
+   if(ioEvent)
+   {
+      CloseHandle(ioEvent);
+      ioEvent = nullptr;
+   }
+}
+
+static ShutdownAction batchServerShutdownAction(BatchServer_Stop);
+
+//
+// BatchServer_Start
+//
+// Create the pipe and begin accepting jobs. Fails if another process is
+// already serving under the same name.
+//
+bool BatchServer_Start(const char *name)
+{
+   std::string path = BatchServer_PipeName(name);
+
+   if(!(connectEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr)) ||
+      !(ioEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr)))
+   {
+      BatchServer_Stop();
+      return false;
+   }
+
+   pipeHandle = CreateNamedPipeA(path.c_str(),
+                                 PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                 PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                 1, BATCHSERVER_BUFFER_SIZE, BATCHSERVER_BUFFER_SIZE, 0, nullptr);
+
+   if(pipeHandle == INVALID_HANDLE_VALUE || !BatchServer_Listen())
+   {
+      BatchServer_Stop();
+      return false;
+   }
+
+   return true;
+}
+
+//
+// BatchServer_GetWakeHandle
+//
+// An event the main loop can wait on, set when a client connects. Null if
+// not serving.
+//
+void *BatchServer_GetWakeHandle()
+{
+   return pipeHandle != INVALID_HANDLE_VALUE ? connectEvent : nullptr;
+}
+
+//
+// BatchServer_Poll
+//
+// Run the waiting client's job, if there is one.
+//
+void BatchServer_Poll()
+{
+   if(pipeHandle != INVALID_HANDLE_VALUE && WaitForSingleObject(connectEvent, 0) == WAIT_OBJECT_0)
+   {
+      ResetEvent(connectEvent);
+      BatchServer_Serve();
+   }
+}
+
+//
+// BatchServer_Submit
+//
+// Client side: send a script and its arguments to a server, print the job's
+// output and return its exit code, or -1 if the server could not be reached.
+//
+int BatchServer_Submit(const char *name, int argc, const char *const *argv)
+{
+   std::string path = BatchServer_PipeName(name);
+   std::string request, response;
+   HANDLE      pipe;
+
+   for(int i = 0; i < argc; i++)
+   {
+      if(i)
+         request += '\t';
+      request += argv[i];
+   }
+   request += '\n';
+
+   // the server takes one job at a time
+   while((pipe = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                             OPEN_EXISTING, 0, nullptr)) == INVALID_HANDLE_VALUE)
+   {
+      if(GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeA(path.c_str(), NMPWAIT_WAIT_FOREVER))
+      {
+         fprintf(stderr, "Cannot connect to %s\n", path.c_str());
+         return -1;
+      }
+   }
+
+   DWORD  put, got;
+   char   buf[4096];
+   size_t eol = std::string::npos, end = std::string::npos;
+
+   if(!WriteFile(pipe, request.data(), static_cast<DWORD>(request.size()), &put, nullptr))
+   {
+      CloseHandle(pipe);
+      fprintf(stderr, "Cannot send to %s\n", path.c_str());
+      return -1;
+   }
+
+   // stop once the output the header promised is in; the server is waiting
+   // for us to close before it takes the next client
+   while(response.size() < end && ReadFile(pipe, buf, sizeof(buf), &got, nullptr) && got)
+   {
+      response.append(buf, got);
+
+      if(eol == std::string::npos && (eol = response.find('\n')) != std::string::npos)
+      {
+         const char *len = strchr(response.c_str(), ' ');
+         end = eol + 1;
+         if(len && static_cast<size_t>(len - response.c_str()) < eol)
+            end += strtoul(len + 1, nullptr, 10);
+      }
+   }
+   CloseHandle(pipe);
+
+   if(eol == std::string::npos || response.size() < end)
+   {
+      fprintf(stderr, "No response from %s\n", path.c_str());
+      return -1;
+   }
+
+   fwrite(response.data() + eol + 1, 1, end - eol - 1, stdout);
+   fflush(stdout);
+
+   return atoi(response.c_str());
+}
+
+#else
+
+bool BatchServer_Start(const char *name)
+{
+   return false;
+}
+
+void *BatchServer_GetWakeHandle()
+{
+   return nullptr;
+}
+
+void BatchServer_Poll()
+{
+}
+
+int BatchServer_Submit(const char *name, int argc, const char *const *argv)
+{
+   fprintf(stderr, "-submit is not supported on this platform\n");
+   return -1;
+}
+
+#endif
+
+// EOF
@@ -0,0 +1,17 @@
+/*
+
+  Batch Server
+
+*/
+
+#ifndef BATCHSERVER_H__
+#define BATCHSERVER_H__
+
+bool  BatchServer_Start(const char *name);
+void *BatchServer_GetWakeHandle();
+void  BatchServer_Poll();
+int   BatchServer_Submit(const char *name, int argc, const char *const *argv);
+
+#endif
+
+// EOF
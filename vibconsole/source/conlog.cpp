@@ -0,0 +1,424 @@
+/*
+
+  Buffered Console Logging
+
+  Console.print and friends used to write through std::cout with std::endl
+  and flush the echo file after every call, so scripts that log per record
+  paid for two synchronous flushes each time. Output now goes into a ring
+  buffer which a writer thread drains every flush interval, writing each
+  batch with one call per destination.
+
+  The ring buffer is single-consumer and lock-free between the producer and
+  the writer: each side only advances its own counter. Producers serialize
+  with each other through a critical section, which is uncontended unless
+  more than one thread is logging.
+
+  Configured by the [console] section of options.ini:
+    buffered      = 0 to write synchronously (default 1)
+    flushinterval = milliseconds between writer passes (default 50)
+    buffersize    = ring buffer size in KB (default 1024)
+    level         = debug, info, warn or error (default info)
+
+  While a capture buffer is set, standard output is appended to it instead,
+  as the batch server does to return a job's output to its client. Echo
+  file output is unaffected. Capturing relies on everyone who logs holding
+  the engine lock, which all scripts and natives do.
+
+*/
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef VIBC_NO_WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+#include "conlog.h"
+#include "inifile.h"
+
+extern std::ofstream echoFile; // jsnatives.cpp
+
+static int logLevel = CONLOG_INFO;
+
+static std::string *captureBuf;
+
+//
+// Divert standard output to the capture buffer, if one is set. Returns false
+// if nothing is left to write.
+//
+static bool ConLog_Capture(const char *str, size_t len, int &dest)
+{
+   if(captureBuf && (dest & CONLOG_OUT))
+   {
+      captureBuf->append(str, len);
+      dest &= ~CONLOG_OUT;
+   }
+   return dest != 0;
+}
+
+// Record header in the ring buffer; the text follows it
+struct conlogrecord_t
+{
+   unsigned int length;
+   unsigned int dest;
+};
+
+//
+// Write directly to the destinations; used when buffering is off, and for
+// records too large for the ring.
+//
+static void ConLog_WriteDirect(const char *str, size_t len, int dest)
+{
+   if(dest & CONLOG_OUT)
+   {
+      fwrite(str, 1, len, stdout);
+      fflush(stdout);
+   }
+   if((dest & CONLOG_ECHO) && echoFile.is_open())
+   {
+      echoFile.write(str, len);
+      echoFile.flush();
+   }
+}
+
+#ifndef VIBC_NO_WIN32
+
+static char            *ringBuffer;
+static unsigned int     ringSize;      // power of two
+static volatile LONG    ringHead;      // bytes ever written; advanced by producers
+static volatile LONG    ringTail;      // bytes ever consumed; advanced by the writer
+static CRITICAL_SECTION producerLock;
+static HANDLE           writerThread;
+static HANDLE           wakeEvent;     // producer -> writer: drain now
+static HANDLE           drainedEvent;  // writer -> producer: a pass completed
+static volatile LONG    writerStop;
+static volatile LONG    flushInterval = 50;
+
+static unsigned int ConLog_Head() { return static_cast<unsigned int>(InterlockedCompareExchange(&ringHead, 0, 0)); }
+static unsigned int ConLog_Tail() { return static_cast<unsigned int>(InterlockedCompareExchange(&ringTail, 0, 0)); }
+
+static void ConLog_CopyIn(unsigned int pos, const void *src, unsigned int len)
+{
+   unsigned int offset = pos & (ringSize - 1);
+   unsigned int first  = ringSize - offset;
+
+   if(first >= len)
+      memcpy(ringBuffer + offset, src, len);
+   else
+   {
+      memcpy(ringBuffer + offset, src, first);
+      memcpy(ringBuffer, static_cast<const char *>(src) + first, len - first);
+   }
+}
+
+static void ConLog_CopyOut(unsigned int pos, void *dst, unsigned int len)
+{
+   unsigned int offset = pos & (ringSize - 1);
+   unsigned int first  = ringSize - offset;
+
+   if(first >= len)
+      memcpy(dst, ringBuffer + offset, len);
+   else
+   {
+      memcpy(dst, ringBuffer + offset, first);
+      memcpy(static_cast<char *>(dst) + first, ringBuffer, len - first);
+   }
+}
+
+//
+// Write out everything published so far, then release the space.
+//
+static void ConLog_Drain()
+{
+   static std::string outBuf, echoBuf;
+
+   unsigned int head = ConLog_Head();
+   unsigned int tail = ConLog_Tail();
+
+   if(head == tail)
+      return;
+
+   outBuf.clear();
+   echoBuf.clear();
+
+   while(tail != head)
+   {
+      conlogrecord_t rec;
+      ConLog_CopyOut(tail, &rec, sizeof(rec));
+      tail += sizeof(rec);
+
+      size_t start = outBuf.size();
+      outBuf.resize(start + rec.length);
+      if(rec.length)
+         ConLog_CopyOut(tail, &outBuf[start], rec.length);
+      tail += rec.length;
+
+      if(rec.dest & CONLOG_ECHO)
+         echoBuf.append(outBuf, start, rec.length);
+      if(!(rec.dest & CONLOG_OUT))
+         outBuf.resize(start);
+   }
+
+   if(!outBuf.empty())
+   {
+      fwrite(outBuf.data(), 1, outBuf.size(), stdout);
+      fflush(stdout);
+   }
+   if(!echoBuf.empty() && echoFile.is_open())
+   {
+      echoFile.write(echoBuf.data(), echoBuf.size());
+      echoFile.flush();
+   }
+
+   // nothing is released until it has been written, so ConLog_Flush can wait
+   // on the tail alone
+   InterlockedExchange(&ringTail, static_cast<LONG>(tail));
+}
+
+static DWORD WINAPI ConLog_WriterThread(LPVOID)
+{
+   while(!InterlockedCompareExchange(&writerStop, 0, 0))
+   {
+      WaitForSingleObject(wakeEvent, static_cast<DWORD>(flushInterval));
+      ConLog_Drain();
+      SetEvent(drainedEvent);
+   }
+
+   ConLog_Drain();
+   SetEvent(drainedEvent);
+   return 0;
+}
+
+//
+// ConLog_Init
+//
+// Read configuration and start the writer thread. Until this is called,
+// output is written synchronously.
+//
+void ConLog_Init()
+{
+   if(writerThread)
+      return;
+
+   IniFile::IniMap &ini = IniFile::GetIniOptions();
+   IniFile::IniMap::iterator itr = ini.find("console");
+   bool         buffered = true;
+   unsigned int sizeKB   = 1024;
+
+   if(itr != ini.end())
+   {
+      IniFile::IniValue &section = itr->second;
+
+      if(section.find("buffered") != section.end())
+         buffered = (atoi(section["buffered"].c_str()) != 0);
+      if(section.find("flushinterval") != section.end())
+         ConLog_SetFlushInterval(static_cast<unsigned int>(atoi(section["flushinterval"].c_str())));
+      if(section.find("buffersize") != section.end() && atoi(section["buffersize"].c_str()) > 0)
+         sizeKB = static_cast<unsigned int>(atoi(section["buffersize"].c_str()));
+      if(section.find("level") != section.end())
+      {
+         const std::string &level = section["level"];
+         if(level == "debug")
+            logLevel = CONLOG_DEBUG;
+         else if(level == "warn")
+            logLevel = CONLOG_WARN;
+         else if(level == "error")
+            logLevel = CONLOG_ERROR;
+         else
+            logLevel = CONLOG_INFO;
+      }
+   }
+
+   if(!buffered)
+      return;
+
+   // round up to a power of two for cheap wrapping
+   for(ringSize = 4096; ringSize < sizeKB * 1024 && ringSize < 0x40000000u; ringSize <<= 1)
+      ;
+   ringBuffer = static_cast<char *>(malloc(ringSize));
+
+   InitializeCriticalSection(&producerLock);
+   wakeEvent    = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+   drainedEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+
+   if(!ringBuffer || !wakeEvent || !drainedEvent ||
+      !(writerThread = CreateThread(nullptr, 0, ConLog_WriterThread, nullptr, 0, nullptr)))
+   {
+      // stay synchronous
+      if(wakeEvent)
+         CloseHandle(wakeEvent);
+      if(drainedEvent)
+         CloseHandle(drainedEvent);
+      DeleteCriticalSection(&producerLock);
+      free(ringBuffer);
+      ringBuffer   = nullptr;
+      wakeEvent    = drainedEvent = nullptr;
+   }
+}
+
+//
+// ConLog_Shutdown
+//
+// Write out anything pending and stop the writer thread.
+//
+void ConLog_Shutdown()
+{
+   if(!writerThread)
+      return;
+
+   InterlockedExchange(&writerStop, 1);
+   SetEvent(wakeEvent);
+   WaitForSingleObject(writerThread, INFINITE);
+
+   CloseHandle(writerThread);
+   CloseHandle(wakeEvent);
+   CloseHandle(drainedEvent);
+   DeleteCriticalSection(&producerLock);
+   free(ringBuffer);
+
+   writerThread = wakeEvent = drainedEvent = nullptr;
+   ringBuffer   = nullptr;
+}
+
+//
+// ConLog_Flush
+//
+// Block until everything logged so far has been written.
+//
+void ConLog_Flush()
+{
+   if(!writerThread)
+   {
+      fflush(stdout);
+      return;
+   }
+
+   unsigned int target = ConLog_Head();
+
+   while(static_cast<int>(target - ConLog_Tail()) > 0)
+   {
+      SetEvent(wakeEvent);
+      WaitForSingleObject(drainedEvent, 10);
+   }
+}
+
+void ConLog_Write(const char *str, size_t len, int dest)
+{
+   if(!len || !ConLog_Capture(str, len, dest))
+      return;
+
+   if(!writerThread)
+   {
+      ConLog_WriteDirect(str, len, dest);
+      return;
+   }
+
+   unsigned int need = static_cast<unsigned int>(sizeof(conlogrecord_t) + len);
+
+   if(len > ringSize / 2)
+   {
+      // too large to queue; write it in order with everything else
+      EnterCriticalSection(&producerLock);
+      ConLog_Flush();
+      ConLog_WriteDirect(str, len, dest);
+      LeaveCriticalSection(&producerLock);
+      return;
+   }
+
+   EnterCriticalSection(&producerLock);
+
+   unsigned int head = ConLog_Head();
+
+   // wait for the writer to make room
+   while(ringSize - (head - ConLog_Tail()) < need)
+   {
+      SetEvent(wakeEvent);
+      WaitForSingleObject(drainedEvent, 10);
+   }
+
+   conlogrecord_t rec;
+   rec.length = static_cast<unsigned int>(len);
+   rec.dest   = static_cast<unsigned int>(dest);
+
+   ConLog_CopyIn(head, &rec, sizeof(rec));
+   ConLog_CopyIn(head + sizeof(rec), str, rec.length);
+
+   // publish; the interlocked exchange orders the copies before it
+   InterlockedExchange(&ringHead, static_cast<LONG>(head + need));
+
+   // don't wait out the interval if the buffer is filling up
+   if(head + need - ConLog_Tail() > ringSize / 2)
+      SetEvent(wakeEvent);
+
+   LeaveCriticalSection(&producerLock);
+}
+
+void ConLog_SetFlushInterval(unsigned int ms)
+{
+   InterlockedExchange(&flushInterval, static_cast<LONG>(ms ? ms : 1));
+}
+
+#else
+
+// No thread support; all output is synchronous
+
+void ConLog_Init()
+{
+}
+
+void ConLog_Shutdown()
+{
+   fflush(stdout);
+}
+
+void ConLog_Flush()
+{
+   fflush(stdout);
+}
+
+void ConLog_Write(const char *str, size_t len, int dest)
+{
+   if(len && ConLog_Capture(str, len, dest))
+      ConLog_WriteDirect(str, len, dest);
+}
+
+void ConLog_SetFlushInterval(unsigned int ms)
+{
+}
+
+#endif
+
+void ConLog_SetLevel(int level)
+{
+   logLevel = level;
+}
+
+int ConLog_GetLevel()
+{
+   return logLevel;
+}
+
+//
+// ConLog_SetCapture
+//
+// Start appending standard output to buf, or stop if it is null.
+//
+void ConLog_SetCapture(std::string *buf)
+{
+   captureBuf = buf;
+}
+
+bool ConLog_Capturing()
+{
+   return captureBuf != nullptr;
+}
+
+// EOF
+
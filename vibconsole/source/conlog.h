@@ -0,0 +1,47 @@
+/*
+
+  Buffered Console Logging
+
+  Output to the console and the echo file is queued in a ring buffer and
+  written in batches by a background thread.
+
+*/
+
+#ifndef CONLOG_H__
+#define CONLOG_H__
+
+#include <stddef.h>
+#include <string>
+
+// Destinations
+enum
+{
+   CONLOG_OUT  = 1, // standard output
+   CONLOG_ECHO = 2, // echo file, if open
+   CONLOG_BOTH = CONLOG_OUT | CONLOG_ECHO
+};
+
+// Levels for Console.debug/println/warn; messages below the current level
+// are discarded by the caller
+enum
+{
+   CONLOG_DEBUG,
+   CONLOG_INFO,
+   CONLOG_WARN,
+   CONLOG_ERROR
+};
+
+void ConLog_Init();
+void ConLog_Shutdown();
+void ConLog_Write(const char *str, size_t len, int dest = CONLOG_BOTH);
+void ConLog_Flush();
+void ConLog_SetFlushInterval(unsigned int ms);
+void ConLog_SetLevel(int level);
+int  ConLog_GetLevel();
+void ConLog_SetCapture(std::string *buf);
+bool ConLog_Capturing();
+
+#endif
+
+// EOF
+
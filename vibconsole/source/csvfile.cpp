@@ -0,0 +1,502 @@
+/*
+
+  CSV Files
+
+  The file is mapped rather than read line by line, and each field is found
+  by scanning for the bytes that can end it, 16 at a time with SSE2 where
+  available and with memchr inside quotes, then copied in one piece.
+  Writing goes the other way, with a table of the bytes that need escaping.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifndef VIBC_NO_WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define CSVFILE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#include "csvfile.h"
+
+#ifdef CSVFILE_SSE2
+static inline unsigned int CSV_FirstBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+   unsigned long bit;
+   _BitScanForward(&bit, mask);
+   return bit;
+#else
+   return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+//
+// Find the end of an unquoted field: the first delimiter, CR or LF in
+// [p, end), or end if there is none.
+//
+static const char *CSV_ScanField(const char *p, const char *end, char delim)
+{
+#ifdef CSVFILE_SSE2
+   const __m128i vdelim = _mm_set1_epi8(delim);
+   const __m128i vcr    = _mm_set1_epi8('\r');
+   const __m128i vlf    = _mm_set1_epi8('\n');
+
+   while(end - p >= 16)
+   {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      __m128i hits  = _mm_or_si128(_mm_cmpeq_epi8(chunk, vdelim),
+                                   _mm_or_si128(_mm_cmpeq_epi8(chunk, vcr), _mm_cmpeq_epi8(chunk, vlf)));
+      unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(hits));
+
+      if(mask)
+         return p + CSV_FirstBit(mask);
+      p += 16;
+   }
+#endif
+
+   for(; p < end; ++p)
+   {
+      if(*p == delim || *p == '\r' || *p == '\n')
+         break;
+   }
+
+   return p;
+}
+
+static size_t CSV_CountLines(const char *p, const char *end)
+{
+   size_t count = 0;
+
+   while((p = static_cast<const char *>(memchr(p, '\n', end - p))))
+   {
+      ++count;
+      ++p;
+   }
+
+   return count;
+}
+
+CSVReader::CSVReader(char pDelim, char pQuote, bool pDoubles)
+   : delim(pDelim), quote(pQuote), doubles(pDoubles), mapping(nullptr), view(nullptr),
+     buffer(), pos(nullptr), end(nullptr), line(1), recordStart(nullptr), recordEnd(nullptr),
+     recordLine(0), error()
+{
+}
+
+CSVReader::~CSVReader()
+{
+   close();
+}
+
+//
+// CSVReader::open
+//
+// Map a file for reading. An empty file opens and has no records.
+//
+bool CSVReader::open(const char *filename)
+{
+   close();
+
+#ifndef VIBC_NO_WIN32
+   // share writing too, so that files another program still has open, such
+   // as a log or a spreadsheet, can be read
+   HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+   if(file == INVALID_HANDLE_VALUE)
+   {
+      error = "Could not open file";
+      return false;
+   }
+
+   LARGE_INTEGER size;
+   if(!GetFileSizeEx(file, &size) || size.HighPart)
+   {
+      CloseHandle(file);
+      error = "File is too large to map";
+      return false;
+   }
+
+   if(size.LowPart)
+   {
+      // the mapping keeps the file open
+      mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if(mapping)
+         view = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+   }
+   CloseHandle(file);
+
+   if(size.LowPart && !view)
+   {
+      close();
+      error = "Could not map file";
+      return false;
+   }
+
+   openBuffer(view, size.LowPart);
+#else
+   FILE *f = fopen(filename, "rb");
+   if(!f)
+   {
+      error = "Could not open file";
+      return false;
+   }
+
+   char   chunk[65536];
+   size_t got;
+   while((got = fread(chunk, 1, sizeof(chunk), f)) > 0)
+      buffer.insert(buffer.end(), chunk, chunk + got);
+   fclose(f);
+
+   openBuffer(buffer.empty() ? nullptr : &buffer[0], buffer.size());
+#endif
+
+   return true;
+}
+
+//
+// CSVReader::openBuffer
+//
+// Read from memory owned by the caller, which must outlive the reading.
+//
+void CSVReader::openBuffer(const char *data, size_t len)
+{
+   pos  = data;
+   end  = data + len;
+   line = 1;
+   recordStart = recordEnd = data;
+   recordLine  = 0;
+   error.clear();
+
+   // skip a UTF-8 byte order mark
+   if(len >= 3 && !memcmp(data, "\xEF\xBB\xBF", 3))
+      pos += 3;
+}
+
+void CSVReader::close()
+{
+#ifndef VIBC_NO_WIN32
+   if(view)
+      UnmapViewOfFile(view);
+   if(mapping)
+      CloseHandle(mapping);
+#endif
+   view    = nullptr;
+   mapping = nullptr;
+   std::vector<char>().swap(buffer);
+
+   pos = end = recordStart = recordEnd = nullptr;
+}
+
+// Step over the line break at pos
+void CSVReader::endLine()
+{
+   if(*pos++ == '\r' && pos < end && *pos == '\n')
+      ++pos;
+   ++line;
+}
+
+//
+// CSVReader::next
+//
+// Read the next record. Returns false at the end of the input, or if a
+// quoted field is still open there, in which case getError says so.
+//
+bool CSVReader::next(CSVRecord &record)
+{
+   record.text.clear();
+   record.ends.clear();
+
+   if(!error.empty())
+      return false;
+
+   while(pos < end && (*pos == '\n' || *pos == '\r'))
+      endLine();
+
+   if(pos >= end)
+      return false;
+
+   recordStart = pos;
+   recordLine  = line;
+
+   for(;;)
+   {
+      if(pos < end && *pos == quote)
+      {
+         for(++pos;;)
+         {
+            const char *q = static_cast<const char *>(memchr(pos, quote, end - pos));
+            if(!q)
+            {
+               char num[32];
+               sprintf(num, "%u", static_cast<unsigned int>(recordLine));
+               error = std::string("Unterminated quoted field in the record starting on line ") + num;
+               recordEnd = end;
+               return false;
+            }
+
+            line += CSV_CountLines(pos, q);
+            record.text.append(pos, q);
+            pos = q + 1;
+
+            if(pos == end || *pos == delim || *pos == '\n' || *pos == '\r')
+               break;                   // closing quote
+            if(doubles && *pos == quote)
+               ++pos;                   // "" is one quote
+            record.text += quote;       // so is a stray one
+         }
+      }
+      else
+      {
+         const char *p = CSV_ScanField(pos, end, delim);
+         record.text.append(pos, p);
+         pos = p;
+      }
+
+      record.ends.push_back(record.text.size());
+
+      if(pos < end && *pos == delim)
+         ++pos;
+      else
+         break;
+   }
+
+   recordEnd = pos;
+   if(pos < end)
+      endLine();
+
+   return true;
+}
+
+//=============================================================================
+//
+// CSVWriter
+//
+
+#define CSVWRITER_BUFFER_SIZE 262144 // written out to a file past this
+
+// charClass values
+enum
+{
+   CSV_PLAIN,
+   CSV_QUOTE,   // the quote character, doubled inside quotes
+   CSV_SPECIAL, // the delimiter or a line break, which need quotes
+   CSV_REPLACE  // given to replaceChars
+};
+
+CSVWriter::CSVWriter(char pDelim, char pQuote, int pQuoting, const char *pEol)
+   : delim(pDelim), quote(pQuote), quoting(pQuoting), eol(pEol), buffer(), file(nullptr),
+     sink(nullptr), sinkContext(nullptr), ioError(false), recordStart(true)
+{
+   memset(replaced, 0, sizeof(replaced));
+   memset(replacement, 0, sizeof(replacement));
+   setCharClasses();
+}
+
+CSVWriter::~CSVWriter()
+{
+   close();
+}
+
+void CSVWriter::setCharClasses()
+{
+   const unsigned char specials[] = { static_cast<unsigned char>(delim), '\r', '\n' };
+
+   memset(charClass, CSV_PLAIN, sizeof(charClass));
+
+   for(size_t i = 0; i < sizeof(specials); i++)
+      charClass[specials[i]] = CSV_SPECIAL;
+   charClass[static_cast<unsigned char>(quote)] = CSV_QUOTE;
+
+   for(int c = 0; c < 256; c++)
+   {
+      if(replaced[c])
+         charClass[c] = CSV_REPLACE;
+   }
+}
+
+//
+// CSVWriter::replaceChars
+//
+// Write each of the given characters as with, or leave them out if with is
+// 0, before any quoting is considered.
+//
+void CSVWriter::replaceChars(const char *chars, char with)
+{
+   for(; *chars; ++chars)
+   {
+      replaced[static_cast<unsigned char>(*chars)]    = true;
+      replacement[static_cast<unsigned char>(*chars)] = with;
+   }
+   setCharClasses();
+}
+
+//
+// CSVWriter::openFile
+//
+// Write to a file from now on, rather than keeping all the text.
+//
+bool CSVWriter::openFile(const char *filename)
+{
+   close();
+
+   if(!(file = fopen(filename, "wb")))
+      return false;
+
+   buffer.reserve(CSVWRITER_BUFFER_SIZE + CSVWRITER_BUFFER_SIZE / 4);
+   return true;
+}
+
+//
+// CSVWriter::openSink
+//
+// Hand the text to fn in chunks from now on, as it would be written to a
+// file, rather than keeping all of it.
+//
+void CSVWriter::openSink(sink_t fn, void *context)
+{
+   close();
+
+   sink        = fn;
+   sinkContext = context;
+   buffer.reserve(CSVWRITER_BUFFER_SIZE + CSVWRITER_BUFFER_SIZE / 4);
+}
+
+//
+// CSVWriter::close
+//
+// Write out what is left and close the file or sink, if one is open.
+// Returns false if anything could not be written.
+//
+bool CSVWriter::close()
+{
+   if(file || sink)
+   {
+      writeOut();
+      if(file && fclose(file))
+         ioError = true;
+      file        = nullptr;
+      sink        = nullptr;
+      sinkContext = nullptr;
+   }
+
+   bool ok = !ioError;
+   ioError = false;
+
+   return ok;
+}
+
+void CSVWriter::writeOut()
+{
+   if(!buffer.empty())
+   {
+      if(file)
+      {
+         if(fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+            ioError = true;
+      }
+      else if(!sink(sinkContext, buffer.data(), buffer.size()))
+         ioError = true;
+   }
+   buffer.clear();
+}
+
+void CSVWriter::flushIfFull()
+{
+   if((file || sink) && buffer.size() >= CSVWRITER_BUFFER_SIZE)
+      writeOut();
+}
+
+//
+// CSVWriter::field
+//
+// Add a field to the current record. Runs of ordinary characters are
+// copied whole; a field found to need quotes under QUOTE_NEEDED has them
+// put around what was written.
+//
+void CSVWriter::field(const char *s, size_t len)
+{
+   const char  *end   = s + len;
+   bool         needs = false;
+
+   // an empty first field could leave an empty line, which reads as no record
+   if(recordStart)
+      needs = !len;
+   else
+      buffer += delim;
+   recordStart = false;
+
+   const size_t start = buffer.size();
+
+   if(quoting == QUOTE_ALL)
+      buffer += quote;
+
+   while(s < end)
+   {
+      const char *run = s;
+
+      while(s < end && charClass[static_cast<unsigned char>(*s)] == CSV_PLAIN)
+         ++s;
+      buffer.append(run, s);
+
+      if(s == end)
+         break;
+
+      const unsigned char c = static_cast<unsigned char>(*s++);
+
+      switch(charClass[c])
+      {
+      case CSV_QUOTE:
+         if(quoting != QUOTE_NONE)
+            buffer += quote;
+         buffer += quote;
+         needs = true;
+         break;
+      case CSV_SPECIAL:
+         buffer += static_cast<char>(c);
+         needs = true;
+         break;
+      default:
+         if(replacement[c])
+            buffer += replacement[c];
+         break;
+      }
+   }
+
+   if(quoting == QUOTE_ALL)
+      buffer += quote;
+   else if(quoting == QUOTE_NEEDED && needs)
+   {
+      buffer.insert(start, 1, quote);
+      buffer += quote;
+   }
+}
+
+void CSVWriter::endRecord()
+{
+   buffer += eol;
+   recordStart = true;
+   flushIfFull();
+}
+
+void CSVWriter::record(const std::vector<std::string> &fields)
+{
+   for(size_t i = 0; i < fields.size(); i++)
+      field(fields[i]);
+   endRecord();
+}
+
+// EOF
@@ -0,0 +1,168 @@
+/*
+
+  CSV Files
+
+  CSVReader maps a delimited text file into memory and splits it into
+  records as described by RFC 4180: a field may be quoted, a doubled quote
+  inside a quoted field stands for one quote, and a quoted field may run
+  over several lines. Records end at LF, CRLF or a lone CR, and blank lines
+  are skipped. As with the old line-at-a-time parser, a quote that does not
+  begin a field, or that is not followed by a delimiter or the end of the
+  line, is kept as an ordinary character.
+
+  Records can be pulled one at a time with next, or handed to a callback
+  with forEach.
+
+  CSVWriter formats records into a large buffer, escaping each field in a
+  single pass, and either keeps the text for the caller or writes it out to
+  a file whenever the buffer fills.
+
+*/
+
+#ifndef CSVFILE_H__
+#define CSVFILE_H__
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+//
+// One record read by CSVReader. The fields are stored end to end in one
+// buffer, which is reused by the next read.
+//
+class CSVRecord
+{
+protected:
+   friend class CSVReader;
+
+   std::string         text;
+   std::vector<size_t> ends; // end of each field in text
+
+public:
+   size_t size() const { return ends.size(); }
+
+   const char *data(size_t i) const { return text.data() + (i ? ends[i - 1] : 0); }
+   size_t length(size_t i) const { return ends[i] - (i ? ends[i - 1] : 0); }
+   std::string str(size_t i) const { return std::string(data(i), length(i)); }
+};
+
+class CSVReader
+{
+protected:
+   char delim;
+   char quote;
+   bool doubles;      // "" inside quotes is one quote
+
+   void       *mapping;   // file mapping handle, if mapped
+   const char *view;      // mapped view, if mapped
+   std::vector<char> buffer; // file contents, if read instead
+
+   const char *pos;
+   const char *end;
+   size_t      line;
+
+   const char *recordStart;
+   const char *recordEnd;
+   size_t      recordLine;
+
+   std::string error;
+
+   void endLine();
+
+public:
+   CSVReader(char delim = ',', char quote = '"', bool doubles = true);
+   ~CSVReader();
+
+   bool open(const char *filename);
+   void openBuffer(const char *data, size_t len);
+   void close();
+
+   bool next(CSVRecord &record);
+
+   //
+   // Call callback(const CSVRecord &) for each remaining record, stopping
+   // early if it returns false. Returns false if the input was malformed.
+   //
+   template<typename F> bool forEach(F callback)
+   {
+      CSVRecord record;
+
+      while(next(record))
+      {
+         if(!callback(static_cast<const CSVRecord &>(record)))
+            break;
+      }
+
+      return error.empty();
+   }
+
+   // Line on which the last record read began, counting from 1
+   size_t getLine() const { return recordLine; }
+
+   // Text of the last record read, as it appears in the file
+   std::string getRawRecord() const { return std::string(recordStart, recordEnd); }
+
+   const std::string &getError() const { return error; }
+};
+
+class CSVWriter
+{
+public:
+   enum
+   {
+      QUOTE_ALL,    // quote every field
+      QUOTE_NEEDED, // quote fields holding the delimiter, a quote or a line break
+      QUOTE_NONE    // write fields as they are
+   };
+
+   // Receives the text a chunk at a time from openSink; returns false if it
+   // could not take it
+   typedef bool (*sink_t)(void *context, const char *data, size_t len);
+
+protected:
+   char          delim;
+   char          quote;
+   int           quoting;
+   std::string   eol;
+   unsigned char charClass[256];   // how each byte is written
+   bool          replaced[256];    // bytes given to replaceChars
+   char          replacement[256]; // and what they become
+
+   std::string buffer;
+   FILE       *file;
+   sink_t      sink;
+   void       *sinkContext;
+   bool        ioError;
+   bool        recordStart;
+
+   void setCharClasses();
+   void writeOut();
+   void flushIfFull();
+
+public:
+   CSVWriter(char delim = ',', char quote = '"', int quoting = QUOTE_NEEDED, const char *eol = "\r\n");
+   ~CSVWriter();
+
+   void setDelimiter(char c)      { delim   = c; setCharClasses(); }
+   void setQuote(char c)          { quote   = c; setCharClasses(); }
+   void setQuoting(int q)         { quoting = q; }
+   void setLineEnd(const char *s) { eol     = s; }
+   void replaceChars(const char *chars, char with);
+
+   bool openFile(const char *filename);
+   void openSink(sink_t fn, void *context);
+   bool close();
+
+   void field(const char *s, size_t len);
+   void field(const std::string &s) { field(s.data(), s.size()); }
+   void endRecord();
+   void record(const std::vector<std::string> &fields);
+
+   // Text written so far, or since the last flush to the file or sink
+   std::string &getBuffer() { return buffer; }
+};
+
+#endif
+
+// EOF
@@ -369,7 +369,12 @@ static JSBool ADOCommand_Execute(JSContext *cx, uintN argc, jsval *vp)
 
    try
    {
-      PrivateADORecordSet::NewAsReturnVal(cx, vp, priv->cmd->execute());
+      ADORecordSetPtr rsp;
+      {
+         JSEngineUnlocked unlocked;
+         rsp = priv->cmd->execute();
+      }
+      PrivateADORecordSet::NewAsReturnVal(cx, vp, std::move(rsp));
       return JS_TRUE;
    }
    catch(_com_error &err)
@@ -703,6 +708,7 @@ static JSBool ADOReadOnlyDB_Execute(JSContext *cx, uintN argc, jsval *vp)
          const char *cmd = SafeGetStringBytes(cx, argv[0], &argv[0]);
          try
          {
+            JSEngineUnlocked unlocked;
             priv->db.execute(cmd);
          }
          catch(_com_error &err)
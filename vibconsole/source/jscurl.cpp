@@ -117,7 +117,11 @@ static JSBool CURLFile_open(JSContext *cx, uintN argc, jsval *vp)
    if(argc >= 2)
       mode = SafeGetStringBytes(cx, argv[1], &argv[1]);
 
-   bool res = file->f->open(filename, mode);
+   bool res;
+   {
+      JSEngineUnlocked unlocked;
+      res = file->f->open(filename, mode);
+   }
 
    JS_SET_RVAL(cx, vp, res ? JSVAL_TRUE : JSVAL_FALSE);
    return JS_TRUE;
@@ -140,7 +144,11 @@ static JSBool CURLFile_openPost(JSContext *cx, uintN argc, jsval *vp)
    if(argc >= 2)
       post = SafeGetStringBytes(cx, argv[1], &argv[1]);
 
-   bool res = file->f->openPost(filename, post);
+   bool res;
+   {
+      JSEngineUnlocked unlocked;
+      res = file->f->openPost(filename, post);
+   }
 
    JS_SET_RVAL(cx, vp, res ? JSVAL_TRUE : JSVAL_FALSE);
    return JS_TRUE;
@@ -196,20 +204,24 @@ static JSBool CURLFile_read(JSContext *cx, uintN argc, jsval *vp)
    unsigned char *outpos = nullptr;
    size_t nread;
    size_t total = 0;
-   do
+
    {
-      nread = file->f->read(readBuffer, 1, sizeof(readBuffer));
-      if(total + nread > total)
+      JSEngineUnlocked unlocked;
+      do
       {
-         ptrdiff_t offs = outpos - output;
-         total += nread;
-         output = static_cast<unsigned char *>(realloc(output, total));
-         outpos = output + offs;
-         memcpy(outpos, readBuffer, nread);
-         outpos += nread;
+         nread = file->f->read(readBuffer, 1, sizeof(readBuffer));
+         if(total + nread > total)
+         {
+            ptrdiff_t offs = outpos - output;
+            total += nread;
+            output = static_cast<unsigned char *>(realloc(output, total));
+            outpos = output + offs;
+            memcpy(outpos, readBuffer, nread);
+            outpos += nread;
+         }
       }
+      while(nread);
    }
-   while(nread);
 
    if(output)
    {
@@ -367,7 +379,11 @@ static JSBool CURLConnection_readURL(JSContext *cx, uintN argc, jsval *vp)
 
    const char *url = SafeGetStringBytes(cx, argv[0], &argv[0]);
 
-   char *res = conn->f->readURL(url);
+   char *res;
+   {
+      JSEngineUnlocked unlocked;
+      res = conn->f->readURL(url);
+   }
    if(res)
    {
       auto jstr = JS_NewStringCopyZ(cx, res);
@@ -393,7 +409,11 @@ static JSBool CURLConnection_postURL(JSContext *cx, uintN argc, jsval *vp)
    const char *url  = SafeGetStringBytes(cx, argv[0], &argv[0]);
    const char *post = SafeGetStringBytes(cx, argv[1], &argv[1]);
 
-   char *res = conn->f->postURL(url, post);
+   char *res;
+   {
+      JSEngineUnlocked unlocked;
+      res = conn->f->postURL(url, post);
+   }
    if(res)
    {
       auto jstr = JS_NewStringCopyZ(cx, res);
@@ -2,6 +2,8 @@
    JS Wrappers for Pdate / Ptime / Pstamp
 */
 
+#include <string.h>
+
 #include "jsengine2.h"
 #include "util.h"
 #include "jsnatives.h"
@@ -136,7 +138,7 @@ static JSBool Pdate_New(JSContext *cx, JSObject *obj, uintN argc,
       else
       {
          const char *dateStr = SafeGetStringBytes(cx, argv[0], &argv[0]);
-         pd->date.InDate(dateStr, global_mode);
+         pd->date.InDate(dateStr, strlen(dateStr), global_mode);
       }
    }
    else
@@ -165,7 +167,7 @@ static JSBool Ptime_New(JSContext *cx, JSObject *obj, uintN argc,
       else
       {
          const char *timeStr = SafeGetStringBytes(cx, argv[0], &argv[0]);
-         pt->time.InTime(timeStr, global_mode);
+         pt->time.InTime(timeStr, strlen(timeStr), global_mode);
       }
    }
    else
@@ -203,7 +205,7 @@ static JSBool Pstamp_New(JSContext *cx, JSObject *obj, uintN argc,
             if(JS_ValueToECMAInt32(cx, argv[1], &tmp))
                mode = int(tmp);
          }
-         ps->stamp.InStamp(timeStr, mode);
+         ps->stamp.InStamp(timeStr, strlen(timeStr), mode);
       }
    }
    else
@@ -284,6 +286,32 @@ static Pdate *AllowDateOrStamp(JSContext *cx, jsval v)
    return nullptr;
 }
 
+//
+// Pdate_FromJSValue
+//
+// For natives outside this file that take a date argument: accepts a Pdate
+// or Pstamp, or a string parsed in the given mode. Returns false for any
+// other kind of value.
+//
+bool Pdate_FromJSValue(JSContext *cx, jsval v, int mode, Pdate &date)
+{
+   Pdate *pd;
+
+   if((pd = AllowDateOrStamp(cx, v)))
+   {
+      date.InDate(*pd);
+      return true;
+   }
+   if(JSVAL_IS_STRING(v))
+   {
+      const char *str = JS_GetStringBytes(JSVAL_TO_STRING(v));
+      date.InDate(str, strlen(str), mode);
+      return true;
+   }
+
+   return false;
+}
+
 static Ptime *AllowTimeOrStamp(JSContext *cx, JSObject *obj)
 {
    if(JS_InstanceOf(cx, obj, &pTimeClass, nullptr))
@@ -339,6 +367,67 @@ static JSBool Pstamp_DayOfWeek(JSContext *cx, uintN argc, jsval *vp)
    return priv ? Shared_DayOfWeek(cx, argc, vp, &priv->stamp) : JS_FALSE;
 }
 
+// Serial day number, 1 for 1 January of year 1; 0 if the date is not valid
+static JSBool Shared_DayNumber(JSContext *cx, uintN argc, jsval *vp, Pdate *date)
+{
+   jsval rval;
+
+   if(!JS_NewNumberValue(cx, date->DayNumber(), &rval))
+      return JS_FALSE;
+
+   JS_SET_RVAL(cx, vp, rval);
+   return JS_TRUE;
+}
+
+static JSBool Pdate_DayNumber(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::GetFromThis<PrivatePdate>(cx, vp);
+
+   return priv ? Shared_DayNumber(cx, argc, vp, &priv->date) : JS_FALSE;
+}
+
+static JSBool Pstamp_DayNumber(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::GetFromThis<PrivatePstamp>(cx, vp);
+
+   return priv ? Shared_DayNumber(cx, argc, vp, &priv->stamp) : JS_FALSE;
+}
+
+// Days from the given Pdate or Pstamp to this date; negative if it is later
+static JSBool Shared_DaysSince(JSContext *cx, uintN argc, jsval *vp, Pdate *date)
+{
+   ASSERT_ARGC_GE(argc, 1, "Pdate::daysSince");
+
+   Pdate *argDate = AllowDateOrStamp(cx, JS_ARGV(cx, vp)[0]);
+   jsval  rval;
+
+   if(!argDate)
+   {
+      JS_ReportError(cx, "Parameter 1 is not an instance of Pdate");
+      return JS_FALSE;
+   }
+
+   if(!JS_NewNumberValue(cx, *date - *argDate, &rval))
+      return JS_FALSE;
+
+   JS_SET_RVAL(cx, vp, rval);
+   return JS_TRUE;
+}
+
+static JSBool Pdate_DaysSince(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::GetFromThis<PrivatePdate>(cx, vp);
+
+   return priv ? Shared_DaysSince(cx, argc, vp, &priv->date) : JS_FALSE;
+}
+
+static JSBool Pstamp_DaysSince(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::GetFromThis<PrivatePstamp>(cx, vp);
+
+   return priv ? Shared_DaysSince(cx, argc, vp, &priv->stamp) : JS_FALSE;
+}
+
 static JSBool Shared_InDate(JSContext *cx, uintN argc, jsval *vp, Pdate *date)
 {
    jsval *argv = JS_ARGV(cx, vp);
@@ -349,7 +438,7 @@ static JSBool Shared_InDate(JSContext *cx, uintN argc, jsval *vp, Pdate *date)
       int32 flags = 0;
       JS_ValueToECMAInt32(cx, argv[1], &flags);
 
-      date->InDate(datestr, flags);
+      date->InDate(datestr, strlen(datestr), flags);
    }
    else if(argc == 1)
    {
@@ -764,8 +853,9 @@ static JSBool Shared_OutDate(JSContext *cx, uintN argc, jsval *vp, Pdate *date)
    int32 mode;
    JS_ValueToECMAInt32(cx, argv[0], &mode);
 
-   std::string outstr = date->OutDate(mode);
-   JSString *jstr = AssertJSNewStringCopyZ(cx, outstr.c_str()); // FIXME/TODO: auto string?
+   char buf[outdate_size];
+   size_t len = date->OutDate(buf, mode);
+   JSString *jstr = AssertJSNewStringCopyN(cx, buf, len);
    JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jstr));
    return JS_TRUE;
 }
@@ -788,13 +878,11 @@ static JSBool Pdate_ToString(JSContext *cx, uintN argc, jsval *vp)
 {
    auto priv = PrivateData::MustGetFromThis<PrivatePdate>(cx, vp);
 
-   std::string dateStr;
+   char buf[outdate_size] = "invalid date";
    if(priv->date.IsValidDate())
-      dateStr = priv->date.OutDate(global_mode);
-   else
-      dateStr = "invalid date";
+      priv->date.OutDate(buf, global_mode);
 
-   JSString *jstr = AssertJSNewStringCopyZ(cx, dateStr.c_str());
+   JSString *jstr = AssertJSNewStringCopyZ(cx, buf);
    JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jstr));
    return JS_TRUE;
 }
@@ -831,7 +919,7 @@ static JSBool Shared_InTime(JSContext *cx, uintN argc, jsval *vp, Ptime *time)
       int32 flags = 0;
       JS_ValueToECMAInt32(cx, argv[1], &flags);
 
-      time->InTime(timeStr, flags);
+      time->InTime(timeStr, strlen(timeStr), flags);
    }
    else if (argc == 1)
    {
@@ -872,8 +960,9 @@ static JSBool Shared_OutTime(JSContext *cx, uintN argc, jsval *vp, Ptime *time)
    int32 mode;
    JS_ValueToECMAInt32(cx, argv[0], &mode);
 
-   std::string outstr = time->OutTime(mode);
-   JSString *jstr = AssertJSNewStringCopyZ(cx, outstr.c_str());
+   char buf[outtime_size];
+   size_t len = time->OutTime(buf, mode);
+   JSString *jstr = AssertJSNewStringCopyN(cx, buf, len);
    JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jstr));
    return JS_TRUE;
 }
@@ -1153,13 +1242,11 @@ static JSBool Ptime_ToString(JSContext *cx, uintN argc, jsval *vp)
 {
    auto priv = PrivateData::MustGetFromThis<PrivatePtime>(cx, vp);
 
-   std::string dateStr;
+   char buf[outtime_size] = "invalid time";
    if(priv->time.IsValidTime())
-      dateStr = priv->time.OutTime(global_mode);
-   else
-      dateStr = "invalid time";
+      priv->time.OutTime(buf, global_mode);
 
-   JSString *jstr = AssertJSNewStringCopyZ(cx, dateStr.c_str());
+   JSString *jstr = AssertJSNewStringCopyZ(cx, buf);
    JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jstr));
    return JS_TRUE;
 }
@@ -1184,7 +1271,7 @@ static JSBool Pstamp_InStamp(JSContext *cx, uintN argc, jsval *vp)
       int32 flags = 0;
       JS_ValueToECMAInt32(cx, argv[1], &flags);
 
-      priv->stamp.InStamp(stampStr, flags);
+      priv->stamp.InStamp(stampStr, strlen(stampStr), flags);
    }
 
    JS_SET_RVAL(cx, vp, JSVAL_VOID);
@@ -1204,8 +1291,9 @@ static JSBool Pstamp_OutStamp(JSContext *cx, uintN argc, jsval *vp)
    int32 mode;
    JS_ValueToECMAInt32(cx, argv[0], &mode);
 
-   std::string outstr = priv->stamp.OutStamp(mode);
-   JSString *jstr = AssertJSNewStringCopyZ(cx, outstr.c_str()); // FIXME/TODO: auto string?
+   char buf[outstamp_size];
+   size_t len = priv->stamp.OutStamp(buf, mode);
+   JSString *jstr = AssertJSNewStringCopyN(cx, buf, len);
    JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jstr));
    return JS_TRUE;
 }
@@ -1218,7 +1306,9 @@ static JSBool Pstamp_ToJSDateString(JSContext *cx, uintN argc, jsval *vp)
    if(!priv->stamp.IsValidStamp())
       throw JSEngineError("Stamp is invalid!");
 
-   JSString *jstr = AssertJSNewStringCopyZ(cx, priv->stamp.OutStamp(global_mode | withoutmillis).c_str());
+   char buf[outstamp_size];
+   size_t len = priv->stamp.OutStamp(buf, global_mode | withoutmillis);
+   JSString *jstr = AssertJSNewStringCopyN(cx, buf, len);
    JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jstr));
    return JS_TRUE;
 }
@@ -1229,9 +1319,7 @@ static JSBool Pstamp_Mod(JSContext *cx, uintN argc, jsval *vp)
    jsval *argv = JS_ARGV(cx, vp);
 
    ASSERT_ARGC_GE(argc, 1, "Pstamp::mod");
-   ASSERT_IS_OBJECT(argv[0], "Argument 0");
 
-   JSObject *param = JSVAL_TO_OBJECT(argv[0]);
    int result = 0;
 
    if(argc == 2)
@@ -1243,6 +1331,10 @@ static JSBool Pstamp_Mod(JSContext *cx, uintN argc, jsval *vp)
    }
    else 
    {
+      ASSERT_IS_OBJECT(argv[0], "Argument 0");
+
+      JSObject *param = JSVAL_TO_OBJECT(argv[0]);
+
       if(JS_InstanceOf(cx, param, &pStampClass, nullptr))
       {
          auto thatPriv = PrivateData::GetFromJSObject<PrivatePstamp>(cx, param);
@@ -1273,13 +1365,11 @@ static JSBool Pstamp_ToString(JSContext *cx, uintN argc, jsval *vp)
 {
    auto priv = PrivateData::MustGetFromThis<PrivatePstamp>(cx, vp);
 
-   std::string ts;
+   char buf[outstamp_size] = "invalid timestamp";
    if(priv->stamp.IsValidStamp())
-      ts = priv->stamp.OutStamp(global_mode);
-   else
-      ts = "invalid timestamp";
+      priv->stamp.OutStamp(buf, global_mode);
 
-   JSString *jstr = AssertJSNewStringCopyZ(cx, ts.c_str());
+   JSString *jstr = AssertJSNewStringCopyZ(cx, buf);
    JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jstr));
    return JS_TRUE;
 }
@@ -1438,6 +1528,8 @@ static JSFunctionSpec PdateMethods[] =
 {
    JSE_FN("calcAge",         Pdate_CalcAge,         0, 0, 0),
    JSE_FN("dayOfWeek",       Pdate_DayOfWeek,       0, 0, 0),
+   JSE_FN("dayNumber",       Pdate_DayNumber,       0, 0, 0),
+   JSE_FN("daysSince",       Pdate_DaysSince,       1, 0, 0),
    JSE_FN("inDate",          Pdate_InDate,          1, 0, 0),
    JSE_FN("isValidDate",     Pdate_IsValidDate,     0, 0, 0),
    JSE_FN("mod",             Pdate_mod,             1, 0, 0),
@@ -1484,6 +1576,8 @@ static JSFunctionSpec PstampMethods[] =
 {
    // Pdate-Inherited Methods
    JSE_FN("dayOfWeek",          Pstamp_DayOfWeek,           0, 0, 0),
+   JSE_FN("dayNumber",          Pstamp_DayNumber,           0, 0, 0),
+   JSE_FN("daysSince",          Pstamp_DaysSince,           1, 0, 0),
    JSE_FN("inDate",             Pstamp_InDate,              1, 0, 0),
    JSE_FN("isValidDate",        Pstamp_IsValidDate,         0, 0, 0),
    JSE_FN("dateMod",            Pstamp_DateMod,             1, 0, 0),
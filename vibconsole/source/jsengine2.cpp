@@ -7,20 +7,44 @@
 
 */
 
+#include <ctype.h>
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
 
+#include "conlog.h"
 #include "jsengine2.h"
 #include "jsnatives.h"
+#include "jsxdrapi.h"
+#include "inifile.h"
+#include "timer.h"
 #include "util.h"
 
-static JSRuntime     *runtime;
-static JSEvalContext *gContext;
+// Per-thread engine state; see the engine lock below
+static JSENGINE_THREADLOCAL JSRuntime     *runtime;
+static JSENGINE_THREADLOCAL JSEvalContext *gContext;
+static JSENGINE_THREADLOCAL bool           isWorkerThread;
+static JSENGINE_THREADLOCAL volatile long *terminateFlag;
 
+static scriptcachestats_t scriptCacheStats;
+static contextpoolstats_t contextPoolStats;
+
+static void ContextPool_Clear();
+static void ModuleRegistry_Clear();
+static void LazyExtension_Clear();
+
+// Defaults; see the [gc] section of options.ini below
 #define RUNTIME_HEAP_SIZE 64L * 1024L * 1024L
 #define STACK_CHUNK_SIZE  8192
 
+static uint32 gcMaxBytes          = RUNTIME_HEAP_SIZE;
+static uint32 gcMaxMallocBytes    = RUNTIME_HEAP_SIZE;
+static uint32 gcStackPoolLifespan = 30000;
+static size_t stackChunkSize      = STACK_CHUNK_SIZE;
+
 //=============================================================================
 //
 // Utilities
@@ -286,6 +310,41 @@ bool JSObjectToStrIntMap(JSContext *cx, JSObject *obj, std::map<std::string, int
    return true;
 }
 
+//
+// Convert a JavaScript array into a vector<string>. Null and undefined
+// elements become empty strings.
+//
+bool JSArrayToStringVec(JSContext *cx, JSObject *obj, std::vector<std::string> &strVec)
+{
+   jsuint arrayLen = 0;
+
+   if(!JS_IsArrayObject(cx, obj) || !JS_GetArrayLength(cx, obj, &arrayLen))
+      return false;
+
+   strVec.resize(arrayLen);
+
+   for(jsuint i = 0; i < arrayLen; i++)
+   {
+      jsval valAtIndex = JSVAL_VOID;
+      if(!JS_LookupElement(cx, obj, (jsint)i, &valAtIndex))
+         return false;
+
+      if(JSVAL_IS_NULL(valAtIndex) || JSVAL_IS_VOID(valAtIndex))
+         strVec[i].clear();
+      else
+      {
+         // nothing can trigger a GC before the characters are copied
+         JSString   *jstr  = JS_ValueToString(cx, valAtIndex);
+         const char *bytes = jstr ? JS_GetStringBytes(jstr) : nullptr;
+         if(!bytes)
+            return false;
+         strVec[i] = bytes;
+      }
+   }
+
+   return true;
+}
+
 //
 // Convert jsval to integer using the global context
 //
@@ -309,7 +368,7 @@ public:
    JSObject    *global;      // JS global object
 
    JSEvalContextPimpl()
-      : autoContext(runtime, STACK_CHUNK_SIZE),
+      : autoContext(runtime, stackChunkSize),
         global(nullptr)
    {
    }
@@ -354,6 +413,21 @@ bool JSEvalContext::setGlobal(JSClass *globalClass, JSObject *parent)
       return false;
 }
 
+//
+// JSEvalContext::clearGlobal
+//
+// Drop the global object so that the context can be given a new one. The old
+// global is collected normally once nothing refers to it.
+//
+void JSEvalContext::clearGlobal()
+{
+   JSContext *ctx = pImpl->autoContext.ctx;
+
+   pImpl->global = nullptr;
+   if(ctx)
+      JS_SetGlobalObject(ctx, nullptr);
+}
+
 //
 // JSEvalContext::getContext
 //
@@ -475,6 +549,130 @@ NativeInitCode Native::EnumerateAll(JSContext *cx, JSObject *obj)
    return ret;
 }
 
+//=============================================================================
+//
+// Lazy Extensions
+//
+// extensions.js registers jslib files that define a single global, such as
+// the Map and Set polyfills, with Core.lazyLoad instead of running them. The
+// file is run the first time its global is looked up on a global object
+// that ran extensions.js and does not have it yet. JSEngine_RunExtensions
+// marks such globals through their private data; bare sandboxes, and those
+// parented to a global, which leave the lookup to their parent, are never
+// marked and never load anything. Files that extend built-in prototypes have
+// no global of their own to trigger them and are still loaded up front.
+//
+
+struct lazyext_t
+{
+   std::string  filename;
+   bool         loading;  // guards the file's own test for its global
+   unsigned int loads;
+   unsigned int loadMS;
+
+   lazyext_t() : loading(false), loads(0), loadMS(0) {}
+};
+
+typedef std::map<std::string, lazyext_t> lazyextmap_t;
+
+static JSENGINE_THREADLOCAL lazyextmap_t *lazyExtensions;
+
+// Private data of globals that have run extensions.js
+static int lazyExtensionGlobal;
+
+//
+// JSEngine_AddLazyExtension
+//
+// Run filename when the global name is first needed on this thread.
+//
+void JSEngine_AddLazyExtension(const char *name, const char *filename)
+{
+   if(!lazyExtensions)
+      lazyExtensions = new lazyextmap_t;
+
+   (*lazyExtensions)[name].filename = filename;
+}
+
+//
+// JSEngine_GetLazyExtensionStats
+//
+// Time spent loading each lazy extension on this thread so far, for those
+// that have been loaded.
+//
+void JSEngine_GetLazyExtensionStats(std::map<std::string, unsigned int> &loadMS)
+{
+   loadMS.clear();
+
+   if(!lazyExtensions)
+      return;
+
+   for(auto itr = lazyExtensions->begin(); itr != lazyExtensions->end(); ++itr)
+   {
+      if(itr->second.loads)
+         loadMS[itr->first] = itr->second.loadMS;
+   }
+}
+
+static void LazyExtension_Clear()
+{
+   delete lazyExtensions;
+   lazyExtensions = nullptr;
+}
+
+//
+// Run the file registered for name, if any, with obj as its global. Sets
+// resolved if the file defined name.
+//
+static JSBool LazyExtension_Resolve(JSContext *cx, JSObject *obj, const char *name, bool &resolved)
+{
+   resolved = false;
+
+   if(!lazyExtensions || JS_GetPrivate(cx, obj) != &lazyExtensionGlobal)
+      return JS_TRUE;
+
+   auto itr = lazyExtensions->find(name);
+   if(itr == lazyExtensions->end() || itr->second.loading)
+      return JS_TRUE;
+
+   lazyext_t   &ext   = itr->second;
+   unsigned int start = Timer_getMS();
+   JSBool       ok    = JS_FALSE;
+   JSScript    *script;
+
+   ext.loading = true;
+   try
+   {
+      if((script = JSEngine_CompileFileCached(cx, obj, ext.filename.c_str())))
+      {
+         JSObject *scriptObj = JS_NewScriptObject(cx, script);
+
+         if(scriptObj)
+         {
+            AutoNamedRoot root(cx, scriptObj, "LazyExtension_Resolve");
+            jsval rval;
+            ok = JS_ExecuteScript(cx, obj, script, &rval);
+         }
+         else
+            JS_DestroyScript(cx, script);
+      }
+   }
+   catch(const JSEngineError &err)
+   {
+      ok = err.propagateToJS(cx);
+   }
+   ext.loading = false;
+
+   ++ext.loads;
+   ext.loadMS += Timer_getMS() - start;
+
+   JSBool found = JS_FALSE;
+   if(!ok || !JS_AlreadyHasOwnProperty(cx, obj, name, &found))
+      return JS_FALSE;
+
+   resolved = !!found;
+   return JS_TRUE;
+}
+
 //=============================================================================
 //
 // Global JavaScript Object and Methods
@@ -492,7 +690,8 @@ static JSBool global_enumerate(JSContext *cx, JSObject *obj)
 
 //
 // Resolution callback for the global JS object class. If the named property
-// is not a standard symbol, check the Native object registry for a match.
+// is not a standard symbol, check the Native object registry for a match,
+// and then the lazy extensions.
 //
 static JSBool global_resolve(JSContext *cx, JSObject *obj, jsval id, uintN flags,
                              JSObject **objp)
@@ -521,6 +720,13 @@ static JSBool global_resolve(JSContext *cx, JSObject *obj, jsval id, uintN flags
             *objp = obj;
             break;
          case NOSUCHPROPERTY:
+            {
+               bool lazyResolved;
+               if(!LazyExtension_Resolve(cx, obj, name, lazyResolved))
+                  return JS_FALSE;
+               if(lazyResolved)
+                  *objp = obj;
+            }
             break; // That's fine, return true below.
          case RESOLUTIONERROR:
             return JS_FALSE; // This on the other hand means something is wrong
@@ -535,7 +741,8 @@ static JSBool global_resolve(JSContext *cx, JSObject *obj, jsval id, uintN flags
 static JSClass global_class =
 {
    "global",                                   // name
-   JSCLASS_NEW_RESOLVE | JSCLASS_GLOBAL_FLAGS, // flags
+   JSCLASS_NEW_RESOLVE | JSCLASS_GLOBAL_FLAGS |
+   JSCLASS_HAS_PRIVATE,                        // flags
    JS_PropertyStub,                            // addProperty
    JS_PropertyStub,                            // delProperty
    JS_PropertyStub,                            // getProperty
@@ -551,7 +758,7 @@ static JSClass global_class =
 static JSClass sandbox_class =
 {
    "Sandbox",
-   JSCLASS_NEW_RESOLVE | JSCLASS_GLOBAL_FLAGS,
+   JSCLASS_NEW_RESOLVE | JSCLASS_GLOBAL_FLAGS | JSCLASS_HAS_PRIVATE,
    JS_PropertyStub,                            
    JS_PropertyStub,                            
    JS_PropertyStub,                             
@@ -582,13 +789,231 @@ static JSClass restricted_class =
 
 //=============================================================================
 //
-// Core Engine Routines
+// Garbage Collection
+//
+// Configured by the [gc] section of options.ini, for every runtime including
+// those of worker threads:
+//   maxbytes          = MB of GC heap allowed before a last-ditch collection,
+//                       past which allocation fails (default 64)
+//   maxmallocbytes    = MB allocated by the engine's malloc between
+//                       collections (default: same as maxbytes)
+//   stackpoollifespan = ms to keep unused interpreter stack space (default
+//                       30000)
+//   stackchunksize    = bytes of interpreter stack allocated at a time
+//                       (default 8192)
+//   longpause         = log collections taking at least this many ms; 0
+//                       disables (default 100)
 //
+// Core.setGCParameter changes the first three for the calling thread's
+// runtime only.
 
 #ifndef VIBC_NO_WIN32
 #include <Windows.h>
 #endif
 
+static unsigned int gcLongPauseMS = 100;
+
+// Pause statistics, per runtime
+static JSENGINE_THREADLOCAL unsigned int gcStartMS;
+static JSENGINE_THREADLOCAL unsigned int gcCollections;
+static JSENGINE_THREADLOCAL unsigned int gcLastPauseMS;
+static JSENGINE_THREADLOCAL unsigned int gcMaxPauseMS;
+static JSENGINE_THREADLOCAL unsigned int gcTotalPauseMS;
+static JSENGINE_THREADLOCAL unsigned int gcLongPauses;
+
+// Parameters as last set on this thread's runtime, by JSGCParamKey
+static JSENGINE_THREADLOCAL uint32 gcParams[JSGC_STACKPOOL_LIFESPAN + 1];
+
+//
+// JS_GetGCParameter and JS_GetGCHeapStats are additions to the js-1.8.0 in
+// this tree that the prebuilt js32.dll in vibconsole/bin lacks, so they are
+// looked up in the loaded DLL rather than linked. Without them, parameters
+// read back from gcParams and the heap statistics hold only what is known
+// here.
+//
+#ifndef VIBC_NO_WIN32
+template<typename F> static F GC_ImportProc(const char *name)
+{
+   HMODULE mod = GetModuleHandleA("js32.dll");
+   return mod ? reinterpret_cast<F>(GetProcAddress(mod, name)) : nullptr;
+}
+#define GC_IMPORT(func) GC_ImportProc<decltype(&func)>(#func)
+#else
+#define GC_IMPORT(func) (&func)
+#endif
+
+static auto gcGetParameterProc = GC_IMPORT(JS_GetGCParameter);
+static auto gcGetHeapStatsProc = GC_IMPORT(JS_GetGCHeapStats);
+
+static void GC_GetHeapStats(JSRuntime *rt, JSGCHeapStats &heap)
+{
+   if(gcGetHeapStatsProc)
+   {
+      gcGetHeapStatsProc(rt, &heap);
+      return;
+   }
+
+   memset(&heap, 0, sizeof(heap));
+   heap.number         = gcCollections;
+   heap.maxBytes       = gcParams[JSGC_MAX_BYTES];
+   heap.maxMallocBytes = gcParams[JSGC_MAX_MALLOC_BYTES];
+}
+
+static uint32 GC_IniMB(IniFile::IniValue &section, const char *key, uint32 def)
+{
+   if(section.find(key) == section.end())
+      return def;
+
+   int mb = atoi(section[key].c_str());
+   if(mb <= 0)
+      return def;
+
+   return mb >= 4096 ? 0xFFFFFFFFu : static_cast<uint32>(mb) * 1024u * 1024u;
+}
+
+//
+// Read the [gc] section; called once, before the main runtime is created.
+//
+static void GC_InitOptions()
+{
+   IniFile::IniMap &ini = IniFile::GetIniOptions();
+   IniFile::IniMap::iterator itr = ini.find("gc");
+
+   if(itr == ini.end())
+      return;
+
+   IniFile::IniValue &section = itr->second;
+
+   gcMaxBytes       = GC_IniMB(section, "maxbytes", gcMaxBytes);
+   gcMaxMallocBytes = GC_IniMB(section, "maxmallocbytes", gcMaxBytes);
+
+   if(section.find("stackpoollifespan") != section.end())
+      gcStackPoolLifespan = static_cast<uint32>(atoi(section["stackpoollifespan"].c_str()));
+   if(section.find("stackchunksize") != section.end() && atoi(section["stackchunksize"].c_str()) > 0)
+      stackChunkSize = static_cast<size_t>(atoi(section["stackchunksize"].c_str()));
+   if(section.find("longpause") != section.end())
+      gcLongPauseMS = static_cast<unsigned int>(atoi(section["longpause"].c_str()));
+}
+
+//
+// Time each collection, and log the ones that take too long.
+//
+static JSBool GC_Callback(JSContext *cx, JSGCStatus status)
+{
+   if(status == JSGC_BEGIN)
+      gcStartMS = Timer_getMS();
+   else if(status == JSGC_END)
+   {
+      unsigned int pause = Timer_getMS() - gcStartMS;
+
+      ++gcCollections;
+      gcLastPauseMS   = pause;
+      gcTotalPauseMS += pause;
+      if(pause > gcMaxPauseMS)
+         gcMaxPauseMS = pause;
+
+      if(gcLongPauseMS && pause >= gcLongPauseMS)
+      {
+         JSGCHeapStats heap;
+         char buf[160];
+         int  len;
+
+         ++gcLongPauses;
+         GC_GetHeapStats(JS_GetRuntime(cx), heap);
+         if(gcGetHeapStatsProc)
+         {
+            len = sprintf(buf, "GC pause of %u ms; heap is %u KB of %u KB\n", 
+                          pause, heap.bytes / 1024, heap.maxBytes / 1024);
+         }
+         else
+            len = sprintf(buf, "GC pause of %u ms\n", pause);
+         if(len > 0 && ConLog_GetLevel() <= CONLOG_WARN)
+            ConLog_Write(buf, static_cast<size_t>(len));
+      }
+   }
+
+   return JS_TRUE;
+}
+
+//
+// Apply the configured limits to a new runtime.
+//
+static void GC_InitRuntime(JSRuntime *rt)
+{
+   JS_SetGCParameter(rt, JSGC_MAX_MALLOC_BYTES,   gcMaxMallocBytes);
+   JS_SetGCParameter(rt, JSGC_STACKPOOL_LIFESPAN, gcStackPoolLifespan);
+   gcParams[JSGC_MAX_BYTES]          = gcMaxBytes;
+   gcParams[JSGC_MAX_MALLOC_BYTES]   = gcMaxMallocBytes;
+   gcParams[JSGC_STACKPOOL_LIFESPAN] = gcStackPoolLifespan;
+   JS_SetGCCallbackRT(rt, GC_Callback);
+}
+
+static bool GC_ParamKey(const char *name, JSGCParamKey &key)
+{
+   if(!strcmp(name, "maxBytes"))
+      key = JSGC_MAX_BYTES;
+   else if(!strcmp(name, "maxMallocBytes"))
+      key = JSGC_MAX_MALLOC_BYTES;
+   else if(!strcmp(name, "stackPoolLifespan"))
+      key = JSGC_STACKPOOL_LIFESPAN;
+   else
+      return false;
+
+   return true;
+}
+
+//
+// JSEngine_SetGCParameter
+//
+// Set maxBytes, maxMallocBytes or stackPoolLifespan on the calling thread's
+// runtime. Returns false for any other name.
+//
+bool JSEngine_SetGCParameter(const char *name, uint32 value)
+{
+   JSGCParamKey key;
+
+   if(!GC_ParamKey(name, key))
+      return false;
+
+   JS_SetGCParameter(runtime, key, value);
+   gcParams[key] = value;
+   return true;
+}
+
+//
+// JSEngine_GetGCParameter
+//
+bool JSEngine_GetGCParameter(const char *name, uint32 &value)
+{
+   JSGCParamKey key;
+
+   if(!GC_ParamKey(name, key))
+      return false;
+
+   value = gcGetParameterProc ? gcGetParameterProc(runtime, key) : gcParams[key];
+   return true;
+}
+
+//
+// JSEngine_GetGCStats
+//
+// Pause times and heap statistics for the calling thread's runtime.
+//
+void JSEngine_GetGCStats(gcstats_t &stats)
+{
+   stats.collections  = gcCollections;
+   stats.lastPauseMS  = gcLastPauseMS;
+   stats.maxPauseMS   = gcMaxPauseMS;
+   stats.totalPauseMS = gcTotalPauseMS;
+   stats.longPauses   = gcLongPauses;
+   GC_GetHeapStats(runtime, stats.heap);
+}
+
+//=============================================================================
+//
+// Core Engine Routines
+//
+
 static void SetErrorReportConsoleAttribs()
 {
 #ifndef VIBC_NO_WIN32
@@ -614,10 +1039,16 @@ static void ErrorReport(JSContext *cx, const char *message, JSErrorReport *repor
    std::string msg;
    bool        addedFile = false;
 
+   // errors are written synchronously, after any output queued before them
+   ConLog_Flush();
+
    if(!report)
    {
       msg = message;
-      std::cout << msg << std::endl;
+      if(ConLog_Capturing())
+         ConLog_Write((msg + '\n').data(), msg.size() + 1, CONLOG_OUT);
+      else
+         std::cout << msg << std::endl;
       if(echoFile)
       {
          echoFile << msg << std::endl;
@@ -644,9 +1075,14 @@ static void ErrorReport(JSContext *cx, const char *message, JSErrorReport *repor
    if(report->linebuf)
       msg += "\nContext: " + std::string(report->linebuf);
 
-   SetErrorReportConsoleAttribs();
-   std::cout << msg << std::endl;
-   ResetConsoleAttribs();
+   if(ConLog_Capturing()) // running a batch job; the error goes to its client
+      ConLog_Write((msg + '\n').data(), msg.size() + 1, CONLOG_OUT);
+   else
+   {
+      SetErrorReportConsoleAttribs();
+      std::cout << msg << std::endl;
+      ResetConsoleAttribs();
+   }
    
    if(echoFile)
    {
@@ -655,6 +1091,130 @@ static void ErrorReport(JSContext *cx, const char *message, JSErrorReport *repor
    }
 }
 
+//=============================================================================
+//
+// Engine Lock
+//
+// SpiderMonkey 1.8.0 keeps some state process-wide (the dtoa freelists, the
+// deflated string cache) and only guards it when built JS_THREADSAFE, which
+// needs NSPR. Instead, each thread gets its own JSRuntime and they take turns
+// through this lock. Scripts running on one thread give the others a chance
+// from the operation callback, and blocking natives release it outright.
+//
+
+#ifndef VIBC_NO_WIN32
+
+static CRITICAL_SECTION engineLock;
+static volatile LONG    engineLockWaiters; // threads blocked in JSEngine_Lock
+static volatile LONG    engineLockEntries; // acquisitions ever made
+
+void JSEngine_Lock()
+{
+   InterlockedIncrement(&engineLockWaiters);
+   EnterCriticalSection(&engineLock);
+   InterlockedDecrement(&engineLockWaiters);
+   InterlockedIncrement(&engineLockEntries);
+}
+
+void JSEngine_Unlock()
+{
+   LeaveCriticalSection(&engineLock);
+}
+
+//
+// JSEngine_Yield
+//
+// If another thread is waiting on the lock, let it have it. Critical sections
+// are not fair, so wait briefly for a handoff before taking it back.
+//
+void JSEngine_Yield()
+{
+   if(!InterlockedCompareExchange(&engineLockWaiters, 0, 0))
+      return;
+
+   LONG entries = InterlockedCompareExchange(&engineLockEntries, 0, 0);
+
+   JSEngineUnlocked unlocked;
+   for(int i = 0; i < 50 && InterlockedCompareExchange(&engineLockEntries, 0, 0) == entries; i++)
+      SwitchToThread();
+}
+
+static void JSEngine_InitLock()
+{
+   InitializeCriticalSection(&engineLock);
+   JSEngine_Lock();
+}
+
+#else
+
+// No thread support; only the main thread runs JS
+
+void JSEngine_Lock()
+{
+}
+
+void JSEngine_Unlock()
+{
+}
+
+void JSEngine_Yield()
+{
+}
+
+static void JSEngine_InitLock()
+{
+}
+
+#endif
+
+//
+// JSEngine_SetTerminateFlag
+//
+// Scripts running on the calling thread will be stopped at the next operation
+// callback once *flag becomes nonzero.
+//
+void JSEngine_SetTerminateFlag(volatile long *flag)
+{
+   terminateFlag = flag;
+}
+
+//
+// Operation callback for all contexts. Returning false without an exception
+// pending terminates the script uncatchably.
+//
+static JSBool OperationCallback(JSContext *cx)
+{
+   if(terminateFlag && *terminateFlag)
+      return JS_FALSE;
+
+   if(jsengineProfiling)
+      JSEngine_ProfilerSample(cx);
+
+   JSEngine_Yield();
+   return JS_TRUE;
+}
+
+// Operation callbacks come around more often while profiling, so that the
+// samples are taken close to when they are due.
+static uint32 JSEngine_OperationLimit()
+{
+   return jsengineProfiling ? JS_OPERATION_WEIGHT_BASE : 100 * JS_OPERATION_WEIGHT_BASE;
+}
+
+//
+// JSEngine_UpdateOperationLimits
+//
+// Apply the current operation limit to every context of the calling thread's
+// runtime; called when profiling starts or stops.
+//
+void JSEngine_UpdateOperationLimits()
+{
+   JSContext *iter = nullptr, *cx;
+
+   while((cx = JS_ContextIterator(runtime, &iter)))
+      JS_SetOperationLimit(cx, JSEngine_OperationLimit());
+}
+
 //
 // New context creation callback which is assigned to the JSRuntime at startup.
 // This will set the error reporter and JavaScript version in that context.
@@ -665,6 +1225,7 @@ static JSBool ContextCallback(JSContext *cx, uintN contextOp)
    {
       JS_SetErrorReporter(cx, ErrorReport);
       JS_SetVersion(cx, JSVERSION_LATEST);
+      JS_SetOperationCallback(cx, OperationCallback, JSEngine_OperationLimit());
    }
    
    return JS_TRUE;
@@ -675,10 +1236,13 @@ static JSBool ContextCallback(JSContext *cx, uintN contextOp)
 //
 // The extensions.js file is expected to contain any configuration which should
 // apply both to the global execution context and to any sandbox contexts that
-// may be created.
+// may be created. The global is marked as one that lazy extensions may load
+// into.
 //
 bool JSEngine_RunExtensions(JSEvalContext *ecx)
 {
+   JS_SetPrivate(ecx->getContext(), ecx->getGlobal(), &lazyExtensionGlobal);
+
    // Run the extensions script
    jsval rval;
    return JSEngine_EvaluateFileInContext(ecx, "extensions.js", &rval);
@@ -706,12 +1270,21 @@ bool JSEngine_RunAutoexec(JSEvalContext *ecx)
 //
 bool JSEngine_Init()
 {
+   unsigned int startTime = Timer_getMS();
+
+   // The main thread holds the engine lock whenever it is running
+   JSEngine_InitLock();
+
+   GC_InitOptions();
+
    try
    {
       // Create runtime
-      if(!(runtime = JS_NewRuntime(RUNTIME_HEAP_SIZE)))
+      if(!(runtime = JS_NewRuntime(gcMaxBytes)))
          return false;
 
+      GC_InitRuntime(runtime);
+
       // Set context callback
       JS_SetContextCallback(runtime, ContextCallback);
 
@@ -722,17 +1295,26 @@ bool JSEngine_Init()
       if(!gContext->setGlobal(&global_class))
          return false;
 
+      unsigned int phaseTime = Timer_getMS();
+      scriptCacheStats.runtimeMS = phaseTime - startTime;
+
       // Run extensions.js for the global context
       JSEngine_RunExtensions(gContext);
 
+      scriptCacheStats.extensionsMS = Timer_getMS() - phaseTime;
+      phaseTime = Timer_getMS();
+
       // Run autoexec.js for the global context
       JSEngine_RunAutoexec(gContext);
+
+      scriptCacheStats.autoexecMS = Timer_getMS() - phaseTime;
    }
    catch(const JSEngineError &)
    {
       return false;
    }
 
+   scriptCacheStats.startupMS = Timer_getMS() - startTime;
    return true;
 }
 
@@ -743,6 +1325,10 @@ bool JSEngine_Init()
 //
 void JSEngine_Shutdown()
 {
+   ModuleRegistry_Clear();
+   ContextPool_Clear();
+   JSEngine_RetireNativeStats();
+
    if(gContext)
    {
       delete gContext;
@@ -755,6 +1341,100 @@ void JSEngine_Shutdown()
       runtime = nullptr;
       JS_ShutDown();
    }
+
+   LazyExtension_Clear();
+}
+
+//
+// JSEngine_InitWorkerThread
+//
+// Create a runtime for the calling thread, which must hold the engine lock.
+// Worker threads are all stopped by shutdown actions before
+// JSEngine_Shutdown calls JS_ShutDown.
+//
+bool JSEngine_InitWorkerThread()
+{
+   if(!(runtime = JS_NewRuntime(gcMaxBytes)))
+      return false;
+
+   GC_InitRuntime(runtime);
+
+   JS_SetContextCallback(runtime, ContextCallback);
+   isWorkerThread = true;
+   return true;
+}
+
+//
+// JSEngine_ShutdownWorkerThread
+//
+// Destroy the calling thread's runtime.
+//
+void JSEngine_ShutdownWorkerThread()
+{
+   JSEngine_DestroyWorkerContext();
+
+   if(runtime)
+   {
+      JS_DestroyRuntime(runtime);
+      runtime = nullptr;
+   }
+
+   LazyExtension_Clear();
+}
+
+//
+// JSEngine_NewWorkerContext
+//
+// Create a fresh global context on a worker thread and run extensions.js in
+// it. autoexec.js is for the main context only.
+//
+bool JSEngine_NewWorkerContext()
+{
+   JSEngine_DestroyWorkerContext();
+   jsengineNativeStats = JSEngine_NativeStatsEnabled();
+
+   try
+   {
+      std::unique_ptr<JSEvalContext> nc(new JSEvalContext());
+      if(!nc->setGlobal(&global_class))
+         return false;
+
+      gContext = nc.release();
+      JSEngine_RunExtensions(gContext);
+   }
+   catch(const JSEngineError &)
+   {
+      return false;
+   }
+
+   return true;
+}
+
+//
+// JSEngine_DestroyWorkerContext
+//
+void JSEngine_DestroyWorkerContext()
+{
+   ModuleRegistry_Clear();
+   ContextPool_Clear();
+   JSEngine_RetireNativeStats();
+
+   if(gContext)
+   {
+      delete gContext;
+      gContext = nullptr;
+   }
+}
+
+//
+// JSEngine_IsWorkerThread
+//
+// True if the calling thread is running a Worker rather than the main
+// program.
+//
+bool JSEngine_IsWorkerThread()
+{
+   return isWorkerThread;
 }
 
 //=============================================================================
@@ -1049,12 +1729,8 @@ void JSEngine_AddInputLine(const std::string &inputLine)
          std::string result = SafeGetStringBytes(cx, retval, root);
          if(result != "undefined")
          {
-            std::cout << result << std::endl;
-            if(echoFile)
-            {
-               echoFile << result << std::endl;
-               echoFile.flush();
-            }
+            result += '\n';
+            ConLog_Write(result.data(), result.size());
          }
       }
 
@@ -1077,6 +1753,333 @@ void JSEngine_GetInputPrompt(std::string &prompt)
    prompt = (cmdlinestate.lineno == cmdlinestate.startline) ? "js> " : "";
 }
 
+//=============================================================================
+//
+// Script Cache
+//
+// Compiled scripts are kept on disk in XDR form, keyed by the source file's
+// full path, modification time and size. A cache file is used only if its
+// header matches both the source file and the running engine; anything else
+// is compiled from source and the cache file rewritten.
+//
+// Cached scripts are compiled without JSOPTION_COMPILE_N_GO, since that bakes
+// in references to the global object they were compiled against.
+//
+// Configured by the [scriptcache] section of options.ini:
+//   enabled = 0 to disable the cache (default 1)
+//   dir     = directory holding cache files (default "xdrcache")
+//
+
+#ifndef VIBC_NO_WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#define SCRIPTCACHE_MAGIC 0x52445856 // "VXDR"
+
+struct scriptcacheheader_t
+{
+   uint32    magic;           // SCRIPTCACHE_MAGIC
+   uint32    bytecodeVersion; // JSXDR_BYTECODE_VERSION
+   uint32    engineStamp;     // see ScriptCache_EngineStamp
+   uint32    pathLength;      // length of the source path following the header
+   long long mtime;           // source file modification time
+   long long size;            // source file size
+   uint32    dataLength;      // length of XDR data following the path
+   uint32    reserved;
+};
+
+static bool        scriptCacheInit;
+static bool        scriptCacheEnabled;
+static std::string scriptCacheDir;
+
+//
+// 32-bit FNV-1a hash
+//
+static uint32 ScriptCache_Hash(const char *str, uint32 hash = 2166136261u)
+{
+   while(*str)
+   {
+      hash ^= static_cast<unsigned char>(*str++);
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+//
+// Identifies the engine build; cache files written by a different build are
+// ignored.
+//
+static uint32 ScriptCache_EngineStamp()
+{
+   return ScriptCache_Hash(JS_GetImplementationVersion()) ^ static_cast<uint32>(sizeof(void *));
+}
+
+//
+// Read configuration on first use, as options.ini is loaded after startup
+// begins.
+//
+static void ScriptCache_Init()
+{
+   if(scriptCacheInit)
+      return;
+   scriptCacheInit = true;
+
+   IniFile::IniMap &ini = IniFile::GetIniOptions();
+   IniFile::IniMap::iterator itr = ini.find("scriptcache");
+
+   scriptCacheEnabled = true;
+   scriptCacheDir     = "xdrcache";
+
+   if(itr != ini.end())
+   {
+      IniFile::IniValue &section = itr->second;
+
+      if(section.find("enabled") != section.end())
+         scriptCacheEnabled = (atoi(section["enabled"].c_str()) != 0);
+      if(section.find("dir") != section.end() && !section["dir"].empty())
+         scriptCacheDir = section["dir"];
+   }
+
+   if(scriptCacheEnabled)
+   {
+#ifndef VIBC_NO_WIN32
+      _mkdir(scriptCacheDir.c_str());
+#else
+      mkdir(scriptCacheDir.c_str(), 0777);
+#endif
+   }
+}
+
+static bool ScriptCache_Stat(const char *filename, long long &mtime, long long &size)
+{
+#ifndef VIBC_NO_WIN32
+   struct _stat64 st;
+   if(_stat64(filename, &st))
+      return false;
+#else
+   struct stat st;
+   if(stat(filename, &st))
+      return false;
+#endif
+   mtime = static_cast<long long>(st.st_mtime);
+   size  = static_cast<long long>(st.st_size);
+   return true;
+}
+
+static std::string ScriptCache_FullPath(const char *filename)
+{
+#ifndef VIBC_NO_WIN32
+   char buf[_MAX_PATH];
+   if(_fullpath(buf, filename, _MAX_PATH))
+      return buf;
+#endif
+   return filename;
+}
+
+static std::string ScriptCache_FileName(const std::string &path)
+{
+   char name[16];
+   sprintf(name, "%08x.xdr", ScriptCache_Hash(path.c_str()));
+   return scriptCacheDir + "/" + name;
+}
+
+//
+// ScriptCache_Load
+//
+// Returns the decoded script if the cache file is valid for the given source
+// file, or nullptr otherwise.
+//
+static JSScript *ScriptCache_Load(JSContext *cx, const std::string &cachefile, 
+                                  const std::string &path, long long mtime, long long size)
+{
+   FILE *f;
+   scriptcacheheader_t header;
+   std::vector<char>   data;
+   bool                valid = false;
+
+   if(!(f = fopen(cachefile.c_str(), "rb")))
+      return nullptr;
+
+   if(fread(&header, sizeof(header), 1, f) == 1 &&
+      header.magic           == SCRIPTCACHE_MAGIC &&
+      header.bytecodeVersion == JSXDR_BYTECODE_VERSION &&
+      header.engineStamp     == ScriptCache_EngineStamp() &&
+      header.mtime           == mtime &&
+      header.size            == size &&
+      header.pathLength      == path.length() &&
+      header.dataLength      > 0)
+   {
+      data.resize(header.pathLength + header.dataLength);
+      if(fread(&data[0], data.size(), 1, f) == 1 &&
+         !path.compare(0, path.length(), &data[0], header.pathLength))
+         valid = true;
+   }
+   fclose(f);
+
+   if(!valid)
+      return nullptr;
+
+   JSXDRState *xdr;
+   JSScript   *script = nullptr;
+
+   if(!(xdr = JS_XDRNewMem(cx, JSXDR_DECODE)))
+      return nullptr;
+
+   // a damaged file just means a recompile, so keep decoding errors quiet
+   JSErrorReporter reporter = JS_SetErrorReporter(cx, nullptr);
+
+   JS_XDRMemSetData(xdr, &data[header.pathLength], header.dataLength);
+   if(!JS_XDRScript(xdr, &script))
+   {
+      script = nullptr;
+      ++scriptCacheStats.errors;
+   }
+   JS_XDRMemSetData(xdr, nullptr, 0); // buffer belongs to the vector
+   JS_XDRDestroy(xdr);
+
+   JS_ClearPendingException(cx);
+   JS_SetErrorReporter(cx, reporter);
+
+   return script;
+}
+
+//
+// ScriptCache_Store
+//
+// Write a script to its cache file. The file is written under a temporary
+// name and then moved into place, so that concurrent processes never see a
+// partial file.
+//
+static void ScriptCache_Store(JSContext *cx, JSScript *script, const std::string &cachefile,
+                              const std::string &path, long long mtime, long long size)
+{
+   JSXDRState *xdr;
+   void       *data   = nullptr;
+   uint32      length = 0;
+
+   if(!(xdr = JS_XDRNewMem(cx, JSXDR_ENCODE)))
+      return;
+
+   if(JS_XDRScript(xdr, &script) && (data = JS_XDRMemGetData(xdr, &length)) && length)
+   {
+      scriptcacheheader_t header;
+      char pid[16];
+
+      header.magic           = SCRIPTCACHE_MAGIC;
+      header.bytecodeVersion = JSXDR_BYTECODE_VERSION;
+      header.engineStamp     = ScriptCache_EngineStamp();
+      header.pathLength      = static_cast<uint32>(path.length());
+      header.mtime           = mtime;
+      header.size            = size;
+      header.dataLength      = length;
+      header.reserved        = 0;
+
+#ifndef VIBC_NO_WIN32
+      sprintf(pid, ".%d", _getpid());
+#else
+      sprintf(pid, ".%d", static_cast<int>(getpid()));
+#endif
+      std::string tmpfile = cachefile + pid;
+      FILE *f;
+      bool  ok = false;
+
+      if((f = fopen(tmpfile.c_str(), "wb")))
+      {
+         ok = (fwrite(&header, sizeof(header), 1, f) == 1 &&
+               fwrite(path.c_str(), path.length(), 1, f) == 1 &&
+               fwrite(data, length, 1, f) == 1);
+         ok = (fclose(f) == 0) && ok;
+      }
+
+      if(ok)
+      {
+#ifndef VIBC_NO_WIN32
+         ok = !!MoveFileExA(tmpfile.c_str(), cachefile.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+         ok = !rename(tmpfile.c_str(), cachefile.c_str());
+#endif
+      }
+
+      if(ok)
+         ++scriptCacheStats.stores;
+      else
+      {
+         remove(tmpfile.c_str());
+         ++scriptCacheStats.errors;
+      }
+   }
+   else
+   {
+      JS_ClearPendingException(cx);
+      ++scriptCacheStats.errors;
+   }
+
+   JS_XDRDestroy(xdr);
+}
+
+//
+// JSEngine_CompileFileCached
+//
+// Compile a script file, using the script cache when possible. The returned
+// script is not rooted; create a script object for it before doing anything
+// that may run the garbage collector.
+//
+JSScript *JSEngine_CompileFileCached(JSContext *cx, JSObject *global, const char *filename)
+{
+   unsigned int startTime = Timer_getMS();
+   long long    mtime = 0, size = 0;
+   std::string  path, cachefile;
+   JSScript    *script;
+
+   ScriptCache_Init();
+
+   bool cacheable = scriptCacheEnabled && ScriptCache_Stat(filename, mtime, size);
+
+   if(cacheable)
+   {
+      path      = ScriptCache_FullPath(filename);
+      cachefile = ScriptCache_FileName(path);
+
+      if((script = ScriptCache_Load(cx, cachefile, path, mtime, size)))
+      {
+         ++scriptCacheStats.hits;
+         scriptCacheStats.loadMS += Timer_getMS() - startTime;
+         return script;
+      }
+   }
+
+   char *text;
+   if(!(text = LoadTextFile(filename)))
+      return nullptr;
+
+   uint32 oldopts = JS_GetOptions(cx);
+   JS_SetOptions(cx, cacheable ? (oldopts & ~JSOPTION_COMPILE_N_GO) : (oldopts | JSOPTION_COMPILE_N_GO));
+
+   script = JS_CompileScript(cx, global, text, strlen(text), filename, 1);
+
+   JS_SetOptions(cx, oldopts);
+   delete [] text;
+
+   if(script && cacheable)
+      ScriptCache_Store(cx, script, cachefile, path, mtime, size);
+
+   ++scriptCacheStats.misses;
+   scriptCacheStats.compileMS += Timer_getMS() - startTime;
+
+   return script;
+}
+
+//
+// JSEngine_GetScriptCacheStats
+//
+void JSEngine_GetScriptCacheStats(scriptcachestats_t &stats)
+{
+   stats = scriptCacheStats;
+}
+
 //=============================================================================
 //
 // Evaluation and Script Execution Functions
@@ -1140,16 +2143,7 @@ bool JSEngine_EvaluateUCScript(const char *filename, const jschar *chars,
 //
 bool JSEngine_EvaluateFile(const char *filename, jsval *rval)
 {
-   char *text;
-   
-   if((text = LoadTextFile(filename)))
-   {
-      bool res = JSEngine_EvaluateScript(filename, text, rval);
-      delete [] text;
-      return res;
-   }
-
-   return false;
+   return JSEngine_EvaluateFileInContext(gContext, filename, rval);
 }
 
 //
@@ -1226,16 +2220,29 @@ bool JSEngine_EvaluateAugmentedFile(JSEvalContext *ecx, const char *filename, js
 //
 bool JSEngine_EvaluateFileInContext(JSEvalContext *gctx, const char *filename, jsval *rval)
 {
-   char *text;
+   JSContext *cx     = gctx->getContext();
+   JSObject  *global = gctx->getGlobal();
+   JSScript  *script;
+   JSObject  *scriptObj;
 
-   if((text = LoadTextFile(filename)))
+   if(!(script = JSEngine_CompileFileCached(cx, global, filename)))
+      return false;
+
+   if(!(scriptObj = JS_NewScriptObject(cx, script)))
    {
-      bool res = JSEngine_EvaluateInContext(gctx, filename, text, rval);
-      delete [] text;
-      return res;
+      JS_DestroyScript(cx, script);
+      return false;
    }
 
-   return false;
+   try
+   {
+      AutoNamedRoot root(cx, scriptObj, "JSEngine_EvaluateFileInContext");
+      return (JS_ExecuteScript(cx, global, script, rval) == JS_TRUE);
+   }
+   catch(const JSEngineError &)
+   {
+      return false;
+   }
 }
 
 //=============================================================================
@@ -1244,31 +2251,17 @@ bool JSEngine_EvaluateFileInContext(JSEvalContext *gctx, const char *filename, j
 //
 
 //
-// JSEngine_NewSandbox
-//
-// Create and return a new sandboxed evaluation context; the JSContext
-// within has its own independent global object not subject to any changes
-// that may have been made within the default global context - this makes
-// it especially useful for evaluation of modules. If the sandbox is not to
-// be persistent, wrap the return value using a std::unique_ptr so that the
-// context will be released when your function returns.
-//
-// Absolutely *never* destroy the evaluation context and *then* try to 
-// access or add a reference to any object that was created as a result of 
-// execution within it - you'll instantly crash the program if you do, as 
-// context destruction causes vehement garbage collection to occur.
+// Give a context a fresh sandbox global and copy the injected properties onto
+// it.
 //
-// Make sure anything that you want to persist past the destruction of the
-// sandbox has already been rooted to something related to the global context,
-// be it an object property, return value, etc.
-//
-JSEvalContext *JSEngine_NewSandbox(JSObject *injectProperties, bool parented, bool withExtensions)
-{  
-   std::unique_ptr<JSEvalContext> nc(new JSEvalContext());
-   nc->setGlobal(&sandbox_class, parented ? gContext->getGlobal() : nullptr);
+static bool JSEngine_SetupSandbox(JSEvalContext *nc, JSObject *injectProperties, bool parented, 
+                                  bool withExtensions)
+{
+   if(!nc->setGlobal(&sandbox_class, parented ? gContext->getGlobal() : nullptr))
+      return false;
 
    if(!parented && withExtensions)
-      JSEngine_RunExtensions(nc.get());
+      JSEngine_RunExtensions(nc);
 
    if(injectProperties)
    {
@@ -1277,9 +2270,7 @@ JSEvalContext *JSEngine_NewSandbox(JSObject *injectProperties, bool parented, bo
       AutoJSPropertyIterator itr(cx, injectProperties);
 
       if(!itr.valid())
-      {
-         return nc.release(); // oh well >_>
-      }
+         return true; // oh well >_>
 
       jsid cur_id;
       while(JS_NextProperty(cx, itr.getObject(), &cur_id) && cur_id != JSVAL_VOID)
@@ -1295,6 +2286,33 @@ JSEvalContext *JSEngine_NewSandbox(JSObject *injectProperties, bool parented, bo
       }
    }
 
+   return true;
+}
+
+//
+// JSEngine_NewSandbox
+//
+// Create and return a new sandboxed evaluation context; the JSContext
+// within has its own independent global object not subject to any changes
+// that may have been made within the default global context - this makes
+// it especially useful for evaluation of modules. If the sandbox is not to
+// be persistent, wrap the return value using a std::unique_ptr so that the
+// context will be released when your function returns. For short-lived
+// sandboxes, prefer JSEngine_AcquireSandbox.
+//
+// Absolutely *never* destroy the evaluation context and *then* try to 
+// access or add a reference to any object that was created as a result of 
+// execution within it - you'll instantly crash the program if you do, as 
+// context destruction causes vehement garbage collection to occur.
+//
+// Make sure anything that you want to persist past the destruction of the
+// sandbox has already been rooted to something related to the global context,
+// be it an object property, return value, etc.
+//
+JSEvalContext *JSEngine_NewSandbox(JSObject *injectProperties, bool parented, bool withExtensions)
+{  
+   std::unique_ptr<JSEvalContext> nc(new JSEvalContext());
+   JSEngine_SetupSandbox(nc.get(), injectProperties, parented, withExtensions);
    return nc.release();
 }
 
@@ -1311,5 +2329,269 @@ JSEvalContext *JSEngine_NewRestrictedContext()
    return nc;
 }
 
+//
+// JSEngine_GetGlobalContext
+//
+// Returns the default global evaluation context.
+//
+JSEvalContext *JSEngine_GetGlobalContext()
+{
+   return gContext;
+}
+
+//=============================================================================
+//
+// Context Pool
+//
+// Creating and destroying a JSContext for every loadModule or evalSandbox
+// call is expensive, mostly because destroying the last reference to a
+// context's global forces a full garbage collection. Contexts are instead
+// kept in a per-thread pool and given a fresh global object each time they
+// are handed out, so one sandbox cannot see what another left behind.
+//
+
+#define CONTEXT_POOL_SIZE 8
+
+static JSENGINE_THREADLOCAL std::vector<JSEvalContext *> *contextPool;
+
+static JSEvalContext *ContextPool_Get()
+{
+   if(contextPool && !contextPool->empty())
+   {
+      JSEvalContext *ecx = contextPool->back();
+      contextPool->pop_back();
+      ++contextPoolStats.reused;
+      return ecx;
+   }
+
+   ++contextPoolStats.created;
+   return new JSEvalContext();
+}
+
+static void ContextPool_Clear()
+{
+   if(!contextPool)
+      return;
+
+   for(auto itr = contextPool->begin(); itr != contextPool->end(); ++itr)
+      delete *itr;
+
+   delete contextPool;
+   contextPool = nullptr;
+}
+
+//
+// JSEngine_AcquireSandbox
+//
+// As JSEngine_NewSandbox, but the context comes from the pool and must be
+// handed back with JSEngine_ReleaseContext; use AutoPooledContext. Objects
+// created in the sandbox remain valid after it is released.
+//
+JSEvalContext *JSEngine_AcquireSandbox(JSObject *injectProperties, bool parented, bool withExtensions)
+{
+   AutoPooledContext nc(ContextPool_Get());
+
+   if(!JSEngine_SetupSandbox(nc.get(), injectProperties, parented, withExtensions))
+      throw JSEngineError("Could not create sandbox global");
+
+   return nc.release();
+}
+
+//
+// JSEngine_AcquireRestrictedContext
+//
+// As JSEngine_NewRestrictedContext, but from the pool.
+//
+JSEvalContext *JSEngine_AcquireRestrictedContext()
+{
+   AutoPooledContext nc(ContextPool_Get());
+
+   if(!nc->setGlobal(&restricted_class))
+      throw JSEngineError("Could not create restricted global");
+
+   return nc.release();
+}
+
+//
+// JSEngine_ReleaseContext
+//
+// Return a context to the pool. Nothing it ran is still on its stack, so all
+// that needs resetting is the global object and leftover error state.
+//
+void JSEngine_ReleaseContext(JSEvalContext *ecx)
+{
+   JSContext *cx = ecx->getContext();
+
+   if(cx)
+   {
+      JS_ClearPendingException(cx);
+      JS_ClearRegExpStatics(cx);
+      JS_ClearNewbornRoots(cx);
+   }
+   ecx->clearGlobal();
+
+   if(!contextPool)
+      contextPool = new std::vector<JSEvalContext *>();
+
+   if(cx && contextPool->size() < CONTEXT_POOL_SIZE)
+      contextPool->push_back(ecx);
+   else
+      delete ecx;
+}
+
+//=============================================================================
+//
+// Module Registry
+//
+// Core.loadModule evaluates each file once and hands back the same value on
+// later calls, the way require does elsewhere. Values are rooted through the
+// thread's global context until the registry is cleared.
+//
+
+struct moduleentry_t
+{
+   jsval value;
+   bool  loading; // set while the module is being evaluated
+};
+
+typedef std::map<std::string, moduleentry_t *> modulemap_t;
+
+static JSENGINE_THREADLOCAL modulemap_t *moduleRegistry;
+
+static std::string ModuleRegistry_Key(const char *filename)
+{
+   std::string key = ScriptCache_FullPath(filename);
+#ifndef VIBC_NO_WIN32
+   // file names are not case sensitive
+   for(auto itr = key.begin(); itr != key.end(); ++itr)
+      *itr = static_cast<char>(tolower(static_cast<unsigned char>(*itr)));
+#endif
+   return key;
+}
+
+static void ModuleRegistry_Remove(modulemap_t::iterator itr)
+{
+   JS_RemoveRoot(gContext->getContext(), &itr->second->value);
+   delete itr->second;
+   moduleRegistry->erase(itr);
+}
+
+static void ModuleRegistry_Clear()
+{
+   JSEngine_ClearRequireCache(true);
+
+   if(!moduleRegistry)
+      return;
+
+   while(!moduleRegistry->empty())
+      ModuleRegistry_Remove(moduleRegistry->begin());
+
+   delete moduleRegistry;
+   moduleRegistry = nullptr;
+}
+
+//
+// JSEngine_LoadModule
+//
+// Evaluate a module file in a pooled sandbox, or return the value from an
+// earlier load of the same file unless reload is true. Returns false if
+// evaluation fails. Throws JSEngineError if the module is still being loaded
+// further up the stack.
+//
+bool JSEngine_LoadModule(const char *filename, bool reload, jsval *rval)
+{
+   std::string key = ModuleRegistry_Key(filename);
+
+   if(!moduleRegistry)
+      moduleRegistry = new modulemap_t();
+
+   modulemap_t::iterator itr = moduleRegistry->find(key);
+   moduleentry_t *entry;
+
+   if(itr != moduleRegistry->end())
+   {
+      entry = itr->second;
+      if(entry->loading)
+         throw JSEngineError(std::string("Circular module load: ") + filename);
+
+      if(!reload)
+      {
+         ++contextPoolStats.moduleHits;
+         *rval = entry->value;
+         return true;
+      }
+   }
+   else
+   {
+      entry = new moduleentry_t;
+      entry->value   = JSVAL_VOID;
+      entry->loading = false;
+
+      if(!JS_AddNamedRoot(gContext->getContext(), &entry->value, "JSEngine_LoadModule"))
+      {
+         delete entry;
+         throw JSEngineError("Out of memory", true);
+      }
+      itr = moduleRegistry->insert(modulemap_t::value_type(key, entry)).first;
+   }
+
+   ++contextPoolStats.moduleLoads;
+   entry->loading = true;
+
+   bool ok;
+   try
+   {
+      AutoPooledContext ecx(JSEngine_AcquireSandbox());
+      ok = JSEngine_EvaluateFileInContext(ecx.get(), filename, &entry->value);
+   }
+   catch(const JSEngineError &)
+   {
+      ModuleRegistry_Remove(itr);
+      throw;
+   }
+
+   if(!ok)
+   {
+      ModuleRegistry_Remove(itr);
+      return false;
+   }
+
+   entry->loading = false;
+   *rval = entry->value;
+   return true;
+}
+
+//
+// JSEngine_ClearModuleCache
+//
+// Forget all loaded modules so the next loadModule or require of each
+// re-evaluates it. Modules in the middle of loading are left alone.
+//
+void JSEngine_ClearModuleCache()
+{
+   JSEngine_ClearRequireCache(false);
+
+   if(!moduleRegistry)
+      return;
+
+   modulemap_t::iterator itr = moduleRegistry->begin();
+   while(itr != moduleRegistry->end())
+   {
+      modulemap_t::iterator cur = itr++;
+      if(!cur->second->loading)
+         ModuleRegistry_Remove(cur);
+   }
+}
+
+//
+// JSEngine_GetContextPoolStats
+//
+void JSEngine_GetContextPoolStats(contextpoolstats_t &stats)
+{
+   stats = contextPoolStats;
+   stats.pooled  = contextPool    ? static_cast<unsigned int>(contextPool->size())    : 0;
+   stats.modules = moduleRegistry ? static_cast<unsigned int>(moduleRegistry->size()) : 0;
+}
+
 // EOF
 
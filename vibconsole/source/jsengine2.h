@@ -8,15 +8,25 @@
 #include <exception>
 #include <map>
 #include <string>
+#include <vector>
 #include "myjsconfig.h"
 #include "jsapi.h"
 
+// Each thread running JS has its own runtime and global context, and any
+// per-context caches must be thread-local as well.
+#ifndef VIBC_NO_WIN32
+#define JSENGINE_THREADLOCAL __declspec(thread)
+#else
+#define JSENGINE_THREADLOCAL __thread
+#endif
+
 const char *SafeGetStringBytes(JSContext *cx, jsval value, jsval *root);
 bool SafeInstanceOf(JSContext *cx, JSClass *jsClass, jsval val);
 void AssertInstanceOf(JSContext *cx, JSClass *jsClass, jsval val);
 bool JSObjectToStringMap(JSContext *cx, JSObject *obj, std::map<std::string, std::string> &strMap);
 void AssertJSObjectToStringMap(JSContext *cx, JSObject *obj, std::map<std::string, std::string> &strMap);
 bool JSObjectToStrIntMap(JSContext *cx, JSObject *obj, std::map<std::string, int> &strIntMap);
+bool JSArrayToStringVec(JSContext *cx, JSObject *obj, std::vector<std::string> &strVec);
 int  JSEngine_ValueToInteger(jsval *val);
 
 //
@@ -107,12 +117,83 @@ public:
    }
 };
 
+// Sampling profiler (jsprofiler.cpp)
+struct profilenative_t
+{
+   unsigned int calls;
+   unsigned int ms;     // time inside the native, excluding scripts it ran
+   unsigned int waitMS; // part of ms spent with the engine lock released
+
+   profilenative_t() : calls(0), ms(0), waitMS(0) {}
+};
+
+struct profileresults_t
+{
+   unsigned int totalMS;  // time the profiler ran
+   unsigned int jsMS;     // time charged to script stacks
+   unsigned int nativeMS; // time charged to natives, excluding waits
+   unsigned int waitMS;   // time charged to natives waiting on I/O
+   unsigned int samples;  // script samples taken
+   std::map<std::string, profilenative_t> natives;
+
+   profileresults_t() : totalMS(0), jsMS(0), nativeMS(0), waitMS(0), samples(0) {}
+};
+
+extern JSENGINE_THREADLOCAL bool jsengineProfiling;
+
+bool   JSEngine_StartProfiler(unsigned int intervalMS);
+bool   JSEngine_StopProfiler(const char *filename, profileresults_t &results);
+void   JSEngine_ProfilerSample(JSContext *cx);
+void   JSEngine_ProfilerWait(bool begin);
+JSBool JSEngine_ProfileNative(JSContext *cx, uintN argc, jsval *vp, JSFastNative fn);
+void   JSEngine_UpdateOperationLimits();
+std::string JSEngine_NativeName(JSContext *cx, jsval *vp);
+
+// Native call statistics (jsnativestats.cpp)
+#define NATIVESTATS_BUCKETS 28
+
+struct nativestats_t
+{
+   unsigned int       calls;
+   unsigned long long totalUS; // wall time, including scripts the native ran
+   unsigned int       maxUS;
+
+   // buckets[0] counts calls under 1 us; buckets[i] those of 2^(i-1) up to
+   // 2^i us; the last bucket has everything longer
+   unsigned int buckets[NATIVESTATS_BUCKETS];
+
+   nativestats_t() : calls(0), totalUS(0), maxUS(0)
+   {
+      for(int i = 0; i < NATIVESTATS_BUCKETS; i++)
+         buckets[i] = 0;
+   }
+   void add(const nativestats_t &other);
+   unsigned int percentileUS(double fraction) const;
+};
+
+typedef std::map<std::string, nativestats_t> nativestatsmap_t;
+
+extern JSENGINE_THREADLOCAL bool jsengineNativeStats;
+
+void   JSEngine_EnableNativeStats(bool enable);
+bool   JSEngine_NativeStatsEnabled();
+void   JSEngine_GetNativeStats(nativestatsmap_t &stats, bool allThreads);
+void   JSEngine_ResetNativeStats();
+void   JSEngine_RetireNativeStats();
+void   JSEngine_FormatNativeStats(const nativestatsmap_t &stats, std::string &out);
+JSBool JSEngine_CountNative(JSContext *cx, uintN argc, jsval *vp, JSFastNative fn);
+
 //
 // Exception wrapper generation template
 //
 template<JSFastNative fn>
 JSBool JSEngineWrapperFn(JSContext *cx, uintN argc, jsval *vp)
 {
+   if(jsengineNativeStats)
+      return JSEngine_CountNative(cx, argc, vp, fn);
+   if(jsengineProfiling)
+      return JSEngine_ProfileNative(cx, argc, vp, fn);
+
    try
    {
       return fn(cx, argc, vp);
@@ -331,6 +412,39 @@ public:
    }
 };
 
+//
+// AutoLocalRootScope
+//
+// Everything allocated while the scope is active stays rooted until it is
+// left. leaveWithResult hands one value on to the enclosing scope.
+//
+class AutoLocalRootScope
+{
+protected:
+   JSContext *cx;
+   bool       active;
+
+public:
+   AutoLocalRootScope(JSContext *pcx) : cx(pcx), active(false)
+   {
+      if(!JS_EnterLocalRootScope(cx))
+         throw JSEngineError("Out of memory", true);
+      active = true;
+   }
+
+   ~AutoLocalRootScope()
+   {
+      if(active)
+         JS_LeaveLocalRootScope(cx);
+   }
+
+   void leaveWithResult(jsval v)
+   {
+      JS_LeaveLocalRootScopeWithResult(cx, v);
+      active = false;
+   }
+};
+
 //
 // AutoNamedRoot
 //
@@ -433,6 +547,7 @@ public:
    ~JSEvalContext();
 
    bool setGlobal(JSClass *globalClass, JSObject *parent = nullptr);
+   void clearGlobal();
 
    JSContext *getContext() const;
    JSObject  *getGlobal()  const;
@@ -621,6 +736,63 @@ public:
 // External Interface
 //
 
+// Script cache and startup statistics
+struct scriptcachestats_t
+{
+   unsigned int hits;      // scripts decoded from the cache
+   unsigned int misses;    // scripts compiled from source
+   unsigned int stores;    // cache files written
+   unsigned int errors;    // cache files that could not be read or written
+   unsigned int loadMS;    // time spent loading cached scripts
+   unsigned int compileMS; // time spent compiling and caching scripts
+   unsigned int startupMS; // time taken by JSEngine_Init
+   unsigned int runtimeMS;    // part of it creating the runtime and global
+   unsigned int extensionsMS; // part of it running extensions.js
+   unsigned int autoexecMS;   // part of it running autoexec.js
+
+   scriptcachestats_t() 
+      : hits(0), misses(0), stores(0), errors(0), loadMS(0), compileMS(0), startupMS(0),
+        runtimeMS(0), extensionsMS(0), autoexecMS(0)
+   {
+   }
+};
+
+// Sandbox context pool and module registry statistics
+struct contextpoolstats_t
+{
+   unsigned int created;     // contexts created for the pool
+   unsigned int reused;      // acquisitions served from the pool
+   unsigned int pooled;      // contexts currently idle in the pool
+   unsigned int moduleHits;  // loadModule calls served from the registry
+   unsigned int moduleLoads; // modules evaluated
+   unsigned int modules;     // modules currently registered
+
+   contextpoolstats_t()
+      : created(0), reused(0), pooled(0), moduleHits(0), moduleLoads(0), modules(0)
+   {
+   }
+};
+
+// Garbage collection statistics for one runtime
+struct gcstats_t
+{
+   unsigned int  collections;  // collections run
+   unsigned int  lastPauseMS;  // duration of the most recent collection
+   unsigned int  maxPauseMS;   // longest collection
+   unsigned int  totalPauseMS; // time spent collecting
+   unsigned int  longPauses;   // collections over the [gc] longpause threshold
+   JSGCHeapStats heap;         // heap size and arena counts
+
+   gcstats_t()
+      : collections(0), lastPauseMS(0), maxPauseMS(0), totalPauseMS(0), longPauses(0), heap()
+   {
+   }
+};
+
+bool JSEngine_SetGCParameter(const char *name, uint32 value);
+bool JSEngine_GetGCParameter(const char *name, uint32 &value);
+void JSEngine_GetGCStats(gcstats_t &stats);
+
 bool JSEngine_Init();
 void JSEngine_Shutdown();
 void JSEngine_AddInputLine(const std::string &inputLine);
@@ -634,8 +806,112 @@ bool JSEngine_EvaluateUCJSString(JSString *jstr, jsval *rval);
 bool JSEngine_EvaluateAugmentedFile(JSEvalContext *ecx, const char *filename, jsval *rval);
 
 bool JSEngine_EvaluateFileInContext(JSEvalContext *gctx, const char *filename, jsval *rval);
+JSScript *JSEngine_CompileFileCached(JSContext *cx, JSObject *global, const char *filename);
+void JSEngine_GetScriptCacheStats(scriptcachestats_t &stats);
+void JSEngine_AddLazyExtension(const char *name, const char *filename);
+void JSEngine_GetLazyExtensionStats(std::map<std::string, unsigned int> &loadMS);
 JSEvalContext *JSEngine_NewSandbox(JSObject *injectProperties = nullptr, bool parented = true, bool withExtensions = false);
 JSEvalContext *JSEngine_NewRestrictedContext();
+JSEvalContext *JSEngine_GetGlobalContext();
+
+JSEvalContext *JSEngine_AcquireSandbox(JSObject *injectProperties = nullptr, bool parented = true, bool withExtensions = false);
+JSEvalContext *JSEngine_AcquireRestrictedContext();
+void           JSEngine_ReleaseContext(JSEvalContext *ecx);
+bool           JSEngine_LoadModule(const char *filename, bool reload, jsval *rval);
+void           JSEngine_ClearModuleCache();
+void           JSEngine_ClearRequireCache(bool shutdown);
+void           JSEngine_GetContextPoolStats(contextpoolstats_t &stats);
+
+//
+// AutoPooledContext
+//
+// Returns a context obtained from JSEngine_AcquireSandbox or
+// JSEngine_AcquireRestrictedContext to the pool when destroyed. Unlike a
+// destroyed sandbox, objects created in it remain valid afterward.
+//
+class AutoPooledContext
+{
+private:
+   JSEvalContext *ecx;
+   AutoPooledContext(const AutoPooledContext &other); // Not copyable.
+
+public:
+   AutoPooledContext(JSEvalContext *pecx) : ecx(pecx)
+   {
+   }
+
+   ~AutoPooledContext()
+   {
+      if(ecx)
+      {
+         JSEngine_ReleaseContext(ecx);
+         ecx = nullptr;
+      }
+   }
+
+   JSEvalContext *get() const { return ecx; }
+   JSEvalContext *operator -> () const { return ecx; }
+
+   // Keep the context; the caller becomes responsible for releasing it.
+   JSEvalContext *release()
+   {
+      JSEvalContext *ret = ecx;
+      ecx = nullptr;
+      return ret;
+   }
+};
+
+// Event loop (jsevents.cpp)
+#define JSENGINE_NO_EVENTS 0xFFFFFFFFu
+
+void         JSEngine_RunMicrotasks();
+void         JSEngine_RunEvents();
+unsigned int JSEngine_NextEventTimeout();
+
+//
+// Engine lock
+//
+// SpiderMonkey is not built JS_THREADSAFE, so every thread that runs JS has
+// its own runtime, and all JSAPI use is serialized by one process-wide lock.
+// The main thread takes it in JSEngine_Init; natives that block on I/O drop
+// it with a JSEngineUnlocked for the duration, and must not touch the JSAPI
+// while it is released. VisualIB calls must keep it, as the lock is also all
+// that keeps two threads from entering VisualIB.dll at once.
+//
+void JSEngine_Lock();
+void JSEngine_Unlock();
+void JSEngine_Yield();
+
+class JSEngineUnlocked
+{
+private:
+   JSEngineUnlocked(const JSEngineUnlocked &other); // Not copyable.
+
+public:
+   JSEngineUnlocked()
+   {
+      if(jsengineProfiling)
+         JSEngine_ProfilerWait(true);
+      JSEngine_Unlock();
+   }
+
+   ~JSEngineUnlocked()
+   {
+      JSEngine_Lock();
+      if(jsengineProfiling)
+         JSEngine_ProfilerWait(false);
+   }
+};
+
+// Worker threads (jsworker.cpp)
+bool  JSEngine_InitWorkerThread();
+void  JSEngine_ShutdownWorkerThread();
+bool  JSEngine_NewWorkerContext();
+void  JSEngine_DestroyWorkerContext();
+bool  JSEngine_IsWorkerThread();
+void  JSEngine_SetTerminateFlag(volatile long *flag);
+void  JSEngine_RunWorkerEvents();
+void *JSEngine_GetWorkerWakeHandle();
 
 #endif
 
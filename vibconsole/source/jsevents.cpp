@@ -0,0 +1,411 @@
+/*
+
+  Event Loop
+
+  setTimeout, setInterval, setImmediate and queueMicrotask, plus the queues
+  behind them. The main loop calls JSEngine_RunEvents to dispatch whatever is
+  due, and JSEngine_NextEventTimeout tells it how long it may sleep.
+
+  Callbacks always run in the global context, so that timers set by a module
+  outlive the sandbox that loaded it.
+
+*/
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include "jsengine2.h"
+#include "jsnatives.h"
+#include "main.h"
+#include "timer.h"
+
+//
+// A scheduled callback. The holder array keeps the function and its
+// arguments alive, and is rooted for as long as the task is pending.
+//
+struct eventtask_t
+{
+   unsigned int id;
+   unsigned int deadline;
+   unsigned int interval; // nonzero for setInterval
+   JSContext   *cx;       // global context, in which the root was added
+   JSObject    *holder;   // [callback, args...]
+
+   eventtask_t(unsigned int pid) : id(pid), deadline(0), interval(0), cx(nullptr), holder(nullptr)
+   {
+   }
+
+   ~eventtask_t()
+   {
+      if(cx && holder)
+         JS_RemoveRoot(cx, &holder);
+   }
+};
+
+// Entry in the timer heap; stale entries are skipped when popped
+struct eventheapitem_t
+{
+   unsigned int deadline;
+   unsigned int id;
+};
+
+// Heap order; deadlines are compared as differences so that the millisecond
+// counter may wrap.
+static bool EventHeapLater(const eventheapitem_t &a, const eventheapitem_t &b)
+{
+   return static_cast<int>(a.deadline - b.deadline) > 0;
+}
+
+static unsigned int                          eventNextId = 1;
+static std::map<unsigned int, eventtask_t *> eventTasks;      // pending timers and immediates
+static std::vector<eventheapitem_t>          eventTimerHeap;  // timers by deadline
+static std::deque<unsigned int>              eventImmediates; // immediates in order
+static std::deque<eventtask_t *>             eventMicrotasks; // microtasks in order
+
+//
+// Create a task for a callback and its arguments. Arguments start at
+// argv[first].
+//
+static eventtask_t *EventTask_New(JSContext *cx, uintN argc, jsval *argv, uintN first)
+{
+   std::vector<jsval> items;
+
+   if(argc < 1 || JS_TypeOfValue(cx, argv[0]) != JSTYPE_FUNCTION)
+      throw JSEngineError("Callback must be a function");
+
+   items.push_back(argv[0]);
+   for(uintN i = first; i < argc; i++)
+      items.push_back(argv[i]);
+
+   JSObject *holder = AssertJSNewArrayObject(cx, static_cast<jsint>(items.size()), &items[0]);
+
+   // root in the global context, which outlives any sandbox the task was
+   // created from
+   JSContext *gcx = JSEngine_GetGlobalContext()->getContext();
+   std::unique_ptr<eventtask_t> task(new eventtask_t(0));
+   task->holder = holder;
+   if(!JS_AddNamedRoot(gcx, &task->holder, "EventTask"))
+   {
+      task->holder = nullptr;
+      throw JSEngineError("Failed to create named GC root");
+   }
+   task->cx = gcx;
+
+   return task.release();
+}
+
+//
+// Run a task's callback in the global context. Uncaught exceptions are
+// reported and otherwise ignored.
+//
+static void EventTask_Run(eventtask_t *task)
+{
+   JSEvalContext *ecx    = JSEngine_GetGlobalContext();
+   JSContext     *cx     = ecx->getContext();
+   JSObject      *global = ecx->getGlobal();
+   JSObject      *holder = task->holder;
+   jsuint         length = 0;
+
+   // the holder may be unrooted if the callback clears its own timer, so
+   // root it for the duration of the call
+   AutoNamedRoot root(cx, holder, "EventTask_Run");
+
+   if(!JS_GetArrayLength(cx, holder, &length) || length < 1)
+      return;
+
+   std::vector<jsval> items(length);
+   for(jsuint i = 0; i < length; i++)
+   {
+      if(!JS_GetElement(cx, holder, static_cast<jsint>(i), &items[i]))
+         return;
+   }
+
+   jsval rval = JSVAL_VOID;
+   if(!JS_CallFunctionValue(cx, global, items[0], length - 1, length > 1 ? &items[1] : nullptr, &rval))
+      JS_ReportPendingException(cx);
+}
+
+static void EventTask_Delete(unsigned int id)
+{
+   auto itr = eventTasks.find(id);
+   if(itr != eventTasks.end())
+   {
+      delete itr->second;
+      eventTasks.erase(itr);
+   }
+}
+
+static void EventTimer_Schedule(eventtask_t *task, unsigned int delay)
+{
+   eventheapitem_t item;
+
+   task->deadline = Timer_getMS() + delay;
+   item.deadline  = task->deadline;
+   item.id        = task->id;
+
+   eventTimerHeap.push_back(item);
+   std::push_heap(eventTimerHeap.begin(), eventTimerHeap.end(), EventHeapLater);
+}
+
+//=============================================================================
+//
+// Dispatch
+//
+
+//
+// JSEngine_RunMicrotasks
+//
+// Run queued microtasks until the queue is empty, including any queued while
+// running.
+//
+void JSEngine_RunMicrotasks()
+{
+   while(!eventMicrotasks.empty())
+   {
+      std::unique_ptr<eventtask_t> task(eventMicrotasks.front());
+      eventMicrotasks.pop_front();
+      EventTask_Run(task.get());
+   }
+}
+
+//
+// JSEngine_RunEvents
+//
+// Pass on worker messages, run immediates queued before this call, then
+// every timer that is due.
+// Microtasks are drained after each callback.
+//
+void JSEngine_RunEvents()
+{
+   JSEngine_RunMicrotasks();
+
+   // messages and errors from workers (jsworker.cpp)
+   JSEngine_RunWorkerEvents();
+
+   // immediates queued by these callbacks wait for the next pass
+   size_t numImmediates = eventImmediates.size();
+   while(numImmediates-- && MainLoopRunning)
+   {
+      unsigned int id = eventImmediates.front();
+      eventImmediates.pop_front();
+
+      auto itr = eventTasks.find(id);
+      if(itr == eventTasks.end())
+         continue; // cleared
+
+      EventTask_Run(itr->second);
+      EventTask_Delete(id);
+      JSEngine_RunMicrotasks();
+   }
+
+   unsigned int now = Timer_getMS();
+
+   while(!eventTimerHeap.empty() && MainLoopRunning)
+   {
+      eventheapitem_t item = eventTimerHeap.front();
+      if(static_cast<int>(item.deadline - now) > 0)
+         break;
+
+      std::pop_heap(eventTimerHeap.begin(), eventTimerHeap.end(), EventHeapLater);
+      eventTimerHeap.pop_back();
+
+      auto itr = eventTasks.find(item.id);
+      if(itr == eventTasks.end() || itr->second->deadline != item.deadline)
+         continue; // cleared or rescheduled
+
+      EventTask_Run(itr->second);
+
+      // look the task up again, as the callback may have cleared it
+      if((itr = eventTasks.find(item.id)) != eventTasks.end())
+      {
+         if(itr->second->interval)
+            EventTimer_Schedule(itr->second, itr->second->interval);
+         else
+            EventTask_Delete(item.id);
+      }
+
+      JSEngine_RunMicrotasks();
+   }
+}
+
+//
+// JSEngine_NextEventTimeout
+//
+// Milliseconds until JSEngine_RunEvents has work to do, or
+// JSENGINE_NO_EVENTS if nothing is scheduled.
+//
+unsigned int JSEngine_NextEventTimeout()
+{
+   if(!eventMicrotasks.empty() || !eventImmediates.empty())
+      return 0;
+
+   // discard stale heap entries so they don't cause early wakeups
+   while(!eventTimerHeap.empty())
+   {
+      const eventheapitem_t &item = eventTimerHeap.front();
+      auto itr = eventTasks.find(item.id);
+
+      if(itr != eventTasks.end() && itr->second->deadline == item.deadline)
+      {
+         int remaining = static_cast<int>(item.deadline - Timer_getMS());
+         return remaining > 0 ? static_cast<unsigned int>(remaining) : 0;
+      }
+
+      std::pop_heap(eventTimerHeap.begin(), eventTimerHeap.end(), EventHeapLater);
+      eventTimerHeap.pop_back();
+   }
+
+   return JSENGINE_NO_EVENTS;
+}
+
+//
+// Release all pending tasks before the runtime is destroyed.
+//
+static void EventLoop_Shutdown()
+{
+   for(auto itr = eventTasks.begin(); itr != eventTasks.end(); ++itr)
+      delete itr->second;
+   eventTasks.clear();
+   eventTimerHeap.clear();
+   eventImmediates.clear();
+
+   while(!eventMicrotasks.empty())
+   {
+      delete eventMicrotasks.front();
+      eventMicrotasks.pop_front();
+   }
+}
+
+static ShutdownAction eventLoopShutdownAction(EventLoop_Shutdown);
+
+//=============================================================================
+//
+// Natives
+//
+
+static unsigned int EventLoop_AddTimer(JSContext *cx, uintN argc, jsval *argv, bool repeat)
+{
+   int32 delay = 0;
+
+   if(argc >= 2 && !JS_ValueToECMAInt32(cx, argv[1], &delay))
+      throw JSEngineError("Invalid delay");
+   if(delay < 1)
+      delay = 1;
+
+   eventtask_t *task = EventTask_New(cx, argc, argv, 2);
+   task->id = eventNextId++;
+   if(repeat)
+      task->interval = static_cast<unsigned int>(delay);
+
+   eventTasks[task->id] = task;
+   EventTimer_Schedule(task, static_cast<unsigned int>(delay));
+
+   return task->id;
+}
+
+static void EventLoop_SetId(JSContext *cx, jsval *vp, unsigned int id)
+{
+   jsval v;
+   if(!JS_NewNumberValue(cx, id, &v))
+      throw JSEngineError("Out of memory", true);
+   JS_SET_RVAL(cx, vp, v);
+}
+
+//
+// setTimeout(callback, delay[, args...])
+//
+static JSBool EventLoop_SetTimeout(JSContext *cx, uintN argc, jsval *vp)
+{
+   EventLoop_SetId(cx, vp, EventLoop_AddTimer(cx, argc, JS_ARGV(cx, vp), false));
+   return JS_TRUE;
+}
+
+//
+// setInterval(callback, delay[, args...])
+//
+static JSBool EventLoop_SetInterval(JSContext *cx, uintN argc, jsval *vp)
+{
+   EventLoop_SetId(cx, vp, EventLoop_AddTimer(cx, argc, JS_ARGV(cx, vp), true));
+   return JS_TRUE;
+}
+
+//
+// setImmediate(callback[, args...])
+//
+static JSBool EventLoop_SetImmediate(JSContext *cx, uintN argc, jsval *vp)
+{
+   eventtask_t *task = EventTask_New(cx, argc, JS_ARGV(cx, vp), 1);
+   task->id = eventNextId++;
+
+   eventTasks[task->id] = task;
+   eventImmediates.push_back(task->id);
+
+   EventLoop_SetId(cx, vp, task->id);
+   return JS_TRUE;
+}
+
+//
+// clearTimeout(id), clearInterval(id), clearImmediate(id)
+//
+static JSBool EventLoop_Clear(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   uint32 id   = 0;
+
+   if(argc >= 1 && JSVAL_IS_NUMBER(argv[0]) && JS_ValueToECMAUint32(cx, argv[0], &id))
+      EventTask_Delete(id);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// queueMicrotask(callback)
+//
+static JSBool EventLoop_QueueMicrotask(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   // microtasks take no arguments
+   eventMicrotasks.push_back(EventTask_New(cx, argc, argv, argc));
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+static JSFunctionSpec eventLoopJSMethods[] =
+{
+   JSE_FN("setTimeout",     EventLoop_SetTimeout,     2, 0, 0),
+   JSE_FN("setInterval",    EventLoop_SetInterval,    2, 0, 0),
+   JSE_FN("setImmediate",   EventLoop_SetImmediate,   1, 0, 0),
+   JSE_FN("clearTimeout",   EventLoop_Clear,          1, 0, 0),
+   JSE_FN("clearInterval",  EventLoop_Clear,          1, 0, 0),
+   JSE_FN("clearImmediate", EventLoop_Clear,          1, 0, 0),
+   JSE_FN("queueMicrotask", EventLoop_QueueMicrotask, 1, 0, 0),
+   JS_FS_END
+};
+
+//
+// All of the event loop functions are defined together when any one of them
+// is first resolved. Worker threads have no event loop, so they don't get
+// them.
+//
+static NativeInitCode EventLoop_Create(JSContext *cx, JSObject *global)
+{
+   if(JSEngine_IsWorkerThread())
+      return NOSUCHPROPERTY;
+
+   return JS_DefineFunctions(cx, global, eventLoopJSMethods) ? RESOLVED : RESOLUTIONERROR;
+}
+
+static Native setTimeoutGlobalNative    ("setTimeout",     EventLoop_Create);
+static Native setIntervalGlobalNative   ("setInterval",    EventLoop_Create);
+static Native setImmediateGlobalNative  ("setImmediate",   EventLoop_Create);
+static Native clearTimeoutGlobalNative  ("clearTimeout",   EventLoop_Create);
+static Native clearIntervalGlobalNative ("clearInterval",  EventLoop_Create);
+static Native clearImmediateGlobalNative("clearImmediate", EventLoop_Create);
+static Native queueMicrotaskGlobalNative("queueMicrotask", EventLoop_Create);
+
+// EOF
+
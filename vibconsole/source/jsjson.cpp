@@ -0,0 +1,985 @@
+/*
+
+  Native JSON object
+
+  JSON.parse tokenizes its input in a single pass over the string's characters
+  and builds the result directly through JSAPI, rather than compiling and
+  running the text inside a restricted context. JSON.stringify writes into one
+  growable buffer and creates a single string at the end.
+
+*/
+
+#include <string.h>
+#include <vector>
+#include "jsengine2.h"
+#include "jsnatives.h"
+#include "jsdtoa.h"
+
+// Deeper nesting than this is refused rather than risking the C stack.
+static const int JSON_MAX_DEPTH = 512;
+
+//=============================================================================
+//
+// JSONParser
+//
+
+class JSONParser
+{
+protected:
+   JSContext          *cx;
+   const jschar       *start;
+   const jschar       *cur;
+   const jschar       *end;
+   int                 depth;
+   std::vector<jschar> strbuf; // decoded text of strings with escapes
+   std::vector<char>   numbuf; // ASCII copy of a number for JS_strtod
+
+   void error(const char *msg);
+   void skipWhitespace();
+   void expect(jschar c, const char *msg);
+   void expectLiteral(const char *lit);
+
+   void parseValue(jsval *vp);
+   void parseObject(jsval *vp);
+   void parseArray(jsval *vp);
+   void parseNumber(jsval *vp);
+   void parseStringChars(const jschar *&chars, size_t &length);
+
+public:
+   JSONParser(JSContext *pcx, const jschar *chars, size_t length)
+      : cx(pcx), start(chars), cur(chars), end(chars + length), depth(0),
+        strbuf(), numbuf()
+   {
+   }
+
+   void parse(jsval *vp);
+};
+
+void JSONParser::error(const char *msg)
+{
+   throw JSEngineError(std::string("JSON.parse: ") + msg + " at offset " +
+                       std::to_string(static_cast<long long>(cur - start)));
+}
+
+void JSONParser::skipWhitespace()
+{
+   while(cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\n' || *cur == '\r'))
+      ++cur;
+}
+
+void JSONParser::expect(jschar c, const char *msg)
+{
+   skipWhitespace();
+   if(cur >= end || *cur != c)
+      error(msg);
+   ++cur;
+}
+
+void JSONParser::expectLiteral(const char *lit)
+{
+   for(const char *p = lit; *p; ++p, ++cur)
+   {
+      if(cur >= end || *cur != static_cast<jschar>(*p))
+         error("unexpected character");
+   }
+}
+
+//
+// Scan a string whose opening quote has been consumed. Strings without
+// escapes are returned in place; others are decoded into strbuf.
+//
+void JSONParser::parseStringChars(const jschar *&chars, size_t &length)
+{
+   const jschar *s = cur;
+
+   // fast path: no escapes
+   while(cur < end && *cur != '"' && *cur != '\\' && *cur >= 0x20)
+      ++cur;
+
+   if(cur < end && *cur == '"')
+   {
+      chars  = s;
+      length = cur - s;
+      ++cur;
+      return;
+   }
+
+   strbuf.assign(s, cur);
+
+   while(cur < end)
+   {
+      jschar c = *cur++;
+
+      if(c == '"')
+      {
+         chars  = strbuf.empty() ? s : &strbuf[0];
+         length = strbuf.size();
+         return;
+      }
+      if(c < 0x20)
+      {
+         --cur;
+         error("control character in string");
+      }
+      if(c != '\\')
+      {
+         strbuf.push_back(c);
+         continue;
+      }
+      if(cur >= end)
+         break;
+
+      switch(c = *cur++)
+      {
+      case '"':
+      case '\\':
+      case '/':
+         strbuf.push_back(c);
+         break;
+      case 'b': strbuf.push_back('\b'); break;
+      case 'f': strbuf.push_back('\f'); break;
+      case 'n': strbuf.push_back('\n'); break;
+      case 'r': strbuf.push_back('\r'); break;
+      case 't': strbuf.push_back('\t'); break;
+      case 'u':
+         {
+            jschar u = 0;
+
+            if(end - cur < 4)
+               error("bad unicode escape");
+            for(int i = 0; i < 4; i++)
+            {
+               jschar h = *cur++;
+               u <<= 4;
+               if(h >= '0' && h <= '9')
+                  u |= h - '0';
+               else if(h >= 'a' && h <= 'f')
+                  u |= h - 'a' + 10;
+               else if(h >= 'A' && h <= 'F')
+                  u |= h - 'A' + 10;
+               else
+                  error("bad unicode escape");
+            }
+            strbuf.push_back(u);
+         }
+         break;
+      default:
+         --cur;
+         error("bad escape");
+      }
+   }
+
+   error("unterminated string");
+}
+
+void JSONParser::parseNumber(jsval *vp)
+{
+   const jschar *s = cur;
+   bool isInt = true;
+
+   if(cur < end && *cur == '-')
+      ++cur;
+
+   if(cur < end && *cur == '0')
+      ++cur;
+   else if(cur < end && *cur >= '1' && *cur <= '9')
+   {
+      while(cur < end && *cur >= '0' && *cur <= '9')
+         ++cur;
+   }
+   else
+      error("bad number");
+
+   if(cur < end && *cur == '.')
+   {
+      isInt = false;
+      ++cur;
+      if(cur >= end || *cur < '0' || *cur > '9')
+         error("bad number");
+      while(cur < end && *cur >= '0' && *cur <= '9')
+         ++cur;
+   }
+
+   if(cur < end && (*cur == 'e' || *cur == 'E'))
+   {
+      isInt = false;
+      ++cur;
+      if(cur < end && (*cur == '+' || *cur == '-'))
+         ++cur;
+      if(cur >= end || *cur < '0' || *cur > '9')
+         error("bad number");
+      while(cur < end && *cur >= '0' && *cur <= '9')
+         ++cur;
+   }
+
+   // small integers become int jsvals without touching the GC; -0 must stay
+   // a double
+   size_t len = cur - s;
+   if(isInt && len <= 9 && !(len == 2 && s[0] == '-' && s[1] == '0'))
+   {
+      const jschar *p = s;
+      bool negative = (*p == '-');
+      jsint i = 0;
+
+      if(negative)
+         ++p;
+      for(; p < cur; ++p)
+         i = i * 10 + (*p - '0');
+      if(negative)
+         i = -i;
+
+      if(INT_FITS_IN_JSVAL(i))
+      {
+         *vp = INT_TO_JSVAL(i);
+         return;
+      }
+   }
+
+   numbuf.assign(s, cur);
+   numbuf.push_back('\0');
+
+   int    err = 0;
+   double d   = JS_strtod(&numbuf[0], nullptr, &err);
+
+   if(err == JS_DTOA_ENOMEM || !JS_NewNumberValue(cx, d, vp))
+      throw JSEngineError("Out of memory", true);
+}
+
+void JSONParser::parseArray(jsval *vp)
+{
+   AutoLocalRootScope scope(cx);
+   std::vector<jsval> elements;
+
+   skipWhitespace();
+   if(cur < end && *cur == ']')
+      ++cur;
+   else
+   {
+      for(;;)
+      {
+         jsval v = JSVAL_NULL;
+         parseValue(&v); // rooted by this scope
+         elements.push_back(v);
+
+         skipWhitespace();
+         if(cur < end && *cur == ',')
+         {
+            ++cur;
+            continue;
+         }
+         expect(']', "expected ',' or ']'");
+         break;
+      }
+   }
+
+   JSObject *arr = JS_NewArrayObject(cx, static_cast<jsint>(elements.size()),
+                                     elements.empty() ? nullptr : &elements[0]);
+   if(!arr)
+      throw JSEngineError("Out of memory", true);
+
+   *vp = OBJECT_TO_JSVAL(arr);
+   scope.leaveWithResult(*vp);
+}
+
+void JSONParser::parseObject(jsval *vp)
+{
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr); // rooted by caller's scope
+   *vp = OBJECT_TO_JSVAL(obj);
+
+   skipWhitespace();
+   if(cur < end && *cur == '}')
+   {
+      ++cur;
+      return;
+   }
+
+   std::vector<jschar> key;
+
+   for(;;)
+   {
+      const jschar *chars;
+      size_t        length;
+
+      expect('"', "expected property name");
+      parseStringChars(chars, length);
+      key.assign(chars, chars + length); // strbuf is reused by the value
+      expect(':', "expected ':'");
+
+      {
+         AutoLocalRootScope scope(cx);
+         jsval v = JSVAL_NULL;
+
+         parseValue(&v);
+         if(!JS_DefineUCProperty(cx, obj, key.empty() ? nullptr : &key[0], key.size(),
+                                 v, nullptr, nullptr, JSPROP_ENUMERATE))
+            throw JSEngineError("Out of memory", true);
+      }
+
+      skipWhitespace();
+      if(cur < end && *cur == ',')
+      {
+         ++cur;
+         continue;
+      }
+      expect('}', "expected ',' or '}'");
+      break;
+   }
+}
+
+void JSONParser::parseValue(jsval *vp)
+{
+   skipWhitespace();
+   if(cur >= end)
+      error("unexpected end of data");
+
+   switch(*cur)
+   {
+   case '{':
+   case '[':
+      if(++depth > JSON_MAX_DEPTH)
+         error("nesting too deep");
+      if(*cur++ == '{')
+         parseObject(vp);
+      else
+         parseArray(vp);
+      --depth;
+      break;
+   case '"':
+      {
+         const jschar *chars;
+         size_t        length;
+         JSString     *str;
+
+         ++cur;
+         parseStringChars(chars, length);
+         if(!(str = JS_NewUCStringCopyN(cx, chars, length)))
+            throw JSEngineError("Out of memory", true);
+         *vp = STRING_TO_JSVAL(str);
+      }
+      break;
+   case 't':
+      expectLiteral("true");
+      *vp = JSVAL_TRUE;
+      break;
+   case 'f':
+      expectLiteral("false");
+      *vp = JSVAL_FALSE;
+      break;
+   case 'n':
+      expectLiteral("null");
+      *vp = JSVAL_NULL;
+      break;
+   default:
+      parseNumber(vp);
+      break;
+   }
+}
+
+void JSONParser::parse(jsval *vp)
+{
+   parseValue(vp);
+   skipWhitespace();
+   if(cur != end)
+      error("unexpected data after JSON value");
+}
+
+//
+// JSON_Revive
+//
+// Post-order walk applying a reviver function, per ES5 15.12.2.
+//
+static void JSON_Revive(JSContext *cx, JSObject *holder, jsval key, jsval reviver, jsval *vp)
+{
+   AutoLocalRootScope scope(cx);
+   jsval val;
+
+   if(JSVAL_IS_INT(key))
+   {
+      if(!JS_GetElement(cx, holder, JSVAL_TO_INT(key), &val))
+         throw JSEngineError("JSON.parse: reviver failed");
+   }
+   else
+   {
+      JSString *str = JSVAL_TO_STRING(key);
+      if(!JS_GetUCProperty(cx, holder, JS_GetStringChars(str), JS_GetStringLength(str), &val))
+         throw JSEngineError("JSON.parse: reviver failed");
+   }
+
+   if(!JSVAL_IS_PRIMITIVE(val))
+   {
+      JSObject *obj = JSVAL_TO_OBJECT(val);
+      JSIdArray *ida = JS_Enumerate(cx, obj);
+      if(!ida)
+         throw JSEngineError("Out of memory", true);
+      AutoIdArray aida(cx, ida);
+
+      for(jsint i = 0; i < ida->length; i++)
+      {
+         jsval idval, newval;
+
+         if(!JS_IdToValue(cx, ida->vector[i], &idval))
+            throw JSEngineError("JSON.parse: reviver failed");
+
+         JSON_Revive(cx, obj, idval, reviver, &newval);
+
+         JSBool ok;
+         if(JSVAL_IS_VOID(newval))
+         {
+            jsval junk;
+            if(JSVAL_IS_INT(idval))
+               ok = JS_DeleteElement2(cx, obj, JSVAL_TO_INT(idval), &junk);
+            else
+            {
+               JSString *str = JSVAL_TO_STRING(idval);
+               ok = JS_DeleteUCProperty2(cx, obj, JS_GetStringChars(str), JS_GetStringLength(str), &junk);
+            }
+         }
+         else if(JSVAL_IS_INT(idval))
+            ok = JS_SetElement(cx, obj, JSVAL_TO_INT(idval), &newval);
+         else
+         {
+            JSString *str = JSVAL_TO_STRING(idval);
+            ok = JS_SetUCProperty(cx, obj, JS_GetStringChars(str), JS_GetStringLength(str), &newval);
+         }
+         if(!ok)
+            throw JSEngineError("JSON.parse: reviver failed");
+      }
+   }
+
+   jsval args[2];
+   JSString *keystr = JS_ValueToString(cx, key);
+   if(!keystr)
+      throw JSEngineError("Out of memory", true);
+   args[0] = STRING_TO_JSVAL(keystr);
+   args[1] = val;
+
+   if(!JS_CallFunctionValue(cx, holder, reviver, 2, args, vp))
+      throw JSEngineError("JSON.parse: reviver failed");
+
+   scope.leaveWithResult(*vp);
+}
+
+//
+// JSON_Parse
+//
+// JSON.parse(text[, reviver])
+//
+static JSBool JSON_Parse(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   ASSERT_ARGC_GE(argc, 1, "parse");
+
+   AutoJSValueToStringRooted jstr(cx, argv[0]);
+   AutoLocalRootScope scope(cx);
+   JSONParser parser(cx, JS_GetStringChars(jstr), JS_GetStringLength(jstr));
+   jsval result = JSVAL_NULL;
+
+   parser.parse(&result);
+
+   if(argc >= 2 && JS_TypeOfValue(cx, argv[1]) == JSTYPE_FUNCTION)
+   {
+      JSObject *root = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+
+      if(!JS_DefineProperty(cx, root, "", result, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory", true);
+
+      JSON_Revive(cx, root, JS_GetEmptyStringValue(cx), argv[1], &result);
+   }
+
+   JS_SET_RVAL(cx, vp, result);
+   return JS_TRUE;
+}
+
+//=============================================================================
+//
+// JSONWriter
+//
+
+class JSONWriter
+{
+protected:
+   JSContext              *cx;
+   std::vector<jschar>     out;
+   std::vector<JSObject *> stack;      // objects being written, for cycle detection
+   jsval                   replacer;   // function, or JSVAL_VOID
+   std::vector<jsval>      properties; // property list from an array replacer
+   std::vector<jschar>     gap;
+   std::vector<jschar>     indent;
+
+   void put(char c) { out.push_back(static_cast<jschar>(c)); }
+   void put(const char *s);
+   void putNewline();
+   void putString(const jschar *s, size_t len);
+   void putNumber(jsval v);
+   void putKey(jsval key);
+
+   bool writeMember(JSObject *holder, jsval key, bool &first);
+   void writeObject(JSObject *obj);
+   void writeArray(JSObject *obj);
+   void getProperty(JSObject *holder, jsval key, jsval *vp);
+
+public:
+   JSONWriter(JSContext *pcx)
+      : cx(pcx), out(), stack(), replacer(JSVAL_VOID), properties(), gap(), indent()
+   {
+   }
+
+   void setReplacer(jsval r);
+   void setSpace(jsval space);
+
+   bool write(JSObject *holder, jsval key, jsval value);
+
+   JSString *toString();
+};
+
+void JSONWriter::put(const char *s)
+{
+   while(*s)
+      out.push_back(static_cast<jschar>(*s++));
+}
+
+void JSONWriter::putNewline()
+{
+   if(gap.empty())
+      return;
+   put('\n');
+   out.insert(out.end(), indent.begin(), indent.end());
+}
+
+void JSONWriter::putString(const jschar *s, size_t len)
+{
+   static const char hex[] = "0123456789abcdef";
+
+   put('"');
+   for(size_t i = 0; i < len; i++)
+   {
+      jschar c = s[i];
+
+      switch(c)
+      {
+      case '"':  put("\\\""); break;
+      case '\\': put("\\\\"); break;
+      case '\b': put("\\b");  break;
+      case '\f': put("\\f");  break;
+      case '\n': put("\\n");  break;
+      case '\r': put("\\r");  break;
+      case '\t': put("\\t");  break;
+      default:
+         // U+2028 and U+2029 are valid in JSON but not in JS source
+         if(c < 0x20 || c == 0x2028 || c == 0x2029)
+         {
+            put("\\u");
+            put(hex[(c >> 12) & 0xf]);
+            put(hex[(c >>  8) & 0xf]);
+            put(hex[(c >>  4) & 0xf]);
+            put(hex[c & 0xf]);
+         }
+         else
+            out.push_back(c);
+         break;
+      }
+   }
+   put('"');
+}
+
+void JSONWriter::putNumber(jsval v)
+{
+   char buf[DTOSTR_STANDARD_BUFFER_SIZE];
+
+   if(JSVAL_IS_INT(v))
+   {
+      jsint i = JSVAL_TO_INT(v);
+      char *p = buf + sizeof(buf);
+      unsigned int u = i < 0 ? 0u - static_cast<unsigned int>(i) : static_cast<unsigned int>(i);
+
+      *--p = '\0';
+      do
+      {
+         *--p = static_cast<char>('0' + u % 10);
+         u /= 10;
+      }
+      while(u);
+      if(i < 0)
+         *--p = '-';
+      put(p);
+   }
+   else
+   {
+      jsdouble d = *JSVAL_TO_DOUBLE(v);
+      const char *s;
+
+      if(!(d - d == 0)) // NaN or infinity
+         put("null");
+      else if(!(s = JS_dtostr(buf, sizeof(buf), DTOSTR_STANDARD, 0, d)))
+         throw JSEngineError("Out of memory", true);
+      else
+         put(s);
+   }
+}
+
+void JSONWriter::putKey(jsval key)
+{
+   if(JSVAL_IS_INT(key))
+   {
+      put('"');
+      putNumber(key);
+      put('"');
+   }
+   else
+   {
+      JSString *str = JSVAL_TO_STRING(key);
+      putString(JS_GetStringChars(str), JS_GetStringLength(str));
+   }
+}
+
+void JSONWriter::getProperty(JSObject *holder, jsval key, jsval *vp)
+{
+   JSBool ok;
+
+   if(JSVAL_IS_INT(key))
+      ok = JS_GetElement(cx, holder, JSVAL_TO_INT(key), vp);
+   else
+   {
+      JSString *str = JSVAL_TO_STRING(key);
+      ok = JS_GetUCProperty(cx, holder, JS_GetStringChars(str), JS_GetStringLength(str), vp);
+   }
+
+   if(!ok)
+      throw JSEngineError("JSON.stringify: could not read property");
+}
+
+void JSONWriter::setReplacer(jsval r)
+{
+   if(JS_TypeOfValue(cx, r) == JSTYPE_FUNCTION)
+      replacer = r;
+   else if(!JSVAL_IS_PRIMITIVE(r) && JS_IsArrayObject(cx, JSVAL_TO_OBJECT(r)))
+   {
+      // property list; strings and numbers name properties, and the strings
+      // made here are kept alive by the caller's local root scope
+      JSObject *arr = JSVAL_TO_OBJECT(r);
+      jsuint    len = 0;
+
+      if(!JS_GetArrayLength(cx, arr, &len))
+         throw JSEngineError("JSON.stringify: bad replacer");
+
+      for(jsuint i = 0; i < len; i++)
+      {
+         jsval item;
+         if(!JS_GetElement(cx, arr, static_cast<jsint>(i), &item))
+            throw JSEngineError("JSON.stringify: bad replacer");
+
+         if(JSVAL_IS_STRING(item) || JSVAL_IS_NUMBER(item))
+         {
+            JSString *str = JS_ValueToString(cx, item);
+            if(!str)
+               throw JSEngineError("Out of memory", true);
+            properties.push_back(STRING_TO_JSVAL(str));
+         }
+      }
+      if(properties.empty())
+         properties.push_back(JSVAL_VOID); // an empty list selects nothing
+   }
+}
+
+void JSONWriter::setSpace(jsval space)
+{
+   if(JSVAL_IS_NUMBER(space))
+   {
+      jsdouble d = 0;
+      JS_ValueToNumber(cx, space, &d);
+      for(int i = 0; i < 10 && i < d; i++)
+         gap.push_back(' ');
+   }
+   else if(JSVAL_IS_STRING(space))
+   {
+      JSString *str = JSVAL_TO_STRING(space);
+      size_t    len = JS_GetStringLength(str);
+      const jschar *chars = JS_GetStringChars(str);
+
+      gap.assign(chars, chars + (len > 10 ? 10 : len));
+   }
+}
+
+//
+// Write one member of an object; returns false without writing anything if
+// its value is not serializable.
+//
+bool JSONWriter::writeMember(JSObject *holder, jsval key, bool &first)
+{
+   AutoLocalRootScope scope(cx);
+   size_t mark = out.size();
+   jsval  value;
+
+   getProperty(holder, key, &value);
+
+   if(!first)
+      put(',');
+   putNewline();
+   putKey(key);
+   put(':');
+   if(!gap.empty())
+      put(' ');
+
+   if(!write(holder, key, value))
+   {
+      out.resize(mark);
+      return false;
+   }
+
+   first = false;
+   return true;
+}
+
+void JSONWriter::writeObject(JSObject *obj)
+{
+   bool first = true;
+
+   put('{');
+   indent.insert(indent.end(), gap.begin(), gap.end());
+
+   if(!properties.empty())
+   {
+      for(size_t i = 0; i < properties.size(); i++)
+      {
+         if(!JSVAL_IS_VOID(properties[i]))
+            writeMember(obj, properties[i], first);
+      }
+   }
+   else
+   {
+      JSIdArray *ida = JS_Enumerate(cx, obj);
+      if(!ida)
+         throw JSEngineError("Out of memory", true);
+      AutoIdArray aida(cx, ida);
+
+      for(jsint i = 0; i < ida->length; i++)
+      {
+         jsval key;
+         if(!JS_IdToValue(cx, ida->vector[i], &key))
+            throw JSEngineError("JSON.stringify: bad property id");
+         if(JSVAL_IS_INT(key) || JSVAL_IS_STRING(key))
+            writeMember(obj, key, first);
+      }
+   }
+
+   indent.resize(indent.size() - gap.size());
+   if(!first)
+      putNewline();
+   put('}');
+}
+
+void JSONWriter::writeArray(JSObject *obj)
+{
+   jsuint len = 0;
+
+   if(!JS_GetArrayLength(cx, obj, &len))
+      throw JSEngineError("JSON.stringify: could not read array length");
+
+   put('[');
+   indent.insert(indent.end(), gap.begin(), gap.end());
+
+   for(jsuint i = 0; i < len; i++)
+   {
+      AutoLocalRootScope scope(cx);
+      jsval key = INT_TO_JSVAL(static_cast<jsint>(i));
+      jsval value;
+
+      if(i)
+         put(',');
+      putNewline();
+
+      getProperty(obj, key, &value);
+      if(!write(obj, key, value))
+         put("null");
+   }
+
+   indent.resize(indent.size() - gap.size());
+   if(len)
+      putNewline();
+   put(']');
+}
+
+//
+// Write a value, per ES5 15.12.3 Str. Returns false if the value is
+// undefined or a function, which is written as nothing.
+//
+bool JSONWriter::write(JSObject *holder, jsval key, jsval value)
+{
+   // toJSON and the replacer function see the key as a string
+   if(!JSVAL_IS_PRIMITIVE(value) || !JSVAL_IS_VOID(replacer))
+   {
+      jsval toJSON = JSVAL_VOID;
+
+      if(!JSVAL_IS_PRIMITIVE(value) &&
+         !JS_GetProperty(cx, JSVAL_TO_OBJECT(value), "toJSON", &toJSON))
+         throw JSEngineError("JSON.stringify: could not read toJSON");
+
+      if(JS_TypeOfValue(cx, toJSON) == JSTYPE_FUNCTION || !JSVAL_IS_VOID(replacer))
+      {
+         JSString *keystr = JS_ValueToString(cx, key);
+         if(!keystr)
+            throw JSEngineError("Out of memory", true);
+
+         jsval args[2] = { STRING_TO_JSVAL(keystr), JSVAL_VOID };
+
+         if(JS_TypeOfValue(cx, toJSON) == JSTYPE_FUNCTION &&
+            !JS_CallFunctionValue(cx, JSVAL_TO_OBJECT(value), toJSON, 1, args, &value))
+            throw JSEngineError("JSON.stringify: toJSON failed");
+
+         if(!JSVAL_IS_VOID(replacer))
+         {
+            args[1] = value;
+            if(!JS_CallFunctionValue(cx, holder, replacer, 2, args, &value))
+               throw JSEngineError("JSON.stringify: replacer failed");
+         }
+      }
+   }
+
+   // unwrap Number, String, and Boolean objects
+   if(!JSVAL_IS_PRIMITIVE(value))
+   {
+      const char *className = JS_GET_CLASS(cx, JSVAL_TO_OBJECT(value))->name;
+
+      if(!strcmp(className, "Number"))
+      {
+         jsdouble d;
+         if(!JS_ValueToNumber(cx, value, &d) || !JS_NewNumberValue(cx, d, &value))
+            throw JSEngineError("JSON.stringify: bad Number");
+      }
+      else if(!strcmp(className, "String"))
+      {
+         JSString *str = JS_ValueToString(cx, value);
+         if(!str)
+            throw JSEngineError("JSON.stringify: bad String");
+         value = STRING_TO_JSVAL(str);
+      }
+      else if(!strcmp(className, "Boolean"))
+      {
+         JSBool b;
+         JS_ValueToBoolean(cx, value, &b);
+         value = BOOLEAN_TO_JSVAL(b);
+      }
+   }
+
+   if(JSVAL_IS_NULL(value))
+      put("null");
+   else if(JSVAL_IS_BOOLEAN(value))
+      put(JSVAL_TO_BOOLEAN(value) ? "true" : "false");
+   else if(JSVAL_IS_STRING(value))
+   {
+      JSString *str = JSVAL_TO_STRING(value);
+      putString(JS_GetStringChars(str), JS_GetStringLength(str));
+   }
+   else if(JSVAL_IS_NUMBER(value))
+      putNumber(value);
+   else if(!JSVAL_IS_PRIMITIVE(value) && JS_TypeOfValue(cx, value) != JSTYPE_FUNCTION)
+   {
+      JSObject *obj = JSVAL_TO_OBJECT(value);
+
+      for(size_t i = 0; i < stack.size(); i++)
+      {
+         if(stack[i] == obj)
+            throw JSEngineError("JSON.stringify: cyclic object value");
+      }
+      if(stack.size() >= JSON_MAX_DEPTH)
+         throw JSEngineError("JSON.stringify: nesting too deep");
+
+      stack.push_back(obj);
+      if(JS_IsArrayObject(cx, obj))
+         writeArray(obj);
+      else
+         writeObject(obj);
+      stack.pop_back();
+   }
+   else
+      return false; // undefined or function
+
+   return true;
+}
+
+JSString *JSONWriter::toString()
+{
+   JSString *str = JS_NewUCStringCopyN(cx, out.empty() ? nullptr : &out[0], out.size());
+   if(!str)
+      throw JSEngineError("Out of memory", true);
+   return str;
+}
+
+//
+// JSON_Stringify
+//
+// JSON.stringify(value[, replacer[, space]])
+//
+static JSBool JSON_Stringify(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   AutoLocalRootScope scope(cx);
+   JSONWriter writer(cx);
+
+   if(argc >= 2)
+      writer.setReplacer(argv[1]);
+   if(argc >= 3)
+      writer.setSpace(argv[2]);
+
+   // the value is written as the "" property of a fresh holder object
+   JSObject *holder = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   jsval     value  = argc >= 1 ? argv[0] : JSVAL_VOID;
+   jsval     key    = JS_GetEmptyStringValue(cx);
+
+   if(!JS_DefineProperty(cx, holder, "", value, nullptr, nullptr, JSPROP_ENUMERATE))
+      throw JSEngineError("Out of memory", true);
+
+   if(writer.write(holder, key, value))
+      JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(writer.toString()));
+   else
+      JS_SET_RVAL(cx, vp, JSVAL_VOID);
+
+   return JS_TRUE;
+}
+
+//=============================================================================
+//
+// JSON object
+//
+
+static JSClass jsonClass =
+{
+   "JSON",
+   0,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_EnumerateStub,
+   JS_ResolveStub,
+   JS_ConvertStub,
+   JS_FinalizeStub,
+   JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+static JSFunctionSpec jsonJSMethods[] =
+{
+   JSE_FN("parse",     JSON_Parse,     1, 0, 0),
+   JSE_FN("stringify", JSON_Stringify, 1, 0, 0),
+   JS_FS_END
+};
+
+static NativeInitCode JSON_Create(JSContext *cx, JSObject *global)
+{
+   JSObject *obj;
+
+   // not permanent, so that scripts may still replace it
+   if(!(obj = JS_DefineObject(cx, global, "JSON", &jsonClass, nullptr, 0)))
+      return RESOLUTIONERROR;
+
+   if(!JS_DefineFunctions(cx, obj, jsonJSMethods))
+      return RESOLUTIONERROR;
+
+   return RESOLVED;
+}
+
+static Native jsonGlobalNative("JSON", JSON_Create);
+
+// EOF
+
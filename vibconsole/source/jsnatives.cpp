@@ -6,10 +6,15 @@
 #include <Windows.h>
 #endif
 
+#include <algorithm>
+#include <climits>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <string>
 #include <vector>
+#include "conlog.h"
+#include "csvfile.h"
 #include "inifile.h"
 #include "jsengine2.h"
 #include "timer.h"
@@ -56,6 +61,187 @@ static JSBool Core_MaybeGC(JSContext *cx, uintN argc, jsval *vp)
    return JS_TRUE;
 }
 
+//
+// Set a GC limit for this thread's runtime: "maxBytes", "maxMallocBytes" or
+// "stackPoolLifespan".
+//
+static JSBool Core_SetGCParameter(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   ASSERT_ARGC_GE(argc, 2, "setGCParameter");
+
+   const char *name  = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   uint32      value = 0;
+
+   if(!JS_ValueToECMAUint32(cx, argv[1], &value))
+      return JS_FALSE;
+
+   if(!JSEngine_SetGCParameter(name, value))
+      throw JSEngineError(std::string("Unknown GC parameter ") + name);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// Get a GC limit for this thread's runtime
+//
+static JSBool Core_GetGCParameter(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   ASSERT_ARGC_GE(argc, 1, "getGCParameter");
+
+   const char *name  = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   uint32      value = 0;
+
+   if(!JSEngine_GetGCParameter(name, value))
+      throw JSEngineError(std::string("Unknown GC parameter ") + name);
+
+   jsval r;
+   if(!JS_NewNumberValue(cx, value, &r))
+      throw JSEngineError("Out of memory", true);
+
+   JS_SET_RVAL(cx, vp, r);
+   return JS_TRUE;
+}
+
+//
+// Get collection pause times and heap statistics for this thread's runtime
+//
+static JSBool Core_GCStats(JSContext *cx, uintN argc, jsval *vp)
+{
+   gcstats_t stats;
+   JSEngine_GetGCStats(stats);
+
+   unsigned int arenas = 0;
+   for(int i = 0; i < JS_GC_HEAP_STATS_LISTS; i++)
+      arenas += stats.heap.arenas[i];
+
+   std::map<std::string, unsigned int> fields;
+   fields["collections"   ] = stats.collections;
+   fields["lastPauseMS"   ] = stats.lastPauseMS;
+   fields["maxPauseMS"    ] = stats.maxPauseMS;
+   fields["totalPauseMS"  ] = stats.totalPauseMS;
+   fields["longPauses"    ] = stats.longPauses;
+   fields["bytes"         ] = stats.heap.bytes;
+   fields["lastBytes"     ] = stats.heap.lastBytes;
+   fields["maxBytes"      ] = stats.heap.maxBytes;
+   fields["mallocBytes"   ] = stats.heap.mallocBytes;
+   fields["maxMallocBytes"] = stats.heap.maxMallocBytes;
+   fields["arenaSize"     ] = stats.heap.arenaSize;
+   fields["arenas"        ] = arenas;
+   fields["doubleArenas"  ] = stats.heap.doubleArenas;
+
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "GCStats");
+
+   for(auto itr = fields.begin(); itr != fields.end(); ++itr)
+   {
+      jsval v;
+      if(!JS_NewNumberValue(cx, itr->second, &v) ||
+         !JS_DefineProperty(cx, obj, itr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   // arenas per free list, as [{ thingSize, arenas }, ...]
+   JSObject *lists = AssertJSNewArrayObject(cx, 0, nullptr);
+   AssertJSDefineProperty(cx, obj, "freeLists", OBJECT_TO_JSVAL(lists), nullptr, nullptr, JSPROP_ENUMERATE);
+
+   for(int i = 0; i < JS_GC_HEAP_STATS_LISTS; i++)
+   {
+      JSObject *list = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+      jsval     v    = OBJECT_TO_JSVAL(list);
+
+      if(!JS_SetElement(cx, lists, i, &v) ||
+         !JS_DefineProperty(cx, list, "thingSize", INT_TO_JSVAL(stats.heap.thingSize[i]), nullptr, nullptr, JSPROP_ENUMERATE) ||
+         !JS_DefineProperty(cx, list, "arenas", INT_TO_JSVAL(stats.heap.arenas[i]), nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+   return JS_TRUE;
+}
+
+//
+// Switch native call statistics on or off; returns the previous setting.
+//
+static JSBool Core_SetNativeStats(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   JSBool enable = JS_TRUE;
+
+   if(argc >= 1 && !JS_ValueToBoolean(cx, argv[0], &enable))
+      return JS_FALSE;
+
+   JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(JSEngine_NativeStatsEnabled()));
+   JSEngine_EnableNativeStats(!!enable);
+   return JS_TRUE;
+}
+
+//
+// Native call statistics for this thread and any finished Worker jobs, as
+// { name: { calls, totalMS, meanUS, p50US, p99US, maxUS, histogram }, ... }
+// where histogram[i] counts calls of 2^(i-1) up to 2^i microseconds.
+//
+static JSBool Core_NativeStats(JSContext *cx, uintN argc, jsval *vp)
+{
+   nativestatsmap_t stats;
+   JSEngine_GetNativeStats(stats, !JSEngine_IsWorkerThread());
+
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "NativeStats");
+
+   for(auto itr = stats.begin(); itr != stats.end(); ++itr)
+   {
+      const nativestats_t &s = itr->second;
+      JSObject *native = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+
+      if(!JS_DefineProperty(cx, obj, itr->first.c_str(), OBJECT_TO_JSVAL(native), nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+
+      std::map<std::string, double> fields;
+      fields["calls"  ] = s.calls;
+      fields["totalMS"] = s.totalUS / 1000.0;
+      fields["meanUS" ] = s.calls ? double(s.totalUS) / s.calls : 0.0;
+      fields["p50US"  ] = s.percentileUS(0.5);
+      fields["p99US"  ] = s.percentileUS(0.99);
+      fields["maxUS"  ] = s.maxUS;
+
+      for(auto fitr = fields.begin(); fitr != fields.end(); ++fitr)
+      {
+         jsval v;
+         if(!JS_NewNumberValue(cx, fitr->second, &v) ||
+            !JS_DefineProperty(cx, native, fitr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+            throw JSEngineError("Out of memory");
+      }
+
+      JSObject *histogram = AssertJSNewArrayObject(cx, 0, nullptr);
+      AssertJSDefineProperty(cx, native, "histogram", OBJECT_TO_JSVAL(histogram), nullptr, nullptr, JSPROP_ENUMERATE);
+
+      for(int i = 0; i < NATIVESTATS_BUCKETS; i++)
+      {
+         jsval v;
+         if(!JS_NewNumberValue(cx, s.buckets[i], &v) || !JS_SetElement(cx, histogram, i, &v))
+            throw JSEngineError("Out of memory");
+      }
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+   return JS_TRUE;
+}
+
+//
+// Zero native call statistics.
+//
+static JSBool Core_ResetNativeStats(JSContext *cx, uintN argc, jsval *vp)
+{
+   JSEngine_ResetNativeStats();
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
 //
 // Load and execute a script
 //
@@ -70,12 +256,9 @@ static JSBool Core_LoadScript(JSContext *cx, uintN argc, jsval *vp)
       JSScript *script;
       const char *filename = SafeGetStringBytes(cx, argv[0], &argv[0]);
 
-      uint32 oldopts = JS_GetOptions(cx);
-      JS_SetOptions(cx, oldopts | JSOPTION_COMPILE_N_GO);
-
       try
       {
-         if((script = JS_CompileFile(cx, obj, filename)))
+         if((script = JSEngine_CompileFileCached(cx, obj, filename)))
          {
             JSObject *scriptRoot = AssertJSNewScriptObject(cx, script);
             AutoNamedRoot root(cx, scriptRoot, "Core_LoadScript");
@@ -99,15 +282,14 @@ static JSBool Core_LoadScript(JSContext *cx, uintN argc, jsval *vp)
       {
          ok = err.propagateToJS(cx);
       }
-
-      JS_SetOptions(cx, oldopts);
    }
 
    return ok;
 }
 
 //
-// Load a module
+// Load a module. Each file is only evaluated once; later calls return the
+// same value unless the optional second argument is true.
 //
 static JSBool Core_LoadModule(JSContext *cx, uintN argc, jsval *vp)
 {
@@ -115,13 +297,15 @@ static JSBool Core_LoadModule(JSContext *cx, uintN argc, jsval *vp)
    
    ASSERT_ARGC_GE(argc, 1, "loadModule");
 
-   // argument is always the module filename
+   // argument 1 is the module filename; argument 2 forces re-evaluation
    const char *filename = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   JSBool      reload   = JS_FALSE;
 
-   jsval rval = JSVAL_VOID;
-   std::unique_ptr<JSEvalContext> ecx(JSEngine_NewSandbox());
+   if(argc >= 2)
+      JS_ValueToBoolean(cx, argv[1], &reload);
 
-   if(!JSEngine_EvaluateFileInContext(ecx.get(), filename, &rval))
+   jsval rval = JSVAL_VOID;
+   if(!JSEngine_LoadModule(filename, !!reload, &rval))
       throw JSEngineError("Module evaluation failed");
 
    JS_SET_RVAL(cx, vp, rval);
@@ -146,7 +330,7 @@ static JSBool Core_LoadMixin(JSContext *cx, uintN argc, jsval *vp)
    // argument 1 is the filename; argument 2 is the target object
    const char *filename  = SafeGetStringBytes(cx, argv[0], &argv[0]);
    JSObject   *targetObj = JSVAL_TO_OBJECT(argv[1]);
-   std::unique_ptr<JSEvalContext> ecx(JSEngine_NewSandbox());
+   AutoPooledContext ecx(JSEngine_AcquireSandbox());
 
    AssertJSDefineProperty(ecx->getContext(), ecx->getGlobal(), "mixin", argv[1], nullptr, nullptr, 0);
 
@@ -173,7 +357,7 @@ static JSBool Core_LoadJSON(JSContext *cx, uintN argc, jsval *vp)
    // argument is always the JSON filename
    const char *filename = SafeGetStringBytes(cx, argv[0], &argv[0]);
 
-   std::unique_ptr<JSEvalContext> ecx(JSEngine_NewRestrictedContext());
+   AutoPooledContext ecx(JSEngine_AcquireRestrictedContext());
    jsval rval = JSVAL_VOID;
    if(!JSEngine_EvaluateAugmentedFile(ecx.get(), filename, &rval))
       throw JSEngineError("JSON evaluation failed");
@@ -211,7 +395,7 @@ static JSBool Core_EvalUntrustedString(JSContext *cx, uintN argc, jsval *vp)
 
    AutoJSValueToStringRooted jstr(cx, argv[0]);
    jsval rval = JSVAL_VOID;
-   std::unique_ptr<JSEvalContext> ecx(JSEngine_NewRestrictedContext());
+   AutoPooledContext ecx(JSEngine_AcquireRestrictedContext());
 
    if(!JSEngine_EvaluateUCJSStringInContext(ecx.get(), jstr, &rval))
       throw JSEngineError("String evaluation failed");
@@ -258,7 +442,7 @@ static JSBool Core_EvalSandbox(JSContext *cx, uintN argc, jsval *vp)
 
    AutoJSValueToStringRooted jstr(cx, argv[0]);
    jsval rval = JSVAL_VOID;
-   std::unique_ptr<JSEvalContext> ecx(JSEngine_NewSandbox(injectProps, parented, withExtensions));
+   AutoPooledContext ecx(JSEngine_AcquireSandbox(injectProps, parented, withExtensions));
 
    if(!JSEngine_EvaluateUCJSStringInContext(ecx.get(), jstr, &rval))
       throw JSEngineError("String evaluation failed");
@@ -273,7 +457,12 @@ static JSBool Core_EvalSandbox(JSContext *cx, uintN argc, jsval *vp)
 static JSBool Core_Exit(JSContext *cx, uintN argc, jsval *vp)
 {
     if(!MainLoopRunning)
+    {
+       FinishProfiling();
+       FinishNativeStats();
+       ConLog_Shutdown();
        exit(ProcessReturnCode); // exit directly if not in main loop
+    }
 
     MainLoopRunning = false;
 
@@ -300,6 +489,194 @@ static JSBool Core_GetMS(JSContext *cx, uintN argc, jsval *vp)
    }
 }
 
+//
+// Get script cache and startup statistics
+//
+static JSBool Core_ScriptCacheStats(JSContext *cx, uintN argc, jsval *vp)
+{
+   scriptcachestats_t stats;
+   JSEngine_GetScriptCacheStats(stats);
+
+   std::map<std::string, unsigned int> fields;
+   fields["hits"        ] = stats.hits;
+   fields["misses"      ] = stats.misses;
+   fields["stores"      ] = stats.stores;
+   fields["errors"      ] = stats.errors;
+   fields["loadMS"      ] = stats.loadMS;
+   fields["compileMS"   ] = stats.compileMS;
+   fields["startupMS"   ] = stats.startupMS;
+   fields["runtimeMS"   ] = stats.runtimeMS;
+   fields["extensionsMS"] = stats.extensionsMS;
+   fields["autoexecMS"  ] = stats.autoexecMS;
+
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "ScriptCacheStats");
+
+   for(auto itr = fields.begin(); itr != fields.end(); ++itr)
+   {
+      jsval v;
+      if(!JS_NewNumberValue(cx, itr->second, &v) ||
+         !JS_DefineProperty(cx, obj, itr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   // lazyExtensions: { name: ms } for each one loaded on this thread so far
+   std::map<std::string, unsigned int> lazyMS;
+   JSEngine_GetLazyExtensionStats(lazyMS);
+
+   JSObject *lazy = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AssertJSDefineProperty(cx, obj, "lazyExtensions", OBJECT_TO_JSVAL(lazy), nullptr, nullptr, JSPROP_ENUMERATE);
+
+   for(auto itr = lazyMS.begin(); itr != lazyMS.end(); ++itr)
+   {
+      jsval v;
+      if(!JS_NewNumberValue(cx, itr->second, &v) ||
+         !JS_DefineProperty(cx, lazy, itr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+   return JS_TRUE;
+}
+
+//
+// Register a jslib file to be run the first time the named global is needed
+//
+static JSBool Core_LazyLoad(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   ASSERT_ARGC_GE(argc, 2, "lazyLoad");
+
+   const char *name     = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   const char *filename = SafeGetStringBytes(cx, argv[1], &argv[1]);
+
+   JSEngine_AddLazyExtension(name, filename);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// Forget all modules loaded through loadModule or require
+//
+static JSBool Core_ClearModuleCache(JSContext *cx, uintN argc, jsval *vp)
+{
+   JSEngine_ClearModuleCache();
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// Get sandbox context pool and module registry statistics
+//
+static JSBool Core_ContextPoolStats(JSContext *cx, uintN argc, jsval *vp)
+{
+   contextpoolstats_t stats;
+   JSEngine_GetContextPoolStats(stats);
+
+   std::map<std::string, unsigned int> fields;
+   fields["created"    ] = stats.created;
+   fields["reused"     ] = stats.reused;
+   fields["pooled"     ] = stats.pooled;
+   fields["moduleHits" ] = stats.moduleHits;
+   fields["moduleLoads"] = stats.moduleLoads;
+   fields["modules"    ] = stats.modules;
+
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "ContextPoolStats");
+
+   for(auto itr = fields.begin(); itr != fields.end(); ++itr)
+   {
+      jsval v;
+      if(!JS_NewNumberValue(cx, itr->second, &v) ||
+         !JS_DefineProperty(cx, obj, itr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+   return JS_TRUE;
+}
+
+//
+// Start the sampling profiler on this thread; the optional argument is the
+// sampling interval in milliseconds.
+//
+static JSBool Core_StartProfiler(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv     = JS_ARGV(cx, vp);
+   uint32 interval = 1;
+
+   if(argc >= 1 && !JS_ValueToECMAUint32(cx, argv[0], &interval))
+      return JS_FALSE;
+
+   if(!JSEngine_StartProfiler(interval))
+      throw JSEngineError("Profiler is already running");
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// Stop the profiler, writing collapsed stacks to the file named by the
+// optional argument, and return a summary with per-native call statistics.
+//
+static JSBool Core_StopProfiler(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   const char *filename = nullptr;
+   profileresults_t results;
+
+   if(!jsengineProfiling)
+      throw JSEngineError("Profiler is not running");
+
+   if(argc >= 1)
+      filename = SafeGetStringBytes(cx, argv[0], &argv[0]);
+
+   if(!JSEngine_StopProfiler(filename, results))
+      throw JSEngineError(std::string("Could not write profile to ") + filename);
+
+   std::map<std::string, unsigned int> fields;
+   fields["totalMS" ] = results.totalMS;
+   fields["jsMS"    ] = results.jsMS;
+   fields["nativeMS"] = results.nativeMS;
+   fields["waitMS"  ] = results.waitMS;
+   fields["samples" ] = results.samples;
+
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "ProfilerResults");
+
+   for(auto itr = fields.begin(); itr != fields.end(); ++itr)
+   {
+      jsval v;
+      if(!JS_NewNumberValue(cx, itr->second, &v) ||
+         !JS_DefineProperty(cx, obj, itr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   // natives: { name: { calls, ms, waitMS }, ... }
+   JSObject *natives = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AssertJSDefineProperty(cx, obj, "natives", OBJECT_TO_JSVAL(natives), nullptr, nullptr, JSPROP_ENUMERATE);
+
+   for(auto itr = results.natives.begin(); itr != results.natives.end(); ++itr)
+   {
+      JSObject *native = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+      jsval calls, ms, waitMS;
+
+      if(!JS_DefineProperty(cx, natives, itr->first.c_str(), OBJECT_TO_JSVAL(native), nullptr, nullptr, JSPROP_ENUMERATE) ||
+         !JS_NewNumberValue(cx, itr->second.calls,  &calls)  ||
+         !JS_DefineProperty(cx, native, "calls",  calls,  nullptr, nullptr, JSPROP_ENUMERATE) ||
+         !JS_NewNumberValue(cx, itr->second.ms,     &ms)     ||
+         !JS_DefineProperty(cx, native, "ms",     ms,     nullptr, nullptr, JSPROP_ENUMERATE) ||
+         !JS_NewNumberValue(cx, itr->second.waitMS, &waitMS) ||
+         !JS_DefineProperty(cx, native, "waitMS", waitMS, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+   return JS_TRUE;
+}
+
 //
 // Change interpreter interactive state
 //
@@ -335,6 +712,9 @@ static JSFunctionSpec coreJSMethods[] =
 {
    JSE_FN("GC",                  Core_GC,                  0, 0, 0),
    JSE_FN("maybeGC",             Core_MaybeGC,             0, 0, 0),
+   JSE_FN("setGCParameter",      Core_SetGCParameter,      2, 0, 0),
+   JSE_FN("getGCParameter",      Core_GetGCParameter,      1, 0, 0),
+   JSE_FN("gcStats",             Core_GCStats,             0, 0, 0),
    JSE_FN("loadScript",          Core_LoadScript,          1, 0, 0),
    JSE_FN("loadModule",          Core_LoadModule,          1, 0, 0),
    JSE_FN("loadMixin",           Core_LoadMixin,           2, 0, 0),
@@ -345,6 +725,15 @@ static JSFunctionSpec coreJSMethods[] =
    JSE_FN("exit",                Core_Exit,                0, 0, 0),
    JSE_FN("getMS",               Core_GetMS,               0, 0, 0),
    JSE_FN("setInteractive",      Core_SetInteractive,      0, 0, 0),
+   JSE_FN("scriptCacheStats",    Core_ScriptCacheStats,    0, 0, 0),
+   JSE_FN("lazyLoad",            Core_LazyLoad,            2, 0, 0),
+   JSE_FN("clearModuleCache",    Core_ClearModuleCache,    0, 0, 0),
+   JSE_FN("contextPoolStats",    Core_ContextPoolStats,    0, 0, 0),
+   JSE_FN("startProfiler",       Core_StartProfiler,       0, 0, 0),
+   JSE_FN("stopProfiler",        Core_StopProfiler,        0, 0, 0),
+   JSE_FN("setNativeStats",      Core_SetNativeStats,      0, 0, 0),
+   JSE_FN("nativeStats",         Core_NativeStats,         0, 0, 0),
+   JSE_FN("resetNativeStats",    Core_ResetNativeStats,    0, 0, 0),
    JS_FS_END
 };
 
@@ -400,21 +789,30 @@ static Native coreGlobalNative("Core", Core_Create);
 
 std::ofstream echoFile;
 
-// Print a message to the console
-static JSBool Console_Print(JSContext *cx, uintN argc, jsval *vp)
+//
+// Concatenate the arguments and queue them for output, if the level is
+// enabled.
+//
+static void Console_Output(JSContext *cx, uintN argc, jsval *argv, bool newline, int level)
 {
-   jsval *argv = JS_ARGV(cx, vp);
+   if(level < ConLog_GetLevel())
+      return;
+
+   std::string line;
 
    for(uintN i = 0; i < argc; i++)
-   {
-      const char *str = SafeGetStringBytes(cx, argv[i], &argv[i]);
-      std::cout << str;
-      if(echoFile)
-         echoFile << str;
-   }
+      line += SafeGetStringBytes(cx, argv[i], &argv[i]);
+
+   if(newline)
+      line += '\n';
+
+   ConLog_Write(line.data(), line.size());
+}
 
-   if(echoFile)
-      echoFile.flush();
+// Print a message to the console
+static JSBool Console_Print(JSContext *cx, uintN argc, jsval *vp)
+{
+   Console_Output(cx, argc, JS_ARGV(cx, vp), false, CONLOG_INFO);
 
    JS_SET_RVAL(cx, vp, JSVAL_VOID);
    return JS_TRUE;
@@ -422,26 +820,74 @@ static JSBool Console_Print(JSContext *cx, uintN argc, jsval *vp)
 
 // Print a message to the console, and end with a linebreak.
 static JSBool Console_PrintLine(JSContext *cx, uintN argc, jsval *vp)
+{
+   Console_Output(cx, argc, JS_ARGV(cx, vp), true, CONLOG_INFO);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+// As println, but only shown when the console level is "debug".
+static JSBool Console_Debug(JSContext *cx, uintN argc, jsval *vp)
+{
+   Console_Output(cx, argc, JS_ARGV(cx, vp), true, CONLOG_DEBUG);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+// As println, but still shown when the console level is "warn".
+static JSBool Console_Warn(JSContext *cx, uintN argc, jsval *vp)
+{
+   Console_Output(cx, argc, JS_ARGV(cx, vp), true, CONLOG_WARN);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+// Wait until all output so far has been written.
+static JSBool Console_Flush(JSContext *cx, uintN argc, jsval *vp)
+{
+   ConLog_Flush();
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+// Set the interval at which buffered output is written, in milliseconds.
+static JSBool Console_SetFlushInterval(JSContext *cx, uintN argc, jsval *vp)
 {
    jsval *argv = JS_ARGV(cx, vp);
+   int32 ms = 0;
 
-   for(uintN i = 0; i < argc; i++)
-   {
-      const char *str = SafeGetStringBytes(cx, argv[i], &argv[i]);
-      std::cout << str;
-      if(echoFile)
-         echoFile << str;
-   }
+   ASSERT_ARGC_GE(argc, 1, "setFlushInterval");
+   JS_ValueToECMAInt32(cx, argv[0], &ms);
+   ConLog_SetFlushInterval(ms > 0 ? static_cast<unsigned int>(ms) : 1);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
 
-   std::cout << std::endl;
-   if(echoFile)
+// Set the output level: "debug", "info", "warn" or "error".
+static JSBool Console_SetLevel(JSContext *cx, uintN argc, jsval *vp)
+{
+   static const char *levelNames[] = { "debug", "info", "warn", "error" };
+   jsval *argv = JS_ARGV(cx, vp);
+
+   ASSERT_ARGC_GE(argc, 1, "setLevel");
+   std::string name = SafeGetStringBytes(cx, argv[0], &argv[0]);
+
+   for(int i = CONLOG_DEBUG; i <= CONLOG_ERROR; i++)
    {
-      echoFile << std::endl;
-      echoFile.flush();
+      if(name == levelNames[i])
+      {
+         ConLog_SetLevel(i);
+         JS_SET_RVAL(cx, vp, JSVAL_VOID);
+         return JS_TRUE;
+      }
    }
 
-   JS_SET_RVAL(cx, vp, JSVAL_VOID);
-   return JS_TRUE;
+   throw JSEngineError("Unknown console level");
 }
 
 // Get a line of input form the console
@@ -449,7 +895,12 @@ static JSBool Console_GetLine(JSContext *cx, uintN argc, jsval *vp)
 {
    std::string cppstr;
 
-   std::getline(std::cin, cppstr);
+   ConLog_Flush(); // show any prompt first
+
+   {
+      JSEngineUnlocked unlocked;
+      std::getline(std::cin, cppstr);
+   }
 
    JSString *str = AssertJSNewStringCopyZ(cx, cppstr.c_str());
    JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(str));
@@ -466,6 +917,7 @@ static JSBool Console_StartEcho(JSContext *cx, uintN argc, jsval *vp)
    ASSERT_ARGC_GE(argc, 1, "startEcho");
    const char *filename = SafeGetStringBytes(cx, argv[0], &argv[0]);
 
+   ConLog_Flush(); // the writer thread must not see a half-opened file
    echoFile.open(filename, std::ios::out);
    if(!echoFile)
       throw JSEngineError("Could not open echo log");
@@ -480,6 +932,7 @@ static JSBool Console_StopEcho(JSContext *cx, uintN argc, jsval *vp)
       JS_SET_RVAL(cx, vp, JSVAL_FALSE);
    else
    {
+      ConLog_Flush(); // write out anything still bound for the file
       echoFile.close();
       JS_SET_RVAL(cx, vp, JSVAL_TRUE);
    }
@@ -629,6 +1082,11 @@ static JSFunctionSpec consoleJSMethods[] =
    JSE_FN("setTextAttrib",    Console_SetTextAttrib,    0, 0, 0),
    JSE_FN("fillOutputAttrib", Console_FillOutputAttrib, 0, 0, 0),
    JSE_FN("setTitle",         Console_SetTitle,         0, 0, 0),
+   JSE_FN("debug",            Console_Debug,            0, 0, 0),
+   JSE_FN("warn",             Console_Warn,             0, 0, 0),
+   JSE_FN("flush",            Console_Flush,            0, 0, 0),
+   JSE_FN("setFlushInterval", Console_SetFlushInterval, 1, 0, 0),
+   JSE_FN("setLevel",         Console_SetLevel,         1, 0, 0),
    JS_FS_END
 };
    
@@ -1578,40 +2036,437 @@ static JSBool LazyVecMap_Size(JSContext *cx, uintN argc, jsval *vp)
    return JS_TRUE;
 }
 
-static JSBool LazyVecMap_toCSV(JSContext *cx, uintN argc, jsval *vp)
+//
+// The columns to write: every field name found in the rows, in order. Rows
+// nearly always share one set of fields, so a row is only merged in when it
+// differs from what has been seen.
+//
+static void LazyVecMap_CSVColumns(const utilvecmap &vm, utilvecstr &columns)
 {
-   auto priv = PrivateData::MustGetFromThis<PrivateVecMap>(cx, vp);
-   jsval *argv = JS_ARGV(cx, vp);
-   const auto &vm = priv->vecmap;
-   std::string str;
-
    for(auto vmitr = vm.cbegin(); vmitr != vm.cend(); ++vmitr)
    {
-      const auto &row = *vmitr;
+      const auto &row  = *vmitr;
+      bool        same = row.size() == columns.size();
+
+      if(same)
+      {
+         size_t i = 0;
+         for(auto rowitr = row.cbegin(); rowitr != row.cend(); ++rowitr, ++i)
+         {
+            if(rowitr->first != columns[i])
+            {
+               same = false;
+               break;
+            }
+         }
+      }
 
-      for(auto rowitr = row.cbegin(); rowitr != row.cend(); ++rowitr)
+      if(!same)
       {
-         str += "\"" + ReplaceStringWithString(ReplaceStringWithString(ReplaceStringWithString(rowitr->second, "\"", "\"\""), "\n", " "), "\r", "") + "\"";
+         utilvecstr names, merged;
+         for(auto rowitr = row.cbegin(); rowitr != row.cend(); ++rowitr)
+            names.push_back(rowitr->first);
+         std::set_union(columns.begin(), columns.end(), names.begin(), names.end(),
+                        std::back_inserter(merged));
+         columns.swap(merged);
       }
-      if(str[str.length() - 1] == ',')
-         str.pop_back();
-      str += '\n';
    }
+}
 
-   JSString *jstr = AssertJSNewStringCopyZ(cx, str.c_str()); // TODO: auto string
-   JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jstr));
-   return JS_TRUE;
+static const char *LazyVecMap_CSVOption(JSContext *cx, JSObject *options, const char *name, jsval &v)
+{
+   if(!JS_GetProperty(cx, options, name, &v))
+      throw JSEngineError("LazyVecMap::toCSV: cannot read options");
+
+   return JSVAL_IS_VOID(v) || JSVAL_IS_NULL(v) ? nullptr : SafeGetStringBytes(cx, v, &v);
 }
 
-/**
- * LazyVecMap JS Class
- *
- * A lazy vector of LazyStringMap objects.
- */
-static JSClass lazyVecMapClass =
+//
+// CSVWriter sink filling a ByteBuffer from the start. Its memory grows by
+// doubling as chunks arrive and is trimmed to the length of the text once
+// the writer is closed.
+//
+class LazyVecMap_CSVBuffer
 {
-   "LazyVecMap",
-   JSCLASS_HAS_PRIVATE | JSCLASS_NEW_RESOLVE,
+public:
+   NativeByteBuffer *nbb;
+   size_t            used;
+
+   LazyVecMap_CSVBuffer(NativeByteBuffer *pNbb) : nbb(pNbb), used(0) {}
+
+   static bool Append(void *context, const char *data, size_t len)
+   {
+      auto self = static_cast<LazyVecMap_CSVBuffer *>(context);
+
+      if(self->used + len > self->nbb->getSize())
+      {
+         size_t grown = self->nbb->getSize() * 2;
+         self->nbb->resize(grown > self->used + len ? grown : self->used + len);
+         if(!self->nbb->getBuffer())
+         {
+            self->nbb->resize(0);
+            self->used = 0;
+            return false;
+         }
+      }
+
+      memcpy(self->nbb->getBuffer() + self->used, data, len);
+      self->used += len;
+      return true;
+   }
+
+   void finish() { nbb->resize(used); }
+};
+
+//
+// LazyVecMap_toCSV
+//
+// toCSV([options]) writes the rows as CSV, with a header row naming the
+// fields. Options:
+//   delimiter - default ','
+//   quote     - default '"'
+//   quoting   - "all" (the default), "needed" or "none"
+//   lineEnd   - default "\n"
+//   headers   - false to leave out the header row
+//   newlines  - true to keep line breaks in values; by default LF becomes
+//               a space and CR is dropped
+//   file      - write to this file and return true
+//   buffer    - fill this ByteBuffer and return it; the text is written
+//               into it in chunks rather than built up in full first
+// Otherwise the text is returned as a string.
+//
+static JSBool LazyVecMap_toCSV(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto   priv = PrivateData::MustGetFromThis<PrivateVecMap>(cx, vp);
+   jsval *argv = JS_ARGV(cx, vp);
+   const auto &vm = priv->vecmap;
+
+   std::unique_ptr<LazyVecMap_CSVBuffer> sink; // must outlive the writer
+   CSVWriter   writer(',', '"', CSVWriter::QUOTE_ALL, "\n");
+   bool        headers  = true;
+   bool        newlines = false;
+   std::string filename;
+   JSObject   *buffer   = nullptr;
+
+   if(argc >= 1 && JSVAL_IS_OBJECT(argv[0]) && !JSVAL_IS_NULL(argv[0]))
+   {
+      JSObject   *options = JSVAL_TO_OBJECT(argv[0]);
+      const char *str;
+      jsval       v;
+      JSBool      b;
+
+      if((str = LazyVecMap_CSVOption(cx, options, "delimiter", v)) && *str)
+         writer.setDelimiter(*str);
+      if((str = LazyVecMap_CSVOption(cx, options, "quote", v)) && *str)
+         writer.setQuote(*str);
+      if((str = LazyVecMap_CSVOption(cx, options, "quoting", v)))
+      {
+         if(!strcmp(str, "all"))
+            writer.setQuoting(CSVWriter::QUOTE_ALL);
+         else if(!strcmp(str, "needed"))
+            writer.setQuoting(CSVWriter::QUOTE_NEEDED);
+         else if(!strcmp(str, "none"))
+            writer.setQuoting(CSVWriter::QUOTE_NONE);
+         else
+            throw JSEngineError(std::string("LazyVecMap::toCSV: unknown quoting ") + str);
+      }
+      if((str = LazyVecMap_CSVOption(cx, options, "lineEnd", v)))
+         writer.setLineEnd(str);
+      if((str = LazyVecMap_CSVOption(cx, options, "file", v)))
+         filename = str;
+
+      if(JS_GetProperty(cx, options, "headers", &v) && !JSVAL_IS_VOID(v) && JS_ValueToBoolean(cx, v, &b))
+         headers = !!b;
+      if(JS_GetProperty(cx, options, "newlines", &v) && !JSVAL_IS_VOID(v) && JS_ValueToBoolean(cx, v, &b))
+         newlines = !!b;
+
+      if(JS_GetProperty(cx, options, "buffer", &v) && !JSVAL_IS_VOID(v) && !JSVAL_IS_NULL(v))
+      {
+         AssertInstanceOf(cx, &bytebuffer_class, v);
+         buffer = JSVAL_TO_OBJECT(v);
+      }
+   }
+
+   if(!newlines)
+   {
+      writer.replaceChars("\n", ' ');
+      writer.replaceChars("\r", '\0');
+   }
+
+   if(!filename.empty())
+   {
+      if(!writer.openFile(filename.c_str()))
+         throw JSEngineError("LazyVecMap::toCSV: cannot open " + filename);
+   }
+   else if(buffer)
+   {
+      sink.reset(new LazyVecMap_CSVBuffer(PrivateData::MustGetFromJSObject<NativeByteBuffer>(cx, buffer)));
+      writer.openSink(LazyVecMap_CSVBuffer::Append, sink.get());
+   }
+
+   utilvecstr columns;
+   LazyVecMap_CSVColumns(vm, columns);
+
+   if(headers)
+      writer.record(columns);
+
+   for(auto vmitr = vm.cbegin(); vmitr != vm.cend(); ++vmitr)
+   {
+      auto rowitr = vmitr->cbegin();
+
+      for(size_t i = 0; i < columns.size(); i++)
+      {
+         if(rowitr != vmitr->cend() && rowitr->first == columns[i])
+         {
+            writer.field(rowitr->second);
+            ++rowitr;
+         }
+         else
+            writer.field("", 0);
+      }
+      writer.endRecord();
+   }
+
+   if(!filename.empty())
+   {
+      if(!writer.close())
+         throw JSEngineError("LazyVecMap::toCSV: error writing " + filename);
+      JS_SET_RVAL(cx, vp, JSVAL_TRUE);
+   }
+   else if(buffer)
+   {
+      bool ok = writer.close();
+      sink->finish();
+      if(!ok)
+         throw JSEngineError("LazyVecMap::toCSV: out of memory filling buffer");
+      JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(buffer));
+   }
+   else
+   {
+      const std::string &text = writer.getBuffer();
+      JSString *jstr = AssertJSNewStringCopyN(cx, text.data(), text.size());
+      JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jstr));
+   }
+
+   return JS_TRUE;
+}
+
+//
+// Date column kernels
+//
+// Whole-column date work for reports and cohort filters. The column is
+// parsed once into day numbers (see Pdate::DayNumber), 0 where a row lacks
+// the field or holds no valid date, and each operation is then a plain loop
+// over ints, without a Pdate or LazyStringMap object per row. Timestamp
+// values are taken by their date part. Nothing is cached between calls, as
+// rows can be changed through the objects the vecmap hands out.
+//
+
+static void LazyVecMap_DateColumn(const utilvecmap &vm, const std::string &field, int mode,
+                                  std::vector<int> &days)
+{
+   days.resize(vm.size());
+
+   for(size_t i = 0; i < vm.size(); i++)
+   {
+      auto  itr = vm[i].find(field);
+      Pdate date;
+
+      if(itr != vm[i].end())
+         date.InDate(itr->second.data(), itr->second.length(), mode);
+      days[i] = date.DayNumber();
+   }
+}
+
+static int LazyVecMap_DateMode(JSContext *cx, uintN argc, jsval *argv, uintN which)
+{
+   int32 mode = global_mode;
+
+   if(argc > which && !JSVAL_IS_VOID(argv[which]) && !JS_ValueToECMAInt32(cx, argv[which], &mode))
+      throw JSEngineError("Invalid date mode");
+
+   return mode;
+}
+
+//
+// Day number of a date argument; 0 if it is null or undefined and may be
+// left open. Anything else that is not a valid date is an error.
+//
+static int LazyVecMap_DateArg(JSContext *cx, jsval v, int mode, bool optional, const char *what)
+{
+   Pdate date;
+
+   if(optional && (JSVAL_IS_NULL(v) || JSVAL_IS_VOID(v)))
+      return 0;
+
+   if(!Pdate_FromJSValue(cx, v, mode, date) || !date.DayNumber())
+      throw JSEngineError(std::string("LazyVecMap: invalid ") + what);
+
+   return date.DayNumber();
+}
+
+//
+// Return a column with null for the rows that had no valid date.
+//
+static void LazyVecMap_ReturnColumn(JSContext *cx, jsval *vp, const std::vector<int> &days,
+                                    const std::vector<int> &values)
+{
+   std::vector<jsval> vals(values.size());
+
+   for(size_t i = 0; i < values.size(); i++)
+      vals[i] = days[i] ? INT_TO_JSVAL(values[i]) : JSVAL_NULL;
+
+   JSObject *arr = AssertJSNewArrayObject(cx, static_cast<jsint>(vals.size()), vals.empty() ? nullptr : &vals[0]);
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(arr));
+}
+
+//
+// LazyVecMap_MapDateColumn
+//
+// mapDateColumn(field, op[, date[, mode]]) returns an array holding op
+// applied to each row's date in the field, or null where the row has none:
+//   "dayNumber" - serial day number
+//   "daysSince" - days since date
+//   "age"       - whole years as of date, default today
+//   "year"      - the year
+//   "month"     - year * 100 + month, for grouping by month
+//   "dayOfWeek" - 1 for Sunday through 7 for Saturday
+// The field is parsed in mode, which is also used for a date given as a
+// string, and defaults to global_mode.
+//
+static JSBool LazyVecMap_MapDateColumn(JSContext *cx, uintN argc, jsval *vp)
+{
+   ASSERT_ARGC_GE(argc, 2, "LazyVecMap::mapDateColumn");
+
+   auto   priv = PrivateData::MustGetFromThis<PrivateVecMap>(cx, vp);
+   jsval *argv = JS_ARGV(cx, vp);
+
+   std::string field = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   std::string op    = SafeGetStringBytes(cx, argv[1], &argv[1]);
+   jsval       ref   = argc >= 3 ? argv[2] : JSVAL_VOID;
+   int         mode  = LazyVecMap_DateMode(cx, argc, argv, 3);
+
+   std::vector<int> days, values;
+   LazyVecMap_DateColumn(priv->vecmap, field, mode, days);
+   values.resize(days.size());
+
+   const size_t count = days.size();
+
+   if(op == "dayNumber")
+      values = days;
+   else if(op == "daysSince")
+   {
+      const int base = LazyVecMap_DateArg(cx, ref, mode, false, "date for daysSince");
+
+      for(size_t i = 0; i < count; i++)
+         values[i] = days[i] - base;
+   }
+   else if(op == "dayOfWeek")
+   {
+      // day numbers run through the changeover unbroken, but the weekday
+      // formula only holds for the Gregorian calendar
+      Pdate anchor, gregorian;
+      anchor.year    = 2000; anchor.month    = 1; anchor.day    = 2;
+      gregorian.year = 1583; gregorian.month = 1; gregorian.day = 1;
+
+      const int sunday = anchor.DayNumber() - (anchor.DayOfWeek() - 1);
+      const int first  = gregorian.DayNumber();
+
+      for(size_t i = 0; i < count; i++)
+      {
+         if(days[i] >= first)
+            values[i] = ((days[i] - sunday) % 7 + 7) % 7 + 1;
+         else if(days[i])
+         {
+            Pdate date;
+            date.InDayNumber(days[i]);
+            values[i] = date.DayOfWeek();
+         }
+      }
+   }
+   else if(op == "year" || op == "month" || op == "age")
+   {
+      Pdate asOf;
+
+      if(op == "age")
+      {
+         if(JSVAL_IS_VOID(ref) || JSVAL_IS_NULL(ref))
+            asOf = CurrentPdate();
+         else
+            asOf.InDayNumber(LazyVecMap_DateArg(cx, ref, mode, false, "date for age"));
+      }
+
+      for(size_t i = 0; i < count; i++)
+      {
+         if(!days[i])
+            continue;
+
+         Pdate date;
+         date.InDayNumber(days[i]);
+
+         if(op == "year")
+            values[i] = date.year;
+         else if(op == "month")
+            values[i] = date.year * 100 + date.month;
+         else
+            values[i] = CalcAge(date, asOf);
+      }
+   }
+   else
+      throw JSEngineError("LazyVecMap::mapDateColumn: unknown operation " + op);
+
+   LazyVecMap_ReturnColumn(cx, vp, days, values);
+   return JS_TRUE;
+}
+
+//
+// LazyVecMap_FilterDateRange
+//
+// filterDateRange(field, lo, hi[, mode]) returns the indices of the rows
+// whose date in the field falls from lo through hi; null for either end
+// leaves it open. Rows without a valid date are never selected.
+//
+static JSBool LazyVecMap_FilterDateRange(JSContext *cx, uintN argc, jsval *vp)
+{
+   ASSERT_ARGC_GE(argc, 3, "LazyVecMap::filterDateRange");
+
+   auto   priv = PrivateData::MustGetFromThis<PrivateVecMap>(cx, vp);
+   jsval *argv = JS_ARGV(cx, vp);
+
+   std::string field = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   int         mode  = LazyVecMap_DateMode(cx, argc, argv, 3);
+   int         lo    = LazyVecMap_DateArg(cx, argv[1], mode, true, "low date");
+   int         hi    = LazyVecMap_DateArg(cx, argv[2], mode, true, "high date");
+
+   if(!lo)
+      lo = 1;
+   if(!hi)
+      hi = INT_MAX;
+
+   std::vector<int> days;
+   LazyVecMap_DateColumn(priv->vecmap, field, mode, days);
+
+   std::vector<jsval> rows;
+   for(size_t i = 0; i < days.size(); i++)
+   {
+      if(days[i] >= lo && days[i] <= hi)
+         rows.push_back(INT_TO_JSVAL(static_cast<jsint>(i)));
+   }
+
+   JSObject *arr = AssertJSNewArrayObject(cx, static_cast<jsint>(rows.size()), rows.empty() ? nullptr : &rows[0]);
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(arr));
+   return JS_TRUE;
+}
+
+/**
+ * LazyVecMap JS Class
+ *
+ * A lazy vector of LazyStringMap objects.
+ */
+static JSClass lazyVecMapClass =
+{
+   "LazyVecMap",
+   JSCLASS_HAS_PRIVATE | JSCLASS_NEW_RESOLVE,
    JS_PropertyStub,
    JS_PropertyStub,
    JS_PropertyStub,
@@ -1627,15 +2482,34 @@ DEFINE_PRIVATE_DATA(PrivateVecMap, lazyVecMapClass)
 
 static JSFunctionSpec lazyVecMapMethods[] =
 {
-   JSE_FN("size",  LazyVecMap_Size,  0, 0, 0),
-   JSE_FN("toCSV", LazyVecMap_toCSV, 0, 0, 0),
+   JSE_FN("size",            LazyVecMap_Size,            0, 0, 0),
+   JSE_FN("toCSV",           LazyVecMap_toCSV,           0, 0, 0),
+   JSE_FN("mapDateColumn",   LazyVecMap_MapDateColumn,   2, 0, 0),
+   JSE_FN("filterDateRange", LazyVecMap_FilterDateRange, 3, 0, 0),
    JS_FS_END
 };
 
+//
+// Get the delimiter or quote character argument of FromCSV, if given; an
+// empty string is an error rather than a NUL character.
+//
+static void CSVtoVecMap_CharArg(JSContext *cx, uintN argc, jsval *argv, uintN i, 
+                                const char *what, char &c)
+{
+   if(argc > i && !JSVAL_IS_VOID(argv[i]))
+   {
+      const char *str = SafeGetStringBytes(cx, argv[i], &argv[i]);
+      if(!*str)
+         throw JSEngineError(std::string("FromCSV: ") + what + " must not be empty");
+      c = *str;
+   }
+}
+
 //
 // CSVtoVecMapWrapper
 //
 // Allow loading CSV data files from JavaScript.
+// LazyVecMap.FromCSV(filename[, delimiter[, quote]])
 //
 static JSBool CSVtoVecMapWrapper(JSContext *cx, uintN argc, jsval *vp)
 {
@@ -1644,12 +2518,18 @@ static JSBool CSVtoVecMapWrapper(JSContext *cx, uintN argc, jsval *vp)
    if(argc >= 1)
    {
       const char *filename = SafeGetStringBytes(cx, argv[0], &argv[0]);
+      char        delim    = ',';
+      char        quote    = '\"';
+
+      CSVtoVecMap_CharArg(cx, argc, argv, 1, "delimiter", delim);
+      CSVtoVecMap_CharArg(cx, argc, argv, 2, "quote", quote);
+
       try
       {
          std::string errmsg;
          utilvecmap  output;
 
-         bool res = CSVtoVecMap(filename, '\"', ',', output, errmsg, true);
+         bool res = CSVtoVecMap(filename, quote, delim, output, errmsg, true);
          if(!res)
          {
             std::string msg = "Error in CSVtoVecMap: " + errmsg;
@@ -1660,11 +2540,15 @@ static JSBool CSVtoVecMapWrapper(JSContext *cx, uintN argc, jsval *vp)
          JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
 
          std::unique_ptr<PrivateVecMap> pvm(new PrivateVecMap());
-         pvm->vecmap = output;
+         pvm->vecmap.swap(output);
          pvm->setToJSObjectAndRelease(cx, obj, pvm);
 
          return JS_TRUE;
       }
+      catch(const JSEngineError &err)
+      {
+         return err.propagateToJS(cx);
+      }
       catch(...)
       {
          JS_ReportError(cx, "Exception thrown by CSVtoVecMap");
@@ -1847,106 +2731,1008 @@ static Native lazyMapStringMapGlobalNative("LazyMapStringMap", LazyMapStringMap_
 // IniFile
 //
 
-static JSClass iniFileClass =
-{
-   "IniFile",
-   0,
-   JS_PropertyStub,
-   JS_PropertyStub,
-   JS_PropertyStub,
-   JS_PropertyStub,
-   JS_EnumerateStub,
-   JS_ResolveStub,
-   JS_ConvertStub,
-   JS_FinalizeStub,
-   JSCLASS_NO_OPTIONAL_MEMBERS
-};
+static JSClass iniFileClass =
+{
+   "IniFile",
+   0,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_EnumerateStub,
+   JS_ResolveStub,
+   JS_ConvertStub,
+   JS_FinalizeStub,
+   JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+//
+// IniFile_GetIniOptions
+//
+// Wrapper method for IniFile::GetIniOptions
+// Note: returns a LazyMapStringMap instance into JS.
+//
+static JSBool IniFile_GetIniOptions(JSContext *cx, uintN argc, jsval *vp)
+{
+   JSObject *newObj = AssertJSNewObject(cx, &lazyMapStringMapClass, nullptr, nullptr);
+   AutoNamedRoot anr(cx, newObj, "NewMapMap");
+   std::unique_ptr<PrivateMapMap> nmm(new PrivateMapMap(&IniFile::GetIniOptions()));
+   nmm->setToJSObjectAndRelease(cx, newObj, nmm);
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(newObj));      
+   return JS_TRUE;
+}
+
+/** 
+ * IniFile JS Method Table
+ */
+static JSFunctionSpec iniFileFuncs[] =
+{
+   JSE_FN("getIniOptions", IniFile_GetIniOptions, 0, 0, 0),
+   JS_FS_END
+};
+
+static NativeInitCode IniFile_Create(JSContext *cx, JSObject *global)
+{
+   JSObject *obj;
+
+   if(!(obj = JS_DefineObject(cx, global, "iniFile", &iniFileClass, nullptr, JSPROP_PERMANENT)))
+      return RESOLUTIONERROR;
+
+   if(!JS_DefineFunctions(cx, obj, iniFileFuncs))
+      return RESOLUTIONERROR;
+
+   return RESOLVED;
+}
+
+static Native iniFileGlobalNative("iniFile", IniFile_Create);
+
+//=============================================================================
+//
+// PrometheusDB
+//
+
+#ifndef VIBC_NO_VISUALIB
+
+//=============================================================================
+//
+// PrometheusCursor
+//
+// Cursors are not constructed directly from JS; they are returned by the
+// cursor methods of PrometheusDB and PrometheusTransaction.
+//
+
+class PrivatePrometheusCursor : public PrivateData
+{
+   DECLARE_PRIVATE_DATA()
+
+public:
+   PrometheusCursor cursor;
+
+   PrivatePrometheusCursor() : PrivateData(), cursor()
+   {
+   }
+};
+
+//
+// PrometheusCursor_Finalize - Class Finalization Hook
+//
+// Close the query and destroy the C++ PrometheusCursor instance. The cursor
+// holds its own reference to the connection or transaction it reads from,
+// so this is safe even if the object it was opened on was finalized first.
+//
+static void PrometheusCursor_Finalize(JSContext *cx, JSObject *obj)
+{
+   auto priv = PrivateData::GetFromJSObject<PrivatePrometheusCursor>(cx, obj);
+
+   if(priv)
+   {
+      delete priv;
+      JS_SetPrivate(cx, obj, nullptr);
+   }
+}
+
+/**
+ * JSClass for PrometheusCursor.
+ */
+static JSClass prometheusCursorClass =
+{
+   "PrometheusCursor",
+   JSCLASS_HAS_PRIVATE,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_EnumerateStub,
+   JS_ResolveStub,
+   JS_ConvertStub,
+   PrometheusCursor_Finalize,
+   JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+DEFINE_PRIVATE_DATA(PrivatePrometheusCursor, prometheusCursorClass)
+
+//
+// PrometheusCursor_Next
+//
+// Returns the next row as a LazyStringMap, or null at the end of the results.
+//
+static JSBool PrometheusCursor_Next(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusCursor>(cx, vp);
+   pdb::stringmap row;
+
+   if(priv->cursor.fetchRow(row))
+      LazyStringMap_ReturnObject(cx, vp, row);
+   else
+      JS_SET_RVAL(cx, vp, JSVAL_NULL);
+
+   return JS_TRUE;
+}
+
+//
+// PrometheusCursor_Fetch
+//
+// Returns up to the requested number of rows as a LazyVecMap, or null at the
+// end of the results.
+//
+static JSBool PrometheusCursor_Fetch(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::MustGetFromThis<PrivatePrometheusCursor>(cx, vp);
+   uint32 maxRows = 1000;
+
+   if(argc >= 1)
+      JS_ValueToECMAUint32(cx, argv[0], &maxRows);
+
+   std::unique_ptr<PrivateVecMap> pvm(new PrivateVecMap());
+   if(maxRows > 0 && priv->cursor.fetchRows(pvm->vecmap, maxRows) > 0)
+   {
+      JSObject *newObj = AssertJSNewObject(cx, &lazyVecMapClass, nullptr, nullptr);
+      AutoNamedRoot anr(cx, newObj, "NewVecMap");
+      AssertJSDefineFunctions(cx, newObj, lazyVecMapMethods);
+      pvm->setToJSObjectAndRelease(cx, newObj, pvm);
+      JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(newObj));
+   }
+   else
+      JS_SET_RVAL(cx, vp, JSVAL_NULL);
+
+   return JS_TRUE;
+}
+
+//
+// PrometheusCursor_Close
+//
+static JSBool PrometheusCursor_Close(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusCursor>(cx, vp);
+
+   priv->cursor.close();
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// PrometheusCursor_IsOpen
+//
+static JSBool PrometheusCursor_IsOpen(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusCursor>(cx, vp);
+
+   JS_SET_RVAL(cx, vp, priv->cursor.isOpen() ? JSVAL_TRUE : JSVAL_FALSE);
+   return JS_TRUE;
+}
+
+//
+// PrometheusCursor_AtEnd
+//
+static JSBool PrometheusCursor_AtEnd(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusCursor>(cx, vp);
+
+   JS_SET_RVAL(cx, vp, priv->cursor.atEnd() ? JSVAL_TRUE : JSVAL_FALSE);
+   return JS_TRUE;
+}
+
+//
+// PrometheusCursor_RowCount
+//
+static JSBool PrometheusCursor_RowCount(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto  priv = PrivateData::MustGetFromThis<PrivatePrometheusCursor>(cx, vp);
+   jsval r;
+
+   if(!JS_NewNumberValue(cx, static_cast<jsdouble>(priv->cursor.rowCount()), &r))
+      throw JSEngineError("Out of memory");
+
+   JS_SET_RVAL(cx, vp, r);
+   return JS_TRUE;
+}
+
+/**
+ * PrometheusCursor JS Method Table
+ */
+static JSFunctionSpec prometheusCursorFuncs[] =
+{
+   JSE_FN("next",     PrometheusCursor_Next,     0, 0, 0),
+   JSE_FN("fetch",    PrometheusCursor_Fetch,    1, 0, 0),
+   JSE_FN("close",    PrometheusCursor_Close,    0, 0, 0),
+   JSE_FN("isOpen",   PrometheusCursor_IsOpen,   0, 0, 0),
+   JSE_FN("atEnd",    PrometheusCursor_AtEnd,    0, 0, 0),
+   JSE_FN("rowCount", PrometheusCursor_RowCount, 0, 0, 0),
+   JS_FS_END
+};
+
+static NativeInitCode PrometheusCursor_Create(JSContext *cx, JSObject *global)
+{
+   auto obj = JS_InitClass(cx, global, nullptr, &prometheusCursorClass, nullptr,
+                           0, nullptr, prometheusCursorFuncs, nullptr, nullptr);
+
+   return obj ? RESOLVED : RESOLUTIONERROR;
+}
+
+static Native prometheusCursorGlobalNative("PrometheusCursor", PrometheusCursor_Create);
+
+//
+// NewPrometheusChildObject
+//
+// Wrap a cursor or bulk inserter which has been successfully opened in a new
+// JS object of the given class, which takes ownership of it.
+//
+template<typename T>
+static JSObject *NewPrometheusChildObject(JSContext *cx, JSClass *clasp, JSFunctionSpec *funcs,
+                                          std::unique_ptr<T> &priv)
+{
+   JSObject *newObj = AssertJSNewObject(cx, clasp, nullptr, nullptr);
+   AutoNamedRoot anr(cx, newObj, clasp->name);
+   AssertJSDefineFunctions(cx, newObj, funcs);
+   priv->setToJSObjectAndRelease(cx, newObj, priv);
+
+   return newObj;
+}
+
+//
+// PrometheusCursor_Open
+//
+// Shared by the cursor methods of PrometheusDB and PrometheusTransaction.
+// Returns a new PrometheusCursor object, or null if the query failed to open.
+//
+template<typename T>
+static JSBool PrometheusCursor_Open(JSContext *cx, uintN argc, jsval *vp, T &source)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   ASSERT_ARGC_GE(argc, 1, "cursor");
+
+   const char *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   std::unique_ptr<PrivatePrometheusCursor> pc(new PrivatePrometheusCursor());
+
+   if(!pc->cursor.open(source, sql))
+   {
+      JS_SET_RVAL(cx, vp, JSVAL_NULL);
+      return JS_TRUE;
+   }
+
+   JSObject *newObj = NewPrometheusChildObject(cx, &prometheusCursorClass, prometheusCursorFuncs, pc);
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(newObj));
+   return JS_TRUE;
+}
+
+//=============================================================================
+//
+// PrometheusBulkInserter
+//
+// Like cursors, bulk inserters are returned by the bulkInserter methods of
+// PrometheusDB and PrometheusTransaction.
+//
+
+class PrivatePrometheusBulkInserter : public PrivateData
+{
+   DECLARE_PRIVATE_DATA()
+
+public:
+   PrometheusBulkInserter inserter;
+
+   PrivatePrometheusBulkInserter() : PrivateData(), inserter()
+   {
+   }
+};
+
+//
+// PrometheusBulkInserter_Finalize - Class Finalization Hook
+//
+// Destroy the C++ PrometheusBulkInserter, rolling back anything not committed.
+// Like a cursor, the inserter holds its own reference to the connection or
+// transaction it writes to, so the object it was opened on may already be gone.
+//
+static void PrometheusBulkInserter_Finalize(JSContext *cx, JSObject *obj)
+{
+   auto priv = PrivateData::GetFromJSObject<PrivatePrometheusBulkInserter>(cx, obj);
+
+   if(priv)
+   {
+      delete priv;
+      JS_SetPrivate(cx, obj, nullptr);
+   }
+}
+
+/**
+ * JSClass for PrometheusBulkInserter.
+ */
+static JSClass prometheusBulkInserterClass =
+{
+   "PrometheusBulkInserter",
+   JSCLASS_HAS_PRIVATE,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_EnumerateStub,
+   JS_ResolveStub,
+   JS_ConvertStub,
+   PrometheusBulkInserter_Finalize,
+   JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+DEFINE_PRIVATE_DATA(PrivatePrometheusBulkInserter, prometheusBulkInserterClass)
+
+//
+// PrometheusBulkInserter_Insert
+//
+// Insert one row, given as an array of values in field order or an object
+// keyed by field name.
+//
+static JSBool PrometheusBulkInserter_Insert(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::MustGetFromThis<PrivatePrometheusBulkInserter>(cx, vp);
+   JSBool res  = JS_FALSE;
+
+   ASSERT_ARGC_GE(argc, 1, "insert");
+
+   if(JSVAL_IS_OBJECT(argv[0]) && !JSVAL_IS_NULL(argv[0]))
+   {
+      JSObject *rowObj = JSVAL_TO_OBJECT(argv[0]);
+
+      if(JS_IsArrayObject(cx, rowObj))
+      {
+         pdb::stringvec row;
+         if(JSArrayToStringVec(cx, rowObj, row))
+            res = priv->inserter.insert(row) ? JS_TRUE : JS_FALSE;
+      }
+      else
+      {
+         pdb::stringmap row;
+         if(JSObjectToStringMap(cx, rowObj, row))
+            res = priv->inserter.insert(row) ? JS_TRUE : JS_FALSE;
+      }
+   }
+
+   JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
+   return JS_TRUE;
+}
+
+//
+// PrometheusBulkInserter_Finish
+//
+static JSBool PrometheusBulkInserter_Finish(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto   priv = PrivateData::MustGetFromThis<PrivatePrometheusBulkInserter>(cx, vp);
+   JSBool res  = priv->inserter.finish() ? JS_TRUE : JS_FALSE;
+
+   JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
+   return JS_TRUE;
+}
+
+//
+// PrometheusBulkInserter_Abort
+//
+static JSBool PrometheusBulkInserter_Abort(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusBulkInserter>(cx, vp);
+
+   priv->inserter.abort();
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// PrometheusBulkInserter_IsOpen
+//
+static JSBool PrometheusBulkInserter_IsOpen(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusBulkInserter>(cx, vp);
+
+   JS_SET_RVAL(cx, vp, priv->inserter.isOpen() ? JSVAL_TRUE : JSVAL_FALSE);
+   return JS_TRUE;
+}
+
+//
+// PrometheusBulkInserter_Stats
+//
+// Returns an object with the rows, commits, ms, and rowsPerSecond of the load.
+//
+static JSBool PrometheusBulkInserter_Stats(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusBulkInserter>(cx, vp);
+   const PrometheusBulkInserter &ins = priv->inserter;
+
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "BulkInserterStats");
+
+   struct { const char *name; jsdouble value; } stats[] =
+   {
+      { "rows",          static_cast<jsdouble>(ins.rowCount())    },
+      { "commits",       static_cast<jsdouble>(ins.commitCount()) },
+      { "ms",            static_cast<jsdouble>(ins.elapsedMS())   },
+      { "rowsPerSecond", ins.rowsPerSecond()                      }
+   };
+
+   for(size_t i = 0; i < sizeof(stats) / sizeof(*stats); i++)
+   {
+      jsval v;
+      if(!JS_NewNumberValue(cx, stats[i].value, &v) ||
+         !JS_DefineProperty(cx, obj, stats[i].name, v, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+   return JS_TRUE;
+}
+
+/**
+ * PrometheusBulkInserter JS Method Table
+ */
+static JSFunctionSpec prometheusBulkInserterFuncs[] =
+{
+   JSE_FN("insert", PrometheusBulkInserter_Insert, 1, 0, 0),
+   JSE_FN("finish", PrometheusBulkInserter_Finish, 0, 0, 0),
+   JSE_FN("abort",  PrometheusBulkInserter_Abort,  0, 0, 0),
+   JSE_FN("isOpen", PrometheusBulkInserter_IsOpen, 0, 0, 0),
+   JSE_FN("stats",  PrometheusBulkInserter_Stats,  0, 0, 0),
+   JS_FS_END
+};
+
+static NativeInitCode PrometheusBulkInserter_Create(JSContext *cx, JSObject *global)
+{
+   auto obj = JS_InitClass(cx, global, nullptr, &prometheusBulkInserterClass, nullptr,
+                           0, nullptr, prometheusBulkInserterFuncs, nullptr, nullptr);
+
+   return obj ? RESOLVED : RESOLUTIONERROR;
+}
+
+static Native prometheusBulkInserterGlobalNative("PrometheusBulkInserter", PrometheusBulkInserter_Create);
+
+//
+// PrometheusBulkInserter_Open
+//
+// Shared by the bulkInserter methods of PrometheusDB and PrometheusTransaction:
+//   bulkInserter(table, fields[, fieldOptions[, commitEvery[, retaining]]])
+// Returns a new PrometheusBulkInserter object, or null if the insert could not
+// be prepared.
+//
+template<typename T>
+static JSBool PrometheusBulkInserter_Open(JSContext *cx, uintN argc, jsval *vp, T &target)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   ASSERT_ARGC_GE(argc, 2, "bulkInserter");
+
+   const char      *table       = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   pdb::stringvec   fields;
+   pdb::strtointmap fieldOpts;
+   uint32           commitEvery = 0;
+   JSBool           retaining   = JS_TRUE;
+
+   if(!JSVAL_IS_OBJECT(argv[1]) || JSVAL_IS_NULL(argv[1]) ||
+      !JSArrayToStringVec(cx, JSVAL_TO_OBJECT(argv[1]), fields))
+   {
+      JS_SET_RVAL(cx, vp, JSVAL_NULL);
+      return JS_TRUE;
+   }
+   if(argc >= 3 && JSVAL_IS_OBJECT(argv[2]) && !JSVAL_IS_NULL(argv[2]))
+      JSObjectToStrIntMap(cx, JSVAL_TO_OBJECT(argv[2]), fieldOpts);
+   if(argc >= 4)
+      JS_ValueToECMAUint32(cx, argv[3], &commitEvery);
+   if(argc >= 5)
+      JS_ValueToBoolean(cx, argv[4], &retaining);
+
+   std::unique_ptr<PrivatePrometheusBulkInserter> pbi(new PrivatePrometheusBulkInserter());
+
+   if(!pbi->inserter.open(target, table, fields, &fieldOpts, commitEvery, !!retaining))
+   {
+      JS_SET_RVAL(cx, vp, JSVAL_NULL);
+      return JS_TRUE;
+   }
+
+   JSObject *newObj = NewPrometheusChildObject(cx, &prometheusBulkInserterClass, 
+                                               prometheusBulkInserterFuncs, pbi);
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(newObj));
+   return JS_TRUE;
+}
+
+
+class PrivatePrometheusDB : public PrivateData
+{
+   DECLARE_PRIVATE_DATA()
+
+public:
+   PrometheusDB db;
+
+   PrivatePrometheusDB() : PrivateData(), db()
+   {
+   }
+};
+
+//
+// PrometheusDB_New - JS Constructor
+//
+// Construct a C++ PrometheusDB and wrap it in the new JavaScript object's
+// private data field.
+//
+static JSBool PrometheusDB_New(JSContext *cx, JSObject *obj, uintN argc,
+                               jsval *argv, jsval *rval)
+{
+   ASSERT_IS_CONSTRUCTING(cx, "PrometheusDB");
+
+   std::unique_ptr<PrivatePrometheusDB> db(new PrivatePrometheusDB());
+   db->setToJSObjectAndRelease(cx, obj, db);
+
+   *rval = JSVAL_VOID;
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_Finalize - Class Finalization Hook
+//
+// Destroy the C++ PrometheusDB instance before the GC releases the JS proxy.
+//
+static void PrometheusDB_Finalize(JSContext *cx, JSObject *obj)
+{
+   auto priv = PrivateData::GetFromJSObject<PrivatePrometheusDB>(cx, obj);
+
+   if(priv)
+   {
+      delete priv;
+      JS_SetPrivate(cx, obj, nullptr);
+   }
+}
+
+/**
+ * JSClass for PrometheusDB
+ * Reserved slot 0 holds the PrometheusPool a pooled connection came from.
+ */
+static JSClass prometheusDBClass =
+{
+   "PrometheusDB",
+   JSCLASS_HAS_PRIVATE | JSCLASS_HAS_RESERVED_SLOTS(1),
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_EnumerateStub,
+   JS_ResolveStub,
+   JS_ConvertStub,
+   PrometheusDB_Finalize,
+   JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+DEFINE_PRIVATE_DATA(PrivatePrometheusDB, prometheusDBClass)
+
+//
+// PrometheusDB_Connect
+//
+// Wrapper method for PrometheusDB::connect
+//
+static JSBool PrometheusDB_Connect(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::GetFromThis<PrivatePrometheusDB>(cx, vp);
+   JSBool res  = JS_FALSE;
+
+   if(!priv)
+      return JS_FALSE;
+
+   if(argc >= 3)
+   {
+      const char *addr = SafeGetStringBytes(cx, argv[0], &argv[0]);
+      const char *user = SafeGetStringBytes(cx, argv[1], &argv[1]);
+      const char *pswd = SafeGetStringBytes(cx, argv[2], &argv[2]);
+
+      res = priv->db.connect(addr, user, pswd) ? JS_TRUE : JS_FALSE;
+   }
+   else if(argc == 1)
+   {
+      const char *section = SafeGetStringBytes(cx, argv[0], &argv[0]);
+      res = priv->db.connect(section) ? JS_TRUE : JS_FALSE;
+   }
+
+   JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_IsConnected
+//
+// Wrapper method for PrometheusDB::isConnected
+//
+static JSBool PrometheusDB_IsConnected(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::GetFromThis<PrivatePrometheusDB>(cx, vp);
+
+   JSBool res = (priv && priv->db.isConnected()) ? JS_TRUE : JS_FALSE;
+
+   JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_Disconnect
+//
+// Wrapper method for PrometheusDB::disconnect
+//
+static JSBool PrometheusDB_Disconnect(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::GetFromThis<PrivatePrometheusDB>(cx, vp);
+   if(!priv)
+      return JS_FALSE;
+
+   priv->db.disconnect();
+   JS_SetReservedSlot(cx, JS_THIS_OBJECT(cx, vp), 0, JSVAL_VOID);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_Release
+//
+// Return a pooled connection to its PrometheusPool.
+//
+static JSBool PrometheusDB_Release(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+
+   priv->db.release();
+   JS_SetReservedSlot(cx, JS_THIS_OBJECT(cx, vp), 0, JSVAL_VOID);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_IsPooled
+//
+static JSBool PrometheusDB_IsPooled(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+
+   JS_SET_RVAL(cx, vp, priv->db.isPooled() ? JSVAL_TRUE : JSVAL_FALSE);
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_ExecuteStatement
+//
+// An optional object argument supplies values for named parameters. Only
+// string-valued properties are used; parameters without one are NULL.
+//
+static JSBool PrometheusDB_ExecuteStatement(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::GetFromThis<PrivatePrometheusDB>(cx, vp);
+   if(!priv)
+      return JS_FALSE;
+
+   if(argc >= 2 && JSVAL_IS_OBJECT(argv[1]) && !JSVAL_IS_NULL(argv[1]))
+   {
+      const char    *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
+      pdb::stringmap params;
+
+      JSBool res = JS_FALSE;
+      if(JSObjectToStringMap(cx, JSVAL_TO_OBJECT(argv[1]), params))
+         res = priv->db.executeStatement(sql, params) ? JS_TRUE : JS_FALSE;
+
+      JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
+      return JS_TRUE;
+   }
+   else if(argc >= 1)
+   {
+      const char *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
+      if(sql != "")
+      {
+         JSBool res = priv->db.executeStatement(sql) ? JS_TRUE : JS_FALSE;
+
+         JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
+         return JS_TRUE;
+      }
+   }
+
+   JS_SET_RVAL(cx, vp, JSVAL_FALSE);
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_GetOneField
+//
+// Wrapper method for PrometheusDB::getOneField
+//
+static JSBool PrometheusDB_GetOneField(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+
+   if(argc >= 1)
+   {
+      const char *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
+      std::string results;
+
+      priv->db.getOneField(sql, results);
+
+      JSString *jres = AssertJSNewStringCopyZ(cx, results.c_str());
+      JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jres));
+   }
+   else
+      JS_SET_RVAL(cx, vp, JSVAL_NULL);
+
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_SQLToVecMap
+//
+// Wrapper method for PrometheusDB::sqlToVecMap
+//
+static JSBool PrometheusDB_SQLToVecMap(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   if(argc >= 1)
+   {
+      const char *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
+      pdb::vecmap vm;
+
+      if(sql)
+      {
+         auto priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+         priv->db.sqlToVecMap(sql, vm);
+
+         JSObject *newObj = AssertJSNewObject(cx, &lazyVecMapClass, nullptr, nullptr);
+         AutoNamedRoot anr(cx, newObj, "NewVecMap");
+         AssertJSDefineFunctions(cx, newObj, lazyVecMapMethods);
+         std::unique_ptr<PrivateVecMap> pvm(new PrivateVecMap());
+         pvm->vecmap = vm;
+         pvm->setToJSObjectAndRelease(cx, newObj, pvm);
+
+         JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(newObj));
+         return JS_TRUE;
+      }
+   }
+
+   JS_SET_RVAL(cx, vp, JSVAL_NULL);
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_BulkInserter
+//
+// Open a PrometheusBulkInserter on a private transaction.
+//
+static JSBool PrometheusDB_BulkInserter(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+
+   return PrometheusBulkInserter_Open(cx, argc, vp, priv->db);
+}
+
+//
+// PrometheusDB_StatementCacheStats
+//
+// Returns an object with the hits, misses, evictions, size, and limit of the
+// connection's prepared statement cache.
+//
+static JSBool PrometheusDB_StatementCacheStats(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+   pdb::strtointmap stats;
+
+   priv->db.getStatementCacheStats(stats);
+
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "StatementCacheStats");
+
+   for(auto itr = stats.begin(); itr != stats.end(); ++itr)
+   {
+      jsval v;
+      if(!JS_NewNumberValue(cx, itr->second, &v) ||
+         !JS_DefineProperty(cx, obj, itr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_SetStatementCacheLimit
+//
+static JSBool PrometheusDB_SetStatementCacheLimit(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv  = JS_ARGV(cx, vp);
+   auto   priv  = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+   uint32 limit = 0;
+
+   ASSERT_ARGC_GE(argc, 1, "setStatementCacheLimit");
+
+   if(!JS_ValueToECMAUint32(cx, argv[0], &limit))
+      return JS_FALSE;
+
+   priv->db.setStatementCacheLimit(limit);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_ClearStatementCache
+//
+static JSBool PrometheusDB_ClearStatementCache(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+
+   priv->db.clearStatementCache();
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_SetIdBlockSize
+//
+static JSBool PrometheusDB_SetIdBlockSize(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+   uint32 size = 0;
+
+   ASSERT_ARGC_GE(argc, 2, "setIdBlockSize");
+
+   const char *table = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   if(!JS_ValueToECMAUint32(cx, argv[1], &size))
+      return JS_FALSE;
+
+   priv->db.setIdBlockSize(table, size);
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// PrometheusDB_IdStats
+//
+// Returns an object with the blockSize, refills, issued, and remaining counts
+// of a table's ID allocation, or null if no IDs have been requested for it.
+//
+static JSBool PrometheusDB_IdStats(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+   pdb::strtointmap stats;
+
+   ASSERT_ARGC_GE(argc, 1, "idStats");
+
+   const char *table = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   if(!priv->db.getIdStats(table, stats))
+   {
+      JS_SET_RVAL(cx, vp, JSVAL_NULL);
+      return JS_TRUE;
+   }
+
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "IdStats");
+
+   for(auto itr = stats.begin(); itr != stats.end(); ++itr)
+   {
+      jsval v;
+      if(!JS_NewNumberValue(cx, itr->second, &v) ||
+         !JS_DefineProperty(cx, obj, itr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+   return JS_TRUE;
+}
 
 //
-// IniFile_GetIniOptions
+// PrometheusDB_Cursor
 //
-// Wrapper method for IniFile::GetIniOptions
-// Note: returns a LazyMapStringMap instance into JS.
+// Open a PrometheusCursor on a private transaction.
 //
-static JSBool IniFile_GetIniOptions(JSContext *cx, uintN argc, jsval *vp)
+static JSBool PrometheusDB_Cursor(JSContext *cx, uintN argc, jsval *vp)
 {
-   JSObject *newObj = AssertJSNewObject(cx, &lazyMapStringMapClass, nullptr, nullptr);
-   AutoNamedRoot anr(cx, newObj, "NewMapMap");
-   std::unique_ptr<PrivateMapMap> nmm(new PrivateMapMap(&IniFile::GetIniOptions()));
-   nmm->setToJSObjectAndRelease(cx, newObj, nmm);
-   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(newObj));      
-   return JS_TRUE;
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+
+   return PrometheusCursor_Open(cx, argc, vp, priv->db);
 }
 
 /** 
- * IniFile JS Method Table
+ * PrometheusDB JS Method Table
  */
-static JSFunctionSpec iniFileFuncs[] =
+static JSFunctionSpec prometheusDBFuncs[] =
 {
-   JSE_FN("getIniOptions", IniFile_GetIniOptions, 0, 0, 0),
+   JSE_FN("connect",                PrometheusDB_Connect,                0, 0, 0),
+   JSE_FN("isConnected",            PrometheusDB_IsConnected,            0, 0, 0),
+   JSE_FN("disconnect",             PrometheusDB_Disconnect,             0, 0, 0),
+   JSE_FN("release",                PrometheusDB_Release,                0, 0, 0),
+   JSE_FN("isPooled",               PrometheusDB_IsPooled,               0, 0, 0),
+   JSE_FN("executeStatement",       PrometheusDB_ExecuteStatement,       1, 0, 0),
+   JSE_FN("getOneField",            PrometheusDB_GetOneField,            1, 0, 0),
+   JSE_FN("sqlToVecMap",            PrometheusDB_SQLToVecMap,            1, 0, 0),
+   JSE_FN("cursor",                 PrometheusDB_Cursor,                 1, 0, 0),
+   JSE_FN("bulkInserter",           PrometheusDB_BulkInserter,           2, 0, 0),
+   JSE_FN("statementCacheStats",    PrometheusDB_StatementCacheStats,    0, 0, 0),
+   JSE_FN("setStatementCacheLimit", PrometheusDB_SetStatementCacheLimit, 1, 0, 0),
+   JSE_FN("clearStatementCache",    PrometheusDB_ClearStatementCache,    0, 0, 0),
+   JSE_FN("setIdBlockSize",         PrometheusDB_SetIdBlockSize,         2, 0, 0),
+   JSE_FN("idStats",                PrometheusDB_IdStats,                1, 0, 0),
    JS_FS_END
 };
 
-static NativeInitCode IniFile_Create(JSContext *cx, JSObject *global)
+static NativeInitCode PrometheusDB_Create(JSContext *cx, JSObject *global)
 {
-   JSObject *obj;
-
-   if(!(obj = JS_DefineObject(cx, global, "iniFile", &iniFileClass, nullptr, JSPROP_PERMANENT)))
-      return RESOLUTIONERROR;
-
-   if(!JS_DefineFunctions(cx, obj, iniFileFuncs))
-      return RESOLUTIONERROR;
+   auto obj = JS_InitClass(cx, global, nullptr, &prometheusDBClass, 
+                           JSEngineNativeWrapper<PrometheusDB_New>,
+                           0, nullptr, prometheusDBFuncs, nullptr, nullptr);
 
-   return RESOLVED;
+   return obj ? RESOLVED : RESOLUTIONERROR;
 }
 
-static Native iniFileGlobalNative("iniFile", IniFile_Create);
+static Native prometheusDBGlobalNative("PrometheusDB", PrometheusDB_Create);
 
 //=============================================================================
 //
-// PrometheusDB
+// PrometheusPool
 //
 
-#ifndef VIBC_NO_VISUALIB
-
-class PrivatePrometheusDB : public PrivateData
+class PrivatePrometheusPool : public PrivateData
 {
    DECLARE_PRIVATE_DATA()
 
 public:
-   PrometheusDB db;
+   PrometheusPool pool;
 
-   PrivatePrometheusDB() : PrivateData(), db()
+   PrivatePrometheusPool() : PrivateData(), pool()
    {
    }
 };
 
 //
-// PrometheusDB_New - JS Constructor
-//
-// Construct a C++ PrometheusDB and wrap it in the new JavaScript object's
-// private data field.
+// PrometheusPool_New - JS Constructor
 //
-static JSBool PrometheusDB_New(JSContext *cx, JSObject *obj, uintN argc,
-                               jsval *argv, jsval *rval)
+static JSBool PrometheusPool_New(JSContext *cx, JSObject *obj, uintN argc,
+                                 jsval *argv, jsval *rval)
 {
-   ASSERT_IS_CONSTRUCTING(cx, "PrometheusDB");
+   ASSERT_IS_CONSTRUCTING(cx, "PrometheusPool");
 
-   std::unique_ptr<PrivatePrometheusDB> db(new PrivatePrometheusDB());
-   db->setToJSObjectAndRelease(cx, obj, db);
+   std::unique_ptr<PrivatePrometheusPool> pp(new PrivatePrometheusPool());
+   pp->setToJSObjectAndRelease(cx, obj, pp);
 
    *rval = JSVAL_VOID;
    return JS_TRUE;
 }
 
 //
-// PrometheusDB_Finalize - Class Finalization Hook
+// PrometheusPool_Finalize - Class Finalization Hook
 //
-// Destroy the C++ PrometheusDB instance before the GC releases the JS proxy.
+// Closes the pool. Connections still leased to PrometheusDB objects are
+// closed when those are released or collected.
 //
-static void PrometheusDB_Finalize(JSContext *cx, JSObject *obj)
+static void PrometheusPool_Finalize(JSContext *cx, JSObject *obj)
 {
-   auto priv = PrivateData::GetFromJSObject<PrivatePrometheusDB>(cx, obj);
+   auto priv = PrivateData::GetFromJSObject<PrivatePrometheusPool>(cx, obj);
 
    if(priv)
    {
@@ -1956,11 +3742,11 @@ static void PrometheusDB_Finalize(JSContext *cx, JSObject *obj)
 }
 
 /**
- * JSClass for PrometheusDB
+ * JSClass for PrometheusPool
  */
-static JSClass prometheusDBClass =
+static JSClass prometheusPoolClass =
 {
-   "PrometheusDB",
+   "PrometheusPool",
    JSCLASS_HAS_PRIVATE,
    JS_PropertyStub,
    JS_PropertyStub,
@@ -1969,187 +3755,230 @@ static JSClass prometheusDBClass =
    JS_EnumerateStub,
    JS_ResolveStub,
    JS_ConvertStub,
-   PrometheusDB_Finalize,
+   PrometheusPool_Finalize,
    JSCLASS_NO_OPTIONAL_MEMBERS
 };
 
-DEFINE_PRIVATE_DATA(PrivatePrometheusDB, prometheusDBClass)
+DEFINE_PRIVATE_DATA(PrivatePrometheusPool, prometheusPoolClass)
 
 //
-// PrometheusDB_Connect
+// PrometheusPool_NewConnection
 //
-// Wrapper method for PrometheusDB::connect
+// Check a connection out of the pool and wrap it in a new PrometheusDB
+// object, which keeps the pool object alive until it is released. Returns
+// null if no connection is available. The caller must root the result.
 //
-static JSBool PrometheusDB_Connect(JSContext *cx, uintN argc, jsval *vp)
+static JSObject *PrometheusPool_NewConnection(JSContext *cx, JSObject *poolObj, PrometheusPool &pool)
 {
-   jsval *argv = JS_ARGV(cx, vp);
-   auto   priv = PrivateData::GetFromThis<PrivatePrometheusDB>(cx, vp);
-   JSBool res  = JS_FALSE;
-
-   if(!priv)
-      return JS_FALSE;
+   std::unique_ptr<PrivatePrometheusDB> pdb(new PrivatePrometheusDB());
 
-   if(argc >= 3)
-   {
-      const char *addr = SafeGetStringBytes(cx, argv[0], &argv[0]);
-      const char *user = SafeGetStringBytes(cx, argv[1], &argv[1]);
-      const char *pswd = SafeGetStringBytes(cx, argv[2], &argv[2]);
+   if(!pdb->db.acquire(pool))
+      return nullptr;
 
-      res = priv->db.connect(addr, user, pswd) ? JS_TRUE : JS_FALSE;
-   }
-   else if(argc == 1)
-   {
-      const char *section = SafeGetStringBytes(cx, argv[0], &argv[0]);
-      res = priv->db.connect(section) ? JS_TRUE : JS_FALSE;
-   }
+   JSObject *newObj = AssertJSNewObject(cx, &prometheusDBClass, nullptr, nullptr);
+   AutoNamedRoot anr(cx, newObj, "NewPooledPrometheusDB");
+   AssertJSDefineFunctions(cx, newObj, prometheusDBFuncs);
+   JS_SetReservedSlot(cx, newObj, 0, OBJECT_TO_JSVAL(poolObj));
+   pdb->setToJSObjectAndRelease(cx, newObj, pdb);
 
-   JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
-   return JS_TRUE;
+   return newObj;
 }
 
 //
-// PrometheusDB_IsConnected
+// PrometheusPool_Open
 //
-// Wrapper method for PrometheusDB::isConnected
+// open(section[, min[, max[, idleTimeoutMS]]])
 //
-static JSBool PrometheusDB_IsConnected(JSContext *cx, uintN argc, jsval *vp)
+static JSBool PrometheusPool_Open(JSContext *cx, uintN argc, jsval *vp)
 {
-   auto priv = PrivateData::GetFromThis<PrivatePrometheusDB>(cx, vp);
+   jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::MustGetFromThis<PrivatePrometheusPool>(cx, vp);
+   uint32 minConnections = 1;
+   uint32 maxConnections = 8;
+   int32  idleTimeoutMS  = 300000;
 
-   JSBool res = (priv && priv->db.isConnected()) ? JS_TRUE : JS_FALSE;
+   ASSERT_ARGC_GE(argc, 1, "open");
+
+   const char *section = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   if(argc >= 2 && !JS_ValueToECMAUint32(cx, argv[1], &minConnections))
+      return JS_FALSE;
+   if(argc >= 3 && !JS_ValueToECMAUint32(cx, argv[2], &maxConnections))
+      return JS_FALSE;
+   if(argc >= 4 && !JS_ValueToECMAInt32(cx, argv[3], &idleTimeoutMS))
+      return JS_FALSE;
+
+   JSBool res = priv->pool.open(section, minConnections, maxConnections, idleTimeoutMS) ? JS_TRUE : JS_FALSE;
 
    JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
    return JS_TRUE;
 }
 
 //
-// PrometheusDB_Disconnect
-//
-// Wrapper method for PrometheusDB::disconnect
+// PrometheusPool_Close
 //
-static JSBool PrometheusDB_Disconnect(JSContext *cx, uintN argc, jsval *vp)
+static JSBool PrometheusPool_Close(JSContext *cx, uintN argc, jsval *vp)
 {
-   auto priv = PrivateData::GetFromThis<PrivatePrometheusDB>(cx, vp);
-   if(!priv)
-      return JS_FALSE;
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusPool>(cx, vp);
 
-   priv->db.disconnect();
+   priv->pool.close();
 
    JS_SET_RVAL(cx, vp, JSVAL_VOID);
    return JS_TRUE;
 }
 
 //
-// PrometheusDB_ExecuteStatement
+// PrometheusPool_IsOpen
 //
-static JSBool PrometheusDB_ExecuteStatement(JSContext *cx, uintN argc, jsval *vp)
+static JSBool PrometheusPool_IsOpen(JSContext *cx, uintN argc, jsval *vp)
 {
-   jsval *argv = JS_ARGV(cx, vp);
-   auto   priv = PrivateData::GetFromThis<PrivatePrometheusDB>(cx, vp);
-   if(!priv)
-      return JS_FALSE;
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusPool>(cx, vp);
 
-   if(argc >= 1)
-   {
-      const char *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
-      if(sql != "")
-      {
-         JSBool res = priv->db.executeStatement(sql) ? JS_TRUE : JS_FALSE;
+   JS_SET_RVAL(cx, vp, priv->pool.isOpen() ? JSVAL_TRUE : JSVAL_FALSE);
+   return JS_TRUE;
+}
 
-         JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
-         return JS_TRUE;
-      }
-   }
+//
+// PrometheusPool_Acquire
+//
+// Returns a pooled PrometheusDB, or null if none is available. Call its
+// release method when finished with it.
+//
+static JSBool PrometheusPool_Acquire(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto      priv  = PrivateData::MustGetFromThis<PrivatePrometheusPool>(cx, vp);
+   JSObject *dbObj = PrometheusPool_NewConnection(cx, JS_THIS_OBJECT(cx, vp), priv->pool);
 
-   JS_SET_RVAL(cx, vp, JSVAL_FALSE);
+   JS_SET_RVAL(cx, vp, dbObj ? OBJECT_TO_JSVAL(dbObj) : JSVAL_NULL);
    return JS_TRUE;
 }
 
 //
-// PrometheusDB_GetOneField
+// PrometheusPool_WithConnection
 //
-// Wrapper method for PrometheusDB::getOneField
+// Call a function with a pooled PrometheusDB and return its result. The
+// connection is released when the function returns or throws. Returns null
+// without calling the function if no connection is available.
 //
-static JSBool PrometheusDB_GetOneField(JSContext *cx, uintN argc, jsval *vp)
+static JSBool PrometheusPool_WithConnection(JSContext *cx, uintN argc, jsval *vp)
 {
-   jsval *argv = JS_ARGV(cx, vp);
-   auto   priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
+   jsval    *argv    = JS_ARGV(cx, vp);
+   JSObject *thisObj = JS_THIS_OBJECT(cx, vp);
+   auto      priv    = PrivateData::MustGetFromThis<PrivatePrometheusPool>(cx, vp);
 
-   if(argc >= 1)
-   {
-      const char *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
-      std::string results;
+   ASSERT_ARGC_GE(argc, 1, "withConnection");
 
-      priv->db.getOneField(sql, results);
+   if(!JSVAL_IS_OBJECT(argv[0]) || JSVAL_IS_NULL(argv[0]) ||
+      !JS_ObjectIsFunction(cx, JSVAL_TO_OBJECT(argv[0])))
+      throw JSEngineError("withConnection: argument must be a function");
 
-      JSString *jres = AssertJSNewStringCopyZ(cx, results.c_str());
-      JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(jres));
-   }
-   else
+   JSObject *dbObj = PrometheusPool_NewConnection(cx, thisObj, priv->pool);
+   if(!dbObj)
+   {
       JS_SET_RVAL(cx, vp, JSVAL_NULL);
+      return JS_TRUE;
+   }
+
+   AutoNamedRoot anr(cx, dbObj, "PooledPrometheusDB");
+   jsval  arg  = OBJECT_TO_JSVAL(dbObj);
+   jsval  rval = JSVAL_VOID;
+   JSBool ok   = JS_CallFunctionValue(cx, thisObj, argv[0], 1, &arg, &rval);
 
+   auto pdb = PrivateData::GetFromJSObject<PrivatePrometheusDB>(cx, dbObj);
+   if(pdb)
+      pdb->db.release();
+   JS_SetReservedSlot(cx, dbObj, 0, JSVAL_VOID);
+
+   if(!ok)
+      return JS_FALSE; // propagate the exception
+
+   JS_SET_RVAL(cx, vp, rval);
    return JS_TRUE;
 }
 
 //
-// PrometheusDB_SQLToVecMap
+// PrometheusPool_EvictIdle
 //
-// Wrapper method for PrometheusDB::sqlToVecMap
+static JSBool PrometheusPool_EvictIdle(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusPool>(cx, vp);
+
+   JS_SET_RVAL(cx, vp, INT_TO_JSVAL(static_cast<jsint>(priv->pool.evictIdle())));
+   return JS_TRUE;
+}
+
 //
-static JSBool PrometheusDB_SQLToVecMap(JSContext *cx, uintN argc, jsval *vp)
+// PrometheusPool_SetHealthCheckInterval
+//
+static JSBool PrometheusPool_SetHealthCheckInterval(JSContext *cx, uintN argc, jsval *vp)
 {
    jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::MustGetFromThis<PrivatePrometheusPool>(cx, vp);
+   uint32 ms   = 0;
 
-   if(argc >= 1)
-   {
-      const char *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
-      pdb::vecmap vm;
+   ASSERT_ARGC_GE(argc, 1, "setHealthCheckInterval");
 
-      if(sql)
-      {
-         auto priv = PrivateData::MustGetFromThis<PrivatePrometheusDB>(cx, vp);
-         priv->db.sqlToVecMap(sql, vm);
+   if(!JS_ValueToECMAUint32(cx, argv[0], &ms))
+      return JS_FALSE;
 
-         JSObject *newObj = AssertJSNewObject(cx, &lazyVecMapClass, nullptr, nullptr);
-         AutoNamedRoot anr(cx, newObj, "NewVecMap");
-         AssertJSDefineFunctions(cx, newObj, lazyVecMapMethods);
-         std::unique_ptr<PrivateVecMap> pvm(new PrivateVecMap());
-         pvm->vecmap = vm;
-         pvm->setToJSObjectAndRelease(cx, newObj, pvm);
+   priv->pool.setHealthCheckInterval(ms);
 
-         JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(newObj));
-         return JS_TRUE;
-      }
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// PrometheusPool_Stats
+//
+// Returns an object with the pool's occupancy and reuse counters.
+//
+static JSBool PrometheusPool_Stats(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivatePrometheusPool>(cx, vp);
+   pdb::strtointmap stats;
+
+   priv->pool.getStats(stats);
+
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "PoolStats");
+
+   for(auto itr = stats.begin(); itr != stats.end(); ++itr)
+   {
+      jsval v;
+      if(!JS_NewNumberValue(cx, itr->second, &v) ||
+         !JS_DefineProperty(cx, obj, itr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+         throw JSEngineError("Out of memory");
    }
 
-   JS_SET_RVAL(cx, vp, JSVAL_NULL);
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
    return JS_TRUE;
 }
 
-/** 
- * PrometheusDB JS Method Table
+/**
+ * PrometheusPool JS Method Table
  */
-static JSFunctionSpec prometheusDBFuncs[] =
-{
-   JSE_FN("connect",          PrometheusDB_Connect,          0, 0, 0),
-   JSE_FN("isConnected",      PrometheusDB_IsConnected,      0, 0, 0),
-   JSE_FN("disconnect",       PrometheusDB_Disconnect,       0, 0, 0),
-   JSE_FN("executeStatement", PrometheusDB_ExecuteStatement, 1, 0, 0),
-   JSE_FN("getOneField",      PrometheusDB_GetOneField,      1, 0, 0),
-   JSE_FN("sqlToVecMap",      PrometheusDB_SQLToVecMap,      1, 0, 0),
+static JSFunctionSpec prometheusPoolFuncs[] =
+{
+   JSE_FN("open",                   PrometheusPool_Open,                   1, 0, 0),
+   JSE_FN("close",                  PrometheusPool_Close,                  0, 0, 0),
+   JSE_FN("isOpen",                 PrometheusPool_IsOpen,                 0, 0, 0),
+   JSE_FN("acquire",                PrometheusPool_Acquire,                0, 0, 0),
+   JSE_FN("withConnection",         PrometheusPool_WithConnection,         1, 0, 0),
+   JSE_FN("evictIdle",              PrometheusPool_EvictIdle,              0, 0, 0),
+   JSE_FN("setHealthCheckInterval", PrometheusPool_SetHealthCheckInterval, 1, 0, 0),
+   JSE_FN("stats",                  PrometheusPool_Stats,                  0, 0, 0),
    JS_FS_END
 };
 
-static NativeInitCode PrometheusDB_Create(JSContext *cx, JSObject *global)
+static NativeInitCode PrometheusPool_Create(JSContext *cx, JSObject *global)
 {
-   auto obj = JS_InitClass(cx, global, nullptr, &prometheusDBClass, 
-                           JSEngineNativeWrapper<PrometheusDB_New>,
-                           0, nullptr, prometheusDBFuncs, nullptr, nullptr);
+   auto obj = JS_InitClass(cx, global, nullptr, &prometheusPoolClass,
+                           JSEngineNativeWrapper<PrometheusPool_New>,
+                           0, nullptr, prometheusPoolFuncs, nullptr, nullptr);
 
    return obj ? RESOLVED : RESOLUTIONERROR;
 }
 
-static Native prometheusDBGlobalNative("PrometheusDB", PrometheusDB_Create);
+static Native prometheusPoolGlobalNative("PrometheusPool", PrometheusPool_Create);
 
 //=============================================================================
 //
@@ -2255,6 +4084,10 @@ static JSBool PrometheusTransaction_StdTransaction(JSContext *cx, uintN argc,
       auto db = PrivateData::GetFromJSObject<PrivatePrometheusDB>(cx, obj);
       
       result = priv->ta.stdTransaction(db->db) ? JS_TRUE : JS_FALSE;
+
+      // the transaction uses the connection's statement cache; keep it alive
+      JS_SetReservedSlot(cx, JS_THIS_OBJECT(cx, vp), 0, 
+                         result ? OBJECT_TO_JSVAL(obj) : JSVAL_VOID);
    }
 
    JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(result));
@@ -2264,6 +4097,9 @@ static JSBool PrometheusTransaction_StdTransaction(JSContext *cx, uintN argc,
 //
 // PrometheusTransaction_ExecuteStatement
 //
+// An optional object argument supplies values for named parameters. Only
+// string-valued properties are used; parameters without one are NULL.
+//
 static JSBool PrometheusTransaction_ExecuteStatement(JSContext *cx, uintN argc,
                                                      jsval *vp)
 {
@@ -2272,7 +4108,19 @@ static JSBool PrometheusTransaction_ExecuteStatement(JSContext *cx, uintN argc,
    if(!priv)
       return JS_FALSE;
 
-   if(argc >= 1)
+   if(argc >= 2 && JSVAL_IS_OBJECT(argv[1]) && !JSVAL_IS_NULL(argv[1]))
+   {
+      const char    *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
+      pdb::stringmap params;
+
+      JSBool res = JS_FALSE;
+      if(JSObjectToStringMap(cx, JSVAL_TO_OBJECT(argv[1]), params))
+         res = priv->ta.executeStatement(sql, params) ? JS_TRUE : JS_FALSE;
+
+      JS_SET_RVAL(cx, vp, BOOLEAN_TO_JSVAL(res));
+      return JS_TRUE;
+   }
+   else if(argc >= 1)
    {
       const char *sql = SafeGetStringBytes(cx, argv[0], &argv[0]);
       if(sql != "")
@@ -2541,13 +4389,77 @@ static JSBool PrometheusTransaction_LockForUpdate(JSContext *cx, uintN argc, jsv
    return JS_TRUE;
 }
 
+//
+// PrometheusTransaction_Cursor
+//
+// Open a PrometheusCursor on this transaction.
+//
+static JSBool PrometheusTransaction_Cursor(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PPTransaction>(cx, vp);
+
+   return PrometheusCursor_Open(cx, argc, vp, priv->ta);
+}
+
+//
+// PrometheusTransaction_ReserveIds
+//
+// Returns an array of count new IDs for a table, or null on failure.
+//
+static JSBool PrometheusTransaction_ReserveIds(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv  = JS_ARGV(cx, vp);
+   auto   priv  = PrivateData::MustGetFromThis<PPTransaction>(cx, vp);
+   uint32 count = 0;
+   pdb::stringvec ids;
+
+   ASSERT_ARGC_GE(argc, 2, "reserveIds");
+
+   const char *table = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   if(!JS_ValueToECMAUint32(cx, argv[1], &count))
+      return JS_FALSE;
+
+   if(!priv->ta.reserveIds(table, count, ids))
+   {
+      JS_SET_RVAL(cx, vp, JSVAL_NULL);
+      return JS_TRUE;
+   }
+
+   JSObject *newArray = AssertJSNewArrayObject(cx, 0, nullptr);
+   AutoNamedRoot anr(cx, newArray, "NewIdArray");
+
+   for(size_t i = 0; i < ids.size(); i++)
+   {
+      JSString *jstr = AssertJSNewStringCopyZ(cx, ids[i].c_str());
+      AutoNamedRoot snr(cx, jstr, "NewIdString");
+
+      jsval v = STRING_TO_JSVAL(jstr);
+      AssertJSSetElement(cx, newArray, static_cast<jsint>(i), &v);
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(newArray));
+   return JS_TRUE;
+}
+
+//
+// PrometheusTransaction_BulkInserter
+//
+// Open a PrometheusBulkInserter on this transaction.
+//
+static JSBool PrometheusTransaction_BulkInserter(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PPTransaction>(cx, vp);
+
+   return PrometheusBulkInserter_Open(cx, argc, vp, priv->ta);
+}
+
 /**
  * PrometheusTransaction JS Class
  */
 static JSClass prometheusTransactionClass =
 {
    "PrometheusTransaction",
-   JSCLASS_HAS_PRIVATE,
+   JSCLASS_HAS_PRIVATE | JSCLASS_HAS_RESERVED_SLOTS(1),
    JS_PropertyStub,
    JS_PropertyStub,
    JS_PropertyStub,
@@ -2571,6 +4483,7 @@ static JSFunctionSpec prometheusTransactionFuncs[] =
    JSE_FN("rollback",               PrometheusTransaction_Rollback,         0, 0, 0),
    JSE_FN("stdTransaction",         PrometheusTransaction_StdTransaction,   1, 0, 0),
    JSE_FN("getNextId",              PrometheusTransaction_GetNextId,        1, 0, 0),
+   JSE_FN("reserveIds",             PrometheusTransaction_ReserveIds,       2, 0, 0),
    JSE_FN("executeStatement",       PrometheusTransaction_ExecuteStatement, 1, 0, 0),
    JSE_FN("executeInsertStatement", PrometheusTransaction_Insert,           3, 0, 0),
    JSE_FN("executeUpdateStatement", PrometheusTransaction_Update,           3, 0, 0),
@@ -2579,6 +4492,8 @@ static JSFunctionSpec prometheusTransactionFuncs[] =
    JSE_FN("lockForUpdate",          PrometheusTransaction_LockForUpdate,    2, 0, 0),
    JSE_FN("sqlToMap",               PrometheusTransaction_SQLToMap,         1, 0, 0),
    JSE_FN("getFullRecord",          PrometheusTransaction_GetFullRecord,    2, 0, 0),
+   JSE_FN("cursor",                 PrometheusTransaction_Cursor,           1, 0, 0),
+   JSE_FN("bulkInserter",           PrometheusTransaction_BulkInserter,     2, 0, 0),
    JS_FS_END
 };
 
@@ -71,6 +71,9 @@ extern std::ofstream echoFile;
 void LazyStringMap_ReturnObject(JSContext *cx, jsval *vp, std::map<std::string, std::string> &sm);
 void LazyVecMap_ReturnObject(JSContext *cx, jsval *vp, std::vector<std::map<std::string, std::string>> &vm);
 
+class Pdate;
+bool Pdate_FromJSValue(JSContext *cx, jsval v, int mode, Pdate &date);
+
 class NativeByteBuffer : public PrivateData
 {
    DECLARE_PRIVATE_DATA()
@@ -90,6 +93,16 @@ public:
 
    void resize(size_t newSize);
 
+   // Give up the memory to the caller, leaving the buffer empty
+   unsigned char *detach(size_t &outSize)
+   {
+      unsigned char *ret = memory;
+      outSize = size;
+      memory  = nullptr;
+      size    = 0;
+      return ret;
+   }
+
    unsigned char &operator [] (size_t index)
    {
       return memory[index];
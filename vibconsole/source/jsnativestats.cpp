@@ -0,0 +1,261 @@
+/*
+
+  Native Call Statistics
+
+  When switched on with Core.setNativeStats(true) or the -nativestats command
+  line option, every native defined with JSE_FN or JSE_WRAP counts its calls,
+  total time and a histogram of call times in power-of-two microsecond
+  buckets. Core.nativeStats() returns the counts, and -nativestats prints or
+  writes a table of them at exit.
+
+  Counters are per thread, so recording takes no lock. A Worker's counts are
+  added to a shared total, under the engine lock, when its context is
+  destroyed at the end of each job. Pool threads read the switch when they
+  start a job.
+
+  Times are wall time from entry to exit, so a native that runs scripts or
+  waits on I/O includes that time, and nested natives are counted in full by
+  each. Counts are kept by native and name, as one native can be defined
+  under several names and on several classes. Timing in the wrapper makes
+  every call more expensive by two reads of the performance counter, making
+  the name, and a map lookup, which is why it is off by default.
+
+*/
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+#include "jsengine2.h"
+#include "timer.h"
+
+JSENGINE_THREADLOCAL bool jsengineNativeStats;
+
+typedef std::pair<JSFastNative, std::string> nativekey_t;
+typedef std::map<nativekey_t, nativestats_t>  nativecounters_t;
+
+static JSENGINE_THREADLOCAL nativecounters_t *counters;
+
+// Switch read by worker threads and totals from finished Worker jobs; both
+// are protected by the engine lock
+static bool             nativeStatsEnabled;
+static nativestatsmap_t retiredStats;
+
+//=============================================================================
+//
+// nativestats_t
+//
+
+void nativestats_t::add(const nativestats_t &other)
+{
+   calls   += other.calls;
+   totalUS += other.totalUS;
+   if(other.maxUS > maxUS)
+      maxUS = other.maxUS;
+
+   for(int i = 0; i < NATIVESTATS_BUCKETS; i++)
+      buckets[i] += other.buckets[i];
+}
+
+//
+// Upper bound of the bucket holding the call at the given fraction of the
+// distribution, such as 0.99 for the 99th percentile.
+//
+unsigned int nativestats_t::percentileUS(double fraction) const
+{
+   double target = fraction * calls;
+   double seen   = 0;
+
+   for(int i = 0; i < NATIVESTATS_BUCKETS - 1; i++)
+   {
+      seen += buckets[i];
+      if(buckets[i] && seen >= target)
+         return std::min(1u << i, maxUS);
+   }
+
+   return maxUS;
+}
+
+//=============================================================================
+//
+// Recording
+//
+
+static nativestats_t &NativeStats_Find(JSContext *cx, jsval *vp, JSFastNative fn)
+{
+   if(!counters)
+      counters = new nativecounters_t;
+
+   return (*counters)[nativekey_t(fn, JSEngine_NativeName(cx, vp))];
+}
+
+static void NativeStats_Record(nativestats_t &stats, unsigned long long us)
+{
+   int bucket = 0;
+
+   for(unsigned long long n = us; n && bucket < NATIVESTATS_BUCKETS - 1; n >>= 1)
+      ++bucket;
+
+   ++stats.calls;
+   ++stats.buckets[bucket];
+   stats.totalUS += us;
+   if(us > stats.maxUS)
+      stats.maxUS = us > 0xffffffffULL ? 0xffffffffu : (unsigned int)us;
+}
+
+//
+// JSEngine_CountNative
+//
+// JSEngineWrapperFn calls natives through here while statistics are on.
+//
+JSBool JSEngine_CountNative(JSContext *cx, uintN argc, jsval *vp, JSFastNative fn)
+{
+   // look up before the call, which replaces the callee with the result
+   nativestats_t &stats = NativeStats_Find(cx, vp, fn);
+   unsigned long long start = Timer_getUS();
+   JSBool ok;
+
+   if(jsengineProfiling)
+      ok = JSEngine_ProfileNative(cx, argc, vp, fn);
+   else
+   {
+      try
+      {
+         ok = fn(cx, argc, vp);
+      }
+      catch(const JSEngineError &err)
+      {
+         ok = err.propagateToJS(cx);
+      }
+   }
+
+   NativeStats_Record(stats, Timer_getUS() - start);
+   return ok;
+}
+
+//=============================================================================
+//
+// Control
+//
+
+//
+// JSEngine_EnableNativeStats
+//
+// Switch statistics on or off for the calling thread and for Worker jobs
+// started afterward. Counts are kept when switched off.
+//
+void JSEngine_EnableNativeStats(bool enable)
+{
+   nativeStatsEnabled  = enable;
+   jsengineNativeStats = enable;
+}
+
+bool JSEngine_NativeStatsEnabled()
+{
+   return nativeStatsEnabled;
+}
+
+//
+// JSEngine_GetNativeStats
+//
+// Get the calling thread's counts by native name, adding those of finished
+// Worker jobs if allThreads is true.
+//
+void JSEngine_GetNativeStats(nativestatsmap_t &stats, bool allThreads)
+{
+   stats.clear();
+
+   if(counters)
+   {
+      for(auto itr = counters->begin(); itr != counters->end(); ++itr)
+      {
+         if(itr->second.calls)
+            stats[itr->first.second].add(itr->second);
+      }
+   }
+
+   if(allThreads)
+   {
+      for(auto itr = retiredStats.begin(); itr != retiredStats.end(); ++itr)
+         stats[itr->first].add(itr->second);
+   }
+}
+
+//
+// JSEngine_ResetNativeStats
+//
+// Zero the calling thread's counts and the totals of finished Worker jobs.
+// Entries are kept, as a native on the stack may still be timing into one.
+//
+void JSEngine_ResetNativeStats()
+{
+   if(counters)
+   {
+      for(auto itr = counters->begin(); itr != counters->end(); ++itr)
+         itr->second = nativestats_t();
+   }
+
+   retiredStats.clear();
+}
+
+//
+// JSEngine_RetireNativeStats
+//
+// Add the calling thread's counts to the shared totals and free them. Called
+// with the engine lock held when a context is destroyed, never from inside a
+// native.
+//
+void JSEngine_RetireNativeStats()
+{
+   std::unique_ptr<nativecounters_t> mine(counters);
+
+   counters = nullptr;
+   if(!mine)
+      return;
+
+   for(auto itr = mine->begin(); itr != mine->end(); ++itr)
+   {
+      if(itr->second.calls)
+         retiredStats[itr->first.second].add(itr->second);
+   }
+}
+
+//
+// JSEngine_FormatNativeStats
+//
+// Format counts as a table sorted by total time, for the exit dump.
+//
+void JSEngine_FormatNativeStats(const nativestatsmap_t &stats, std::string &out)
+{
+   std::vector<std::pair<unsigned long long, std::string>> order;
+   unsigned long long total = 0;
+   char line[320];
+
+   for(auto itr = stats.begin(); itr != stats.end(); ++itr)
+   {
+      order.push_back(std::make_pair(itr->second.totalUS, itr->first));
+      total += itr->second.totalUS;
+   }
+   std::sort(order.rbegin(), order.rend());
+
+   sprintf(line, "%-32s %10s %12s %6s %10s %10s %10s %10s\n",
+           "native", "calls", "total ms", "%", "mean us", "p50 us", "p99 us", "max us");
+   out = line;
+
+   for(auto itr = order.begin(); itr != order.end(); ++itr)
+   {
+      const nativestats_t &s = stats.find(itr->second)->second;
+
+      sprintf(line, "%-32.200s %10u %12.3f %6.1f %10.1f %10u %10u %10u\n",
+              itr->second.c_str(), s.calls, s.totalUS / 1000.0,
+              total ? 100.0 * s.totalUS / total : 0.0,
+              s.calls ? double(s.totalUS) / s.calls : 0.0,
+              s.percentileUS(0.5), s.percentileUS(0.99), s.maxUS);
+      out += line;
+   }
+}
+
+// EOF
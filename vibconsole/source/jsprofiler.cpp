@@ -0,0 +1,374 @@
+/*
+
+  Sampling Profiler
+
+  Core.startProfiler([intervalMS]) begins profiling the calling thread, and
+  Core.stopProfiler([file]) ends it, writing collapsed stacks in the format
+  taken by flamegraph.pl: one line per distinct stack, frames separated by
+  semicolons and outermost first, followed by a count of milliseconds. The
+  -profile [file] command line option profiles the whole run.
+
+  Time is divided three ways:
+    - script time is sampled from the operation callback, which is run more
+      often while profiling; each sample charges the time since the last one
+      to the JS stack at that point
+    - time inside natives defined with JSE_FN is measured exactly on entry
+      and exit, and charged to a "Class.method [native]" frame on top of the
+      calling JS stack
+    - time a native spends with the engine lock released, which is how
+      database queries and CURL transfers wait, goes to a "[wait]" frame
+      above that native
+
+  Scripts that a native runs in another context, such as a module being
+  loaded, appear above the native that ran them, and their time is not
+  charged to it.
+
+  The JSAPI call hook (jsdbgapi.h) would be the obvious way to see native
+  calls, but fast natives bypass it, and almost all of ours are fast.
+
+*/
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#include "jsengine2.h"
+#include "jsdbgapi.h"
+#include "timer.h"
+
+JSENGINE_THREADLOCAL bool jsengineProfiling;
+
+// A native call in progress
+struct profilerframe_t
+{
+   std::string  stack;            // collapsed stack including the native
+   std::string  name;             // native name
+   JSContext    *cx;              // context the native was called in
+   JSStackFrame *fp;              // innermost frame at the call
+   unsigned int startMS;
+   unsigned int attributedAtStart;
+   unsigned int waitAttributedAtStart;
+   unsigned int waitAtStart;
+};
+
+struct profiler_t
+{
+   unsigned int intervalMS;
+   unsigned int startMS;
+   unsigned int lastSampleMS;     // end of the time already charged to a stack
+   unsigned int waitStartMS;      // when the engine lock was released, or 0
+   unsigned int attributedMS;     // time charged to any stack so far
+   unsigned int waitAttributedMS; // [wait] time charged so far
+   unsigned int waitMS;           // time spent with the lock released
+
+   std::map<std::string, unsigned int> stacks;
+   std::vector<profilerframe_t>        frames;
+   profileresults_t                    results;
+
+   profiler_t(unsigned int interval)
+      : intervalMS(interval), startMS(Timer_getMS()), lastSampleMS(startMS), waitStartMS(0),
+        attributedMS(0), waitAttributedMS(0), waitMS(0)
+   {
+   }
+};
+
+static JSENGINE_THREADLOCAL profiler_t   *profiler;
+static JSENGINE_THREADLOCAL unsigned int  profilerGeneration;
+
+//=============================================================================
+//
+// Stack Walking
+//
+
+static void Profiler_AppendName(std::string &out, const char *name)
+{
+   for(; *name; ++name)
+      out += (*name == ';') ? ',' : *name;
+}
+
+//
+// Build the collapsed stack for a context, prefixed by that of the native
+// call it is running under, if any.
+//
+static void Profiler_Stack(profiler_t *p, JSContext *cx, std::string &out)
+{
+   std::vector<std::string> names;
+   JSStackFrame *iter = nullptr, *fp;
+   JSStackFrame *stop = nullptr;
+
+   // frames below a native that called back into the same context are
+   // already part of the native's stack
+   if(!p->frames.empty() && p->frames.back().cx == cx)
+      stop = p->frames.back().fp;
+
+   while((fp = JS_FrameIterator(cx, &iter)) && fp != stop)
+   {
+      JSFunction *fun    = JS_GetFrameFunction(cx, fp);
+      JSScript   *script = JS_GetFrameScript(cx, fp);
+
+      if(!fun && !script)
+         continue;
+
+      std::string name;
+      Profiler_AppendName(name, fun ? JS_GetFunctionName(fun) : "(top)");
+
+      if(script)
+      {
+         const char *filename = JS_GetScriptFilename(cx, script);
+         char line[16];
+         sprintf(line, ":%u)", JS_GetScriptBaseLineNumber(cx, script));
+         name += " (";
+         Profiler_AppendName(name, filename ? filename : "?");
+         name += line;
+      }
+      names.push_back(name);
+   }
+
+   out = p->frames.empty() ? std::string() : p->frames.back().stack;
+
+   for(auto itr = names.rbegin(); itr != names.rend(); ++itr)
+   {
+      if(!out.empty())
+         out += ';';
+      out += *itr;
+   }
+
+   if(out.empty())
+      out = "(root)";
+}
+
+static void Profiler_Charge(profiler_t *p, const std::string &stack, unsigned int ms)
+{
+   if(ms)
+   {
+      p->stacks[stack] += ms;
+      p->attributedMS  += ms;
+   }
+}
+
+//
+// JSEngine_NativeName
+//
+// The name of the native being called: the function name, qualified by the
+// class of "this" when it is something more specific than an Object. Must be
+// called before the native sets its return value.
+//
+std::string JSEngine_NativeName(JSContext *cx, jsval *vp)
+{
+   std::string name;
+   JSFunction *fun;
+
+   if(JSVAL_IS_OBJECT(vp[1]) && !JSVAL_IS_NULL(vp[1]))
+   {
+      JSClass *clasp = JS_GET_CLASS(cx, JSVAL_TO_OBJECT(vp[1]));
+      if(clasp && strcmp(clasp->name, "Object") && !(clasp->flags & JSCLASS_IS_GLOBAL))
+      {
+         Profiler_AppendName(name, clasp->name);
+         name += '.';
+      }
+   }
+
+   if((fun = JS_ValueToFunction(cx, JS_CALLEE(cx, vp))))
+      Profiler_AppendName(name, JS_GetFunctionName(fun));
+   else
+      name += "native";
+
+   return name;
+}
+
+//=============================================================================
+//
+// Hooks
+//
+
+//
+// JSEngine_ProfilerSample
+//
+// Called from the operation callback; charges the time since the last sample
+// to the current stack once the sampling interval has passed.
+//
+void JSEngine_ProfilerSample(JSContext *cx)
+{
+   profiler_t  *p;
+   unsigned int now = Timer_getMS();
+
+   if(!(p = profiler) || now - p->lastSampleMS < p->intervalMS)
+      return;
+
+   std::string stack;
+   Profiler_Stack(p, cx, stack);
+
+   unsigned int ms = now - p->lastSampleMS;
+   Profiler_Charge(p, stack, ms);
+   p->results.jsMS += ms;
+   ++p->results.samples;
+   p->lastSampleMS = now;
+}
+
+//
+// JSEngine_ProfilerWait
+//
+// Called when the engine lock is released and retaken. Waiting time is kept
+// out of script samples and charged to the native doing the waiting.
+//
+void JSEngine_ProfilerWait(bool begin)
+{
+   profiler_t *p;
+
+   if(!(p = profiler))
+      return;
+
+   if(begin)
+      p->waitStartMS = Timer_getMS();
+   else if(p->waitStartMS)
+   {
+      unsigned int ms = Timer_getMS() - p->waitStartMS;
+
+      p->waitMS       += ms;
+      p->lastSampleMS += ms;
+      p->waitStartMS   = 0;
+   }
+}
+
+//
+// JSEngine_ProfileNative
+//
+// JSEngineWrapperFn calls natives through here while profiling.
+//
+JSBool JSEngine_ProfileNative(JSContext *cx, uintN argc, jsval *vp, JSFastNative fn)
+{
+   profiler_t  *p          = profiler;
+   unsigned int generation = profilerGeneration;
+   unsigned int now        = Timer_getMS();
+   std::string  caller;
+
+   Profiler_Stack(p, cx, caller);
+
+   // script time up to this call belongs to the caller
+   unsigned int ms = now - p->lastSampleMS;
+   Profiler_Charge(p, caller, ms);
+   p->results.jsMS += ms;
+   p->lastSampleMS  = now;
+
+   JSStackFrame *iter = nullptr;
+
+   profilerframe_t frame;
+   frame.cx                    = cx;
+   frame.fp                    = JS_FrameIterator(cx, &iter);
+   frame.name                  = JSEngine_NativeName(cx, vp);
+   frame.stack                 = caller + ";" + frame.name + " [native]";
+   frame.startMS               = now;
+   frame.attributedAtStart     = p->attributedMS;
+   frame.waitAttributedAtStart = p->waitAttributedMS;
+   frame.waitAtStart           = p->waitMS;
+   p->frames.push_back(frame);
+
+   JSBool ok;
+   try
+   {
+      ok = fn(cx, argc, vp);
+   }
+   catch(const JSEngineError &err)
+   {
+      ok = err.propagateToJS(cx);
+   }
+
+   // the native may have stopped the profiler
+   if(!(p = profiler) || profilerGeneration != generation || p->frames.empty())
+      return ok;
+
+   profilerframe_t &top = p->frames.back();
+   now = Timer_getMS();
+
+   // time charged while this native was on the stack belongs to its callees
+   unsigned int elapsed   = now - top.startMS;
+   unsigned int childMS   = p->attributedMS - top.attributedAtStart;
+   unsigned int childWait = p->waitAttributedMS - top.waitAttributedAtStart;
+   unsigned int wait      = p->waitMS - top.waitAtStart;
+   unsigned int self      = elapsed > childMS ? elapsed - childMS : 0;
+
+   wait = wait > childWait ? wait - childWait : 0;
+   if(wait > self)
+      wait = self;
+
+   Profiler_Charge(p, top.stack, self - wait);
+   if(wait)
+   {
+      Profiler_Charge(p, top.stack + ";[wait]", wait);
+      p->waitAttributedMS += wait;
+   }
+   p->results.nativeMS += self - wait;
+   p->results.waitMS   += wait;
+
+   profilenative_t &stats = p->results.natives[top.name];
+   ++stats.calls;
+   stats.ms     += self;
+   stats.waitMS += wait;
+
+   p->frames.pop_back();
+   p->lastSampleMS = now;
+
+   return ok;
+}
+
+//=============================================================================
+//
+// Control
+//
+
+//
+// JSEngine_StartProfiler
+//
+// Begin profiling the calling thread. Returns false if it already is.
+//
+bool JSEngine_StartProfiler(unsigned int intervalMS)
+{
+   if(profiler)
+      return false;
+
+   profiler = new profiler_t(intervalMS ? intervalMS : 1);
+   ++profilerGeneration;
+   jsengineProfiling = true;
+   JSEngine_UpdateOperationLimits();
+   return true;
+}
+
+//
+// JSEngine_StopProfiler
+//
+// Stop profiling the calling thread and write collapsed stacks to filename,
+// if it is not null. Returns false if the profiler was not running or the
+// file could not be written.
+//
+bool JSEngine_StopProfiler(const char *filename, profileresults_t &results)
+{
+   std::unique_ptr<profiler_t> p(profiler);
+
+   if(!p)
+      return false;
+
+   profiler = nullptr;
+   ++profilerGeneration;
+   jsengineProfiling = false;
+   JSEngine_UpdateOperationLimits();
+
+   results = p->results;
+   results.totalMS = Timer_getMS() - p->startMS;
+
+   if(!filename || !*filename)
+      return true;
+
+   std::ofstream out(filename);
+   if(!out)
+      return false;
+
+   for(auto itr = p->stacks.begin(); itr != p->stacks.end(); ++itr)
+      out << itr->first << ' ' << itr->second << '\n';
+
+   return !!out;
+}
+
+// EOF
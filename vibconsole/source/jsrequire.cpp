@@ -0,0 +1,459 @@
+/*
+
+  CommonJS Modules
+
+  require(id) loads a module file once and returns its module.exports. Each
+  module runs in a pooled sandbox parented to the global context, with these
+  globals of its own:
+    module     - { id, filename, exports }
+    exports    - the initial module.exports object
+    require    - resolves ids relative to this module's directory
+    __filename - full path of the module file
+    __dirname  - directory of the module file
+
+  Ids beginning with ./ or ../ are relative to the requiring module, or to
+  the working directory for require calls made outside of any module. Other
+  relative ids are looked up in the working directory and then in jslib. For
+  each candidate path, the path itself, path.js and path/index.js are tried
+  in that order.
+
+  Modules are cached by full path, so diamond dependencies run once. A module
+  that is required again while it is still loading, as happens with circular
+  dependencies, gets its exports as they stand at that point. Compilation
+  goes through the script cache, so unchanged modules are not recompiled
+  between runs either.
+
+  require.resolve(id) returns the path a module would be loaded from, and
+  require.stats() returns compile and run times and cache hits per module.
+  Core.clearModuleCache also empties the require cache.
+
+*/
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include <stdlib.h>
+
+#include "jsengine2.h"
+#include "jsnatives.h"
+#include "timer.h"
+
+struct requireentry_t
+{
+   jsval        module;    // the module object; rooted
+   bool         loading;   // set while the module body is running
+   unsigned int compileMS; // time spent compiling or loading from the script cache
+   unsigned int runMS;     // time spent running the body, including its own requires
+   unsigned int hits;      // requires satisfied from the cache
+};
+
+typedef std::map<std::string, requireentry_t *> requiremap_t;
+
+static JSENGINE_THREADLOCAL requiremap_t *requireCache;
+
+static JSBool Require_Require(JSContext *cx, uintN argc, jsval *vp);
+static JSBool Require_Resolve(JSContext *cx, uintN argc, jsval *vp);
+static JSBool Require_Stats(JSContext *cx, uintN argc, jsval *vp);
+
+static JSFunctionSpec requireJSMethods[] =
+{
+   JSE_FN("resolve", Require_Resolve, 1, 0, 0),
+   JSE_FN("stats",   Require_Stats,   0, 0, 0),
+   JS_FS_END
+};
+
+//=============================================================================
+//
+// Path Resolution
+//
+
+static bool Require_IsFile(const std::string &path)
+{
+#ifndef VIBC_NO_WIN32
+   struct _stat64 st;
+   return !_stat64(path.c_str(), &st) && (st.st_mode & _S_IFREG);
+#else
+   struct stat st;
+   return !stat(path.c_str(), &st) && S_ISREG(st.st_mode);
+#endif
+}
+
+static std::string Require_FullPath(const std::string &path)
+{
+#ifndef VIBC_NO_WIN32
+   char buf[_MAX_PATH];
+   if(_fullpath(buf, path.c_str(), _MAX_PATH))
+      return buf;
+#else
+   char *buf;
+   if((buf = realpath(path.c_str(), nullptr)))
+   {
+      std::string ret = buf;
+      free(buf);
+      return ret;
+   }
+#endif
+   return path;
+}
+
+static std::string Require_DirName(const std::string &path)
+{
+   size_t slash = path.find_last_of("/\\");
+   return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+static bool Require_IsAbsolute(const std::string &id)
+{
+   return (!id.empty() && (id[0] == '/' || id[0] == '\\')) ||
+          (id.size() >= 2 && isalpha(static_cast<unsigned char>(id[0])) && id[1] == ':');
+}
+
+static bool Require_TryPath(const std::string &path, std::string &out)
+{
+   static const char *suffixes[] = { "", ".js", "/index.js" };
+
+   for(size_t i = 0; i < sizeof(suffixes) / sizeof(*suffixes); i++)
+   {
+      std::string candidate = path + suffixes[i];
+      if(Require_IsFile(candidate))
+      {
+         out = Require_FullPath(candidate);
+         return true;
+      }
+   }
+   return false;
+}
+
+//
+// Find the file for a module id. basedir is the requiring module's
+// directory, or empty at the top level.
+//
+static bool Require_ResolvePath(const std::string &id, const std::string &basedir, std::string &out)
+{
+   if(Require_IsAbsolute(id))
+      return Require_TryPath(id, out);
+
+   bool dotted = (id.compare(0, 2, "./") == 0 || id.compare(0, 3, "../") == 0 ||
+                  id.compare(0, 2, ".\\") == 0 || id.compare(0, 3, "..\\") == 0);
+
+   if(dotted)
+      return Require_TryPath(basedir.empty() ? id : basedir + "/" + id, out);
+
+   return Require_TryPath(id, out) || Require_TryPath("jslib/" + id, out);
+}
+
+// Cache keys ignore case where the file system does
+static std::string Require_Key(const std::string &path)
+{
+   std::string key = path;
+#ifndef VIBC_NO_WIN32
+   for(auto itr = key.begin(); itr != key.end(); ++itr)
+      *itr = static_cast<char>(tolower(static_cast<unsigned char>(*itr)));
+#endif
+   return key;
+}
+
+//
+// The directory a require function resolves against is kept on the function
+// object itself; the top-level require has none.
+//
+static std::string Require_BaseDir(JSContext *cx, jsval fnval)
+{
+   jsval v = JSVAL_VOID;
+
+   if(JSVAL_IS_OBJECT(fnval) && !JSVAL_IS_NULL(fnval) &&
+      JS_GetProperty(cx, JSVAL_TO_OBJECT(fnval), "basedir", &v) && JSVAL_IS_STRING(v))
+   {
+      const char *str = JS_GetStringBytes(JSVAL_TO_STRING(v));
+      if(str)
+         return str;
+   }
+   return std::string();
+}
+
+static std::string Require_ResolveArg(JSContext *cx, jsval fnval, jsval *argv)
+{
+   const char *id = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   std::string path;
+
+   if(!Require_ResolvePath(id, Require_BaseDir(cx, fnval), path))
+      throw JSEngineError(std::string("Cannot find module '") + id + "'");
+
+   return path;
+}
+
+//=============================================================================
+//
+// Loading
+//
+
+//
+// Make a require function for a module in the given directory, rooted by
+// the caller's AutoNamedRoot.
+//
+static JSObject *Require_NewFunction(JSContext *cx, JSObject *parent, const std::string &basedir,
+                                     AutoNamedRoot &anr)
+{
+   JSFunction *fun;
+   if(!(fun = JS_NewFunction(cx, (JSNative)JSE_WRAP(Require_Require), 1, JSFUN_FAST_NATIVE, parent, "require")))
+      throw JSEngineError("Out of memory", true);
+
+   JSObject *obj = JS_GetFunctionObject(fun);
+   anr.init(cx, obj, "Require_NewFunction");
+
+   JSString *dir = AssertJSNewStringCopyZ(cx, basedir.c_str());
+   AssertJSDefineProperty(cx, obj, "basedir", STRING_TO_JSVAL(dir), nullptr, nullptr,
+                          JSPROP_READONLY | JSPROP_PERMANENT);
+   AssertJSDefineFunctions(cx, obj, requireJSMethods);
+
+   return obj;
+}
+
+static void Require_Remove(requiremap_t::iterator itr)
+{
+   JS_RemoveRoot(JSEngine_GetGlobalContext()->getContext(), &itr->second->module);
+   delete itr->second;
+   requireCache->erase(itr);
+}
+
+//
+// Get module.exports for a cache entry.
+//
+static jsval Require_Exports(JSContext *cx, requireentry_t *entry)
+{
+   jsval exports = JSVAL_VOID;
+   JS_GetProperty(cx, JSVAL_TO_OBJECT(entry->module), "exports", &exports);
+   return exports;
+}
+
+//
+// Set up the module's sandbox and run it. The entry's module object is
+// already rooted.
+//
+static bool Require_Run(const std::string &path, requireentry_t *entry)
+{
+   AutoPooledContext ecx(JSEngine_AcquireSandbox());
+   JSContext *cx     = ecx->getContext();
+   JSObject  *global = ecx->getGlobal();
+   std::string dir   = Require_DirName(path);
+
+   JSObject *moduleObj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   entry->module = OBJECT_TO_JSVAL(moduleObj);
+
+   JSObject *exportsObj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AssertJSDefineProperty(cx, moduleObj, "exports", OBJECT_TO_JSVAL(exportsObj), nullptr, nullptr, JSPROP_ENUMERATE);
+
+   JSString *file = AssertJSNewStringCopyZ(cx, path.c_str());
+   AssertJSDefineProperty(cx, moduleObj, "id",       STRING_TO_JSVAL(file), nullptr, nullptr, JSPROP_ENUMERATE);
+   AssertJSDefineProperty(cx, moduleObj, "filename", STRING_TO_JSVAL(file), nullptr, nullptr, JSPROP_ENUMERATE);
+
+   JSString *dirStr = AssertJSNewStringCopyZ(cx, dir.c_str());
+   AssertJSDefineProperty(cx, global, "__filename", STRING_TO_JSVAL(file),   nullptr, nullptr, 0);
+   AssertJSDefineProperty(cx, global, "__dirname",  STRING_TO_JSVAL(dirStr), nullptr, nullptr, 0);
+   AssertJSDefineProperty(cx, global, "module",     entry->module,           nullptr, nullptr, 0);
+   AssertJSDefineProperty(cx, global, "exports",    OBJECT_TO_JSVAL(exportsObj), nullptr, nullptr, 0);
+
+   AutoNamedRoot anr;
+   JSObject *requireObj = Require_NewFunction(cx, global, dir, anr);
+   AssertJSDefineProperty(cx, global, "require", OBJECT_TO_JSVAL(requireObj), nullptr, nullptr, 0);
+
+   unsigned int startTime = Timer_getMS();
+   JSScript *script;
+   JSObject *scriptObj;
+
+   if(!(script = JSEngine_CompileFileCached(cx, global, path.c_str())))
+      return false;
+
+   if(!(scriptObj = JS_NewScriptObject(cx, script)))
+   {
+      JS_DestroyScript(cx, script);
+      return false;
+   }
+
+   AutoNamedRoot root(cx, scriptObj, "Require_Run");
+
+   entry->compileMS = Timer_getMS() - startTime;
+   startTime = Timer_getMS();
+
+   jsval rval = JSVAL_VOID;
+   bool ok = (JS_ExecuteScript(cx, global, script, &rval) == JS_TRUE);
+
+   entry->runMS = Timer_getMS() - startTime;
+   return ok;
+}
+
+//
+// Return the exports of the module at the given full path, loading it first
+// if it is not in the cache.
+//
+static jsval Require_Load(JSContext *cx, const std::string &path)
+{
+   std::string key = Require_Key(path);
+
+   if(!requireCache)
+      requireCache = new requiremap_t();
+
+   requiremap_t::iterator itr = requireCache->find(key);
+   if(itr != requireCache->end())
+   {
+      ++itr->second->hits;
+      return Require_Exports(cx, itr->second);
+   }
+
+   requireentry_t *entry = new requireentry_t;
+   entry->module    = JSVAL_NULL;
+   entry->loading   = true;
+   entry->compileMS = entry->runMS = entry->hits = 0;
+
+   if(!JS_AddNamedRoot(JSEngine_GetGlobalContext()->getContext(), &entry->module, "Require_Load"))
+   {
+      delete entry;
+      throw JSEngineError("Out of memory", true);
+   }
+   itr = requireCache->insert(requiremap_t::value_type(key, entry)).first;
+
+   bool ok;
+   try
+   {
+      ok = Require_Run(path, entry);
+   }
+   catch(const JSEngineError &)
+   {
+      Require_Remove(itr);
+      throw;
+   }
+
+   if(!ok)
+   {
+      Require_Remove(itr);
+      throw JSEngineError("Module evaluation failed: " + path);
+   }
+
+   entry->loading = false;
+   return Require_Exports(cx, entry);
+}
+
+//=============================================================================
+//
+// Natives
+//
+
+//
+// require(id)
+//
+static JSBool Require_Require(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   ASSERT_ARGC_GE(argc, 1, "require");
+
+   std::string path = Require_ResolveArg(cx, JS_CALLEE(cx, vp), argv);
+   JS_SET_RVAL(cx, vp, Require_Load(cx, path));
+   return JS_TRUE;
+}
+
+//
+// require.resolve(id)
+//
+static JSBool Require_Resolve(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   ASSERT_ARGC_GE(argc, 1, "resolve");
+
+   std::string path = Require_ResolveArg(cx, JS_THIS(cx, vp), argv);
+   JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(AssertJSNewStringCopyZ(cx, path.c_str())));
+   return JS_TRUE;
+}
+
+//
+// require.stats()
+//
+// Returns { path: { compileMS, runMS, hits }, ... } for every cached module.
+//
+static JSBool Require_Stats(JSContext *cx, uintN argc, jsval *vp)
+{
+   JSObject *obj = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+   AutoNamedRoot anr(cx, obj, "RequireStats");
+
+   if(requireCache)
+   {
+      for(auto itr = requireCache->begin(); itr != requireCache->end(); ++itr)
+      {
+         requireentry_t *entry = itr->second;
+         std::map<std::string, unsigned int> fields;
+         fields["compileMS"] = entry->compileMS;
+         fields["runMS"    ] = entry->runMS;
+         fields["hits"     ] = entry->hits;
+
+         JSObject *modStats = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+         if(!JS_DefineProperty(cx, obj, itr->first.c_str(), OBJECT_TO_JSVAL(modStats), nullptr, nullptr, JSPROP_ENUMERATE))
+            throw JSEngineError("Out of memory");
+
+         for(auto fitr = fields.begin(); fitr != fields.end(); ++fitr)
+         {
+            jsval v;
+            if(!JS_NewNumberValue(cx, fitr->second, &v) ||
+               !JS_DefineProperty(cx, modStats, fitr->first.c_str(), v, nullptr, nullptr, JSPROP_ENUMERATE))
+               throw JSEngineError("Out of memory");
+         }
+      }
+   }
+
+   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+   return JS_TRUE;
+}
+
+//
+// JSEngine_ClearRequireCache
+//
+// Forget all modules loaded by require, except those still loading. Called
+// by Core.clearModuleCache, and with shutdown true before the global context
+// is destroyed.
+//
+void JSEngine_ClearRequireCache(bool shutdown)
+{
+   if(!requireCache)
+      return;
+
+   requiremap_t::iterator itr = requireCache->begin();
+   while(itr != requireCache->end())
+   {
+      requiremap_t::iterator cur = itr++;
+      if(shutdown || !cur->second->loading)
+         Require_Remove(cur);
+   }
+
+   if(shutdown)
+   {
+      delete requireCache;
+      requireCache = nullptr;
+   }
+}
+
+//
+// The top-level require resolves relative ids against the working
+// directory.
+//
+static NativeInitCode Require_Create(JSContext *cx, JSObject *global)
+{
+   try
+   {
+      AutoNamedRoot anr;
+      JSObject *requireObj = Require_NewFunction(cx, global, std::string(), anr);
+      if(!JS_DefineProperty(cx, global, "require", OBJECT_TO_JSVAL(requireObj), nullptr, nullptr, 0))
+         return RESOLUTIONERROR;
+   }
+   catch(const JSEngineError &)
+   {
+      return RESOLUTIONERROR;
+   }
+
+   return RESOLVED;
+}
+
+static Native requireGlobalNative("require", Require_Create);
+
+// EOF
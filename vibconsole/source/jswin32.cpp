@@ -111,6 +111,7 @@ static JSBool JSWin_Exec(JSContext *cx, uintN argc, jsval *vp)
    {
       if(waitOnProc)
       {
+         JSEngineUnlocked unlocked;
          WaitForSingleObject(procInfo.hProcess, INFINITE);
          GetExitCodeProcess(procInfo.hProcess, &exitCode);
       }
@@ -145,7 +146,10 @@ JSBool JSWin_Shell(JSContext *cx, uintN argc, jsval *vp)
                            &startupInfo, &procInfo);   
    if(result)
    {
-      WaitForSingleObject(procInfo.hProcess, INFINITE);
+      {
+         JSEngineUnlocked unlocked;
+         WaitForSingleObject(procInfo.hProcess, INFINITE);
+      }
       CloseHandle(procInfo.hProcess);
       CloseHandle(procInfo.hThread);
    }
@@ -655,7 +659,10 @@ static JSBool Timer_Delay(JSContext *cx, uintN argc, jsval *vp)
    ASSERT_ARGC_GE(argc, 1, "delay");
    JS_ValueToECMAInt32(cx, argv[0], &ms);
 
-   Sleep(static_cast<DWORD>(ms));
+   {
+      JSEngineUnlocked unlocked;
+      Sleep(static_cast<DWORD>(ms));
+   }
    JS_SET_RVAL(cx, vp, JSVAL_VOID);
    return JS_TRUE;
 }
@@ -0,0 +1,984 @@
+/*
+
+  Workers
+
+  new Worker(filename) runs a script on a pool thread, in a global context of
+  its own with extensions.js loaded. The two sides talk by postMessage; what
+  is posted is copied, not shared:
+    - strings are copied as they are
+    - a ByteBuffer is transferred; the sender's buffer is left empty
+    - anything else goes through JSON.stringify and JSON.parse
+
+  Inside the worker, postMessage(value) and close() are globals, and after the
+  script returns, messages from the parent are passed to onmessage({data})
+  until close() is called, the parent calls terminate(), or there is no
+  onmessage function left.
+
+  On the parent side, a Worker's onmessage({data}) and onerror({message}) are
+  called from the event loop, or receive([ms]) can be used to wait for the
+  next message directly. join([ms]) waits for the worker to finish.
+
+  The parent-side Worker object is kept alive until the worker finishes, so
+  that its handlers are still called when the script keeps no reference to
+  it; letting go of it does not stop the worker. terminate() does: a running
+  script is interrupted at its next operation callback, and no more events
+  are delivered to the Worker object afterward.
+
+  Each pool thread owns its own runtime, and threads take turns through the
+  engine lock (see jsengine2.cpp), which natives release around blocking I/O
+  such as CURL transfers and ADO commands. Scripts that mostly wait on such
+  I/O therefore overlap well; scripts that mostly compute do not run any
+  faster than they would in turn. Database calls through VisualIB keep the
+  lock, as VisualIB.dll may only be entered by one thread at a time (its
+  last error, for one, is process-wide), so workers take turns querying.
+
+  The pool size is set by the [workers] section of options.ini:
+    threads = maximum number of pool threads (default: number of CPUs)
+
+  Workers beyond that wait for a thread to come free, so a worker that never
+  finishes holds on to its thread.
+
+*/
+
+#include <deque>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+#ifndef VIBC_NO_WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <objbase.h>
+#endif
+
+#include "jsengine2.h"
+#include "jsnatives.h"
+#include "inifile.h"
+#include "main.h"
+#include "timer.h"
+#include "util.h"
+
+#ifndef VIBC_NO_WIN32
+
+//=============================================================================
+//
+// Messages
+//
+
+struct workermessage_t
+{
+   enum
+   {
+      MSG_UNDEFINED,
+      MSG_STRING,    // text is the string
+      MSG_JSON,      // text is JSON to parse
+      MSG_BUFFER,    // memory and size came from a transferred ByteBuffer
+      MSG_ERROR      // text is an error message
+   };
+
+   int                 type;
+   std::vector<jschar> text;
+   unsigned char      *memory;
+   size_t              size;
+
+   workermessage_t(int pType = MSG_UNDEFINED) : type(pType), text(), memory(nullptr), size(0)
+   {
+   }
+
+   ~workermessage_t()
+   {
+      if(memory)
+         free(memory);
+   }
+};
+
+//
+// A message queue between two threads. The event is set whenever a message
+// is pushed.
+//
+class WorkerQueue
+{
+protected:
+   CRITICAL_SECTION                lock;
+   HANDLE                          event;
+   std::deque<workermessage_t *>   items;
+
+   WorkerQueue(const WorkerQueue &other); // Not copyable.
+
+public:
+   WorkerQueue() : items()
+   {
+      InitializeCriticalSection(&lock);
+      event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+   }
+
+   ~WorkerQueue()
+   {
+      for(auto itr = items.begin(); itr != items.end(); ++itr)
+         delete *itr;
+      CloseHandle(event);
+      DeleteCriticalSection(&lock);
+   }
+
+   void push(workermessage_t *msg)
+   {
+      EnterCriticalSection(&lock);
+      items.push_back(msg);
+      LeaveCriticalSection(&lock);
+      SetEvent(event);
+   }
+
+   // Returns nullptr if the queue is empty; the caller owns the message
+   workermessage_t *pop()
+   {
+      workermessage_t *msg = nullptr;
+
+      EnterCriticalSection(&lock);
+      if(!items.empty())
+      {
+         msg = items.front();
+         items.pop_front();
+      }
+      LeaveCriticalSection(&lock);
+
+      return msg;
+   }
+
+   HANDLE getEvent() const { return event; }
+};
+
+//
+// State shared by the parent-side Worker object and the pool thread running
+// it.
+//
+class WorkerState
+{
+private:
+   WorkerState(const WorkerState &other); // Not copyable.
+
+public:
+   std::string   filename;
+   WorkerQueue   inbox;     // parent -> worker
+   WorkerQueue   outbox;    // worker -> parent
+   WorkerQueue   errors;    // worker -> parent, for onerror
+   HANDLE        doneEvent; // set when the worker has finished
+   volatile LONG terminate; // stop as soon as possible
+   volatile LONG finished;
+   bool          closing;   // close() was called; worker thread only
+   bool          hadError;  // an error was posted; worker thread only
+   JSObject     *obj;       // parent-side Worker object, rooted until reaped
+   JSContext    *rootcx;    // context in which the root was added
+
+   WorkerState(const char *pFilename)
+      : filename(pFilename), terminate(0), finished(0), closing(false), hadError(false),
+        obj(nullptr), rootcx(nullptr)
+   {
+      doneEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+   }
+
+   ~WorkerState()
+   {
+      CloseHandle(doneEvent);
+   }
+};
+
+typedef std::shared_ptr<WorkerState> WorkerStatePtr;
+
+static HANDLE workerWakeEvent; // set whenever the parent has something to do
+
+static void Worker_WakeParent()
+{
+   if(workerWakeEvent)
+      SetEvent(workerWakeEvent);
+}
+
+static void Worker_PostError(WorkerState *state, const std::string &text)
+{
+   std::unique_ptr<workermessage_t> msg(new workermessage_t(workermessage_t::MSG_ERROR));
+   msg->text.assign(text.begin(), text.end());
+
+   state->hadError = true;
+   state->errors.push(msg.release());
+   Worker_WakeParent();
+}
+
+static void Worker_CopyChars(JSString *str, std::vector<jschar> &out)
+{
+   const jschar *chars = JS_GetStringChars(str);
+   out.assign(chars, chars + JS_GetStringLength(str));
+}
+
+static JSObject *Worker_GetJSON(JSContext *cx)
+{
+   jsval json = JSVAL_VOID;
+
+   if(!JS_GetProperty(cx, JS_GetGlobalObject(cx), "JSON", &json) ||
+      JSVAL_IS_PRIMITIVE(json))
+      throw JSEngineError("JSON is not available");
+
+   return JSVAL_TO_OBJECT(json);
+}
+
+//
+// Copy a value out of the sender's runtime.
+//
+static workermessage_t *Worker_Serialize(JSContext *cx, jsval v)
+{
+   std::unique_ptr<workermessage_t> msg(new workermessage_t());
+
+   if(JSVAL_IS_STRING(v))
+   {
+      msg->type = workermessage_t::MSG_STRING;
+      Worker_CopyChars(JSVAL_TO_STRING(v), msg->text);
+   }
+   else if(SafeInstanceOf(cx, NativeByteBuffer::GetJSClass(), v))
+   {
+      auto nbb = PrivateData::MustGetFromJSObject<NativeByteBuffer>(cx, JSVAL_TO_OBJECT(v));
+
+      msg->type   = workermessage_t::MSG_BUFFER;
+      msg->memory = nbb->detach(msg->size);
+   }
+   else if(!JSVAL_IS_VOID(v))
+   {
+      jsval rval = JSVAL_VOID;
+
+      if(!JS_CallFunctionName(cx, Worker_GetJSON(cx), "stringify", 1, &v, &rval))
+         throw JSEngineError("postMessage: value cannot be cloned");
+
+      if(JSVAL_IS_STRING(rval))
+      {
+         msg->type = workermessage_t::MSG_JSON;
+         Worker_CopyChars(JSVAL_TO_STRING(rval), msg->text);
+      }
+   }
+
+   return msg.release();
+}
+
+//
+// Recreate a message's value in the receiver's runtime. Must be called inside
+// a local root scope.
+//
+static jsval Worker_Deserialize(JSContext *cx, workermessage_t *msg)
+{
+   jsval v = JSVAL_VOID;
+
+   switch(msg->type)
+   {
+   case workermessage_t::MSG_STRING:
+   case workermessage_t::MSG_JSON:
+   case workermessage_t::MSG_ERROR:
+      {
+         JSString *str = JS_NewUCStringCopyN(cx, msg->text.empty() ? nullptr : &msg->text[0], msg->text.size());
+         if(!str)
+            throw JSEngineError("Out of memory", true);
+         v = STRING_TO_JSVAL(str);
+
+         jsval parsed = JSVAL_VOID;
+         if(msg->type == workermessage_t::MSG_JSON)
+         {
+            if(!JS_CallFunctionName(cx, Worker_GetJSON(cx), "parse", 1, &v, &parsed))
+               throw JSEngineError("Worker: message could not be parsed");
+            v = parsed;
+         }
+      }
+      break;
+
+   case workermessage_t::MSG_BUFFER:
+      {
+         std::unique_ptr<NativeByteBuffer> nbb(new NativeByteBuffer(msg->memory, msg->size));
+         msg->memory = nullptr;
+
+         AutoNamedRoot anr;
+         JSObject *obj = NativeByteBuffer::ExternalCreate(cx, nbb.get(), anr);
+         if(!obj)
+            throw JSEngineError("Out of memory", true);
+         nbb.release();
+         v = OBJECT_TO_JSVAL(obj);
+      }
+      break;
+
+   default:
+      break;
+   }
+
+   return v;
+}
+
+//
+// Call handler({data}) or, for errors, handler({message}).
+//
+static void Worker_Dispatch(JSContext *cx, JSObject *thisObj, jsval handler, workermessage_t *msg)
+{
+   AutoNamedRoot handlerRoot(cx, JSVAL_TO_OBJECT(handler), "WorkerHandler");
+   AutoNamedRoot eventRoot;
+   JSObject     *evt;
+
+   {
+      // the scope is left before calling out, so the handler's garbage isn't
+      // kept alive with it
+      AutoLocalRootScope scope(cx);
+
+      evt = AssertJSNewObject(cx, nullptr, nullptr, nullptr);
+      jsval data = Worker_Deserialize(cx, msg);
+
+      AssertJSDefineProperty(cx, evt, msg->type == workermessage_t::MSG_ERROR ? "message" : "data",
+                             data, nullptr, nullptr, JSPROP_ENUMERATE);
+      eventRoot.init(cx, evt, "WorkerEvent");
+   }
+
+   jsval argv = OBJECT_TO_JSVAL(evt);
+   jsval rval = JSVAL_VOID;
+
+   if(!JS_CallFunctionValue(cx, thisObj, handler, 1, &argv, &rval))
+      JS_ReportPendingException(cx);
+}
+
+//=============================================================================
+//
+// Thread Pool
+//
+// Pool data is only touched while holding the engine lock.
+//
+
+static std::deque<WorkerStatePtr> poolQueue;
+static std::vector<HANDLE>        poolThreads;
+static HANDLE                     poolSemaphore;
+static unsigned int               poolMaxThreads;
+static unsigned int               poolIdleThreads;
+static bool                       poolStop;
+
+static __declspec(thread) WorkerState *currentWorker;
+static JSErrorReporter                 workerBaseReporter;
+
+//
+// Error reporter for worker contexts; reports as usual, then passes errors on
+// to the parent's onerror.
+//
+static void Worker_ErrorReport(JSContext *cx, const char *message, JSErrorReport *report)
+{
+   if(workerBaseReporter)
+      workerBaseReporter(cx, message, report);
+
+   if(currentWorker && !(report && JSREPORT_IS_WARNING(report->flags)))
+   {
+      std::string text;
+
+      if(report && report->filename)
+      {
+         text = report->filename;
+         if(report->lineno)
+            text += " @ line " + IntToString(static_cast<int>(report->lineno));
+         text += ": ";
+      }
+      text += message;
+
+      Worker_PostError(currentWorker, text);
+   }
+}
+
+//
+// postMessage(value), in a worker
+//
+static JSBool WorkerGlobal_PostMessage(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+
+   if(!currentWorker)
+      throw JSEngineError("postMessage: not running in a Worker");
+
+   currentWorker->outbox.push(Worker_Serialize(cx, argc >= 1 ? argv[0] : JSVAL_VOID));
+   Worker_WakeParent();
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// close(), in a worker: finish once the current script or handler returns.
+//
+static JSBool WorkerGlobal_Close(JSContext *cx, uintN argc, jsval *vp)
+{
+   if(currentWorker)
+      currentWorker->closing = true;
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+static JSFunctionSpec workerGlobalJSMethods[] =
+{
+   JSE_FN("postMessage", WorkerGlobal_PostMessage, 1, 0, 0),
+   JSE_FN("close",       WorkerGlobal_Close,       0, 0, 0),
+   JS_FS_END
+};
+
+//
+// Pass messages from the parent to onmessage until there is no reason to
+// wait for more.
+//
+static void Worker_MessageLoop(JSContext *cx, JSObject *global, WorkerState *state)
+{
+   while(!state->terminate && !state->closing)
+   {
+      jsval handler = JSVAL_VOID;
+
+      if(!JS_GetProperty(cx, global, "onmessage", &handler) ||
+         JS_TypeOfValue(cx, handler) != JSTYPE_FUNCTION)
+         break; // nothing could ever run again
+
+      std::unique_ptr<workermessage_t> msg(state->inbox.pop());
+      if(!msg)
+      {
+         JSEngineUnlocked unlocked;
+         WaitForSingleObject(state->inbox.getEvent(), INFINITE);
+         continue;
+      }
+
+      try
+      {
+         Worker_Dispatch(cx, global, handler, msg.get());
+      }
+      catch(const JSEngineError &err)
+      {
+         err.propagateToJS(cx);
+         JS_ReportPendingException(cx);
+      }
+   }
+}
+
+//
+// Run one worker to completion on the calling pool thread.
+//
+static void Worker_Run(WorkerState *state)
+{
+   if(state->terminate)
+      return;
+
+   currentWorker = state;
+   JSEngine_SetTerminateFlag(&state->terminate);
+
+   if(JSEngine_NewWorkerContext())
+   {
+      JSEvalContext *ecx    = JSEngine_GetGlobalContext();
+      JSContext     *cx     = ecx->getContext();
+      JSObject      *global = ecx->getGlobal();
+
+      JSErrorReporter prev = JS_SetErrorReporter(cx, Worker_ErrorReport);
+      if(prev != Worker_ErrorReport)
+         workerBaseReporter = prev;
+
+      jsval rval = JSVAL_VOID;
+      if(!JS_DefineFunctions(cx, global, workerGlobalJSMethods))
+         Worker_PostError(state, "Worker: cannot define worker globals");
+      else if(JSEngine_EvaluateFileInContext(ecx, state->filename.c_str(), &rval))
+         Worker_MessageLoop(cx, global, state);
+      else if(!state->hadError && !state->terminate)
+         Worker_PostError(state, "Worker: cannot run " + state->filename);
+
+      JSEngine_DestroyWorkerContext();
+   }
+   else
+      Worker_PostError(state, "Worker: cannot create a context");
+
+   JSEngine_SetTerminateFlag(nullptr);
+   currentWorker = nullptr;
+}
+
+static void Worker_Finish(WorkerState *state)
+{
+   InterlockedExchange(&state->finished, 1);
+   SetEvent(state->doneEvent);
+   Worker_WakeParent();
+}
+
+//
+// Pool thread. Holds the engine lock except while waiting for work.
+//
+static DWORD WINAPI Worker_PoolThread(LPVOID)
+{
+   // ADO objects created by scripts need COM on this thread
+   CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+
+   JSEngine_Lock();
+
+   bool haveRuntime = JSEngine_InitWorkerThread();
+
+   while(!poolStop)
+   {
+      ++poolIdleThreads;
+      {
+         JSEngineUnlocked unlocked;
+         WaitForSingleObject(poolSemaphore, INFINITE);
+      }
+      --poolIdleThreads;
+
+      if(poolStop || poolQueue.empty())
+         continue;
+
+      WorkerStatePtr state = poolQueue.front();
+      poolQueue.pop_front();
+
+      if(haveRuntime)
+         Worker_Run(state.get());
+      else
+         Worker_PostError(state.get(), "Worker: cannot create a runtime");
+
+      Worker_Finish(state.get());
+   }
+
+   JSEngine_ShutdownWorkerThread();
+   JSEngine_Unlock();
+
+   CoUninitialize();
+   return 0;
+}
+
+static unsigned int Worker_PoolSize()
+{
+   IniFile::IniMap &ini = IniFile::GetIniOptions();
+   IniFile::IniMap::iterator itr = ini.find("workers");
+
+   if(itr != ini.end())
+   {
+      IniFile::IniValue &section = itr->second;
+
+      if(section.find("threads") != section.end() && atoi(section["threads"].c_str()) > 0)
+         return static_cast<unsigned int>(atoi(section["threads"].c_str()));
+   }
+
+   SYSTEM_INFO si;
+   GetSystemInfo(&si);
+   return si.dwNumberOfProcessors ? si.dwNumberOfProcessors : 1;
+}
+
+//
+// Queue a worker to run, starting another pool thread if none is free.
+//
+static void Worker_Start(const WorkerStatePtr &state)
+{
+   if(!poolSemaphore)
+   {
+      poolMaxThreads  = Worker_PoolSize();
+      poolSemaphore   = CreateSemaphore(nullptr, 0, 0x7fffffff, nullptr);
+      workerWakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+
+      if(!poolSemaphore || !workerWakeEvent)
+         throw JSEngineError("Worker: cannot create thread pool");
+   }
+
+   poolQueue.push_back(state);
+
+   if(poolIdleThreads < poolQueue.size() && poolThreads.size() < poolMaxThreads)
+   {
+      HANDLE thread = CreateThread(nullptr, 0, Worker_PoolThread, nullptr, 0, nullptr);
+      if(thread)
+         poolThreads.push_back(thread);
+      else if(poolThreads.empty())
+      {
+         poolQueue.pop_back();
+         throw JSEngineError("Worker: cannot create thread");
+      }
+   }
+
+   ReleaseSemaphore(poolSemaphore, 1, nullptr);
+}
+
+//=============================================================================
+//
+// Worker Class
+//
+
+static std::list<WorkerStatePtr> liveWorkers; // rooted parent-side workers
+
+class PrivateWorker : public PrivateData
+{
+   DECLARE_PRIVATE_DATA()
+
+public:
+   WorkerStatePtr state;
+
+   PrivateWorker(const WorkerStatePtr &pState) : PrivateData(), state(pState)
+   {
+   }
+};
+
+static void Worker_Unroot(WorkerState *state)
+{
+   if(state->obj)
+   {
+      JS_RemoveRoot(state->rootcx, &state->obj);
+      state->obj    = nullptr;
+      state->rootcx = nullptr;
+   }
+}
+
+//
+// Worker_New - JS Constructor
+//
+// new Worker(filename)
+//
+static JSBool Worker_New(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+   ASSERT_IS_CONSTRUCTING(cx, "Worker");
+   ASSERT_ARGC_GE(argc, 1, "Worker");
+
+   const char *filename = SafeGetStringBytes(cx, argv[0], &argv[0]);
+   if(!filename)
+      throw JSEngineError("Worker: invalid filename");
+
+   WorkerStatePtr state(new WorkerState(filename));
+   std::unique_ptr<PrivateWorker> pw(new PrivateWorker(state));
+   pw->setToJSObjectAndRelease(cx, obj, pw);
+
+   // keep the object alive while it can still receive events, rooted in the
+   // global context where they are dispatched
+   JSContext *gcx = JSEngine_GetGlobalContext()->getContext();
+   state->obj = obj;
+   if(!JS_AddNamedRoot(gcx, &state->obj, "Worker"))
+   {
+      state->obj = nullptr;
+      throw JSEngineError("Failed to create named GC root");
+   }
+   state->rootcx = gcx;
+   liveWorkers.push_back(state);
+
+   try
+   {
+      Worker_Start(state);
+   }
+   catch(const JSEngineError &)
+   {
+      Worker_Finish(state.get());
+      throw;
+   }
+
+   *rval = JSVAL_VOID;
+   return JS_TRUE;
+}
+
+//
+// Worker_Finalize
+//
+// Only reached once the worker has finished or been terminated, or the
+// runtime is going away; in any case, tell it to stop.
+//
+static void Worker_Finalize(JSContext *cx, JSObject *obj)
+{
+   auto priv = PrivateData::GetFromJSObject<PrivateWorker>(cx, obj);
+
+   if(priv)
+   {
+      InterlockedExchange(&priv->state->terminate, 1);
+      SetEvent(priv->state->inbox.getEvent());
+      delete priv;
+      JS_SetPrivate(cx, obj, nullptr);
+   }
+}
+
+static JSClass workerClass =
+{
+   "Worker",
+   JSCLASS_HAS_PRIVATE,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_PropertyStub,
+   JS_EnumerateStub,
+   JS_ResolveStub,
+   JS_ConvertStub,
+   Worker_Finalize,
+   JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+DEFINE_PRIVATE_DATA(PrivateWorker, workerClass)
+
+//
+// postMessage(value)
+//
+static JSBool Worker_PostMessage(JSContext *cx, uintN argc, jsval *vp)
+{
+   jsval *argv = JS_ARGV(cx, vp);
+   auto   priv = PrivateData::MustGetFromThis<PrivateWorker>(cx, vp);
+
+   priv->state->inbox.push(Worker_Serialize(cx, argc >= 1 ? argv[0] : JSVAL_VOID));
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// terminate(): stop the worker at its next opportunity. Nothing more is
+// dispatched to onmessage or onerror, so the object is no longer kept alive
+// on the worker's behalf; receive() still returns what was already posted.
+//
+static JSBool Worker_Terminate(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivateWorker>(cx, vp);
+
+   InterlockedExchange(&priv->state->terminate, 1);
+   SetEvent(priv->state->inbox.getEvent());
+   Worker_Unroot(priv->state.get());
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// isRunning()
+//
+static JSBool Worker_IsRunning(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto priv = PrivateData::MustGetFromThis<PrivateWorker>(cx, vp);
+
+   JS_SET_RVAL(cx, vp, priv->state->finished ? JSVAL_FALSE : JSVAL_TRUE);
+   return JS_TRUE;
+}
+
+static DWORD Worker_TimeoutArg(JSContext *cx, uintN argc, jsval *argv)
+{
+   int32 ms = -1;
+
+   if(argc >= 1 && !JS_ValueToECMAInt32(cx, argv[0], &ms))
+      throw JSEngineError("Invalid timeout");
+
+   return ms < 0 ? INFINITE : static_cast<DWORD>(ms);
+}
+
+//
+// receive([ms])
+//
+// Wait for the next message from the worker and return its value. Returns
+// undefined on timeout, or once the worker has finished and nothing is left.
+//
+static JSBool Worker_Receive(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto  priv    = PrivateData::MustGetFromThis<PrivateWorker>(cx, vp);
+   DWORD timeout = Worker_TimeoutArg(cx, argc, JS_ARGV(cx, vp));
+   auto &state   = priv->state;
+
+   unsigned int startTime = Timer_getMS();
+
+   for(;;)
+   {
+      std::unique_ptr<workermessage_t> msg(state->outbox.pop());
+      if(msg)
+      {
+         AutoLocalRootScope scope(cx);
+         jsval v = Worker_Deserialize(cx, msg.get());
+         scope.leaveWithResult(v);
+         JS_SET_RVAL(cx, vp, v);
+         return JS_TRUE;
+      }
+
+      if(state->finished)
+         break;
+
+      DWORD wait = INFINITE;
+      if(timeout != INFINITE)
+      {
+         unsigned int elapsed = Timer_getMS() - startTime;
+         if(elapsed >= timeout)
+            break;
+         wait = timeout - elapsed;
+      }
+
+      HANDLE handles[2] = { state->outbox.getEvent(), state->doneEvent };
+      JSEngineUnlocked unlocked;
+      WaitForMultipleObjects(2, handles, FALSE, wait);
+   }
+
+   JS_SET_RVAL(cx, vp, JSVAL_VOID);
+   return JS_TRUE;
+}
+
+//
+// join([ms])
+//
+// Wait for the worker to finish. Returns true if it has.
+//
+static JSBool Worker_Join(JSContext *cx, uintN argc, jsval *vp)
+{
+   auto  priv    = PrivateData::MustGetFromThis<PrivateWorker>(cx, vp);
+   DWORD timeout = Worker_TimeoutArg(cx, argc, JS_ARGV(cx, vp));
+   DWORD res;
+
+   {
+      JSEngineUnlocked unlocked;
+      res = WaitForSingleObject(priv->state->doneEvent, timeout);
+   }
+
+   JS_SET_RVAL(cx, vp, res == WAIT_OBJECT_0 ? JSVAL_TRUE : JSVAL_FALSE);
+   return JS_TRUE;
+}
+
+static JSFunctionSpec workerJSMethods[] =
+{
+   JSE_FN("postMessage", Worker_PostMessage, 1, 0, 0),
+   JSE_FN("terminate",   Worker_Terminate,   0, 0, 0),
+   JSE_FN("isRunning",   Worker_IsRunning,   0, 0, 0),
+   JSE_FN("receive",     Worker_Receive,     0, 0, 0),
+   JSE_FN("join",        Worker_Join,        0, 0, 0),
+   JS_FS_END
+};
+
+//
+// Workers are not available inside workers; there is no event loop there to
+// deliver their messages.
+//
+static NativeInitCode Worker_Create(JSContext *cx, JSObject *global)
+{
+   if(JSEngine_IsWorkerThread())
+      return NOSUCHPROPERTY;
+
+   auto obj = JS_InitClass(cx, global, nullptr, &workerClass,
+                           JSEngineNativeWrapper<Worker_New>,
+                           0, nullptr, workerJSMethods, nullptr, nullptr);
+
+   return obj ? RESOLVED : RESOLUTIONERROR;
+}
+
+static Native workerGlobalNative("Worker", Worker_Create);
+
+//=============================================================================
+//
+// Event Loop Integration
+//
+
+//
+// JSEngine_RunWorkerEvents
+//
+// Called from JSEngine_RunEvents on the main thread: pass waiting messages
+// and errors to onmessage and onerror handlers, and release workers that have
+// finished.
+//
+void JSEngine_RunWorkerEvents()
+{
+   if(liveWorkers.empty())
+      return;
+
+   JSContext *cx = JSEngine_GetGlobalContext()->getContext();
+
+   // handlers may start more workers, so walk a copy
+   std::vector<WorkerStatePtr> workers(liveWorkers.begin(), liveWorkers.end());
+
+   for(auto itr = workers.begin(); itr != workers.end() && MainLoopRunning; ++itr)
+   {
+      WorkerState *state = itr->get();
+
+      // anything posted before the worker finished is already queued
+      bool wasFinished = (state->finished != 0);
+
+      const char  *handlers[2] = { "onmessage", "onerror" };
+      WorkerQueue *queues[2]   = { &state->outbox, &state->errors };
+
+      for(int i = 0; i < 2 && state->obj; i++)
+      {
+         jsval handler = JSVAL_VOID;
+
+         if(!JS_GetProperty(cx, state->obj, handlers[i], &handler) ||
+            JS_TypeOfValue(cx, handler) != JSTYPE_FUNCTION)
+            continue;
+
+         workermessage_t *msg;
+         while(state->obj && MainLoopRunning && (msg = queues[i]->pop()))
+         {
+            std::unique_ptr<workermessage_t> msgptr(msg);
+
+            try
+            {
+               Worker_Dispatch(cx, state->obj, handler, msg);
+            }
+            catch(const JSEngineError &err)
+            {
+               err.propagateToJS(cx);
+               JS_ReportPendingException(cx);
+            }
+            JSEngine_RunMicrotasks();
+         }
+      }
+
+      if(wasFinished)
+      {
+         Worker_Unroot(state);
+         liveWorkers.remove(*itr);
+      }
+   }
+}
+
+//
+// JSEngine_GetWorkerWakeHandle
+//
+// An event the main loop can wait on, set whenever a worker posts a message
+// or finishes. Null until the first worker is started.
+//
+void *JSEngine_GetWorkerWakeHandle()
+{
+   return workerWakeEvent;
+}
+
+//
+// Stop all workers and their threads before the runtime is destroyed.
+//
+static void Worker_Shutdown()
+{
+   if(!poolSemaphore)
+      return;
+
+   poolStop = true;
+
+   for(auto itr = poolQueue.begin(); itr != poolQueue.end(); ++itr)
+      Worker_Finish(itr->get());
+   poolQueue.clear();
+
+   for(auto itr = liveWorkers.begin(); itr != liveWorkers.end(); ++itr)
+   {
+      InterlockedExchange(&(*itr)->terminate, 1);
+      SetEvent((*itr)->inbox.getEvent());
+   }
+
+   ReleaseSemaphore(poolSemaphore, static_cast<LONG>(poolThreads.size()), nullptr);
+
+   {
+      JSEngineUnlocked unlocked;
+      for(auto itr = poolThreads.begin(); itr != poolThreads.end(); ++itr)
+      {
+         WaitForSingleObject(*itr, INFINITE);
+         CloseHandle(*itr);
+      }
+   }
+   poolThreads.clear();
+
+   for(auto itr = liveWorkers.begin(); itr != liveWorkers.end(); ++itr)
+      Worker_Unroot(itr->get());
+   liveWorkers.clear();
+
+   CloseHandle(poolSemaphore);
+   CloseHandle(workerWakeEvent);
+   poolSemaphore   = nullptr;
+   workerWakeEvent = nullptr;
+}
+
+static ShutdownAction workerShutdownAction(Worker_Shutdown);
+
+#else
+
+// No thread support; Worker is not defined
+
+void JSEngine_RunWorkerEvents()
+{
+}
+
+void *JSEngine_GetWorkerWakeHandle()
+{
+   return nullptr;
+}
+
+#endif
+
+// EOF
+
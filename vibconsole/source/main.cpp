@@ -12,11 +12,14 @@
 #include <fstream>
 #include <string>
 
+#include "batchserver.h"
+#include "conlog.h"
 #include "inifile.h"
 #include "main.h"
 #include "misc.h"
 #include "jsengine2.h"
 #include "jsnatives.h"
+#include "timer.h"
 
 // Globals
 bool MainLoopRunning;
@@ -78,6 +81,16 @@ static void SetupConsoleWindow()
 static int myargc;
 static const char *const *myargv;
 
+static std::string profileFile; // set by -profile
+
+static bool        nativeStatsDump; // set by -nativestats
+static std::string nativeStatsFile;
+
+// Startup phase times for -startupreport
+static unsigned int initStartMS;
+static unsigned int iniMS;
+static unsigned int consoleMS;
+
 const char *const *myenvp;
 
 static int CheckArg(const char *arg)
@@ -113,6 +126,45 @@ static void ProcessCmdLine()
    if(CheckArg("-noninteractive"))
       NonInteractive = true;
 
+   // -startupreport: print how long each startup phase took, and script
+   // cache statistics
+   if(CheckArg("-startupreport"))
+   {
+      scriptcachestats_t stats;
+      JSEngine_GetScriptCacheStats(stats);
+
+      ConLog_Flush();
+      std::cout << "Startup: " << (Timer_getMS() - initStartMS) << " ms (options.ini " 
+                << iniMS << " ms, console " << consoleMS << " ms, runtime " 
+                << stats.runtimeMS << " ms, extensions.js " << stats.extensionsMS 
+                << " ms, autoexec.js " << stats.autoexecMS << " ms); scripts: " 
+                << stats.hits << " cached (" << stats.loadMS << " ms), " 
+                << stats.misses << " compiled (" << stats.compileMS << " ms), "
+                << stats.stores << " cache writes, " << stats.errors << " cache errors" 
+                << std::endl;
+   }
+
+   // -profile [file]: profile the main thread until exit, writing collapsed
+   // stacks to the file (default profile.folded)
+   if((p = CheckArg("-profile")))
+   {
+      if(p < myargc - 1 && !IsCommandArg(myargv[p + 1]))
+         profileFile = myargv[p + 1];
+      else
+         profileFile = "profile.folded";
+      JSEngine_StartProfiler(1);
+   }
+
+   // -nativestats [file]: count and time native calls, printing a table at
+   // exit or writing it to the file
+   if((p = CheckArg("-nativestats")))
+   {
+      if(p < myargc - 1 && !IsCommandArg(myargv[p + 1]))
+         nativeStatsFile = myargv[p + 1];
+      nativeStatsDump = true;
+      JSEngine_EnableNativeStats(true);
+   }
+
    // -file: execute the following arguments as script files in order provided
    if((p = CheckArg("-file")) && p < myargc - 1)
    {
@@ -123,6 +175,7 @@ static void ProcessCmdLine()
          jsval res;
          JSEngine_EvaluateFile(myargv[i], &res);
          code = JSEngine_ValueToInteger(&res);
+         JSEngine_RunMicrotasks();
       }
    }
 
@@ -136,11 +189,31 @@ static void ProcessCmdLine()
          jsval res;
          JSEngine_EvaluateScript("command line", myargv[i], &res);
          code = JSEngine_ValueToInteger(&res);
+         JSEngine_RunMicrotasks();
+      }
+   }
+
+   // -serve <name>: keep running and execute scripts sent to the named pipe;
+   // see batchserver.cpp
+   if((p = CheckArg("-serve")) && p < myargc - 1 && !exitImm)
+   {
+      NonInteractive = true;
+      if(!BatchServer_Start(myargv[p + 1]))
+      {
+         ConLog_Flush();
+         std::cout << "Cannot serve on " << myargv[p + 1] << std::endl;
+         exitImm = true;
+         code    = 1;
       }
    }
 
    if(exitImm)
+   {
+      FinishProfiling();
+      FinishNativeStats();
+      ConLog_Shutdown();
       exit(code);
+   }
 }
 
 /**
@@ -150,6 +223,8 @@ static void ProcessCmdLine()
  */
 static bool InitProgram()
 {
+   initStartMS = Timer_getMS();
+
    SetupConsoleWindow();
 
    // Ensure ios is in sync with stdio
@@ -167,8 +242,15 @@ static bool InitProgram()
 #endif
 
    // Load ini file
+   unsigned int phaseMS = Timer_getMS();
    IniFile &ini = IniFile::GetIniFile();
    ini.loadOptionsFromFile("options.ini");
+   iniMS = Timer_getMS() - phaseMS;
+
+   // Start buffered console output
+   phaseMS = Timer_getMS();
+   ConLog_Init();
+   consoleMS = Timer_getMS() - phaseMS;
    
    // Initialize JSAPI
    if(!JSEngine_Init())
@@ -192,31 +274,56 @@ static void MainLoop()
       // if in non-interactive mode, run non-interactive features instead
       if(NonInteractive)
       {
+         JSEngine_RunEvents();
+         if(!MainLoopRunning)
+            break;
+
+#ifndef VIBC_NO_WIN32
+         // sleep until the next timer is due, a worker has something for us,
+         // a batch client connects, or a console event wants us to exit
+         DWORD  timeout = JSEngine_NextEventTimeout();
+         HANDLE handles[3];
+         DWORD  count = 0;
+         DWORD  res;
+
+         handles[count++] = stopAppEvent;
+         if((handles[count] = JSEngine_GetWorkerWakeHandle()))
+            ++count;
+         if((handles[count] = BatchServer_GetWakeHandle()))
+            ++count;
+         {
+            JSEngineUnlocked unlocked;
+            res = WaitForMultipleObjects(count, handles, FALSE, 
+                                         timeout == JSENGINE_NO_EVENTS ? INFINITE : timeout);
+         }
+         if(res == WAIT_OBJECT_0)
+            break;
+
+         BatchServer_Poll();
+#endif
       }
       else
       {
          std::string prompt;
          JSEngine_GetInputPrompt(prompt);
-         std::cout << prompt;
-
-         if(echoFile)
-         {
-            echoFile << prompt;
-            echoFile.flush();
-         }
+         ConLog_Write(prompt.data(), prompt.size());
+         ConLog_Flush();
 
          // Get a line of input
          std::string input;
-         std::getline(std::cin, input);
-
-         if(echoFile)
          {
-            echoFile << input << std::endl;
-            echoFile.flush();
+            JSEngineUnlocked unlocked;
+            std::getline(std::cin, input);
          }
 
+         std::string echo = input + '\n';
+         ConLog_Write(echo.data(), echo.size(), CONLOG_ECHO);
+
          // Feed it to the JS interpreter
          JSEngine_AddInputLine(input);
+
+         // Run anything that became due while waiting for input
+         JSEngine_RunEvents();
       }
 
 #ifndef VIBC_NO_WIN32
@@ -226,16 +333,73 @@ static void MainLoop()
    }
 }
 
+/**
+ * Write out the profile started by -profile, if any
+ */
+void FinishProfiling()
+{
+   profileresults_t results;
+
+   if(profileFile.empty() || !jsengineProfiling)
+      return;
+
+   bool written = JSEngine_StopProfiler(profileFile.c_str(), results);
+
+   ConLog_Flush();
+   if(written)
+   {
+      std::cout << "Profile written to " << profileFile << ": " << results.totalMS << " ms; "
+                << results.jsMS << " ms script, " << results.nativeMS << " ms native, " 
+                << results.waitMS << " ms waiting" << std::endl;
+   }
+   else
+      std::cout << "Could not write profile to " << profileFile << std::endl;
+}
+
+/**
+ * Print or write out the native call statistics requested by -nativestats
+ */
+void FinishNativeStats()
+{
+   nativestatsmap_t stats;
+   std::string      table;
+
+   if(!nativeStatsDump)
+      return;
+   nativeStatsDump = false;
+
+   JSEngine_GetNativeStats(stats, true);
+   JSEngine_FormatNativeStats(stats, table);
+
+   ConLog_Flush();
+   if(nativeStatsFile.empty())
+      std::cout << table;
+   else
+   {
+      std::ofstream out(nativeStatsFile.c_str());
+      if(!(out << table))
+         std::cout << "Could not write native statistics to " << nativeStatsFile << std::endl;
+   }
+}
+
 /**
  * Shutdown tasks
  */
 void Shutdown()
 {
+   FinishProfiling();
+
    // Run all shutdown actions
    ShutdownAction::RunActions();
 
+   // Workers have stopped, so their statistics are in
+   FinishNativeStats();
+
    // Shutdown JS
    JSEngine_Shutdown();
+
+   // Write out any remaining console output
+   ConLog_Shutdown();
 }
 
 /**
@@ -247,6 +411,12 @@ int main(int argc, const char *argv[], const char *envp[])
    myargv = argv;
    myenvp = envp;
 
+   // -submit <name> <script> [args...]: run a script in a -serve process
+   // and exit with its code, without starting up here
+   int p;
+   if((p = CheckArg("-submit")) && p < myargc - 2)
+      return BatchServer_Submit(myargv[p + 1], myargc - p - 2, myargv + p + 2);
+
    if(InitProgram())
       MainLoop();
 
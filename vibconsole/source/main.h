@@ -46,6 +46,9 @@ public:
 
 extern const char *const *myenvp;
 
+void FinishProfiling();
+void FinishNativeStats();
+
 #endif
 
 // EOF
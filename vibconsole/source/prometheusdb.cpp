@@ -26,7 +26,9 @@
 
 #ifndef VIBC_NO_VISUALIB
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 
 #include "prometheusdb.h"
 
@@ -34,6 +36,7 @@
 #include "sqlLib.h"
 #include "util.h"
 #include "inifile.h"
+#include "timer.h"
 
 //=============================================================================
 //
@@ -53,9 +56,11 @@ static void VerboseSQLError(const char *query)
 class PrometheusDBPimpl
 {
 public:
-   VIB::Database db;
+   VIB::Database     db;
+   SqlStatementCache statements; // must be destroyed before db
+   SqlIdAllocator    ids;
 
-   PrometheusDBPimpl() : db()
+   PrometheusDBPimpl() : db(), statements(&db), ids(1)
    {
    }
 };
@@ -63,21 +68,18 @@ public:
 //
 // PrometheusDB Constructor
 //
-PrometheusDB::PrometheusDB()
+PrometheusDB::PrometheusDB() : pImpl(new PrometheusDBPimpl), pool()
 {
-   pImpl = new PrometheusDBPimpl;
 }
 
 //
 // PrometheusDB Destructor
 //
+// The connection lives on while transactions, cursors, or bulk inserters
+// opened on it still hold a reference.
+//
 PrometheusDB::~PrometheusDB()
 {
-   if(pImpl)
-   {
-      delete pImpl;
-      pImpl = nullptr;
-   }
 }
 
 //
@@ -96,7 +98,10 @@ bool PrometheusDB::connect(const pdb::string &addr, const pdb::string &user, con
          result = true;       // Already connected.
       else
       {
-         // Establish a new connection
+         // Establish a new connection; anything prepared on a lost one is
+         // no longer any good
+         pImpl->statements.Clear();
+         pImpl->ids.Clear();
          result = ConnectToDatabase(db, addr, user, pw);
       }
    }
@@ -134,14 +139,23 @@ bool PrometheusDB::connect(const char *dbname)
 //
 // Disconnect from the database, if it's connected. It can be reconnected if
 // necessary by calling connect() again. This invalidates any open datasets or
-// transactions.
+// transactions. Pooled connections are returned to their pool instead.
 //
 void PrometheusDB::disconnect()
 {
+   if(pool)
+   {
+      release();
+      return;
+   }
+
    VIB::Database *db = &pImpl->db;
 
    try
    {
+      pImpl->statements.Clear();
+      pImpl->ids.Clear();
+
       if(db->TestConnected())
          db->Close();
    }
@@ -250,7 +264,32 @@ bool PrometheusDB::executeStatement(const pdb::string &sql)
 
    try
    {
-      result = ExecuteStatement(&pImpl->db, sql);
+      result = CachedExecuteStatement(pImpl->statements, sql);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during ExecuteStatement");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(sql.c_str());
+
+   return result;
+}
+
+//
+// PrometheusDB::executeStatement
+//
+// Execute a SQL statement with named parameters against the database.
+//
+bool PrometheusDB::executeStatement(const pdb::string &sql, const pdb::stringmap &params)
+{
+   bool result = false;
+
+   try
+   {
+      result = CachedExecuteStatement(pImpl->statements, sql, &params);
    }
    catch(...)
    {
@@ -274,7 +313,7 @@ void PrometheusDB::getOneField(const pdb::string &sql, pdb::string &result)
 {
    try
    {
-      result = GetOneField(&pImpl->db, sql);
+      result = CachedGetOneField(pImpl->statements, sql);
    }
    catch(...)
    {
@@ -294,7 +333,7 @@ bool PrometheusDB::sqlToMap(const pdb::string &sql, pdb::stringmap &fieldMap)
 
    try
    {
-      result = SqlToMap(&pImpl->db, sql, fieldMap);
+      result = CachedSqlToMap(pImpl->statements, sql, fieldMap);
    }
    catch(...)
    {
@@ -308,6 +347,85 @@ bool PrometheusDB::sqlToMap(const pdb::string &sql, pdb::stringmap &fieldMap)
    return result;
 }
 
+//
+// PrometheusDB::setStatementCacheLimit
+//
+// Set the number of prepared statements kept for this connection.
+//
+void PrometheusDB::setStatementCacheLimit(size_t limit)
+{
+   try
+   {
+      pImpl->statements.SetLimit(limit);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Exception while freeing cached statements");
+   }
+}
+
+//
+// PrometheusDB::clearStatementCache
+//
+// Free all prepared statements kept for this connection.
+//
+void PrometheusDB::clearStatementCache()
+{
+   try
+   {
+      pImpl->statements.Clear();
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Exception while freeing cached statements");
+   }
+}
+
+//
+// PrometheusDB::getStatementCacheStats
+//
+// Report the statement cache's hit rate and occupancy.
+//
+void PrometheusDB::getStatementCacheStats(pdb::strtointmap &stats)
+{
+   const SqlStatementCache &cache = pImpl->statements;
+
+   stats["hits"]      = static_cast<int>(cache.Hits());
+   stats["misses"]    = static_cast<int>(cache.Misses());
+   stats["evictions"] = static_cast<int>(cache.Evictions());
+   stats["size"]      = static_cast<int>(cache.Size());
+   stats["limit"]     = static_cast<int>(cache.Limit());
+}
+
+//
+// PrometheusDB::setIdBlockSize
+//
+// Set the number of IDs reserved per generator query for a table.
+//
+void PrometheusDB::setIdBlockSize(const pdb::string &tableName, unsigned int blockSize)
+{
+   pImpl->ids.SetBlockSize(tableName, blockSize);
+}
+
+//
+// PrometheusDB::getIdStats
+//
+// Report how often a table's ID block has been refilled.
+//
+bool PrometheusDB::getIdStats(const pdb::string &tableName, pdb::strtointmap &stats)
+{
+   SqlIdAllocator::Stats idStats;
+
+   if(!pImpl->ids.GetStats(tableName, idStats))
+      return false;
+
+   stats["blockSize"] = static_cast<int>(idStats.block_size);
+   stats["refills"]   = static_cast<int>(idStats.refills);
+   stats["issued"]    = static_cast<int>(idStats.issued);
+   stats["remaining"] = static_cast<int>(idStats.remaining);
+   return true;
+}
+
 //
 // PrometheusDB::sqlToVecMap
 //
@@ -388,419 +506,1574 @@ bool PrometheusDB::sqlToVec(const pdb::string &sql, pdb::stringvec &fieldVec)
 
 //=============================================================================
 //
-// PrometheusTransaction
+// PrometheusPool
 //
 
 //
-// Private implementation details for PrometheusTransaction
+// Private implementation details for PrometheusPool. Leased PrometheusDB
+// instances share ownership, so connections can be returned after the pool
+// itself is gone; they are then simply closed.
 //
-class PrometheusTransactionPimpl
+class PrometheusPoolPimpl
 {
 public:
-   VIB::Transaction transaction;
-
-   PrometheusTransactionPimpl() : transaction()
+   struct IdleConnection
+   {
+      PrometheusDBPimpl *conn;
+      unsigned int       since; // Timer_getMS when returned
+   };
+
+   SqlMutex     lock;
+   pdb::string  addr;
+   pdb::string  user;
+   pdb::string  pw;
+   unsigned int minConnections;
+   unsigned int maxConnections;
+   int          idleTimeoutMS;
+   unsigned int healthCheckMS;
+   bool         isOpen;
+
+   std::vector<IdleConnection> idle; // least recently returned first
+   unsigned int inUse;
+
+   unsigned long created;
+   unsigned long reused;
+   unsigned long healthChecks;
+   unsigned long failedChecks;
+   unsigned long evicted;
+   unsigned long exhausted;
+
+   PrometheusPoolPimpl()
+      : lock(), addr(), user(), pw(), minConnections(0), maxConnections(0),
+        idleTimeoutMS(0), healthCheckMS(30000), isOpen(false), idle(), inUse(0),
+        created(0), reused(0), healthChecks(0), failedChecks(0), evicted(0),
+        exhausted(0)
    {
    }
-};
-
-//
-// PrometheusTransaction Constructor
-//
-PrometheusTransaction::PrometheusTransaction()
-{
-   pImpl = new PrometheusTransactionPimpl;
-}
 
-//
-// PrometheusTransaction Destructor
-//
-// This will help with memory management enormously. By declaring this object
-// on the stack, the enclosed TIBTransaction will be closed and freed
-// automatically when the calling function returns. You must still commit
-// any written changes first though, or the transaction will rollback by
-// default for safety.
-//
-PrometheusTransaction::~PrometheusTransaction()
-{
-   if(pImpl)
+   ~PrometheusPoolPimpl()
    {
-      delete pImpl;
-      pImpl = nullptr;
+      closeIdle();
    }
-}
+
+   static void destroy(PrometheusDBPimpl *conn);
+
+   PrometheusDBPimpl *connect();
+   PrometheusDBPimpl *checkout();
+   void               checkin(PrometheusDBPimpl *conn);
+   void               addIdle(PrometheusDBPimpl *conn, unsigned int now);
+   bool               isHealthy(const IdleConnection &ic, unsigned int now);
+   unsigned int       evict(unsigned int now);
+   void               closeIdle();
+};
 
 //
-// PrometheusTransaction::isActive
+// PrometheusPoolPimpl::destroy
 //
-// Returns true or false regarding the transaction's active state.
+// Close and free a connection.
 //
-bool PrometheusTransaction::isActive()
+void PrometheusPoolPimpl::destroy(PrometheusDBPimpl *conn)
 {
-   bool result = false;
-
    try
    {
-      result = pImpl->transaction.Active;
+      conn->statements.Clear();
+
+      if(conn->db.Connected)
+         conn->db.Close();
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Exception while testing transaction active state");
-      result = false;
+      //DEBUGOUT(dbg_database, "DB: Failed trying to close pooled connection");
    }
 
-   if(!result)
-      VerboseSQLError(nullptr);
-
-   return result;
+   delete conn;
 }
 
 //
-// PrometheusTransaction::commit
+// PrometheusPoolPimpl::connect
 //
-// Commit a transaction. It should be in the active state or the resulting VCL
-// exception will cause a false return value. The transaction is closed after
-// this call.
+// Open a new connection with the pool's parameters. Called without the lock
+// held, since connecting takes a while.
 //
-bool PrometheusTransaction::commit()
+PrometheusDBPimpl *PrometheusPoolPimpl::connect()
 {
-   bool result = false;
+   std::unique_ptr<PrometheusDBPimpl> conn(new PrometheusDBPimpl);
 
    try
    {
-      pImpl->transaction.Commit();
-      result = true;
+      if(ConnectToDatabase(&conn->db, addr, user, pw))
+         return conn.release();
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_error, "DB: WARNING: transaction commit failure! Data may be lost!");
-      result = false;
+      //DEBUGOUT(dbg_database, "DB: Pooled connection failed due to an unknown exception");
    }
 
-   if(!result)
-      VerboseSQLError(nullptr);
-
-   return result;
+   VerboseSQLError(nullptr);
+   return nullptr;
 }
 
 //
-// PrometheusTransaction::rollback
+// PrometheusPoolPimpl::addIdle
 //
-// Rollback a transaction. It should be in the active state or the resulting VCL
-// exception will cause a false return value. The transaction is closed after
-// this call.
+// Park a connection in the idle list. Lock must be held.
 //
-bool PrometheusTransaction::rollback()
+void PrometheusPoolPimpl::addIdle(PrometheusDBPimpl *conn, unsigned int now)
 {
-   bool result = false;
+   IdleConnection ic = { conn, now };
+
+   idle.push_back(ic);
+}
 
+//
+// PrometheusPoolPimpl::isHealthy
+//
+// Connections that have been idle for a while are probed with TestConnected;
+// recently used ones are trusted on the strength of their Connected flag.
+// Lock must be held.
+//
+bool PrometheusPoolPimpl::isHealthy(const IdleConnection &ic, unsigned int now)
+{
    try
    {
-      pImpl->transaction.Rollback();
-      result = true;
+      if(!ic.conn->db.Connected)
+         return false;
+
+      if(now - ic.since >= healthCheckMS)
+      {
+         ++healthChecks;
+         return ic.conn->db.TestConnected();
+      }
+
+      return true;
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Transaction rollback failure");
-      result = false;
+      return false;
    }
-
-   if(!result)
-      VerboseSQLError(nullptr);
-
-   return result;
 }
 
 //
-// PrometheusTransaction::stdTransaction
+// PrometheusPoolPimpl::evict
 //
-// Attach a transaction to the database with the standard parameters.
+// Close connections, oldest first, that have sat idle for longer than the
+// idle timeout, as long as the pool stays at or above its minimum size.
+// IBX's own IdleTimer is not used, as it needs a message loop to fire.
+// Connections that IBX has already dropped are always closed. Lock must be
+// held.
 //
-bool PrometheusTransaction::stdTransaction(PrometheusDB &db)
+unsigned int PrometheusPoolPimpl::evict(unsigned int now)
 {
-   bool result = false;
-   VIB::Database    *ibdb = &(db.pImpl->db);
-   VIB::Transaction *ibta = &pImpl->transaction;
+   unsigned int count = 0;
+   auto itr = idle.begin();
 
-   result = StdTransaction(ibta, ibdb);
+   while(itr != idle.end())
+   {
+      bool drop = false;
 
-   if(!result)
-      VerboseSQLError(nullptr);
+      try
+      {
+         if(!itr->conn->db.Connected)
+            drop = true;
+         else if(idleTimeoutMS > 0 && now - itr->since >= static_cast<unsigned int>(idleTimeoutMS) &&
+                 inUse + idle.size() > minConnections)
+            drop = true;
+      }
+      catch(...)
+      {
+         drop = true;
+      }
 
-   return result;
+      if(drop)
+      {
+         destroy(itr->conn);
+         itr = idle.erase(itr);
+         ++evicted;
+         ++count;
+      }
+      else
+         ++itr;
+   }
+
+   return count;
 }
 
 //
-// PrometheusTransaction::executeUpdateStatement
-//
-// Send in a table name, map of fields, and optionally, a map of options for
-// those fields, to update records in the database.
+// PrometheusPoolPimpl::closeIdle
 //
-bool PrometheusTransaction::executeUpdateStatement
-(
-   const pdb::string      &tableName,
-   const pdb::stringmap   &fieldMap,
-   const pdb::strtointmap *fieldOptions
-)
+void PrometheusPoolPimpl::closeIdle()
 {
-   bool result = false;
-
-   try
-   {
-      result = ExecuteUpdateStatement(&pImpl->transaction, tableName, fieldMap, fieldOptions);
-   }
-   catch(...)
-   {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during ExecuteUpdateStatement");
-      result = false;
-   }
-
-   if(!result)
-      VerboseSQLError(nullptr);
+   for(auto itr = idle.begin(); itr != idle.end(); ++itr)
+      destroy(itr->conn);
 
-   return result;
+   idle.clear();
 }
 
 //
-// PrometheusTransaction::executeInsertStatement
+// PrometheusPoolPimpl::checkout
 //
-// Send in a table name, map of fields, and optionally, a map of options for
-// those fields, to insert new records into the database.
+// Hand out the most recently returned healthy connection, or open a new one
+// if there is none and the pool is below its maximum size.
 //
-bool PrometheusTransaction::executeInsertStatement
-(
-   const pdb::string      &tableName,
-   const pdb::stringmap   &fieldMap,
-   const pdb::strtointmap *fieldOptions
-)
+PrometheusDBPimpl *PrometheusPoolPimpl::checkout()
 {
-   bool result = false;
-
-   try
-   {
-      result = ExecuteInsertStatement(&pImpl->transaction, tableName, fieldMap, fieldOptions);
-   }
-   catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during ExecuteInsertStatement");
-      result = false;
+      SqlMutexHold hold(lock);
+      unsigned int now = Timer_getMS();
+
+      if(!isOpen)
+         return nullptr;
+
+      evict(now);
+
+      while(!idle.empty())
+      {
+         IdleConnection ic = idle.back();
+         idle.pop_back();
+
+         if(isHealthy(ic, now))
+         {
+            ++inUse;
+            ++reused;
+            return ic.conn;
+         }
+
+         ++failedChecks;
+         destroy(ic.conn);
+      }
+
+      if(inUse >= maxConnections)
+      {
+         ++exhausted;
+         return nullptr;
+      }
+
+      ++inUse; // claim the slot before connecting
    }
 
-   if(!result)
-      VerboseSQLError(nullptr);
+   PrometheusDBPimpl *conn = connect();
+   SqlMutexHold hold(lock);
 
-   return result;
+   if(conn)
+      ++created;
+   else
+      --inUse;
+
+   return conn;
 }
 
 //
-// PrometheusTransaction::executeStatement
+// PrometheusPoolPimpl::checkin
 //
-// Execute a generic SQL statement against the database.
+// Take back a leased connection. If the pool has been closed, or the
+// connection has been lost, it is closed instead.
 //
-bool PrometheusTransaction::executeStatement(const pdb::string &sql)
+void PrometheusPoolPimpl::checkin(PrometheusDBPimpl *conn)
 {
-   bool result = false;
+   SqlMutexHold hold(lock);
+   unsigned int now = Timer_getMS();
 
-   try
-   {
-      result = ExecuteStatement(&pImpl->transaction, sql);
-   }
-   catch(...)
-   {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during ExecuteStatement");
-      result = false;
-   }
+   --inUse;
 
-   if(!result)
-      VerboseSQLError(sql.c_str());
+   if(isOpen && conn->db.Connected)
+      addIdle(conn, now);
+   else
+      destroy(conn);
 
-   return result;
+   evict(now);
 }
 
 //
-// PrometheusTransaction::lockForUpdate
+// PrometheusPool Constructor
 //
-// Protects prospective records from concurrent modification by other database
-// users during the period of time between a query of all the record's existing
+PrometheusPool::PrometheusPool() : pImpl(new PrometheusPoolPimpl)
+{
+}
+
+//
+// PrometheusPool Destructor
+//
+PrometheusPool::~PrometheusPool()
+{
+   close();
+}
+
+//
+// PrometheusPool::open
+//
+// Configure the pool and open its minimum number of connections.
+//
+bool PrometheusPool::open(const pdb::string &addr, const pdb::string &user, const pdb::string &pw,
+                          unsigned int minConnections, unsigned int maxConnections,
+                          int idleTimeoutMS)
+{
+   close();
+
+   try
+   {
+      {
+         SqlMutexHold hold(pImpl->lock);
+
+         pImpl->addr           = addr;
+         pImpl->user           = user;
+         pImpl->pw             = pw;
+         pImpl->maxConnections = maxConnections ? maxConnections : 1;
+         pImpl->minConnections = std::min(minConnections, pImpl->maxConnections);
+         pImpl->idleTimeoutMS  = idleTimeoutMS;
+         pImpl->isOpen         = true;
+      }
+
+      unsigned int opened = 0;
+
+      for(unsigned int i = 0; i < pImpl->minConnections; i++)
+      {
+         PrometheusDBPimpl *conn = pImpl->connect();
+         if(!conn)
+            break;
+
+         SqlMutexHold hold(pImpl->lock);
+         pImpl->addIdle(conn, Timer_getMS());
+         ++pImpl->created;
+         ++opened;
+      }
+
+      if(pImpl->minConnections && !opened)
+      {
+         close();
+         return false;
+      }
+
+      return true;
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception while opening connection pool");
+      close();
+      return false;
+   }
+}
+
+//
+// PrometheusPool::open
+//
+// Open the pool using connection parameters from the global IniFile.
+//
+bool PrometheusPool::open(const char *dbname, unsigned int minConnections,
+                          unsigned int maxConnections, int idleTimeoutMS)
+{
+   IniFile::IniMap &ini = IniFile::GetIniOptions();
+
+   return open(ini[dbname]["db"], ini[dbname]["user"], ini[dbname]["password"],
+               minConnections, maxConnections, idleTimeoutMS);
+}
+
+//
+// PrometheusPool::close
+//
+void PrometheusPool::close()
+{
+   try
+   {
+      SqlMutexHold hold(pImpl->lock);
+
+      pImpl->isOpen = false;
+      pImpl->closeIdle();
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Exception while closing connection pool");
+   }
+}
+
+//
+// PrometheusPool::isOpen
+//
+bool PrometheusPool::isOpen() const
+{
+   return pImpl->isOpen;
+}
+
+//
+// PrometheusPool::setHealthCheckInterval
+//
+void PrometheusPool::setHealthCheckInterval(unsigned int ms)
+{
+   SqlMutexHold hold(pImpl->lock);
+   pImpl->healthCheckMS = ms;
+}
+
+//
+// PrometheusPool::evictIdle
+//
+unsigned int PrometheusPool::evictIdle()
+{
+   try
+   {
+      SqlMutexHold hold(pImpl->lock);
+      return pImpl->evict(Timer_getMS());
+   }
+   catch(...)
+   {
+      return 0;
+   }
+}
+
+//
+// PrometheusPool::getStats
+//
+// Report pool occupancy and how often connections were reused, probed, and
+// closed for idleness.
+//
+void PrometheusPool::getStats(pdb::strtointmap &stats)
+{
+   SqlMutexHold hold(pImpl->lock);
+   const PrometheusPoolPimpl &p = *pImpl;
+
+   stats["open"]         = static_cast<int>(p.inUse + p.idle.size());
+   stats["idle"]         = static_cast<int>(p.idle.size());
+   stats["inUse"]        = static_cast<int>(p.inUse);
+   stats["created"]      = static_cast<int>(p.created);
+   stats["reused"]       = static_cast<int>(p.reused);
+   stats["healthChecks"] = static_cast<int>(p.healthChecks);
+   stats["failedChecks"] = static_cast<int>(p.failedChecks);
+   stats["evicted"]      = static_cast<int>(p.evicted);
+   stats["exhausted"]    = static_cast<int>(p.exhausted);
+   stats["min"]          = static_cast<int>(p.minConnections);
+   stats["max"]          = static_cast<int>(p.maxConnections);
+}
+
+//
+// PrometheusPoolLease
+//
+// Deleter for a connection checked out of a pool. The shared_ptr holding a
+// leased connection is the lease itself: PrometheusDB and everything opened
+// on it share it, and the last of them to let go returns the connection.
+//
+class PrometheusPoolLease
+{
+protected:
+   std::shared_ptr<PrometheusPoolPimpl> pool;
+
+public:
+   explicit PrometheusPoolLease(const std::shared_ptr<PrometheusPoolPimpl> &pPool)
+      : pool(pPool)
+   {
+   }
+
+   void operator () (PrometheusDBPimpl *conn) const
+   {
+      try
+      {
+         pool->checkin(conn);
+      }
+      catch(...)
+      {
+         //DEBUGOUT(dbg_database, "DB: Unknown exception during pool checkin");
+      }
+   }
+};
+
+//
+// PrometheusDB::acquire
+//
+// Replace this object's own connection with a lease on one checked out of
+// the pool. Anything still open on the old connection keeps it alive.
+//
+bool PrometheusDB::acquire(PrometheusPool &pool)
+{
+   PrometheusDBPimpl *conn = nullptr;
+
+   release();
+
+   try
+   {
+      conn = pool.pImpl->checkout();
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during pool checkout");
+   }
+
+   if(!conn)
+      return false;
+
+   pImpl.reset(conn, PrometheusPoolLease(pool.pImpl));
+   this->pool = pool.pImpl;
+   return true;
+}
+
+//
+// PrometheusDB::release
+//
+// Let go of a pooled connection, leaving this object with a fresh,
+// unconnected one of its own. The connection is checked back in once any
+// transactions, cursors, and bulk inserters opened on it are also gone.
+//
+void PrometheusDB::release()
+{
+   if(!pool)
+      return;
+
+   pImpl.reset(new PrometheusDBPimpl);
+   pool.reset();
+}
+
+//
+// PrometheusDB::isPooled
+//
+bool PrometheusDB::isPooled() const
+{
+   return pool.get() != nullptr;
+}
+
+//=============================================================================
+//
+// PrometheusTransaction
+//
+
+//
+// Private implementation details for PrometheusTransaction
+//
+class PrometheusTransactionPimpl
+{
+public:
+   std::shared_ptr<PrometheusDBPimpl> dbImpl;      // set by stdTransaction; must outlive transaction
+   VIB::Transaction                   transaction;
+
+   PrometheusTransactionPimpl() : dbImpl(), transaction()
+   {
+   }
+};
+
+//
+// PrometheusTransaction Constructor
+//
+PrometheusTransaction::PrometheusTransaction() : pImpl(new PrometheusTransactionPimpl)
+{
+}
+
+//
+// PrometheusTransaction Destructor
+//
+// This will help with memory management enormously. By declaring this object
+// on the stack, the enclosed TIBTransaction will be closed and freed
+// automatically when the calling function returns. You must still commit
+// any written changes first though, or the transaction will rollback by
+// default for safety. Open cursors and bulk inserters hold their own
+// reference, and the last of them to go does this instead.
+//
+PrometheusTransaction::~PrometheusTransaction()
+{
+}
+
+//
+// PrometheusTransaction::isActive
+//
+// Returns true or false regarding the transaction's active state.
+//
+bool PrometheusTransaction::isActive()
+{
+   bool result = false;
+
+   try
+   {
+      result = pImpl->transaction.Active;
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Exception while testing transaction active state");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(nullptr);
+
+   return result;
+}
+
+//
+// PrometheusTransaction::commit
+//
+// Commit a transaction. It should be in the active state or the resulting VCL
+// exception will cause a false return value. The transaction is closed after
+// this call.
+//
+bool PrometheusTransaction::commit()
+{
+   bool result = false;
+
+   try
+   {
+      pImpl->transaction.Commit();
+      result = true;
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_error, "DB: WARNING: transaction commit failure! Data may be lost!");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(nullptr);
+
+   return result;
+}
+
+//
+// PrometheusTransaction::rollback
+//
+// Rollback a transaction. It should be in the active state or the resulting VCL
+// exception will cause a false return value. The transaction is closed after
+// this call.
+//
+bool PrometheusTransaction::rollback()
+{
+   bool result = false;
+
+   try
+   {
+      pImpl->transaction.Rollback();
+      result = true;
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Transaction rollback failure");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(nullptr);
+
+   return result;
+}
+
+//
+// PrometheusTransaction::stdTransaction
+//
+// Attach a transaction to the database with the standard parameters.
+//
+bool PrometheusTransaction::stdTransaction(PrometheusDB &db)
+{
+   bool result = false;
+   VIB::Database    *ibdb = &(db.pImpl->db);
+   VIB::Transaction *ibta = &pImpl->transaction;
+
+   result = StdTransaction(ibta, ibdb);
+   if(result)
+      pImpl->dbImpl = db.pImpl;
+   else
+      pImpl->dbImpl.reset();
+
+   if(!result)
+      VerboseSQLError(nullptr);
+
+   return result;
+}
+
+//
+// PrometheusTransaction::executeUpdateStatement
+//
+// Send in a table name, map of fields, and optionally, a map of options for
+// those fields, to update records in the database.
+//
+bool PrometheusTransaction::executeUpdateStatement
+(
+   const pdb::string      &tableName,
+   const pdb::stringmap   &fieldMap,
+   const pdb::strtointmap *fieldOptions
+)
+{
+   bool result = false;
+
+   try
+   {
+      result = ExecuteUpdateStatement(&pImpl->transaction, tableName, fieldMap, fieldOptions);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during ExecuteUpdateStatement");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(nullptr);
+
+   return result;
+}
+
+//
+// PrometheusTransaction::executeInsertStatement
+//
+// Send in a table name, map of fields, and optionally, a map of options for
+// those fields, to insert new records into the database.
+//
+bool PrometheusTransaction::executeInsertStatement
+(
+   const pdb::string      &tableName,
+   const pdb::stringmap   &fieldMap,
+   const pdb::strtointmap *fieldOptions
+)
+{
+   bool result = false;
+
+   try
+   {
+      result = ExecuteInsertStatement(&pImpl->transaction, tableName, fieldMap, fieldOptions);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during ExecuteInsertStatement");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(nullptr);
+
+   return result;
+}
+
+//
+// PrometheusTransaction::executeStatement
+//
+// Execute a generic SQL statement against the database.
+//
+bool PrometheusTransaction::executeStatement(const pdb::string &sql)
+{
+   bool result = false;
+
+   try
+   {
+      if(pImpl->dbImpl)
+         result = CachedExecuteStatement(pImpl->dbImpl->statements, &pImpl->transaction, sql);
+      else
+         result = ExecuteStatement(&pImpl->transaction, sql);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during ExecuteStatement");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(sql.c_str());
+
+   return result;
+}
+
+//
+// PrometheusTransaction::executeStatement
+//
+// Execute a SQL statement with named parameters against the database.
+//
+bool PrometheusTransaction::executeStatement(const pdb::string &sql, const pdb::stringmap &params)
+{
+   bool result = false;
+
+   try
+   {
+      if(pImpl->dbImpl)
+         result = CachedExecuteStatement(pImpl->dbImpl->statements, &pImpl->transaction, sql, &params);
+      else
+      {
+         // no connection cache; prepare into a private one-off cache
+         VIB::Database     db = pImpl->transaction.DefaultDatabase;
+         SqlStatementCache cache(&db, 1);
+         result = CachedExecuteStatement(cache, &pImpl->transaction, sql, &params);
+      }
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during ExecuteStatement");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(sql.c_str());
+
+   return result;
+}
+
+//
+// PrometheusTransaction::lockForUpdate
+//
+// Protects prospective records from concurrent modification by other database
+// users during the period of time between a query of all the record's existing
 // field values and the actual update statement.
 //
-bool PrometheusTransaction::lockForUpdate(const pdb::string &tableName, const pdb::string &id)
+bool PrometheusTransaction::lockForUpdate(const pdb::string &tableName, const pdb::string &id)
+{
+   bool result = false;
+
+   try
+   {
+      result = LockRecordForUpdate(&pImpl->transaction, tableName, id);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during LockRecordForUpdate");
+      VerboseSQLError(nullptr);
+      result = false;
+   }
+
+   return result;
+}
+
+//
+// PrometheusTransaction::getNextId
+//
+// For properly setup tables (those with a uniformly-named id generator), this
+// will retrieve a suitable id for the next record, in a manner that can be
+// rolled back if a subsequent insert op should fail.
+//
+void PrometheusTransaction::getNextId(const pdb::string &tableName, pdb::string &result)
+{
+   try
+   {
+      if(pImpl->dbImpl)
+         result = pImpl->dbImpl->ids.NextId(&pImpl->transaction, tableName);
+      else
+         result = GetNextId(&pImpl->transaction, tableName);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during GetNextId");
+      VerboseSQLError(nullptr);
+   }
+}
+
+//
+// PrometheusTransaction::reserveIds
+//
+// Retrieve count IDs for a table with at most one trip to its generator.
+//
+bool PrometheusTransaction::reserveIds(const pdb::string &tableName, unsigned int count, 
+                                       pdb::stringvec &ids)
+{
+   bool result = false;
+
+   try
+   {
+      if(pImpl->dbImpl)
+         result = pImpl->dbImpl->ids.Reserve(&pImpl->transaction, tableName, count, ids);
+      else
+      {
+         // not opened through stdTransaction; use a private allocator
+         SqlIdAllocator allocator(count ? count : 1);
+         result = allocator.Reserve(&pImpl->transaction, tableName, count, ids);
+      }
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during reserveIds");
+      VerboseSQLError(nullptr);
+      result = false;
+   }
+
+   return result;
+}
+
+//
+// PrometheusTransaction::getOneField
+//
+// Returns the value of a single field in "result" given a SQL statement that
+// generates a single column and row.
+//
+void PrometheusTransaction::getOneField(const pdb::string &sql, pdb::string &result)
+{
+   try
+   {
+      if(pImpl->dbImpl)
+         result = CachedGetOneField(pImpl->dbImpl->statements, &pImpl->transaction, sql);
+      else
+         result = GetOneField(&pImpl->transaction, sql);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during GetOneField");
+      VerboseSQLError(sql.c_str());
+   }
+}
+
+//
+// PrometheusTransaction::sqlToMap
+//
+// Return the single-row results of a SQL query in a map<string, string>
+//
+bool PrometheusTransaction::sqlToMap(const pdb::string &sql, pdb::stringmap &fieldMap)
+{
+   bool result = false;
+
+   try
+   {
+      if(pImpl->dbImpl)
+         result = CachedSqlToMap(pImpl->dbImpl->statements, &pImpl->transaction, sql, fieldMap);
+      else
+         result = SqlToMap(&pImpl->transaction, sql, fieldMap);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during SqlToMap");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(sql.c_str());
+
+   return result;
+}
+
+//
+// PrometheusTransaction:;getFullRecord
+//
+// This is largely a convenience wrapper around sqlToMap.
+//
+bool PrometheusTransaction::getFullRecord
+(
+   const pdb::string &tableName, 
+   const pdb::string &id, 
+   pdb::stringmap    &outmap
+)
+{
+   std::string query = "select * from " + tableName + " where id = " + id;
+   return sqlToMap(query, outmap);
+}
+
+
+//
+// PrometheusTransaction::sqlToVecMap
+//
+// Returns the multiple-row result of a SQL query as a vector<map<string, string> >,
+// which while not of maximum efficiency due to the duplication of field names
+// in every map row of the vector, is MUCH easier to use than a more efficient
+// data structure would be.
+//
+bool PrometheusTransaction::sqlToVecMap(const pdb::string &sql, pdb::vecmap &fieldVecMap)
+{
+   bool result = false;
+
+   try
+   {
+      result = SqlToVecMap(&pImpl->transaction, sql, fieldVecMap);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during SqlToVecMap");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(sql.c_str());
+
+   return result;
+}
+
+//
+// PrometheusTransaction::sqlToSet
+//
+// Returns the single-row results of a SQL query as a set of strings.
+//
+bool PrometheusTransaction::sqlToSet(const pdb::string &sql, pdb::stringset &fieldSet)
+{
+   bool result = false;
+
+   try
+   {
+      result = SqlToSet(&pImpl->transaction, sql, fieldSet);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during SqlToSet");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(sql.c_str());
+
+   return result;
+}
+
+//
+// PrometheusTransaction::sqlToVec
+//
+// Returns the single-row results of a SQL query as a vector of strings.
+//
+bool PrometheusTransaction::sqlToVec(const pdb::string &sql, pdb::stringvec &fieldVec)
+{
+   bool result = false;
+
+   try
+   {
+      result = SqlToVec(&pImpl->transaction, sql, fieldVec);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during SqlToVec");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(sql.c_str());
+
+   return result;
+}
+
+//=============================================================================
+//
+// PrometheusCursor
+//
+
+//
+// Private implementation details for PrometheusCursor
+//
+class PrometheusCursorPimpl
+{
+public:
+   std::shared_ptr<PrometheusTransactionPimpl> trImpl;         // when opened on a PrometheusTransaction
+   std::shared_ptr<PrometheusDBPimpl>          dbImpl;         // when opened against a PrometheusDB
+   std::unique_ptr<VIB::Transaction>           ownTransaction; // likewise
+   VIB::DataSet                                dataSet;
+   VIB::Transaction                           *transaction;    // transaction of the open query
+   std::unique_ptr<SqlRowReader>               reader;
+   bool                                        canCommit;      // cursor started the transaction
+   bool                                        atEnd;
+   size_t                                      rowCount;
+
+   PrometheusCursorPimpl() 
+      : trImpl(), dbImpl(), ownTransaction(), dataSet(), transaction(nullptr), reader(),
+        canCommit(false), atEnd(true), rowCount(0)
+   {
+   }
+
+   void openDataSet(VIB::Transaction *vtr, const pdb::string &sql);
+   void closeDataSet();
+};
+
+//
+// PrometheusCursorPimpl::openDataSet
+//
+// As sqlLib's StdDataSet, but with a unidirectional cursor so that IBX does
+// not buffer every record it has read.
+//
+void PrometheusCursorPimpl::openDataSet(VIB::Transaction *vtr, const pdb::string &sql)
+{
+   transaction = vtr;
+   canCommit   = !vtr->Active;
+
+   dataSet.Database       = vtr->DefaultDatabase;
+   dataSet.Transaction    = vtr->getVIBTransaction();
+   dataSet.UniDirectional = true;
+
+   if(canCommit)
+      vtr->StartTransaction();
+
+   dataSet.SelectSQL->Clear();
+   dataSet.SelectSQL->Add(sql);
+   dataSet.Open();
+
+   reader.reset(new SqlRowReader(dataSet));
+   atEnd    = false;
+   rowCount = 0;
+}
+
+//
+// PrometheusCursorPimpl::closeDataSet
+//
+void PrometheusCursorPimpl::closeDataSet()
+{
+   reader.reset();
+   atEnd = true;
+
+   if(!transaction)
+      return;
+
+   VIB::Transaction *vtr = transaction;
+   transaction = nullptr;
+
+   try
+   {
+      dataSet.Close();
+      if(canCommit && vtr->Active)
+         vtr->Commit();
+   }
+   catch(...)
+   {
+      if(canCommit && vtr->Active)
+         vtr->Rollback();
+      throw;
+   }
+}
+
+//
+// OpenPrivateTransaction
+//
+// Start a transaction of its own for a cursor or bulk inserter opened against
+// a PrometheusDB, holding the connection for as long as the transaction is
+// kept. Returns the started transaction, or nullptr on failure.
+//
+static VIB::Transaction *OpenPrivateTransaction(const std::shared_ptr<PrometheusDBPimpl> &conn, 
+                                                std::shared_ptr<PrometheusDBPimpl> &dbImpl,
+                                                std::unique_ptr<VIB::Transaction> &ownTransaction)
+{
+   dbImpl = conn;
+   ownTransaction.reset(new VIB::Transaction());
+   return StdTransaction(ownTransaction.get(), &dbImpl->db, false) ? ownTransaction.get() : nullptr;
+}
+
+//
+// PrometheusCursor Constructor
+//
+PrometheusCursor::PrometheusCursor()
+{
+   pImpl = new PrometheusCursorPimpl;
+}
+
+//
+// PrometheusCursor Destructor
+//
+PrometheusCursor::~PrometheusCursor()
+{
+   if(pImpl)
+   {
+      close();
+      delete pImpl;
+      pImpl = nullptr;
+   }
+}
+
+//
+// PrometheusCursor::open
+//
+// Open a query on the caller's transaction.
+//
+bool PrometheusCursor::open(PrometheusTransaction &tr, const pdb::string &sql)
 {
    bool result = false;
 
+   close();
+
    try
    {
-      result = LockRecordForUpdate(&pImpl->transaction, tableName, id);
+      pImpl->trImpl = tr.pImpl;
+      pImpl->openDataSet(&tr.pImpl->transaction, sql);
+      result = true;
+   }
+   catch(VIB::IBError &error)
+   {
+      last_sql_lib_error = error;
+      result = false;
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during LockRecordForUpdate");
-      VerboseSQLError(nullptr);
+      //DEBUGOUT(dbg_database, "DB: Unknown exception opening cursor");
       result = false;
    }
 
+   if(!result)
+   {
+      VerboseSQLError(sql.c_str());
+      close();
+   }
+
    return result;
 }
 
 //
-// PrometheusTransaction::getNextId
+// PrometheusCursor::open
 //
-// For properly setup tables (those with a uniformly-named id generator), this
-// will retrieve a suitable id for the next record, in a manner that can be
-// rolled back if a subsequent insert op should fail.
+// Open a query on a private transaction against the given database.
 //
-void PrometheusTransaction::getNextId(const pdb::string &tableName, pdb::string &result)
+bool PrometheusCursor::open(PrometheusDB &db, const pdb::string &sql)
 {
+   bool result = false;
+
+   close();
+
    try
    {
-      result = GetNextId(&pImpl->transaction, tableName);
+      VIB::Transaction *vtr = OpenPrivateTransaction(db.pImpl, pImpl->dbImpl, pImpl->ownTransaction);
+      if(vtr)
+      {
+         pImpl->openDataSet(vtr, sql);
+         result = true;
+      }
+   }
+   catch(VIB::IBError &error)
+   {
+      last_sql_lib_error = error;
+      result = false;
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during GetNextId");
-      VerboseSQLError(nullptr);
+      //DEBUGOUT(dbg_database, "DB: Unknown exception opening cursor");
+      result = false;
+   }
+
+   if(!result)
+   {
+      VerboseSQLError(sql.c_str());
+      close();
    }
+
+   return result;
 }
 
 //
-// PrometheusTransaction::getOneField
+// PrometheusCursor::close
 //
-// Returns the value of a single field in "result" given a SQL statement that
-// generates a single column and row.
+// Close the query. Since the cursor only reads, the transaction is committed
+// rather than rolled back if the cursor was the one to start it.
 //
-void PrometheusTransaction::getOneField(const pdb::string &sql, pdb::string &result)
+void PrometheusCursor::close()
 {
    try
    {
-      result = GetOneField(&pImpl->transaction, sql);
+      pImpl->closeDataSet();
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Exception while closing cursor");
+      VerboseSQLError(nullptr);
+   }
+
+   try
+   {
+      pImpl->ownTransaction.reset();
+      pImpl->dbImpl.reset();
+      pImpl->trImpl.reset();
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during GetOneField");
-      VerboseSQLError(sql.c_str());
    }
 }
 
 //
-// PrometheusTransaction::sqlToMap
+// PrometheusCursor::isOpen
 //
-// Return the single-row results of a SQL query in a map<string, string>
+bool PrometheusCursor::isOpen() const
+{
+   return (pImpl->transaction != nullptr);
+}
+
 //
-bool PrometheusTransaction::sqlToMap(const pdb::string &sql, pdb::stringmap &fieldMap)
+// PrometheusCursor::atEnd
+//
+bool PrometheusCursor::atEnd() const
+{
+   return pImpl->atEnd;
+}
+
+//
+// PrometheusCursor::rowCount
+//
+size_t PrometheusCursor::rowCount() const
+{
+   return pImpl->rowCount;
+}
+
+//
+// PrometheusCursor::fetchRow
+//
+// Read the next row of the query.
+//
+bool PrometheusCursor::fetchRow(pdb::stringmap &row)
 {
    bool result = false;
 
+   row.clear();
+
+   if(pImpl->atEnd)
+      return false;
+
    try
    {
-      result = SqlToMap(&pImpl->transaction, sql, fieldMap);
+      if((result = pImpl->reader->Next()))
+      {
+         pImpl->reader->ToMap(row);
+         ++pImpl->rowCount;
+      }
+      else
+         pImpl->atEnd = true;
+   }
+   catch(VIB::IBError &error)
+   {
+      last_sql_lib_error = error;
+      VerboseSQLError(nullptr);
+      pImpl->atEnd = true;
+      result = false;
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during SqlToMap");
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during cursor fetch");
+      pImpl->atEnd = true;
       result = false;
    }
 
-   if(!result)
-      VerboseSQLError(sql.c_str());
-
    return result;
 }
 
 //
-// PrometheusTransaction:;getFullRecord
+// PrometheusCursor::fetchRows
 //
-// This is largely a convenience wrapper around sqlToMap.
+// Read a chunk of up to maxRows rows of the query.
 //
-bool PrometheusTransaction::getFullRecord
-(
-   const pdb::string &tableName, 
-   const pdb::string &id, 
-   pdb::stringmap    &outmap
-)
+size_t PrometheusCursor::fetchRows(pdb::vecmap &rows, size_t maxRows)
 {
-   std::string query = "select * from " + tableName + " where id = " + id;
-   return sqlToMap(query, outmap);
+   rows.clear();
+
+   if(pImpl->atEnd)
+      return 0;
+
+   rows.reserve(std::min<size_t>(maxRows, 4096));
+
+   pdb::stringmap row;
+   while(rows.size() < maxRows && fetchRow(row))
+      rows.push_back(std::move(row));
+
+   return rows.size();
 }
 
+//=============================================================================
+//
+// PrometheusBulkInserter
+//
 
 //
-// PrometheusTransaction::sqlToVecMap
+// Private implementation details for PrometheusBulkInserter
 //
-// Returns the multiple-row result of a SQL query as a vector<map<string, string> >,
-// which while not of maximum efficiency due to the duplication of field names
-// in every map row of the vector, is MUCH easier to use than a more efficient
-// data structure would be.
+class PrometheusBulkInserterPimpl
+{
+public:
+   std::shared_ptr<PrometheusTransactionPimpl> trImpl;         // when opened on a PrometheusTransaction
+   std::shared_ptr<PrometheusDBPimpl>          dbImpl;         // when opened against a PrometheusDB
+   std::unique_ptr<VIB::Transaction>           ownTransaction; // likewise
+   BulkInserter                                inserter;       // must be destroyed first
+
+   PrometheusBulkInserterPimpl() : trImpl(), dbImpl(), ownTransaction(), inserter()
+   {
+   }
+};
+
 //
-bool PrometheusTransaction::sqlToVecMap(const pdb::string &sql, pdb::vecmap &fieldVecMap)
+// PrometheusBulkInserter Constructor
+//
+PrometheusBulkInserter::PrometheusBulkInserter()
+{
+   pImpl = new PrometheusBulkInserterPimpl;
+}
+
+//
+// PrometheusBulkInserter Destructor
+//
+PrometheusBulkInserter::~PrometheusBulkInserter()
+{
+   if(pImpl)
+   {
+      abort();
+      delete pImpl;
+      pImpl = nullptr;
+   }
+}
+
+//
+// PrometheusBulkInserter::open
+//
+// Prepare the insert on the caller's transaction.
+//
+bool PrometheusBulkInserter::open(PrometheusTransaction &tr, const pdb::string &tableName,
+                                  const pdb::stringvec &fieldNames, 
+                                  const pdb::strtointmap *fieldOptions,
+                                  unsigned int commitEvery, bool retaining)
 {
    bool result = false;
 
+   abort();
+
    try
    {
-      result = SqlToVecMap(&pImpl->transaction, sql, fieldVecMap);
+      pImpl->trImpl = tr.pImpl;
+      result = pImpl->inserter.Open(&tr.pImpl->transaction, tableName, fieldNames,
+                                    fieldOptions, commitEvery, retaining);
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during SqlToVecMap");
+      //DEBUGOUT(dbg_database, "DB: Unknown exception opening bulk inserter");
       result = false;
    }
 
    if(!result)
-      VerboseSQLError(sql.c_str());
+   {
+      VerboseSQLError(nullptr);
+      abort();
+   }
 
    return result;
 }
 
 //
-// PrometheusTransaction::sqlToSet
+// PrometheusBulkInserter::open
 //
-// Returns the single-row results of a SQL query as a set of strings.
+// Prepare the insert on a private transaction against the given database.
 //
-bool PrometheusTransaction::sqlToSet(const pdb::string &sql, pdb::stringset &fieldSet)
+bool PrometheusBulkInserter::open(PrometheusDB &db, const pdb::string &tableName,
+                                  const pdb::stringvec &fieldNames, 
+                                  const pdb::strtointmap *fieldOptions,
+                                  unsigned int commitEvery, bool retaining)
 {
    bool result = false;
 
+   abort();
+
    try
    {
-      result = SqlToSet(&pImpl->transaction, sql, fieldSet);
+      VIB::Transaction *vtr = OpenPrivateTransaction(db.pImpl, pImpl->dbImpl, pImpl->ownTransaction);
+      if(vtr)
+         result = pImpl->inserter.Open(vtr, tableName, fieldNames, fieldOptions, commitEvery, retaining);
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during SqlToSet");
+      //DEBUGOUT(dbg_database, "DB: Unknown exception opening bulk inserter");
       result = false;
    }
 
    if(!result)
-      VerboseSQLError(sql.c_str());
+   {
+      VerboseSQLError(nullptr);
+      abort();
+   }
 
    return result;
 }
 
 //
-// PrometheusTransaction::sqlToVec
+// PrometheusBulkInserter::insert
 //
-// Returns the single-row results of a SQL query as a vector of strings.
+bool PrometheusBulkInserter::insert(const pdb::stringvec &row)
+{
+   bool result = false;
+
+   try
+   {
+      result = pImpl->inserter.Insert(row);
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during bulk insert");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(nullptr);
+
+   return result;
+}
+
 //
-bool PrometheusTransaction::sqlToVec(const pdb::string &sql, pdb::stringvec &fieldVec)
+// PrometheusBulkInserter::insert
+//
+bool PrometheusBulkInserter::insert(const pdb::stringmap &row)
 {
    bool result = false;
 
    try
    {
-      result = SqlToVec(&pImpl->transaction, sql, fieldVec);
+      result = pImpl->inserter.Insert(row);
    }
    catch(...)
    {
-      //DEBUGOUT(dbg_database, "DB: Unknown exception during SqlToVec");
+      //DEBUGOUT(dbg_database, "DB: Unknown exception during bulk insert");
       result = false;
    }
 
    if(!result)
-      VerboseSQLError(sql.c_str());
+      VerboseSQLError(nullptr);
+
+   return result;
+}
+
+//
+// PrometheusBulkInserter::finish
+//
+// Commit outstanding rows and release the private transaction, if any.
+//
+bool PrometheusBulkInserter::finish()
+{
+   bool result = false;
+
+   try
+   {
+      result = pImpl->inserter.Finish();
+   }
+   catch(...)
+   {
+      //DEBUGOUT(dbg_database, "DB: Unknown exception finishing bulk insert");
+      result = false;
+   }
+
+   if(!result)
+      VerboseSQLError(nullptr);
+
+   abort(); // releases the private transaction
 
    return result;
 }
 
+//
+// PrometheusBulkInserter::abort
+//
+void PrometheusBulkInserter::abort()
+{
+   try
+   {
+      pImpl->inserter.Abort();
+      pImpl->ownTransaction.reset();
+      pImpl->dbImpl.reset();
+      pImpl->trImpl.reset();
+   }
+   catch(...)
+   {
+   }
+}
+
+//
+// PrometheusBulkInserter::isOpen
+//
+bool PrometheusBulkInserter::isOpen() const
+{
+   return pImpl->inserter.IsOpen();
+}
+
+//
+// PrometheusBulkInserter::rowCount
+//
+unsigned long PrometheusBulkInserter::rowCount() const
+{
+   return pImpl->inserter.Rows();
+}
+
+//
+// PrometheusBulkInserter::commitCount
+//
+unsigned long PrometheusBulkInserter::commitCount() const
+{
+   return pImpl->inserter.Commits();
+}
+
+//
+// PrometheusBulkInserter::elapsedMS
+//
+unsigned int PrometheusBulkInserter::elapsedMS() const
+{
+   return pImpl->inserter.ElapsedMS();
+}
+
+//
+// PrometheusBulkInserter::rowsPerSecond
+//
+double PrometheusBulkInserter::rowsPerSecond() const
+{
+   return pImpl->inserter.RowsPerSecond();
+}
+
 //=============================================================================
 //
 // PrometheusLookup
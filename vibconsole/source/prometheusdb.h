@@ -31,12 +31,17 @@
 #ifndef VIBC_NO_VISUALIB
 
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
 class PrometheusTransactionPimpl;
 class PrometheusDB;
+class PrometheusCursor;
+class PrometheusBulkInserter;
+class PrometheusPool;
+class PrometheusPoolPimpl;
 
 /** Convenience typedefs for annoying verbose STL composite types */
 namespace pdb
@@ -67,8 +72,10 @@ namespace pdb
 class PrometheusTransaction
 {
 protected:
-   PrometheusTransactionPimpl *pImpl; //!< Private implementation object.
+   std::shared_ptr<PrometheusTransactionPimpl> pImpl; //!< Private implementation object.
    friend class PrometheusDB;
+   friend class PrometheusCursor;
+   friend class PrometheusBulkInserter;
 
 public:
    /**
@@ -86,6 +93,8 @@ public:
     * fails, the destructor will be invoked one time anyway. If that also
     * fails, the TIBTransaction object will be deliberately leaked (destructors
     * should not throw exceptions, Borland!).
+    * Cursors and bulk inserters opened on the transaction hold their own
+    * reference to it, so this is put off until they are gone as well.
     */
    ~PrometheusTransaction();
 
@@ -158,6 +167,18 @@ public:
     */
    bool executeStatement(const pdb::string &sql);
 
+   /**
+    * Execute a parameterized SQL statement against this transaction.
+    * When the transaction was started with stdTransaction, the statement is
+    * prepared once in that connection's statement cache.
+    * @param sql    SQL statement with named parameters (ie. ":id").
+    * @param params Map of parameter names to values. Parameters not in the
+    *   map are NULL; an empty value is an empty string.
+    * @return True if the statement executed, false otherwise.
+    * @pre The transaction must be active.
+    */
+   bool executeStatement(const pdb::string &sql, const pdb::stringmap &params);
+
    /**
     * Lock a record for update.
     * @param tableName Database table the record resides within.
@@ -178,9 +199,22 @@ public:
     * @param[in] tableName Name of table. "_gen" will be appended to find the generator.
     * @param[out] result Value of the next ID to use. Unmodified if this operation fails.
     * @note Test the result using IsBlankOrZero to see if a valid result was returned.
+    * @note If PrometheusDB::setIdBlockSize has been called for the table, the ID
+    *       comes from a block reserved in advance rather than a query per call.
     * @pre The transaction must be active.
     */
    void getNextId(const pdb::string &tableName, pdb::string &result);
+
+   /**
+    * Retrieve several IDs for a table at once, as by getNextId, using at most
+    * one generator query.
+    * @param[in] tableName Name of table. "_gen" will be appended to find the generator.
+    * @param[in] count Number of IDs wanted.
+    * @param[out] ids Receives the IDs, appended in ascending order.
+    * @return True if successful, false otherwise.
+    * @pre The transaction must be active.
+    */
+   bool reserveIds(const pdb::string &tableName, unsigned int count, pdb::stringvec &ids);
    
    /**
     * Execute a SQL statement that is expected to return a single field in a single
@@ -256,8 +290,11 @@ class PrometheusDBPimpl;
 class PrometheusDB
 {
 protected:
-   PrometheusDBPimpl *pImpl;            //!< Private implementation object.
+   std::shared_ptr<PrometheusDBPimpl>   pImpl; //!< Private implementation object.
+   std::shared_ptr<PrometheusPoolPimpl> pool;  //!< Pool the connection is checked out of, if any.
    friend class PrometheusTransaction;
+   friend class PrometheusCursor;
+   friend class PrometheusBulkInserter;
 
 public:
    /**
@@ -276,6 +313,9 @@ public:
     * fails, the destructor will be invoked one time anyway. If that also
     * fails, the TIBDatabase object will be deliberately leaked (destructors
     * should not throw exceptions, Borland!).
+    * Transactions, cursors and bulk inserters opened on the connection hold
+    * their own reference to it, so it is not closed, or returned to its pool,
+    * until they are gone as well.
     */
    ~PrometheusDB();
 
@@ -298,10 +338,33 @@ public:
    bool connect(const char *dbname);
 
    /**
-    * Disconnect from the Firebird database, if connected.
+    * Disconnect from the Firebird database, if connected. A pooled connection
+    * is released back to its pool instead.
     */
    void disconnect();
 
+   /**
+    * Check a connection out of a pool, in place of this object's own. The
+    * lease ends on release(), disconnect(), or destruction of this object, so
+    * a stack-allocated PrometheusDB serves as a scoped lease. The connection
+    * goes back to the pool once the lease has ended and every transaction,
+    * cursor and bulk inserter opened on it is gone.
+    * @param pool An open PrometheusPool.
+    * @return False if the pool is closed, at its maximum size, or cannot connect.
+    */
+   bool acquire(PrometheusPool &pool);
+
+   /**
+    * End the lease on a pooled connection. The object is left disconnected.
+    * Does nothing if the connection was not acquired from a pool.
+    */
+   void release();
+
+   /**
+    * Test whether the connection was checked out of a PrometheusPool.
+    */
+   bool isPooled() const;
+
    /**
     * Test the state of the connection to the database.
     * @return True if connected, false if not.
@@ -352,6 +415,54 @@ public:
     */
    bool executeStatement(const pdb::string &sql);
 
+   /**
+    * Execute a parameterized SQL statement against a fresh transaction.
+    * The statement is prepared once and kept in this connection's statement
+    * cache, so repeated calls only bind new values.
+    * @param sql    SQL statement with named parameters (ie. ":id").
+    * @param params Map of parameter names to values. Parameters not in the
+    *   map are NULL; an empty value is an empty string.
+    * @return True if the statement executed, false otherwise.
+    * @pre The database must be connected.
+    */
+   bool executeStatement(const pdb::string &sql, const pdb::stringmap &params);
+
+   /**
+    * Set the maximum number of prepared statements this connection will keep.
+    * Least recently used statements are freed first. The default is 64.
+    * @param limit Maximum number of cached statements.
+    */
+   void setStatementCacheLimit(size_t limit);
+
+   /**
+    * Free every prepared statement cached by this connection. Disconnecting
+    * does this automatically.
+    */
+   void clearStatementCache();
+
+   /**
+    * Retrieve statement cache statistics.
+    * @param[out] stats Receives "hits", "misses", "evictions", "size" and "limit".
+    */
+   void getStatementCacheStats(pdb::strtointmap &stats);
+
+   /**
+    * Set how many IDs PrometheusTransaction::getNextId reserves from a table's
+    * generator at once. IDs left over are skipped when the connection is
+    * closed. The default is 1, which queries the generator on every call.
+    * @param tableName Name of table.
+    * @param blockSize IDs per generator query.
+    */
+   void setIdBlockSize(const pdb::string &tableName, unsigned int blockSize);
+
+   /**
+    * Retrieve ID allocation statistics for a table.
+    * @param[in] tableName Name of table.
+    * @param[out] stats Receives "blockSize", "refills", "issued" and "remaining".
+    * @return False if no IDs have been requested for the table.
+    */
+   bool getIdStats(const pdb::string &tableName, pdb::strtointmap &stats);
+
    /**
     * Execute a SQL statement that is expected to return a single field in a single
     * row, and return that result in the second parameter.
@@ -405,6 +516,273 @@ public:
    bool sqlToVec(const pdb::string &sql, pdb::stringvec &fieldVec);
 };
 
+class PrometheusCursorPimpl;
+
+/**
+ * Pool of connections to one Firebird database, shared by PrometheusDB
+ * instances through PrometheusDB::acquire.
+ *
+ * Connections are not probed on every statement. A connection idle for
+ * longer than the health check interval is tested with a server round trip
+ * when it is next checked out, and replaced if dead. Connections idle for
+ * longer than the pool's idle timeout are closed, down to its minimum size,
+ * whenever a connection is checked out or returned and on evictIdle; the
+ * console runs no message loop for IBX's IdleTimer to fire from.
+ *
+ * All methods are guaranteed to be exception-safe and never throw, and may
+ * be called from any thread.
+ */
+class PrometheusPool
+{
+protected:
+   std::shared_ptr<PrometheusPoolPimpl> pImpl; //!< Shared with leased connections
+   friend class PrometheusDB;
+
+private:
+   PrometheusPool(const PrometheusPool &);            // not copyable
+   PrometheusPool &operator = (const PrometheusPool &);
+
+public:
+   PrometheusPool();
+
+   /**
+    * Closes the pool. Connections still checked out are closed when they
+    * are released rather than returned to it.
+    */
+   ~PrometheusPool();
+
+   /**
+    * Open the pool and establish its minimum number of connections.
+    * @param addr Host address and database filepath, separated by a colon.
+    * @param user Database username.
+    * @param pw   Database username's password.
+    * @param minConnections Connections opened up front and kept when idle.
+    * @param maxConnections Limit on connections open at once.
+    * @param idleTimeoutMS Idle time after which connections beyond the minimum
+    *        are closed; 0 keeps them indefinitely.
+    * @return False if minConnections is nonzero and no connection could be made.
+    */
+   bool open(const pdb::string &addr, const pdb::string &user, const pdb::string &pw,
+             unsigned int minConnections = 1, unsigned int maxConnections = 8,
+             int idleTimeoutMS = 300000);
+
+   /**
+    * Open the pool using the db, user, and password values of a section of
+    * the global IniFile, as PrometheusDB::connect does.
+    * @see open(const pdb::string &, ...) for the remaining parameters.
+    */
+   bool open(const char *dbname, unsigned int minConnections = 1,
+             unsigned int maxConnections = 8, int idleTimeoutMS = 300000);
+
+   /**
+    * Close all idle connections and refuse further checkouts.
+    */
+   void close();
+
+   /** Test if the pool is open. */
+   bool isOpen() const;
+
+   /**
+    * Set how long a connection may sit idle before it is tested with a
+    * server round trip at checkout. The default is 30 seconds.
+    */
+   void setHealthCheckInterval(unsigned int ms);
+
+   /**
+    * Close idle connections that have outlived the idle timeout. This is also
+    * done on every checkout and return.
+    * @return Number of connections closed.
+    */
+   unsigned int evictIdle();
+
+   /**
+    * Retrieve pool statistics.
+    * @param[out] stats Receives "open", "idle", "inUse", "created", "reused",
+    *   "healthChecks", "failedChecks", "evicted", "exhausted", "min" and "max".
+    */
+   void getStats(pdb::strtointmap &stats);
+};
+
+/**
+ * Forward-only cursor over the results of a query. Unlike sqlToVecMap, rows
+ * are handed out one at a time or in fixed-size chunks as they are read from
+ * the server, so memory use is bounded regardless of the size of the result
+ * set. All methods are guaranteed to be exception-safe and never throw.
+ */
+class PrometheusCursor
+{
+protected:
+   PrometheusCursorPimpl *pImpl; //!< Private implementation object.
+
+public:
+   /**
+    * Instantiating an instance of PrometheusCursor creates a unidirectional
+    * dataset that is managed privately. Call open() to execute a query.
+    */
+   PrometheusCursor();
+
+   /**
+    * Closes the cursor, if open, before freeing the dataset.
+    */
+   ~PrometheusCursor();
+
+   /**
+    * Execute a query on an existing transaction. If the transaction is not
+    * yet active, it is started, and then committed when the cursor is closed.
+    * The cursor keeps the transaction alive until then.
+    * @param tr A transaction.
+    * @param sql Fully-formed SQL query to execute.
+    * @return True if the query is open, false otherwise.
+    */
+   bool open(PrometheusTransaction &tr, const pdb::string &sql);
+
+   /**
+    * Execute a query on a private transaction against the indicated
+    * database. The transaction is committed when the cursor is closed, and
+    * the cursor keeps the connection alive until then.
+    * @param db A connected database.
+    * @param sql Fully-formed SQL query to execute.
+    * @return True if the query is open, false otherwise.
+    */
+   bool open(PrometheusDB &db, const pdb::string &sql);
+
+   /**
+    * Close the query, committing the transaction if the cursor started it.
+    */
+   void close();
+
+   /**
+    * Test if the cursor has an open query.
+    * @return True if open, false if not.
+    */
+   bool isOpen() const;
+
+   /**
+    * Test if every row of the query has been fetched.
+    * @return True if at the end of the result set or not open.
+    */
+   bool atEnd() const;
+
+   /**
+    * Get the number of rows fetched from the cursor since it was opened.
+    */
+   size_t rowCount() const;
+
+   /**
+    * Fetch the next row of results, keyed by lowercased field name.
+    * @param[out] row Map that will receive the row. It is cleared first.
+    * @return True if a row was fetched, false at the end of the results or
+    *   on error.
+    */
+   bool fetchRow(pdb::stringmap &row);
+
+   /**
+    * Fetch up to maxRows rows of results into a vecmap.
+    * @param[out] rows Vector receiving the rows. It is cleared first.
+    * @param maxRows Maximum number of rows to fetch.
+    * @return Number of rows fetched; zero at the end of the results or on error.
+    */
+   size_t fetchRows(pdb::vecmap &rows, size_t maxRows);
+};
+
+class PrometheusBulkInserterPimpl;
+
+/**
+ * Loads many rows into a single table through one prepared insert statement,
+ * optionally committing in batches so that long imports do not accumulate in
+ * one transaction.
+ * All methods are guaranteed to be exception-safe and never throw.
+ */
+class PrometheusBulkInserter
+{
+protected:
+   PrometheusBulkInserterPimpl *pImpl; //!< Private implementation object.
+
+public:
+   /**
+    * Instantiating an instance of PrometheusBulkInserter creates an insert
+    * statement that is managed privately. Call open() to prepare it.
+    */
+   PrometheusBulkInserter();
+
+   /**
+    * Rows that have not been committed are rolled back if the inserter
+    * started the transaction and finish() was never called.
+    */
+   ~PrometheusBulkInserter();
+
+   /**
+    * Prepare to insert into a table on an existing transaction. If the
+    * transaction is not yet active, the inserter starts it and finish()
+    * commits it.
+    * @param tr A transaction that must outlive the inserter or its next finish().
+    * @param tableName Table into which rows are inserted.
+    * @param fieldNames Fields supplied for each row.
+    * @param fieldOptions Optional map of field names to sql_ option flags.
+    * @param commitEvery If nonzero, commit after every this many rows. Ignored
+    *   if the transaction was already active, as it is then the caller's to commit.
+    * @param retaining If true, batch commits use CommitRetaining.
+    * @return True if ready to insert, false otherwise.
+    */
+   bool open(PrometheusTransaction &tr, const pdb::string &tableName,
+             const pdb::stringvec &fieldNames, const pdb::strtointmap *fieldOptions = nullptr,
+             unsigned int commitEvery = 0, bool retaining = true);
+
+   /**
+    * Prepare to insert into a table on a private transaction against the
+    * indicated database. finish() commits the transaction.
+    * @param db A connected database that must outlive the inserter or its next finish().
+    * @see open(PrometheusTransaction &, ...) for the remaining parameters.
+    */
+   bool open(PrometheusDB &db, const pdb::string &tableName,
+             const pdb::stringvec &fieldNames, const pdb::strtointmap *fieldOptions = nullptr,
+             unsigned int commitEvery = 0, bool retaining = true);
+
+   /**
+    * Insert one row.
+    * @param row Values in the same order as the field names given to open().
+    *   Empty values are inserted as NULL.
+    * @return True if the row was inserted, false otherwise.
+    */
+   bool insert(const pdb::stringvec &row);
+
+   /**
+    * Insert one row.
+    * @param row Values keyed by field name. Empty or absent values are
+    *   inserted as NULL.
+    * @return True if the row was inserted, false otherwise.
+    */
+   bool insert(const pdb::stringmap &row);
+
+   /**
+    * Commit remaining rows, if the inserter started the transaction, and
+    * close the statement.
+    * @return True if successful, false otherwise.
+    */
+   bool finish();
+
+   /**
+    * Roll back rows not yet committed, if the inserter started the
+    * transaction, and close the statement.
+    */
+   void abort();
+
+   /** Test if the inserter is open. */
+   bool isOpen() const;
+
+   /** Number of rows inserted since open(). */
+   unsigned long rowCount() const;
+
+   /** Number of commits made since open(). */
+   unsigned long commitCount() const;
+
+   /** Milliseconds spent since open(), up to finish() or abort(). */
+   unsigned int elapsedMS() const;
+
+   /** Insertion rate since open(). */
+   double rowsPerSecond() const;
+};
+
 /**
  * Represents a bidirectional lookup table.
  */
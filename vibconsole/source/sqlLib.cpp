@@ -4,9 +4,20 @@
 
 #include <algorithm>
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef VIBC_NO_WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
 
 #include "util.h"
 #include "sqlLib.h"
+#include "csvfile.h"
+#include "timer.h"
 
 //---------------------------------------------------------------------------
 sql_error last_sql_lib_error;
@@ -29,6 +40,306 @@ static void StdDataSet(VIB::DataSet &vds, VIB::Transaction *vtr, sqlcstr sql, bo
    vds.First();
 }
 //---------------------------------------------------------------------------
+// SqlRowReader
+SqlRowReader::SqlRowReader(VIB::DataSet &ds, bool preserve_fieldname_case, int block_rows)
+   : dataSet(ds), block(block_rows), keys(), keyOrder(), row(0)
+{
+   int count = dataSet.Fields->Count;
+
+   keys.reserve(count);
+   keyOrder.reserve(count);
+
+   for(int i = 0; i < count; i++)
+   {
+      std::string field_name = dataSet.Fields->Fields[i]->FieldName;
+      if(!preserve_fieldname_case)
+         field_name = LowercaseString(field_name); // compat w/ Prometheus
+      keys.push_back(field_name);
+      keyOrder.push_back(i);
+   }
+
+   // Visiting columns in key order lets ToMap append each value at the end of
+   // the map. FieldByName resolves a duplicated name to its first field, so
+   // keep only the lowest column of each run of equal keys.
+   const sqlvecstr &k = keys;
+   std::stable_sort(keyOrder.begin(), keyOrder.end(), 
+                    [&k] (int a, int b) { return k[a] < k[b]; });
+   keyOrder.erase(std::unique(keyOrder.begin(), keyOrder.end(), 
+                              [&k] (int a, int b) { return k[a] == k[b]; }),
+                  keyOrder.end());
+}
+
+bool SqlRowReader::Next()
+{
+   if(++row < block.Rows())
+      return true;
+
+   row = 0;
+   return (dataSet.fetchBlock(block) > 0);
+}
+
+void SqlRowReader::ToMap(sqlmapstrs &row_map) const
+{
+   for(auto itr = keyOrder.cbegin(); itr != keyOrder.cend(); ++itr)
+      row_map.insert(row_map.end(), sqlmapstrs::value_type(keys[*itr], block.AsString(row, *itr)));
+}
+//---------------------------------------------------------------------------
+// SqlStatementCache
+SqlStatementCache::SqlStatementCache(VIB::Database *dbDatabase, size_t max_entries)
+   : database(dbDatabase), ownTransaction(), ownReady(false), readTransaction(),
+     readReady(false), entries(), index(), limit(max_entries), hits(0), misses(0),
+     evictions(0)
+{
+}
+
+SqlStatementCache::~SqlStatementCache()
+{
+   try
+   {
+      Clear();
+   }
+   catch(...)
+   {
+   }
+}
+
+// Build a cache key from SQL text. Comments and runs of whitespace outside
+// of quoted literals and identifiers count as a single space, so that
+// statements differing only in layout share an entry.
+std::string SqlStatementCache::NormalizeSql(sqlcstr sql)
+{
+   std::string normalized;
+   char quote = 0;
+   bool pending_space = false;
+
+   normalized.reserve(sql.length());
+
+   for(std::string::const_iterator itr = sql.begin(); itr != sql.end(); ++itr)
+   {
+      char c = *itr;
+      char next = (itr + 1 != sql.end()) ? *(itr + 1) : 0;
+
+      if(quote)
+      {
+         normalized += c;
+         if(c == quote)
+            quote = 0; // a doubled quote simply reopens on the next character
+      }
+      else if(c == ' ' || c == '\t' || c == '\r' || c == '\n')
+         pending_space = !normalized.empty();
+      else if(c == '-' && next == '-')
+      {
+         // line comment, up to but not including the line break
+         while(itr + 1 != sql.end() && *(itr + 1) != '\n' && *(itr + 1) != '\r')
+            ++itr;
+         pending_space = !normalized.empty();
+      }
+      else if(c == '/' && next == '*')
+      {
+         // block comment; an unterminated one runs to the end
+         for(++itr; itr + 1 != sql.end() && !(*itr == '*' && *(itr + 1) == '/'); ++itr)
+            ;
+         if(itr + 1 != sql.end())
+            ++itr;
+         pending_space = !normalized.empty();
+      }
+      else
+      {
+         if(pending_space)
+            normalized += ' ';
+         pending_space = false;
+         normalized += c;
+         if(c == '\'' || c == '"')
+            quote = c;
+      }
+   }
+
+   return normalized;
+}
+
+// Only DML is cached; DDL and transaction control must see a fresh statement.
+bool SqlStatementCache::IsCacheable(sqlcstr normalized_sql)
+{
+   static const char *const cacheable[] =
+   {
+      "select", "insert", "update", "delete", "execute", "with", "merge"
+   };
+   std::string verb = LowercaseString(normalized_sql.substr(0, normalized_sql.find_first_of(" (")));
+
+   for(size_t i = 0; i < sizeof(cacheable) / sizeof(*cacheable); i++)
+   {
+      if(verb == cacheable[i])
+         return true;
+   }
+
+   return false;
+}
+
+auto SqlStatementCache::Lookup(const std::string &key, bool &found) -> Entry &
+{
+   auto itr = index.find(key);
+
+   if((found = (itr != index.end())))
+   {
+      entries.splice(entries.begin(), entries, itr->second);
+      return entries.front();
+   }
+
+   Entry entry = { key, NULL, NULL };
+   entries.push_front(entry);
+   index[key] = entries.begin();
+   return entries.front();
+}
+
+void SqlStatementCache::Remove(entrylist::iterator itr)
+{
+   VIB::SQL     *statement = itr->statement;
+   VIB::DataSet *query     = itr->query;
+
+   index.erase(itr->key);
+   entries.erase(itr);
+
+   delete statement;
+   delete query;
+}
+
+// The most recent entry is always kept, as its statement is about to be used.
+void SqlStatementCache::Trim()
+{
+   while(entries.size() > limit && entries.size() > 1)
+   {
+      Remove(--entries.end());
+      ++evictions;
+   }
+}
+
+void SqlStatementCache::SetLimit(size_t max_entries)
+{
+   limit = max_entries;
+   Trim();
+}
+
+void SqlStatementCache::Clear()
+{
+   while(!entries.empty())
+      Remove(entries.begin());
+
+   // nothing prepared in it is left to keep; end it if the connection allows
+   if(readReady && readTransaction.Active)
+   {
+      try
+      {
+         readTransaction.Commit();
+      }
+      catch(...)
+      {
+      }
+   }
+}
+
+// Returns NULL if the transaction could not be set up.
+VIB::Transaction *SqlStatementCache::OwnTransaction()
+{
+   if(!ownReady)
+      ownReady = StdTransaction(&ownTransaction, database, false);
+
+   return ownReady ? &ownTransaction : NULL;
+}
+
+// Left active between calls, as committing it would unprepare every cached
+// data set. Being read-only and read committed, it sees each commit as it
+// happens and holds no locks. Returns NULL if the transaction could not be
+// set up; throws VIB::IBError if it could not be started.
+VIB::Transaction *SqlStatementCache::ReadTransaction()
+{
+   if(!readReady && SpyTransaction(&readTransaction, database, false))
+   {
+      readTransaction.Params->Add("read");
+      readReady = true;
+   }
+
+   if(!readReady)
+      return NULL;
+
+   if(!readTransaction.Active)
+      readTransaction.StartTransaction();
+
+   return &readTransaction;
+}
+
+VIB::SQL *SqlStatementCache::Statement(VIB::Transaction *dbTransaction, sqlcstr sql)
+{
+   bool   found;
+   Entry &entry = Lookup("X" + NormalizeSql(sql), found);
+
+   try
+   {
+      if(!entry.statement)
+      {
+         entry.statement = new VIB::SQL();
+         entry.statement->Database = database->getVIBDatabase();
+      }
+
+      entry.statement->Transaction = dbTransaction->getVIBTransaction();
+
+      if(found && entry.statement->Prepared)
+         ++hits;
+      else
+      {
+         ++misses;
+         entry.statement->_SQL->Text = sql;
+         entry.statement->Prepare();
+      }
+   }
+   catch(...)
+   {
+      Remove(entries.begin());
+      throw;
+   }
+
+   VIB::SQL *statement = entry.statement;
+   Trim();
+   return statement;
+}
+
+VIB::DataSet *SqlStatementCache::Query(VIB::Transaction *dbTransaction, sqlcstr sql)
+{
+   bool   found;
+   Entry &entry = Lookup("Q" + NormalizeSql(sql), found);
+
+   try
+   {
+      if(!entry.query)
+      {
+         entry.query = new VIB::DataSet();
+         entry.query->Database       = database->getVIBDatabase();
+         entry.query->UniDirectional = true;
+         entry.query->SelectSQL->Add(sql);
+      }
+      else
+         entry.query->Close(); // in case a previous user failed mid-read
+
+      entry.query->Transaction = dbTransaction->getVIBTransaction();
+
+      if(found && entry.query->Prepared)
+         ++hits;
+      else
+      {
+         ++misses;
+         entry.query->Prepare();
+      }
+   }
+   catch(...)
+   {
+      Remove(entries.begin());
+      throw;
+   }
+
+   VIB::DataSet *query = entry.query;
+   Trim();
+   return query;
+}
+//---------------------------------------------------------------------------
 // jhaley 20110318: Connect to a database
 // VIB port done 20121119
 bool ConnectToDatabase(VIB::Database *dbDatabase, sqlcstr server, sqlcstr user_name, sqlcstr password)
@@ -42,6 +353,11 @@ bool ConnectToDatabase(VIB::Database *dbDatabase, sqlcstr server, sqlcstr user_n
          std::string userNameParam = "user_name=" + user_name;
          std::string passwordParam = "password="  + password;
 
+         // a link the server has dropped still reads as connected, which
+         // would leave the settings below read-only and Connected a no-op
+         if(SqlIsConnected(*dbDatabase))
+            dbDatabase->ForceClose();
+
          dbDatabase->DatabaseName = server;
          dbDatabase->Params->Add(userNameParam);
          dbDatabase->Params->Add(passwordParam);
@@ -64,7 +380,7 @@ bool LockRecordForUpdate(VIB::Transaction *dbTransaction, sqlcstr tableName, sql
 {
    VIB::Database vdb = dbTransaction->DefaultDatabase;
 
-   if(vdb.TestConnected())
+   if(SqlIsConnected(vdb))
    {
       bool can_commit = true;
 
@@ -111,7 +427,7 @@ bool ExecuteUpdateStatement(VIB::Transaction *dbTransaction, sqlcstr tableName,
    if(!field_options)
       field_options = &def_field_options;
 
-   if(vdb.TestConnected())
+   if(SqlIsConnected(vdb))
    {
       VIB::SQL dbSQL = VIB::SQL();
       std::string sqlstring;
@@ -211,7 +527,7 @@ bool ExecuteUpdateStatement(VIB::Database *dbDatabase, sqlcstr tableName,
                             sqlcmapstrs fieldMap, const sqlmapstrtoint *field_options, 
                             bool show_error)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       bool return_value = true;
       VIB::Transaction dbTransaction;
@@ -244,7 +560,7 @@ bool ExecuteInsertStatement(VIB::Transaction *dbTransaction, sqlcstr tableName,
    if(!field_options)
       field_options = &default_options;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       bool can_commit = true;
 
@@ -347,7 +663,7 @@ bool ExecuteInsertStatement(VIB::Database *dbDatabase, sqlcstr tableName,
                             sqlcmapstrs fieldMap, const sqlmapstrtoint *field_options, 
                             bool show_error)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       bool return_value = true;
       VIB::Transaction dbTransaction;
@@ -375,7 +691,7 @@ std::string GetNextId(VIB::Transaction *dbTransaction, sqlcstr tableName)
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
    
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
       std::string returnString;
@@ -413,7 +729,7 @@ std::string GetNextId(VIB::Database *dbDatabase, sqlcstr tableName)
 {
    std::string returnString = "";
    
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       
@@ -432,13 +748,227 @@ std::string GetNextId(VIB::Database *dbDatabase, sqlcstr tableName)
    return returnString;
 }
 //--------------------------------------------------------------------------
+// Parse a plain decimal integer of up to 18 digits, which always fits.
+static bool ParseInt64(const char *str, long long &result)
+{
+   const char *p = str;
+   bool negative = (*p == '-');
+
+   if(*p == '-' || *p == '+')
+      ++p;
+   if(!*p || strlen(p) > 18 || strspn(p, "0123456789") != strlen(p))
+      return false;
+
+   for(result = 0; *p; ++p)
+      result = result * 10 + (*p - '0');
+   if(negative)
+      result = -result;
+
+   return true;
+}
+//--------------------------------------------------------------------------
+static std::string Int64ToString(long long value)
+{
+   char  buf[24];
+   char *p = buf + sizeof(buf);
+   unsigned long long u = value < 0 ? 0ULL - value : value;
+
+   *--p = '\0';
+   do
+   {
+      *--p = static_cast<char>('0' + u % 10);
+      u /= 10;
+   }
+   while(u);
+   if(value < 0)
+      *--p = '-';
+
+   return p;
+}
+//--------------------------------------------------------------------------
+SqlMutex::SqlMutex() : cs(NULL)
+{
+#ifndef VIBC_NO_WIN32
+   CRITICAL_SECTION *section = new CRITICAL_SECTION;
+   InitializeCriticalSection(section);
+   cs = section;
+#endif
+}
+
+SqlMutex::~SqlMutex()
+{
+#ifndef VIBC_NO_WIN32
+   CRITICAL_SECTION *section = static_cast<CRITICAL_SECTION *>(cs);
+   DeleteCriticalSection(section);
+   delete section;
+#endif
+}
+
+void SqlMutex::Lock()
+{
+#ifndef VIBC_NO_WIN32
+   EnterCriticalSection(static_cast<CRITICAL_SECTION *>(cs));
+#endif
+}
+
+void SqlMutex::Unlock()
+{
+#ifndef VIBC_NO_WIN32
+   LeaveCriticalSection(static_cast<CRITICAL_SECTION *>(cs));
+#endif
+}
+//--------------------------------------------------------------------------
+SqlIdAllocator::SqlIdAllocator(unsigned int default_block_size)
+   : blocks(), defaultSize(default_block_size ? default_block_size : 1), clears(0), lock()
+{
+}
+
+SqlIdAllocator::~SqlIdAllocator()
+{
+}
+
+SqlIdAllocator::Block &SqlIdAllocator::GetBlock(sqlcstr table_name)
+{
+   blockmap::iterator itr = blocks.find(table_name);
+
+   if(itr == blocks.end())
+   {
+      Block block = { 0, -1, 0, 0, 0 }; // empty: next > last
+      itr = blocks.insert(blockmap::value_type(table_name, block)).first;
+   }
+
+   return itr->second;
+}
+
+// Append count ids for table_name to ids, from the current block if what is
+// left of it suffices, and otherwise from a fresh block of at least count ids
+// reserved in one round trip. The lock is not held during the round trip, so
+// other threads can carry on drawing ids meanwhile; the state is checked
+// again once it is reacquired.
+bool SqlIdAllocator::Take(VIB::Transaction *dbTransaction, sqlcstr table_name, unsigned int count,
+                          sqlvecstr &ids)
+{
+   unsigned int  size;
+   unsigned long generation;
+
+   {
+      SqlMutexHold hold(lock);
+      Block &block = GetBlock(table_name);
+
+      if(block.last - block.next + 1 >= static_cast<long long>(count))
+      {
+         ids.reserve(ids.size() + count);
+         for(unsigned int i = 0; i < count; i++)
+            ids.push_back(Int64ToString(block.next++));
+         block.issued += count;
+         return true;
+      }
+
+      size = block.size ? block.size : defaultSize;
+      if(count > size)
+         size = count;
+      generation = clears;
+   }
+
+   // gen_id returns the last id of the range it has just reserved
+   std::string sqlstring = "select gen_id(" + table_name + "_gen, " + UIntToString(size) + ") from uno";
+   std::string value     = GetOneField(dbTransaction, sqlstring);
+   long long   last;
+
+   if(!ParseInt64(value.c_str(), last))
+      return false;
+
+   long long first = last - size + 1;
+
+   SqlMutexHold hold(lock);
+   Block &block = GetBlock(table_name);
+
+   ids.reserve(ids.size() + count);
+   for(unsigned int i = 0; i < count; i++)
+      ids.push_back(Int64ToString(first++));
+   block.issued += count;
+   ++block.refills;
+
+   // another thread may have refilled the block while the lock was released;
+   // the rest of this range replaces it only if longer, and never after a
+   // Clear. Whichever range is dropped is skipped, like any unused ids.
+   if(generation == clears && last - first > block.last - block.next)
+   {
+      block.next = first;
+      block.last = last;
+   }
+
+   return true;
+}
+
+std::string SqlIdAllocator::NextId(VIB::Transaction *dbTransaction, sqlcstr table_name)
+{
+   sqlvecstr ids;
+
+   return Take(dbTransaction, table_name, 1, ids) ? ids[0] : std::string();
+}
+
+bool SqlIdAllocator::Reserve(VIB::Transaction *dbTransaction, sqlcstr table_name, unsigned int count,
+                             sqlvecstr &ids)
+{
+   return Take(dbTransaction, table_name, count, ids);
+}
+
+void SqlIdAllocator::SetBlockSize(sqlcstr table_name, unsigned int block_size)
+{
+   SqlMutexHold hold(lock);
+   GetBlock(table_name).size = block_size;
+}
+
+unsigned int SqlIdAllocator::BlockSize(sqlcstr table_name)
+{
+   SqlMutexHold hold(lock);
+   unsigned int size = GetBlock(table_name).size;
+
+   return size ? size : defaultSize;
+}
+
+bool SqlIdAllocator::GetStats(sqlcstr table_name, Stats &stats)
+{
+   SqlMutexHold hold(lock);
+   blockmap::const_iterator itr = blocks.find(table_name);
+
+   if(itr == blocks.end())
+      return false;
+
+   const Block &block = itr->second;
+   stats.block_size = block.size ? block.size : defaultSize;
+   stats.refills    = block.refills;
+   stats.issued     = block.issued;
+   stats.remaining  = block.last - block.next + 1;
+
+   return true;
+}
+
+void SqlIdAllocator::Clear()
+{
+   SqlMutexHold hold(lock);
+
+   ++clears;
+
+   // keep configured block sizes; drop the reserved ranges and counters
+   for(blockmap::iterator itr = blocks.begin(); itr != blocks.end(); ++itr)
+   {
+      Block &block = itr->second;
+      block.next    = 0;
+      block.last    = -1;
+      block.refills = 0;
+      block.issued  = 0;
+   }
+}
+//--------------------------------------------------------------------------
 // VIB port done 20121120
 std::string GetOneField(VIB::Transaction *dbTransaction, sqlcstr sqlstring)
 {
    std::string returnString = "";
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       bool canCommit = true;
       VIB::DataSet dbDataSet;
@@ -478,7 +1008,7 @@ std::string GetOneField(VIB::Database *dbDatabase, sqlcstr sqlstring)
 {
    std::string returnString = "";
    
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       
@@ -502,7 +1032,7 @@ bool FillSKVTable(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapmap &secti
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
    
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       // empty map
       section_key_value_map.clear();
@@ -554,7 +1084,7 @@ std::string GetPersonName(VIB::Transaction *dbTransaction, sqlcstr person_id, in
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
    
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       std::string returnString = "";
 
@@ -620,7 +1150,7 @@ std::string GetPersonName(VIB::Database *dbDatabase, sqlcstr person_id, int orde
 {
    std::string returnString = "";
 
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       
@@ -644,7 +1174,7 @@ std::string GetUserName(VIB::Transaction *dbTransaction, sqlcstr user_id, int or
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       std::string returnString = "";
       
@@ -673,7 +1203,7 @@ std::string GetUserName(VIB::Database *dbDatabase, sqlcstr user_id, int order)
 {
    std::string returnString = "";
 
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       
@@ -697,7 +1227,7 @@ bool ExecuteStatement(VIB::Transaction *dbTransaction, sqlcstr sqlstring)
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       bool canCommit = true;
       bool toReturn = true;
@@ -744,7 +1274,7 @@ bool ExecuteStatement(VIB::Transaction *dbTransaction, sqlcstr sqlstring)
 // VIB port done 20121120
 bool ExecuteStatement(VIB::Database *dbDatabase, sqlcstr sqlstring)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       bool toReturn = true;
       VIB::Transaction dbTransaction;
@@ -772,10 +1302,9 @@ bool SqlToMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrs &field_ma
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
    
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
-      std::string field_name;
       bool toReturn = true;
       bool can_commit = true;
       
@@ -788,14 +1317,9 @@ bool SqlToMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrs &field_ma
       {
          StdDataSet(dbDataSet, dbTransaction, sql, can_commit);
          
-         if(!dbDataSet.Eof())
-         {
-            for(int i = 0; i < dbDataSet.Fields->Count; i++)
-            {
-               field_name = LowercaseString(dbDataSet.Fields->Fields[i]->FieldName);
-               field_map[field_name] = dbDataSet.FieldByName(field_name)->AsString;
-            }
-         }
+         SqlRowReader reader(dbDataSet, false, 1);
+         if(reader.Next())
+            reader.ToMap(field_map);
          
          dbDataSet.Close();
          
@@ -827,21 +1351,287 @@ bool SqlToMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrs &field_ma
 // VIB port done 20121120
 bool SqlToMap(VIB::Database *dbDatabase, sqlcstr sql, sqlmapstrs &field_map)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
+   {
+      VIB::Transaction dbTransaction;
+      bool toReturn = true;
+
+      try
+      {
+         StdTransaction(&dbTransaction, dbDatabase, false);
+         toReturn = SqlToMap(&dbTransaction, sql, field_map);
+      }
+      catch(...)
+      {
+         toReturn = false;
+         if(dbTransaction.Active)
+            dbTransaction.Rollback();
+      }
+
+      return toReturn;
+   }
+   else
+      return false;
+}
+//--------------------------------------------------------------------------
+// Bind named parameters and execute. A cached statement keeps the values of
+// its last use, so every parameter is set to NULL first; those named in
+// params then receive their values, empty strings included.
+static void ExecWithParams(VIB::SQL *dbSQL, const sqlmapstrs *params)
+{
+   if(params)
+   {
+      if(!dbSQL->Prepared)
+         dbSQL->Prepare();
+
+      int count = dbSQL->Params->Count();
+      for(int i = 0; i < count; i++)
+         dbSQL->Params->SetIsNull(i, true);
+
+      for(sqlmapstrs::const_iterator itr = params->begin(); itr != params->end(); ++itr)
+         dbSQL->Params->ByName(itr->first)->AsString = itr->second;
+   }
+
+   dbSQL->ExecQuery();
+   dbSQL->Close();
+}
+//--------------------------------------------------------------------------
+// ExecuteStatement through a statement cache. Named parameters in the
+// statement are bound from params; any not given there are NULL. Only DML
+// is cached; anything else runs in a one-off statement.
+bool CachedExecuteStatement(SqlStatementCache &cache, VIB::Transaction *dbTransaction,
+                            sqlcstr sqlstring, const sqlmapstrs *params)
+{
+   bool cacheable = SqlStatementCache::IsCacheable(SqlStatementCache::NormalizeSql(sqlstring));
+
+   if(!cacheable)
+   {
+      // release any locks cached statements hold on objects this may change
+      cache.Clear();
+      if(!params)
+         return ExecuteStatement(dbTransaction, sqlstring);
+   }
+
+   VIB::Database db = dbTransaction->DefaultDatabase;
+
+   if(SqlIsConnected(db))
+   {
+      bool canCommit = true;
+      bool toReturn = true;
+
+      if(dbTransaction->Active)
+         canCommit = false;
+
+      try
+      {
+         if(canCommit)
+            dbTransaction->StartTransaction();
+
+         if(cacheable)
+            ExecWithParams(cache.Statement(dbTransaction, sqlstring), params);
+         else
+         {
+            VIB::SQL dbSQL;
+
+            dbSQL.Database    = dbTransaction->DefaultDatabase;
+            dbSQL.Transaction = dbTransaction->getVIBTransaction();
+            dbSQL._SQL->Text  = sqlstring;
+            ExecWithParams(&dbSQL, params);
+         }
+
+         if(canCommit)
+            dbTransaction->Commit();
+
+         toReturn = true;
+      }
+      catch(VIB::IBError & error)
+      {
+         last_sql_lib_error = error;
+         toReturn = false;
+      }
+      catch (...)
+      {
+         toReturn = false;
+      }
+
+      if(canCommit && dbTransaction->Active)
+         dbTransaction->Rollback();
+
+      return toReturn;
+   }
+   else
+      return false;
+}
+//--------------------------------------------------------------------------
+bool CachedExecuteStatement(SqlStatementCache &cache, sqlcstr sqlstring, const sqlmapstrs *params)
+{
+   VIB::Database    *dbDatabase    = cache.GetDatabase();
+   VIB::Transaction *dbTransaction = NULL;
+
+   if(SqlIsConnected(*dbDatabase))
+   {
+      bool toReturn = true;
+
+      try
+      {
+         if((dbTransaction = cache.OwnTransaction()))
+            toReturn = CachedExecuteStatement(cache, dbTransaction, sqlstring, params);
+         else
+            toReturn = false;
+      }
+      catch(...)
+      {
+         toReturn = false;
+         if(dbTransaction && dbTransaction->Active)
+            dbTransaction->Rollback();
+      }
+
+      return toReturn;
+   }
+   else
+      return false;
+}
+//--------------------------------------------------------------------------
+std::string CachedGetOneField(SqlStatementCache &cache, VIB::Transaction *dbTransaction, sqlcstr sqlstring)
+{
+   std::string returnString = "";
+   VIB::Database db = dbTransaction->DefaultDatabase;
+
+   if(SqlIsConnected(db))
+   {
+      bool canCommit = true;
+
+      try
+      {
+         if(dbTransaction->Active)
+            canCommit = false;
+
+         if(canCommit)
+            dbTransaction->StartTransaction();
+
+         VIB::DataSet *dbDataSet = cache.Query(dbTransaction, sqlstring);
+
+         dbDataSet->Open();
+         if(dbDataSet->Eof() == false)
+            returnString = dbDataSet->Fields->Fields[0]->AsString;
+         dbDataSet->Close();
+
+         if(canCommit)
+            dbTransaction->Commit();
+      }
+      catch(VIB::IBError & error)
+      {
+         last_sql_lib_error = error;
+      }
+      catch (...)
+      {
+      }
+
+      if(canCommit && (dbTransaction->Active))
+         dbTransaction->Rollback();
+   }
+
+   return returnString;
+}
+//--------------------------------------------------------------------------
+std::string CachedGetOneField(SqlStatementCache &cache, sqlcstr sqlstring)
+{
+   std::string       returnString  = "";
+   VIB::Database    *dbDatabase    = cache.GetDatabase();
+   VIB::Transaction *dbTransaction = NULL;
+
+   if(SqlIsConnected(*dbDatabase))
+   {
+      try
+      {
+         if((dbTransaction = cache.ReadTransaction()))
+            returnString = CachedGetOneField(cache, dbTransaction, sqlstring);
+      }
+      catch(...)
+      {
+         if(dbTransaction && dbTransaction->Active)
+            dbTransaction->Rollback();
+      }
+   }
+
+   return returnString;
+}
+//--------------------------------------------------------------------------
+bool CachedSqlToMap(SqlStatementCache &cache, VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrs &field_map)
+{
+   VIB::Database db = dbTransaction->DefaultDatabase;
+
+   if(SqlIsConnected(db))
+   {
+      bool toReturn = true;
+      bool can_commit = true;
+
+      if(dbTransaction->Active)
+         can_commit = false;
+
+      field_map.clear();
+
+      try
+      {
+         if(can_commit)
+            dbTransaction->StartTransaction();
+
+         VIB::DataSet *dbDataSet = cache.Query(dbTransaction, sql);
+
+         dbDataSet->Open();
+         {
+            SqlRowReader reader(*dbDataSet, false, 1);
+            if(reader.Next())
+               reader.ToMap(field_map);
+         }
+         dbDataSet->Close();
+
+         if(can_commit)
+            dbTransaction->Commit();
+
+         toReturn = true;
+      }
+      catch(VIB::IBError & error)
+      {
+         last_sql_lib_error = error;
+         toReturn = false;
+         if(dbTransaction->Active && can_commit)
+            dbTransaction->Rollback();
+      }
+      catch(...)
+      {
+         toReturn = false;
+         if(dbTransaction->Active && can_commit)
+            dbTransaction->Rollback();
+      }
+
+      return toReturn;
+   }
+   else
+      return false;
+}
+//--------------------------------------------------------------------------
+bool CachedSqlToMap(SqlStatementCache &cache, sqlcstr sql, sqlmapstrs &field_map)
+{
+   VIB::Database    *dbDatabase    = cache.GetDatabase();
+   VIB::Transaction *dbTransaction = NULL;
+
+   if(SqlIsConnected(*dbDatabase))
    {
-      VIB::Transaction dbTransaction;
       bool toReturn = true;
 
       try
       {
-         StdTransaction(&dbTransaction, dbDatabase, false);
-         toReturn = SqlToMap(&dbTransaction, sql, field_map);
+         if((dbTransaction = cache.ReadTransaction()))
+            toReturn = CachedSqlToMap(cache, dbTransaction, sql, field_map);
+         else
+            toReturn = false;
       }
       catch(...)
       {
          toReturn = false;
-         if(dbTransaction.Active)
-            dbTransaction.Rollback();
+         if(dbTransaction && dbTransaction->Active)
+            dbTransaction->Rollback();
       }
 
       return toReturn;
@@ -855,10 +1645,9 @@ bool SqlToVecMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlvecmap &field_
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
-      std::string field_name;
       bool toReturn   = true;
       bool can_commit = true;
       
@@ -871,19 +1660,13 @@ bool SqlToVecMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlvecmap &field_
       {
          StdDataSet(dbDataSet, dbTransaction, sql, can_commit);
 
-         while(!dbDataSet.Eof())
+         SqlRowReader reader(dbDataSet, preserve_fieldname_case);
+         while(reader.Next())
          {
             sqlmapstrs temp_map;
             
-            for(int i = 0; i < dbDataSet.Fields->Count; i++)
-            {
-               field_name = dbDataSet.Fields->Fields[i]->FieldName;
-               if(!preserve_fieldname_case) 
-                  field_name = LowercaseString(field_name); // default false; compat w/ Prometheus
-               temp_map[field_name] = dbDataSet.FieldByName(field_name)->AsString;
-            }
-            field_vec.push_back(temp_map);
-            dbDataSet.Next();
+            reader.ToMap(temp_map);
+            field_vec.push_back(std::move(temp_map));
          }
          
          dbDataSet.Close();
@@ -916,7 +1699,7 @@ bool SqlToVecMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlvecmap &field_
 // VIB port done 20121120
 bool SqlToVecMap(VIB::Database *dbDatabase, sqlcstr sql, sqlvecmap &field_vec, bool preserve_fieldname_case)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -944,10 +1727,9 @@ bool SqlToListMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqllistmap &fiel
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
-      std::string field_name;
       bool toReturn   = true;
       bool can_commit = true;
       
@@ -960,17 +1742,13 @@ bool SqlToListMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqllistmap &fiel
       {
          StdDataSet(dbDataSet, dbTransaction, sql, can_commit);
          
-         while(!dbDataSet.Eof())
+         SqlRowReader reader(dbDataSet);
+         while(reader.Next())
          {
             sqlmapstrs temp_map;
             
-            for(int i = 0; i < dbDataSet.Fields->Count; i++)
-            {
-               field_name = LowercaseString(dbDataSet.Fields->Fields[i]->FieldName);
-               temp_map[field_name] = dbDataSet.FieldByName(field_name.c_str())->AsString;
-            }
-            field_list.push_back(temp_map);
-            dbDataSet.Next();
+            reader.ToMap(temp_map);
+            field_list.push_back(std::move(temp_map));
          }
 
          dbDataSet.Close();
@@ -1003,7 +1781,7 @@ bool SqlToListMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqllistmap &fiel
 // VIB port done 20121120
 bool SqlToListMap(VIB::Database *dbDatabase, sqlcstr sql, sqllistmap &field_list)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1034,10 +1812,10 @@ bool SqlToMapMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapmap &field_
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
-      std::string field_name, key;
+      std::string key;
       bool toReturn   = true;
       bool can_commit = true;
       
@@ -1050,24 +1828,18 @@ bool SqlToMapMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapmap &field_
       {
          StdDataSet(dbDataSet, dbTransaction, sql, can_commit);
 
-         while(!dbDataSet.Eof())
+         SqlRowReader reader(dbDataSet, preserve_fieldname_case);
+         while(reader.Next())
          {
             // assume the data in the first column is the key
-            key = dbDataSet.Fields->Fields[0]->AsString;
+            key = reader.AsString(0);
 
             // iterate
             sqlmapstrs temp_map;
-            for(int i = 0; i < dbDataSet.Fields->Count; i++)
-            {
-               field_name = dbDataSet.Fields->Fields[i]->FieldName;
-               if(!preserve_fieldname_case) 
-                  field_name = LowercaseString(field_name); // default false; compat w/ Prometheus
-               temp_map[field_name] = dbDataSet.FieldByName(field_name)->AsString;
-            }
+            reader.ToMap(temp_map);
 
             // slap it in the map.  overwrite if necessary.  not going to bother with the more generic multimap case.
-            field_map[key] = temp_map;
-            dbDataSet.Next();
+            field_map[key] = std::move(temp_map);
          }
          
          dbDataSet.Close();
@@ -1100,7 +1872,7 @@ bool SqlToMapMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapmap &field_
 // VIB port done 20121120
 bool SqlToMapMap(VIB::Database *dbDatabase, sqlcstr sql, sqlmapmap &field_map, bool preserve_fieldname_case)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1128,7 +1900,7 @@ bool SqlToSet(VIB::Transaction *dbTransaction, sqlcstr sql, sqlsetstr &field_set
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
       bool toReturn   = true;
@@ -1143,11 +1915,9 @@ bool SqlToSet(VIB::Transaction *dbTransaction, sqlcstr sql, sqlsetstr &field_set
       {
          StdDataSet(dbDataSet, dbTransaction, sql, can_commit);
          
-         while(!dbDataSet.Eof())
-         {
-            field_set.insert(dbDataSet.Fields->Fields[0]->AsString);
-            dbDataSet.Next();
-         }
+         SqlRowReader reader(dbDataSet);
+         while(reader.Next())
+            field_set.insert(reader.AsString(0));
 
          dbDataSet.Close();
          
@@ -1179,7 +1949,7 @@ bool SqlToSet(VIB::Transaction *dbTransaction, sqlcstr sql, sqlsetstr &field_set
 // VIB port done 20121120
 bool SqlToSet(VIB::Database *dbDatabase, sqlcstr sql, sqlsetstr &field_set)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1207,7 +1977,7 @@ bool SqlToList(VIB::Transaction *dbTransaction, sqlcstr sql, sqlliststr &result_
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
       bool toReturn   = true;
@@ -1222,11 +1992,9 @@ bool SqlToList(VIB::Transaction *dbTransaction, sqlcstr sql, sqlliststr &result_
       {
          StdDataSet(dbDataSet, dbTransaction, sql, can_commit);
          
-         while(!dbDataSet.Eof())
-         {
-            result_list.push_back(dbDataSet.Fields->Fields[0]->AsString);
-            dbDataSet.Next();
-         }
+         SqlRowReader reader(dbDataSet);
+         while(reader.Next())
+            result_list.push_back(reader.AsString(0));
 
          dbDataSet.Close();
          
@@ -1258,7 +2026,7 @@ bool SqlToList(VIB::Transaction *dbTransaction, sqlcstr sql, sqlliststr &result_
 // VIB port done 20121120
 bool SqlToList(VIB::Database *dbDatabase, sqlcstr sql, sqlliststr &result_list)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1286,7 +2054,7 @@ bool SqlToVec(VIB::Transaction *dbTransaction, sqlcstr sql, sqlvecstr &result_ve
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
       bool toReturn   = true;
@@ -1301,11 +2069,9 @@ bool SqlToVec(VIB::Transaction *dbTransaction, sqlcstr sql, sqlvecstr &result_ve
       {
          StdDataSet(dbDataSet, dbTransaction, sql, can_commit);
 
-         while(!dbDataSet.Eof())
-         {
-            result_vec.push_back(dbDataSet.Fields->Fields[0]->AsString);
-            dbDataSet.Next();
-         }
+         SqlRowReader reader(dbDataSet);
+         while(reader.Next())
+            result_vec.push_back(reader.AsString(0));
 
          dbDataSet.Close();
          
@@ -1337,7 +2103,7 @@ bool SqlToVec(VIB::Transaction *dbTransaction, sqlcstr sql, sqlvecstr &result_ve
 // VIB port done 20121120
 bool SqlToVec(VIB::Database *dbDatabase, sqlcstr sql, sqlvecstr &result_vec)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1365,7 +2131,7 @@ bool SqlToValueMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrs &fie
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
       std::string key;
@@ -1383,11 +2149,11 @@ bool SqlToValueMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrs &fie
 
          if(dbDataSet.FieldCount == 2)
          {
-            while(!dbDataSet.Eof())
+            SqlRowReader reader(dbDataSet);
+            while(reader.Next())
             {
-               key            = dbDataSet.Fields->Fields[0]->AsString;
-               field_map[key] = dbDataSet.Fields->Fields[1]->AsString;
-               dbDataSet.Next();
+               key            = reader.AsString(0);
+               field_map[key] = reader.AsString(1);
             }
          }
 
@@ -1421,7 +2187,7 @@ bool SqlToValueMap(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrs &fie
 // VIB port done 20121120
 bool SqlToValueMap(VIB::Database *dbDatabase, sqlcstr sql, sqlmapstrs &field_map)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1449,7 +2215,7 @@ bool SqlToMapStringVec(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrve
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
       std::string key;
@@ -1467,11 +2233,11 @@ bool SqlToMapStringVec(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrve
 
          if(dbDataSet.FieldCount == 2)
          {
-            while(!dbDataSet.Eof())
+            SqlRowReader reader(dbDataSet);
+            while(reader.Next())
             {
-               key = dbDataSet.Fields->Fields[0]->AsString;
-               field_map[key].push_back(dbDataSet.Fields->Fields[1]->AsString);
-               dbDataSet.Next();
+               key = reader.AsString(0);
+               field_map[key].push_back(reader.AsString(1));
             }
          }
 
@@ -1505,7 +2271,7 @@ bool SqlToMapStringVec(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrve
 // VIB port done 20121120
 bool SqlToMapStringVec(VIB::Database *dbDatabase, sqlcstr sql, sqlmapstrvec &field_map)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1533,7 +2299,7 @@ bool SqlToMapStringList(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrl
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
    
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       VIB::DataSet dbDataSet;
       std::string key;
@@ -1551,11 +2317,11 @@ bool SqlToMapStringList(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrl
 
          if(dbDataSet.FieldCount == 2)
          {
-            while(!dbDataSet.Eof())
+            SqlRowReader reader(dbDataSet);
+            while(reader.Next())
             {
-               key = dbDataSet.Fields->Fields[0]->AsString;
-               field_map[key].push_back(dbDataSet.Fields->Fields[1]->AsString);
-               dbDataSet.Next();
+               key = reader.AsString(0);
+               field_map[key].push_back(reader.AsString(1));
             }
          }
 
@@ -1589,7 +2355,7 @@ bool SqlToMapStringList(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrl
 // VIB port done 20121120
 bool SqlToMapStringList(VIB::Database *dbDatabase, sqlcstr sql, sqlmapstrlist &field_map)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1612,109 +2378,350 @@ bool SqlToMapStringList(VIB::Database *dbDatabase, sqlcstr sql, sqlmapstrlist &f
       return false;
 }
 //--------------------------------------------------------------------------
-// VIB port done 20121120
-bool ExecutePreparedInsert(VIB::Transaction *dbTransaction, sqlcstr tableName,
-                           sqlvecstr &field_names,
-                           sqllistvecstr &insert_data,
-                           sqlmapstrtoint *field_options)
+// In-place equivalent of the uppercasing and trimming that the sql_ field
+// options control, for reuse of a single buffer across rows.
+static void ApplyFieldOptions(std::string &value, int opts)
 {
-   VIB::Database db = dbTransaction->DefaultDatabase;
-   sqlmapstrtoint default_options;
+   if((opts & sql_no_uppercasing) == 0)
+   {
+      for(std::string::iterator itr = value.begin(); itr != value.end(); ++itr)
+      {
+         if(*itr >= 'a' && *itr <= 'z')
+            *itr += ('A' - 'a');
+      }
+   }
+   if((opts & sql_no_left_trimming) == 0)
+      value.erase(0, std::min(value.find_first_not_of(' '), value.length()));
+   if((opts & sql_no_right_trimming) == 0)
+   {
+      std::string::size_type last = value.find_last_not_of(' ');
+      value.erase(last == std::string::npos ? 0 : last + 1);
+   }
+}
+//--------------------------------------------------------------------------
+// Bind a field value by ordinal. Plain integers and reals headed for numeric
+// columns are bound natively so IBX need not parse them; anything else,
+// including scaled decimals and dates, is bound as a string as before.
+static void BindPreparedParam(VIB::SQL &dbSQL, int idx, int sql_type, sqlcstr value)
+{
+   const char *str = value.c_str();
 
-   if(!field_options)
-      field_options = &default_options;
+   switch(sql_type)
+   {
+   case VIB_SQL_SHORT:
+   case VIB_SQL_LONG:
+   case VIB_SQL_INT64:
+      {
+         long long result;
+
+         if(ParseInt64(str, result))
+         {
+            dbSQL.Params->SetInt64(idx, result);
+            return;
+         }
+      }
+      break;
+   case VIB_SQL_DOUBLE:
+   case VIB_SQL_FLOAT:
+   case VIB_SQL_D_FLOAT:
+      if(strspn(str, "0123456789+-.eE") == value.length())
+      {
+         char  *end    = NULL;
+         double result = strtod(str, &end);
+
+         if(end == str + value.length())
+         {
+            dbSQL.Params->SetDouble(idx, result);
+            return;
+         }
+      }
+      break;
+   default:
+      break;
+   }
+
+   dbSQL.Params->SetAsString(idx, value);
+}
+//--------------------------------------------------------------------------
+// BulkInserter
+BulkInserter::BulkInserter()
+   : transaction(NULL), statement(), fieldNames(), paramIndex(), paramType(),
+     paramOpts(), buffer(), commitEvery(0), commitRetaining(true), canCommit(false),
+     rows(0), pending(0), commits(0), startMS(0), elapsedMS(0)
+{
+}
+
+BulkInserter::~BulkInserter()
+{
+   Abort();
+}
+
+bool BulkInserter::Open(VIB::Transaction *dbTransaction, sqlcstr table_name, sqlcvecstr field_names,
+                        const sqlmapstrtoint *field_options, unsigned int commit_every,
+                        bool commit_retaining)
+{
+   Abort();
 
-   if(db.TestConnected())
+   if(field_names.empty())
+      return false;
+
+   try
    {
-      bool can_commit = true;
+      size_t n = field_names.size();
+      sqlvecstr param_names = field_names;
 
-      if(dbTransaction->Active)
-         can_commit = false;
+      transaction = dbTransaction;
+      canCommit   = !dbTransaction->Active;
 
-      if(!field_names.empty())
+      statement.Database    = dbTransaction->DefaultDatabase;
+      statement.Transaction = dbTransaction->getVIBTransaction();
+
+      if(canCommit)
+         dbTransaction->StartTransaction();
+
+      for(size_t i = 0; i < n; i++)
+         param_names[i] = ":" + param_names[i];
+
+      statement._SQL->Text = 
+         "insert into " + table_name + "(" + VecToCommaString(field_names) + ") "
+         "values (" + VecToCommaString(param_names) + ")";
+      statement.Prepare();
+
+      fieldNames = field_names;
+      paramIndex.resize(n);
+      paramType.resize(n);
+      paramOpts.resize(n);
+
+      for(size_t i = 0; i < n; i++)
       {
-         VIB::SQL dbSQL;
+         paramIndex[i] = statement.Params->IndexOf(field_names[i]);
+         paramType[i]  = statement.Params->GetSQLType(paramIndex[i]) & ~1;
+         paramOpts[i]  = sql_full_processing;
 
-         try
+         if(field_options)
          {
-            dbSQL.Database    = dbTransaction->DefaultDatabase;
-            dbSQL.Transaction = dbTransaction->getVIBTransaction();
-            
-            if(can_commit)
-               dbTransaction->StartTransaction();
+            sqlmapstrtoint::const_iterator opt_itr = field_options->find(field_names[i]);
+            if(opt_itr != field_options->end())
+               paramOpts[i] = opt_itr->second;
+         }
+      }
 
-            // sqlstring with parameter names
-            unsigned int n = field_names.size();
-            sqlvecstr param_names = field_names;
-            
-            for(unsigned int i = 0; i < n; i++)
-               param_names[i] = ":" + param_names[i];
+      commitEvery     = commit_every;
+      commitRetaining = commit_retaining;
+      rows = pending = commits = 0;
+      startMS   = Timer_getMS();
+      elapsedMS = 0;
 
-            std::string sqlstring = 
-               "insert into " + tableName + "(" + VecToCommaString(field_names) + ") "
-               "values (" + VecToCommaString(param_names) + ")";
-            
-            dbSQL._SQL->Text = sqlstring;
-            dbSQL.Prepare();
-            
-            std::string field_value;
-            std::string field_name;
+      return true;
+   }
+   catch(VIB::IBError & error)
+   {
+      last_sql_lib_error = error;
+   }
+   catch(...)
+   {
+   }
 
-            // loop through the rows
-            for(sqllistvecstr::iterator i_row = insert_data.begin(); i_row != insert_data.end(); i_row++)
-            {
-               // get the params in there
-               for(unsigned int i = 0; i < n; i++)
-               {
-                  field_value = (*i_row)[i];
-                  field_name  = field_names[i];
-                  if (field_value.empty())
-                  {
-                     dbSQL.Params->ByName(field_name)->IsNull = true;
-                  }
-                  else
-                  {
-                     sqlmapstrtoint::iterator opt_itr = field_options->find(field_name);
-                     
-                     if(opt_itr == field_options->end())
-                     {
-                        field_value = StripLeading(StripTrailing(UppercaseString(field_value), " "), " ");
-                     }
-                     else
-                     {
-                        int opts = opt_itr->second;
-                        if ((opts & sql_no_uppercasing) == 0)
-                           field_value = UppercaseString(field_value);
-                        if ((opts & sql_no_left_trimming) == 0)
-                           field_value = StripLeading(field_value, " ");
-                        if ((opts & sql_no_right_trimming) == 0)
-                           field_value = StripTrailing(field_value, " ");
-                     }
-                     dbSQL.Params->ByName(field_name)->AsString = field_value;
-                  }
-               }
+   Abort();
+   return false;
+}
 
-               dbSQL.ExecQuery();
-            }
+void BulkInserter::BindValue(size_t col, sqlcstr value)
+{
+   if(value.empty())
+      statement.Params->SetIsNull(paramIndex[col], true);
+   else
+   {
+      buffer.assign(value);
+      ApplyFieldOptions(buffer, paramOpts[col]);
+      BindPreparedParam(statement, paramIndex[col], paramType[col], buffer);
+   }
+}
 
-            if(can_commit)
-               dbTransaction->Commit();
+bool BulkInserter::Execute()
+{
+   statement.ExecQuery();
+   ++rows;
 
-            return true;
-         }
-         catch(VIB::IBError & error)
-         {
-            last_sql_lib_error = error;
-            if(dbTransaction->Active && can_commit)
-               dbTransaction->Rollback();
+   // a transaction the caller supplied is the caller's to commit
+   if(canCommit && commitEvery && ++pending >= commitEvery)
+   {
+      if(commitRetaining)
+         transaction->CommitRetaining();
+      else
+      {
+         transaction->Commit();
+         transaction->StartTransaction();
+         if(!statement.Prepared)
+            statement.Prepare(); // ordinals are unchanged for the same text
+      }
+      ++commits;
+      pending = 0;
+   }
+
+   return true;
+}
+
+bool BulkInserter::Insert(sqlcvecstr row)
+{
+   if(!transaction || row.size() != fieldNames.size())
+      return false;
+
+   try
+   {
+      for(size_t i = 0; i < row.size(); i++)
+         BindValue(i, row[i]);
+
+      return Execute();
+   }
+   catch(VIB::IBError & error)
+   {
+      last_sql_lib_error = error;
+   }
+   catch(...)
+   {
+   }
+
+   return false;
+}
+
+bool BulkInserter::Insert(sqlcmapstrs row)
+{
+   static const std::string null_value;
+
+   if(!transaction)
+      return false;
+
+   try
+   {
+      for(size_t i = 0; i < fieldNames.size(); i++)
+      {
+         sqlmapstrs::const_iterator itr = row.find(fieldNames[i]);
+         BindValue(i, itr == row.end() ? null_value : itr->second);
+      }
+
+      return Execute();
+   }
+   catch(VIB::IBError & error)
+   {
+      last_sql_lib_error = error;
+   }
+   catch(...)
+   {
+   }
+
+   return false;
+}
+
+void BulkInserter::Close()
+{
+   try
+   {
+      statement.Close();
+   }
+   catch(...)
+   {
+   }
+
+   elapsedMS   = Timer_getMS() - startMS;
+   transaction = NULL;
+}
+
+bool BulkInserter::Finish()
+{
+   bool toReturn = true;
+
+   if(!transaction)
+      return false;
+
+   try
+   {
+      if(canCommit && transaction->Active)
+      {
+         transaction->Commit();
+         if(pending)
+            ++commits;
+      }
+      pending = 0;
+   }
+   catch(VIB::IBError & error)
+   {
+      last_sql_lib_error = error;
+      toReturn = false;
+   }
+   catch(...)
+   {
+      toReturn = false;
+   }
+
+   if(!toReturn)
+      Abort();
+   else
+      Close();
+
+   return toReturn;
+}
+
+void BulkInserter::Abort()
+{
+   if(!transaction)
+      return;
+
+   try
+   {
+      if(canCommit && transaction->Active)
+         transaction->Rollback();
+   }
+   catch(...)
+   {
+   }
+
+   pending = 0;
+   Close();
+}
+
+unsigned int BulkInserter::ElapsedMS() const
+{
+   return transaction ? Timer_getMS() - startMS : elapsedMS;
+}
+
+double BulkInserter::RowsPerSecond() const
+{
+   unsigned int ms = ElapsedMS();
+   return ms ? rows * 1000.0 / ms : static_cast<double>(rows);
+}
+//--------------------------------------------------------------------------
+// VIB port done 20121120
+// Rewritten over BulkInserter; with commit_every set, rows are committed in
+// batches and a failure only rolls back the current batch.
+bool ExecutePreparedInsert(VIB::Transaction *dbTransaction, sqlcstr tableName,
+                           sqlvecstr &field_names,
+                           sqllistvecstr &insert_data,
+                           sqlmapstrtoint *field_options,
+                           unsigned int commit_every)
+{
+   VIB::Database db = dbTransaction->DefaultDatabase;
+
+   if(SqlIsConnected(db))
+   {
+      if(!field_names.empty())
+      {
+         BulkInserter inserter;
+
+         if(!inserter.Open(dbTransaction, tableName, field_names, field_options, commit_every))
             return false;
-         }
-         catch (...)
+
+         // loop through the rows
+         for(sqllistvecstr::iterator i_row = insert_data.begin(); i_row != insert_data.end(); i_row++)
          {
-            if(dbTransaction->Active && can_commit)
-               dbTransaction->Rollback();
-            return false;
+            if(!inserter.Insert(*i_row))
+            {
+               inserter.Abort();
+               return false;
+            }
          }
+
+         return inserter.Finish();
       } 
       else
       {
@@ -1730,9 +2737,10 @@ bool ExecutePreparedInsert(VIB::Transaction *dbTransaction, sqlcstr tableName,
 bool ExecutePreparedInsert(VIB::Database * dbDatabase, sqlcstr tableName,
                             sqlvecstr &field_names,
                             sqllistvecstr &insert_data,
-                            sqlmapstrtoint *field_options)
+                            sqlmapstrtoint *field_options,
+                            unsigned int commit_every)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1740,7 +2748,7 @@ bool ExecutePreparedInsert(VIB::Database * dbDatabase, sqlcstr tableName,
       try
       {
          StdTransaction(&dbTransaction, dbDatabase, false);
-         toReturn = ExecutePreparedInsert(&dbTransaction, tableName, field_names, insert_data, field_options);
+         toReturn = ExecutePreparedInsert(&dbTransaction, tableName, field_names, insert_data, field_options, commit_every);
       }
       catch(...)
       {
@@ -1766,7 +2774,7 @@ bool ExecutePreparedSetInsert(VIB::Transaction *dbTransaction, sqlcstr table_nam
    if(!field_options)
       field_options = &default_options;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       bool can_commit = true;
 
@@ -1861,7 +2869,7 @@ bool ExecutePreparedSetInsert(VIB::Database *dbDatabase, sqlcstr table_name,
                               sqlcstr field_name, sqlcsetstr &insert_data,
                               sqlmapstrtoint *field_options)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -1951,7 +2959,7 @@ bool SqlToCommaString(VIB::Transaction *dbTransaction, sqlcstr sql, std::string
 {
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       bool to_return;
       sqlvecstr temp_vec;
@@ -1972,7 +2980,7 @@ bool SqlToCommaString(VIB::Transaction *dbTransaction, sqlcstr sql, std::string
 // VIB port done 20121120
 bool SqlToCommaString(VIB::Database *dbDatabase, sqlcstr sql, std::string &result_string)
 {
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -2014,7 +3022,7 @@ bool ForeignKeyLookup(VIB::Transaction *dbTransaction, sqlcstr local_table_name,
 
    // shamelessly pulled from paul's codeSpecialDataQuery -- many thanks to paul for getting this "just right"
    VIB::Database db = dbTransaction->DefaultDatabase;
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       std::string gsql;
       gsql = 
@@ -2054,7 +3062,7 @@ bool ForeignKeyLookup(VIB::Database *dbDatabase, sqlcstr local_table_name, sqlcs
    if(!dbDatabase)
       return false;
 
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       StdTransaction(&dbTransaction, dbDatabase);
@@ -2090,7 +3098,7 @@ bool ForeignKeyLookupByConstraint(VIB::Transaction *dbTransaction, sqlcstr const
       return false;
 
    VIB::Database db = dbTransaction->DefaultDatabase;
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       std::string info_sql = 
          "select local_table.rdb$relation_name a, local_field.rdb$field_name b, foreign_table.rdb$relation_name c, foreign_field.rdb$field_name d "
@@ -2132,7 +3140,7 @@ bool ForeignKeyLookupByConstraint(VIB::Database *dbDatabase, sqlcstr constraint_
    if(!dbDatabase)
       return false;
 
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       StdTransaction(&dbTransaction, dbDatabase);
@@ -2169,7 +3177,7 @@ bool GetPrimaryKey(VIB::Transaction *dbTransaction, sqlcstr fk_table, sqlcstr fk
 
    VIB::Database db = dbTransaction->DefaultDatabase;
 
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       std::string pk_sql = 
          "select I2.rdb$relation_name pk_table, IS2.rdb$field_name pk_field "
@@ -2209,7 +3217,7 @@ bool GetPrimaryKey(VIB::Database *dbDatabase, sqlcstr fk_table, sqlcstr fk_field
    if(!dbDatabase)
       return false;
 
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       StdTransaction(&dbTransaction, dbDatabase);
@@ -2244,7 +3252,7 @@ bool GetForeignKeys(VIB::Transaction *dbTransaction, sqlcstr pk_table, sqlcstr p
       return false;
 
    VIB::Database db = dbTransaction->DefaultDatabase;
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       std::string fk_sql = 
          "select RC.rdb$relation_name fk_table, IS1.rdb$field_name fk_field "
@@ -2285,7 +3293,7 @@ bool GetForeignKeys(VIB::Database *dbDatabase, sqlcstr pk_table, sqlcstr pk_fiel
    if(!dbDatabase)
       return false;
 
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       StdTransaction(&dbTransaction, dbDatabase);
@@ -2320,7 +3328,7 @@ bool GetFieldsFromTable(VIB::Transaction *dbTransaction, sqlcstr table, sqlvecst
 
    std::string sql;
    VIB::Database db = dbTransaction->DefaultDatabase;
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       // get a list of all the fields in the table we were passed
       sql = 
@@ -2350,7 +3358,7 @@ bool GetFieldsFromTable(VIB::Database *dbDatabase, sqlcstr table, sqlvecstr &fie
    if(!dbDatabase)
       return false;
 
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       StdTransaction(&dbTransaction, dbDatabase);
@@ -2413,7 +3421,7 @@ bool GetTablePrimaryKey(VIB::Transaction *dbTransaction, sqlcstr table, sqlvecst
 
    std::string sql;
    VIB::Database db = dbTransaction->DefaultDatabase;
-   if(db.TestConnected())
+   if(SqlIsConnected(db))
    {
       // get a list of all the fields in the table we were passed
       sql = 
@@ -2446,7 +3454,7 @@ bool GetTablePrimaryKey(VIB::Database *dbDatabase, sqlcstr table, sqlvecstr &pk)
    if (!dbDatabase)
       return false;
 
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       bool toReturn = true;
@@ -2484,7 +3492,7 @@ bool CreateInsertMap(VIB::Transaction *dbTransaction, sqlcstr table, sqlmapstrs
 
    VIB::Database db = dbTransaction->DefaultDatabase;
    std::string sql;
-   if(all_is_well && db.TestConnected())
+   if(all_is_well && SqlIsConnected(db))
    {
       sqlvecmap fields;
       std::string sql = 
@@ -2533,7 +3541,7 @@ bool CreateInsertMap(VIB::Database *dbDatabase, sqlcstr table, sqlmapstrs &ins_m
    if(!dbDatabase)
       return false;
 
-   if(dbDatabase->TestConnected())
+   if(SqlIsConnected(*dbDatabase))
    {
       VIB::Transaction dbTransaction;
       StdTransaction(&dbTransaction, dbDatabase);
@@ -2601,7 +3609,7 @@ bool GetSqlPlan(VIB::Database *dbDatabase, sqlcstr sql_statement, std::string &p
    if(!dbDatabase) 
       all_is_well = false;
 
-   if(dbDatabase->TestConnected() && all_is_well)
+   if(SqlIsConnected(*dbDatabase) && all_is_well)
    {
       VIB::Transaction dbTransaction;
       
@@ -2786,43 +3794,28 @@ std::string SafeInClause(sqlcstr field, sqlcvecstr values)
 //--------------------------------------------------------------------------
 bool DataSetToCSV(VIB::DataSet *ds, sqlcstr filename, bool headers)
 {
-   std::fstream f;
+   // every field quoted, control characters blanked out, and CRLF line ends
+   // as the text-mode stream this used to write through gave
+   CSVWriter writer(',', '"', CSVWriter::QUOTE_ALL, "\r\n");
+   writer.replaceChars("\a\f\n\r\t", '?');
 
-   try
-   {
-      f.open(filename.c_str(), std::ios::out | std::ios::trunc);
-   }
-   catch(...)
-   { 
-      return false; 
-   }
-   
-   if(!f.is_open()) 
+   if(!writer.openFile(filename.c_str()))
       return false;
 
    try
    {
-      std::string answer;
       ds->First();
             
       if(headers)
       {
          for(int i = 0; i < ds->FieldCount; i++)
-         {
-            if(i > 0)
-               answer += ",";
-            answer += "\"" + ReplaceStringWithString(ReplaceAnyCharWithString(ds->Fields->Fields[i]->FieldName, "\a\f\n\r\t", "?"), "\"", "\"\"") + "\"";
-         }
-         f << answer << std::endl;
+            writer.field(ds->Fields->Fields[i]->FieldName);
+         writer.endRecord();
       }
       while(!ds->Eof())
       {
-         answer = "";
          for(int i = 0; i < ds->FieldCount; i++)
          {
-            if (i > 0)
-               answer += ",";
-            
             std::string value;
             try
             {
@@ -2832,21 +3825,19 @@ bool DataSetToCSV(VIB::DataSet *ds, sqlcstr filename, bool headers)
             {
             }
 
-            answer += "\"" + ReplaceStringWithString(ReplaceAnyCharWithString(value, "\a\f\n\r\t", "?"), "\"", "\"\"") + "\"";
+            writer.field(value);
          }
-         f << answer << std::endl;
+         writer.endRecord();
          ds->Next();
       }
    }
    catch(...) 
    { 
+      writer.close();
       return false; 
    }
    
-   if(f.is_open()) /* and it should be */ 
-      f.close();
-   
-   return true;
+   return writer.close();
 }
 //--------------------------------------------------------------------------
 // jhaley 20110224: I had to write this code for debugging back when I had issues with 
@@ -84,6 +84,13 @@ typedef sqlmapstrlist const &              sqlcmapstrlist;
 
 bool ConnectToDatabase(VIB::Database *dbDatabase, sqlcstr server, sqlcstr user_name, sqlcstr password);
 
+// Connection check made by the helpers below before they touch the database.
+// This reads IBX's local Connected flag rather than probing the server with
+// TestConnected; liveness is tested by PrometheusDB::connect and by
+// PrometheusPool on checkout, and a connection lost in between surfaces as an
+// IBError from the statement itself.
+inline bool SqlIsConnected(VIB::Database &db) { return db.Connected; }
+
 bool LockRecordForUpdate(VIB::Transaction* dbTransaction, sqlcstr tableName, sqlcstr id);
 
 bool ExecuteUpdateStatement(VIB::Transaction *dbTransaction, sqlcstr tableName, sqlcmapstrs fieldMap, const sqlmapstrtoint *field_options = NULL, bool show_error = false);
@@ -141,8 +148,8 @@ bool SqlToMapStringVec(VIB::Database    *dbDatabase,    sqlcstr sql, sqlmapstrve
 bool SqlToMapStringList(VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrlist &field_map);
 bool SqlToMapStringlist(VIB::Database    *dbDatabase,    sqlcstr sql, sqlmapstrlist &&field_map);
 
-bool ExecutePreparedInsert(VIB::Transaction *dbTransaction, sqlcstr tableName, sqlvecstr &field_names, sqllistvecstr &insert_data, sqlmapstrtoint *field_options = NULL);
-bool ExecutePreparedInsert(VIB::Database    *dbDatabase,    sqlcstr tableName, sqlvecstr &field_names, sqllistvecstr &insert_data, sqlmapstrtoint *field_options = NULL);
+bool ExecutePreparedInsert(VIB::Transaction *dbTransaction, sqlcstr tableName, sqlvecstr &field_names, sqllistvecstr &insert_data, sqlmapstrtoint *field_options = NULL, unsigned int commit_every = 0);
+bool ExecutePreparedInsert(VIB::Database    *dbDatabase,    sqlcstr tableName, sqlvecstr &field_names, sqllistvecstr &insert_data, sqlmapstrtoint *field_options = NULL, unsigned int commit_every = 0);
 
 bool StdTransaction(VIB::Transaction *dbTransaction, VIB::Database *dbDatabase, bool autostart = true);
 bool SpyTransaction(VIB::Transaction *dbTransaction, VIB::Database *dbDatabase, bool autostart = true);
@@ -260,6 +267,271 @@ public:
          return false;
    }
 };
+//--------------------------------------------------------------------------
+// SqlRowReader - shared row materialization for the SqlTo* family. Column
+// keys are resolved and case-folded once per query, and cell values are
+// fetched by ordinal a block of records at a time, rather than through a
+// FieldByName lookup for every cell of every row.
+class SqlRowReader
+{
+protected:
+   VIB::DataSet    &dataSet;
+   VIB::FetchBlock  block;
+   sqlvecstr        keys;     // row map key of each column
+   std::vector<int> keyOrder; // columns sorted by key, first of any duplicates only
+   int              row;      // current row within block
+
+public:
+   SqlRowReader(VIB::DataSet &ds, bool preserve_fieldname_case = false, int block_rows = 256);
+
+   // Step to the next record; returns false once the data set is exhausted.
+   // Must be called once before reading the first record.
+   bool Next();
+
+   int         ColumnCount() const    { return static_cast<int>(keys.size()); }
+   sqlcstr     Key(int col) const     { return keys[col]; }
+   bool        IsNull(int col) const  { return block.IsNull(row, col); }
+   std::string AsString(int col) const { return block.AsString(row, col); }
+
+   // Add the current record to an empty map, keyed by column.
+   void ToMap(sqlmapstrs &row_map) const;
+};
+//---------------------------------------------------------------------------
+// Per-connection LRU cache of prepared statements, keyed by SQL text with
+// comments removed and whitespace outside of quoted literals collapsed. The
+// key is only used for lookup; statements are prepared from the caller's own
+// text. IBX unprepares a statement when it is moved to another transaction,
+// and a data set whenever its transaction ends, so a cached statement is only
+// reused while it is still prepared. The overloads of the Cached functions
+// that take no transaction run in transactions of the cache's own, so that
+// their statements stay prepared from one call to the next: ExecQuery
+// statements in one committed after every call, and selects in a read-only,
+// read committed one that is left open until the cache is cleared. DDL and other
+// uncacheable statements are never cached, and clear the cache before they
+// run so that no cached statement holds locks on the objects they change.
+class SqlStatementCache
+{
+protected:
+   struct Entry
+   {
+      std::string   key;
+      VIB::SQL     *statement; // set for ExecQuery statements
+      VIB::DataSet *query;     // set for selects
+   };
+   typedef std::list<Entry> entrylist;
+
+   VIB::Database   *database;
+   VIB::Transaction ownTransaction; // for calls that supply no transaction
+   bool             ownReady;
+   VIB::Transaction readTransaction; // for selects that supply none
+   bool             readReady;
+   entrylist        entries;        // most recently used first
+   std::map<std::string, entrylist::iterator> index;
+   size_t           limit;
+   unsigned long    hits;
+   unsigned long    misses;
+   unsigned long    evictions;
+
+   Entry &Lookup(const std::string &key, bool &found);
+   void   Remove(entrylist::iterator itr);
+   void   Trim();
+
+private:
+   SqlStatementCache(const SqlStatementCache &);            // not copyable
+   SqlStatementCache &operator = (const SqlStatementCache &);
+
+public:
+   SqlStatementCache(VIB::Database *dbDatabase, size_t max_entries = 64);
+   ~SqlStatementCache();
+
+   // Prepared statement or data set for sql, bound to dbTransaction. Throws
+   // VIB::IBError if the statement cannot be prepared.
+   VIB::SQL     *Statement(VIB::Transaction *dbTransaction, sqlcstr sql);
+   VIB::DataSet *Query(VIB::Transaction *dbTransaction, sqlcstr sql);
+
+   // Transaction, not yet started, for use when the caller supplies none.
+   VIB::Transaction *OwnTransaction();
+   // Started read-only transaction for selects when the caller supplies none.
+   VIB::Transaction *ReadTransaction();
+
+   // Free every cached statement; call before disconnecting.
+   void Clear();
+
+   void           SetLimit(size_t max_entries);
+   size_t         Limit() const     { return limit;          }
+   size_t         Size() const      { return entries.size(); }
+   unsigned long  Hits() const      { return hits;           }
+   unsigned long  Misses() const    { return misses;         }
+   unsigned long  Evictions() const { return evictions;      }
+   VIB::Database *GetDatabase() const { return database;     }
+
+   static std::string NormalizeSql(sqlcstr sql);
+   static bool        IsCacheable(sqlcstr normalized_sql);
+};
+
+bool        CachedExecuteStatement(SqlStatementCache &cache, VIB::Transaction *dbTransaction, sqlcstr sqlstring, const sqlmapstrs *params = NULL);
+bool        CachedExecuteStatement(SqlStatementCache &cache, sqlcstr sqlstring, const sqlmapstrs *params = NULL);
+std::string CachedGetOneField(SqlStatementCache &cache, VIB::Transaction *dbTransaction, sqlcstr sqlstring);
+std::string CachedGetOneField(SqlStatementCache &cache, sqlcstr sqlstring);
+bool        CachedSqlToMap(SqlStatementCache &cache, VIB::Transaction *dbTransaction, sqlcstr sql, sqlmapstrs &field_map);
+bool        CachedSqlToMap(SqlStatementCache &cache, sqlcstr sql, sqlmapstrs &field_map);
+//---------------------------------------------------------------------------
+// Streams rows into one table through a single prepared insert. Parameter
+// ordinals, types, and field options are resolved once by Open, and values
+// are transformed in a reused buffer. If the transaction was not active at
+// Open, the inserter owns it: Finish commits it, and Abort or destruction
+// rolls back whatever has not been committed yet. With commit_every set, an
+// owned transaction is also committed (or commit-retained) after every that
+// many rows, so that long imports do not pile up in a single transaction.
+class BulkInserter
+{
+protected:
+   VIB::Transaction *transaction; // NULL when not open
+   VIB::SQL          statement;
+   sqlvecstr         fieldNames;
+   std::vector<int>  paramIndex;
+   std::vector<int>  paramType;
+   std::vector<int>  paramOpts;
+   std::string       buffer;
+   unsigned int      commitEvery;
+   bool              commitRetaining;
+   bool              canCommit;   // inserter started the transaction
+   unsigned long     rows;
+   unsigned long     pending;     // rows since the last commit
+   unsigned long     commits;
+   unsigned int      startMS;
+   unsigned int      elapsedMS;   // total time, once closed
+
+   void BindValue(size_t col, sqlcstr value);
+   bool Execute();
+   void Close();
+
+private:
+   BulkInserter(const BulkInserter &);             // not copyable
+   BulkInserter &operator = (const BulkInserter &);
+
+public:
+   BulkInserter();
+   ~BulkInserter();
+
+   bool Open(VIB::Transaction *dbTransaction, sqlcstr table_name, sqlcvecstr field_names,
+             const sqlmapstrtoint *field_options = NULL, unsigned int commit_every = 0,
+             bool commit_retaining = true);
+
+   // Insert one row, with values in field name order or keyed by field name.
+   // Empty and absent values are inserted as NULL.
+   bool Insert(sqlcvecstr row);
+   bool Insert(sqlcmapstrs row);
+
+   // Commit the rows not yet committed, if the inserter owns the transaction.
+   bool Finish();
+   // Roll back the rows not yet committed, if the inserter owns the transaction.
+   void Abort();
+
+   bool          IsOpen() const  { return transaction != NULL; }
+   unsigned long Rows() const    { return rows;                }
+   unsigned long Commits() const { return commits;             }
+   unsigned int  ElapsedMS() const;
+   double        RowsPerSecond() const;
+};
+//---------------------------------------------------------------------------
+// Lock for objects shared between threads, such as SqlIdAllocator and
+// PrometheusPool. Without Win32 there are no threads and it does nothing.
+class SqlMutex
+{
+protected:
+   void *cs;
+
+private:
+   SqlMutex(const SqlMutex &);            // not copyable
+   SqlMutex &operator = (const SqlMutex &);
+
+public:
+   SqlMutex();
+   ~SqlMutex();
+
+   void Lock();
+   void Unlock();
+};
+
+// Holds an SqlMutex for the rest of the enclosing scope.
+class SqlMutexHold
+{
+protected:
+   SqlMutex &mutex;
+
+private:
+   SqlMutexHold(const SqlMutexHold &);
+   SqlMutexHold &operator = (const SqlMutexHold &);
+
+public:
+   SqlMutexHold(SqlMutex &m) : mutex(m) { mutex.Lock(); }
+   ~SqlMutexHold()                      { mutex.Unlock(); }
+};
+//---------------------------------------------------------------------------
+// Hands out ids for tables with a uniformly-named <table>_gen generator,
+// like GetNextId, but reserves them a block at a time with a single
+// gen_id(<table>_gen, N) so that bulk loads do not make a round trip per
+// row. Block sizes can be set per table. Generators are outside transaction
+// control, so ids reserved but never used are simply skipped, as they would
+// be after a rolled back GetNextId. One allocator serves one database and may
+// be shared between threads; the gen_id round trip is made without its lock
+// held.
+class SqlIdAllocator
+{
+public:
+   struct Stats
+   {
+      unsigned int  block_size;
+      unsigned long refills;   // gen_id round trips
+      unsigned long issued;    // ids handed out
+      long long     remaining; // ids left in the current block
+   };
+
+protected:
+   struct Block
+   {
+      long long     next;
+      long long     last;
+      unsigned int  size;
+      unsigned long refills;
+      unsigned long issued;
+   };
+   typedef std::map<std::string, Block> blockmap;
+
+   blockmap      blocks;
+   unsigned int  defaultSize;
+   unsigned long clears;      // Clear count, so a refill racing one is not kept
+   SqlMutex      lock;
+
+   Block &GetBlock(sqlcstr table_name);
+   bool   Take(VIB::Transaction *dbTransaction, sqlcstr table_name, unsigned int count, sqlvecstr &ids);
+
+private:
+   SqlIdAllocator(const SqlIdAllocator &);            // not copyable
+   SqlIdAllocator &operator = (const SqlIdAllocator &);
+
+public:
+   SqlIdAllocator(unsigned int default_block_size = 100);
+   ~SqlIdAllocator();
+
+   // Next id for table_name, or "" if the generator could not be read.
+   std::string NextId(VIB::Transaction *dbTransaction, sqlcstr table_name);
+
+   // Append count ids for table_name to ids. Any shortfall beyond the current
+   // block is reserved in one round trip.
+   bool Reserve(VIB::Transaction *dbTransaction, sqlcstr table_name, unsigned int count, sqlvecstr &ids);
+
+   // Block size used for table_name from its next refill on; 0 restores the
+   // default.
+   void         SetBlockSize(sqlcstr table_name, unsigned int block_size);
+   unsigned int BlockSize(sqlcstr table_name);
+
+   bool GetStats(sqlcstr table_name, Stats &stats);
+
+   // Forget all reserved ids, eg. when the database connection changes.
+   void Clear();
+};
 //---------------------------------------------------------------------------
 extern sql_error last_sql_lib_error;
 //---------------------------------------------------------------------------
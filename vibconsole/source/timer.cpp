@@ -22,6 +22,20 @@ unsigned int Timer_getMS()
    return GetTickCount();
 }
 #endif
+
+/* Microseconds from the performance counter */
+unsigned long long Timer_getUS()
+{
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER now;
+
+   if(!freq.QuadPart)
+      QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&now);
+
+   return (unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000ULL +
+          (unsigned long long)(now.QuadPart % freq.QuadPart) * 1000000ULL / freq.QuadPart;
+}
 #elif !defined(VIBC_NO_SDL)
 /* Use SDL Timer if available */
 #include "SDL.h"
@@ -30,6 +44,12 @@ unsigned int Timer_getMS()
 {
    return SDL_GetTicks();
 }
+
+/* SDL 1.2 has no finer timer */
+unsigned long long Timer_getUS()
+{
+   return SDL_GetTicks() * 1000ULL;
+}
 #else
 /* No implementation provided, error */
 #error Need an implementation for Timer_getMS()!
@@ -8,6 +8,7 @@
 #define TIMER_H__
 
 unsigned int Timer_getMS();
+unsigned long long Timer_getUS();
 
 #endif
 
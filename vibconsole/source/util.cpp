@@ -4,6 +4,8 @@
 #include <sstream>
 #include <cstdarg>
 #include <algorithm>
+#include <climits>
+#include <cstring>
 
 #ifdef WIN32
 #include <sys/stat.h>
@@ -12,6 +14,7 @@
 #endif
 
 #include "util.h"
+#include "csvfile.h"
 
 //---------------------------------------------------------------------------
 
@@ -158,6 +161,41 @@ int LastDayOf(int month, int year)
    return (IsLeapYear(year) ? daysinleap[month] : daysinnorm[month]);
 }
 
+static int daysbeforenorm[13] = { 0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+static int daysbeforeleap[13] = { 0, 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335 };
+
+//
+// Number of leap years from 1 through year, by the same rule as IsLeapYear.
+//
+static int LeapYearsThrough(int year)
+{
+   if(year < 1582)
+      return year / 4;
+
+   // Julian leap years through 1581, then Gregorian ones from 1582 on
+   return 1581 / 4 + (year / 4 - year / 100 + year / 400) - (1581 / 4 - 1581 / 100 + 1581 / 400);
+}
+
+//
+// Day number of January 1 of a year, year >= 1.
+//
+static int FirstDayNumberOf(int year)
+{
+   return 365 * (year - 1) + LeapYearsThrough(year - 1) + 1;
+}
+
+//
+// Division rounding toward negative infinity, so that moving backward through
+// a cycle borrows the same way stepping one unit at a time does.
+//
+static int FloorDiv(long long num, int den)
+{
+   long long q = num / den;
+   if((num % den) < 0)
+      --q;
+   return static_cast<int>(q);
+}
+
 //pad to the left with a zero to make it two digits.
 utilstr twodigit(int incoming)
 {
@@ -178,40 +216,116 @@ utilstr threedigit(int incoming)
    return answer;
 }
 
+// Write an integer in decimal, padded on the left with zeros to at least
+// width characters as twodigit and threedigit do, and return the end.
+static char *PutDigits(char *out, int value, int width)
+{
+   char         digits[12];
+   int          n   = 0;
+   unsigned int u   = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+
+   do
+   {
+      digits[n++] = static_cast<char>('0' + u % 10);
+      u /= 10;
+   }
+   while(u);
+
+   if(value < 0)
+      digits[n++] = '-';
+
+   for(int i = n; i < width; i++)
+      *out++ = '0';
+   while(n)
+      *out++ = digits[--n];
+
+   return out;
+}
+
+static bool IsDigitChar(char c)
+{
+   return c >= '0' && c <= '9';
+}
+
+// atoi over a range: leading white space, an optional sign, then digits
+static int RangeToInt(const char *p, const char *end)
+{
+   bool      neg   = false;
+   long long value = 0;
+
+   while(p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+      ++p;
+   if(p < end && (*p == '-' || *p == '+'))
+      neg = (*p++ == '-');
+
+   while(p < end && IsDigitChar(*p))
+   {
+      if(value <= INT_MAX)
+         value = value * 10 + (*p - '0');
+      ++p;
+   }
+
+   if(neg)
+      value = -value;
+   if(value > INT_MAX)
+      return INT_MAX;
+   if(value < INT_MIN)
+      return INT_MIN;
+   return static_cast<int>(value);
+}
+
+static bool RangeHasAnyOf(const char *p, size_t len, const char *characters)
+{
+   for(size_t i = 0; i < len; i++)
+   {
+      if(strchr(characters, p[i]) && p[i])
+         return true;
+   }
+   return false;
+}
+
 // separate a string into three integers, ignoring leading spaces,
 // and differentiating the three integers by a single character.
 // used both for time and date parsing, to get h:m:s or m/d/y
 // or any other combination (see the date stuff to understand.)
 void septhree(utilcstr incoming, char separator, int &A, int&B, int&C)
 {
-   unsigned int beginA; // first digit
-   unsigned int beginB; // first mark
-   unsigned int beginC; // second mark
-   unsigned int beginD; // after last digit
+   septhree(incoming.data(), incoming.length(), separator, A, B, C);
+}
+
+// Likewise, straight out of a character range without making substrings.
+// Fields that are not found are left alone.
+void septhree(const char *incoming, size_t len, char separator, int &A, int&B, int&C)
+{
+   size_t beginA = 0; // first digit
+   size_t beginB;     // first mark
+   size_t beginC;     // second mark
+   size_t beginD;     // after last digit
 
-   beginA = incoming.find_first_of("0123456789");
+   while(beginA < len && !IsDigitChar(incoming[beginA]))
+      ++beginA;
 
-   if(beginA < incoming.length() - 1 && beginA != utilstr::npos)
+   if(beginA + 1 < len)
    {
-      beginB = incoming.find_first_of (separator, beginA + 1);
-      if(beginB < incoming.length() - 1 && beginB != utilstr::npos)
+      for(beginB = beginA + 1; beginB < len && incoming[beginB] != separator; beginB++)
+         ;
+      if(beginB + 1 < len)
       {
-         A = StringToInt(incoming.substr(beginA, beginB - beginA));
-         beginC = incoming.find_first_of (separator, beginB + 1);
-         if(beginC < incoming.length() - 1 && beginC != utilstr::npos)
+         A = RangeToInt(incoming + beginA, incoming + beginB);
+         for(beginC = beginB + 1; beginC < len && incoming[beginC] != separator; beginC++)
+            ;
+         if(beginC + 1 < len)
          {
-            B = StringToInt(incoming.substr(beginB + 1, beginC - beginB - 1));
-            beginD = incoming.find_first_not_of ("0123456789", beginC + 1);
-            if(beginD == utilstr::npos)
-               C = StringToInt(incoming.substr(beginC + 1));
-            else
-               C = StringToInt(incoming.substr(beginC + 1, beginD - beginC - 1));
+            B = RangeToInt(incoming + beginB + 1, incoming + beginC);
+            for(beginD = beginC + 1; beginD < len && IsDigitChar(incoming[beginD]); beginD++)
+               ;
+            C = RangeToInt(incoming + beginC + 1, incoming + beginD);
          }
-         else if(beginC == utilstr::npos)
-            B = StringToInt(incoming.substr(beginB + 1));
+         else if(beginC == len)
+            B = RangeToInt(incoming + beginB + 1, incoming + len);
       }
-      else if(beginB == utilstr::npos)
-         A = StringToInt(incoming.substr(beginA));
+      else if(beginB == len)
+         A = RangeToInt(incoming + beginA, incoming + len);
    }
 }
 
@@ -266,6 +380,11 @@ void Pdate::InDate(const time_t *time)
 }
 
 void Pdate::InDate(utilcstr incoming, int mode)
+{
+   InDate(incoming.data(), incoming.length(), mode);
+}
+
+void Pdate::InDate(const char *incoming, size_t len, int mode)
 {
    int y;
    int m;
@@ -277,11 +396,11 @@ void Pdate::InDate(utilcstr incoming, int mode)
 
    // jhaley 20151009: allow '-' in dates as well as '/'
    char sepchar = datechar;
-   if(!incoming.empty() && incoming.find(sepchar) == utilstr::npos)
+   if(len && !memchr(incoming, sepchar, len))
       sepchar = datecharalt;
 
    // take three chunks out
-   septhree (incoming, sepchar, a, b, c);
+   septhree (incoming, len, sepchar, a, b, c);
 
    // determine which is which
    if(mode & ymd)
@@ -324,6 +443,72 @@ void Pdate::InDate (const Pdate & incoming)
    day   = incoming.day;
 }
 
+// Day numbers are kept below the year 1000000, well clear of overflow
+#define PDATE_DAYNUMBER_YEARS 1000000
+
+static bool HasDayNumber(const Pdate &date)
+{
+   return date.IsValidDate() && date.year < PDATE_DAYNUMBER_YEARS;
+}
+
+//
+// Serial day number, counting 1 January of year 1 as day 1, with the same
+// calendar as IsLeapYear (which has no gap at the Gregorian changeover).
+// 0 for a date that is not valid.
+//
+int Pdate::DayNumber() const
+{
+   if(!HasDayNumber(*this))
+      return 0;
+
+   int before = IsLeapYear(year) ? daysbeforeleap[month] : daysbeforenorm[month];
+   return FirstDayNumberOf(year) + before + day - 1;
+}
+
+//
+// Set the date from a serial day number >= 1.
+//
+void Pdate::InDayNumber(int serial)
+{
+   // estimate the year, then correct; off by at most one
+   year = static_cast<int>((serial - 1) / 365.2425) + 1;
+   while(year > 1 && FirstDayNumberOf(year) > serial)
+      --year;
+   while(FirstDayNumberOf(year + 1) <= serial)
+      ++year;
+
+   int  dayOfYear = serial - FirstDayNumberOf(year);
+   int *before    = IsLeapYear(year) ? daysbeforeleap : daysbeforenorm;
+
+   month = 12;
+   while(month > 1 && before[month] > dayOfYear)
+      --month;
+   day = dayOfYear - before[month] + 1;
+}
+
+//
+// Move a date by a number of days. Dates that are not valid, or would leave
+// the range of day numbers, step one day at a time so they come out the same
+// as they always have.
+//
+static void AddDays(Pdate &date, long long days)
+{
+   if(HasDayNumber(date))
+   {
+      long long serial = date.DayNumber() + days;
+      if(serial >= 1 && serial < FirstDayNumberOf(PDATE_DAYNUMBER_YEARS))
+      {
+         date.InDayNumber(static_cast<int>(serial));
+         return;
+      }
+   }
+
+   for(; days > 0; days--)
+      date++;
+   for(; days < 0; days++)
+      date--;
+}
+
 bool Pdate::IsValidDate () const
 {
    if(month < 1 || month > 12) 
@@ -339,38 +524,56 @@ bool Pdate::IsValidDate () const
 
 utilstr Pdate::OutDate (int mode) const
 {
-   utilstr y, m, d, c;
+   char buf[outdate_size];
+   return utilstr(buf, OutDate(buf, mode));
+}
+
+// Format into buf, which must hold outdate_size characters; returns the
+// length written, not counting the terminating NUL.
+size_t Pdate::OutDate (char *buf, int mode) const
+{
+   char  y[12];
+   char *yend   = PutDigits(y, year, 0);
+   char *ystart = y;
+   int   width  = (mode & left_zeros) ? 2 : 0;
+   char  c      = (mode & no_separators) ? '\0' : datechar; // jhaley 20120723
+   char *p      = buf;
 
-   y = IntToString(year);
-   
-   if(mode & left_zeros)
-      m = twodigit(month);
-   else
-      m = IntToString(month);
-   
-   if(mode & left_zeros)
-      d = twodigit(day);
-   else
-      d = IntToString(day);
-   
-   c = "";
-   
-   if(!(mode & no_separators)) // jhaley 20120723
-      c += datechar;
-   
-   utilstr answer = "";
-   
    if(!(mode & yyyy))
-      y = y.substr(2);
+      ystart = (yend - y > 2) ? y + 2 : yend;
+
+   size_t ylen = yend - ystart;
 
    if(mode & ymd)
-      answer = y + c + m + c + d;
+   {
+      memcpy(p, ystart, ylen);
+      p += ylen;
+      if(c) *p++ = c;
+      p = PutDigits(p, month, width);
+      if(c) *p++ = c;
+      p = PutDigits(p, day, width);
+   }
    else if(mode & dmy)
-      answer = d + c + m + c + y;
+   {
+      p = PutDigits(p, day, width);
+      if(c) *p++ = c;
+      p = PutDigits(p, month, width);
+      if(c) *p++ = c;
+      memcpy(p, ystart, ylen);
+      p += ylen;
+   }
    else // (mode & mdy)
-      answer = m + c + d + c + y;
-   
-   return answer;
+   {
+      p = PutDigits(p, month, width);
+      if(c) *p++ = c;
+      p = PutDigits(p, day, width);
+      if(c) *p++ = c;
+      memcpy(p, ystart, ylen);
+      p += ylen;
+   }
+
+   *p = '\0';
+   return p - buf;
 }
 
 bool Pdate::operator < (const Pdate & rhs) const
@@ -483,36 +686,15 @@ Pdate Pdate::operator -- (int)
 int Pdate::mod (int p_distance, int p_metric)
 {
    if(p_metric == in_days)
-   {
-      while (p_distance)
-      {
-         if (p_distance > 0)
-         {
-            (*this)++;
-            p_distance--;
-         }
-         else
-         {
-            (*this)--;
-            p_distance++;
-         }
-      }
-   }
+      AddDays(*this, p_distance);
    else if (p_metric == in_weeks)
+      AddDays(*this, 7LL * p_distance);
+   else if (p_metric == in_months && month >= 1 && month <= 12)
    {
-      while (p_distance)
-      {
-         if (p_distance > 0)
-         {
-            for (int i = 0; i < 7; i++) (*this)++;
-            p_distance--;
-         }
-         else
-         {
-            for (int i = 0; i < 7; i++) (*this)--;
-            p_distance++;
-         }
-      }
+      long long months = 12LL * year + (month - 1) + p_distance;
+
+      year  = FloorDiv(months, 12);
+      month = static_cast<int>(months - 12LL * year) + 1;
    }
    else if (p_metric == in_months)
    {
@@ -541,21 +723,7 @@ int Pdate::mod (int p_distance, int p_metric)
       }
    }
    else if (p_metric == in_years)
-   {
-      while (p_distance)
-      {
-         if (p_distance > 0)
-         {
-            year++;
-            p_distance--;
-         }
-         else
-         {
-            year--;
-            p_distance++;
-         }
-      }
-   }
+      year += p_distance;
 
    // handle both leap years and changing from a month with 31 days
    // to a month with 30 days, but only after done moving through the
@@ -641,43 +809,13 @@ utilstr Pdate::NameOfMonth() const
 
 Pdate Pdate::operator += (int rhs)
 {
-   if(rhs > 0)
-   {
-      while(rhs > 0)
-      {
-         (*this)++;
-         rhs--;
-      }
-   }
-   else if(rhs < 0)
-   {
-      while(rhs < 0)
-      {
-         (*this)--;
-         rhs++;
-      }
-   }
+   AddDays(*this, rhs);
    return *this;
 }
 
 Pdate Pdate::operator -= (int rhs)
 {
-   if(rhs > 0)
-   {
-      while(rhs > 0)
-      {
-         (*this)--;
-         rhs--;
-      }
-   }
-   else if(rhs < 0)
-   {
-      while(rhs < 0)
-      {
-         (*this)++;
-         rhs++;
-      }
-   }
+   AddDays(*this, -static_cast<long long>(rhs));
    return *this;
 }
 
@@ -703,6 +841,9 @@ int operator - (const Pdate & lhs, const Pdate & rhs)
    // if days are the same, return zero.
    // if left later than right, return positive.
    // if left earlier than right, return negative.
+   if(HasDayNumber(lhs) && HasDayNumber(rhs))
+      return lhs.DayNumber() - rhs.DayNumber();
+
    int days_diff = 0;
    Pdate lowerbound((std::min)(lhs, rhs));
    Pdate upperbound((std::max)(lhs, rhs));
@@ -722,25 +863,7 @@ int operator - (const Pdate & lhs, const Pdate & rhs)
 
 int CalcAge(Pdate lhs)
 {
-   // 12/11/1980 to 12/11/1980: 0
-   // 12/11/1980 to 13/11/1980: 0
-   // 12/11/1980 to 11/11/1981: 0
-   // 12/11/1980 to 12/11/1981: 1
-   // 12/11/1980 to 13/11/1981: 1
-
-   int c = 0;
-   Pdate today = Pdate(Date(), global_mode); 
-   auto a = std::min<Pdate>(lhs, today);
-   auto b = std::max<Pdate>(lhs, today);
-   
-   while(a < b)
-   {
-      a.mod(1, in_years);
-      if(a <= b)
-         c++;
-   }
-
-   return c;
+   return CalcAge(lhs, Pdate(Date(), global_mode));
 }
 
 int CalcAge(Pdate lhs, Pdate rhs)
@@ -751,10 +874,25 @@ int CalcAge(Pdate lhs, Pdate rhs)
    // 12/11/1980 to 12/11/1981: 1
    // 12/11/1980 to 13/11/1981: 1
 
-   int c = 0;
    auto a = std::min<Pdate>(lhs, rhs);
    auto b = std::max<Pdate>(lhs, rhs);
-   
+
+   if(a.IsValidDate() && b.IsValidDate())
+   {
+      // Count the anniversaries up to b. Stepping a year at a time pulls a
+      // 29 February down to the 28th on the first anniversary, after which
+      // it stays there.
+      int anniversary = (a.month == 2 && a.day == 29) ? 28 : a.day;
+      int c = b.year - a.year;
+
+      if(c > 0 && (a.month > b.month || (a.month == b.month && anniversary > b.day)))
+         c--;
+
+      return c;
+   }
+
+   int c = 0;
+
    while(a < b)
    {
       a.mod(1, in_years);
@@ -940,37 +1078,43 @@ Ptime::Ptime(utilcstr incoming, int mode)
 }
 
 void Ptime::InTime(utilcstr incoming, int mode)
+{
+   InTime(incoming.data(), incoming.length(), mode);
+}
+
+void Ptime::InTime(const char *incoming, size_t len, int mode)
 {
    int  h  = 0;
    int  m  = 0;
    int  s  = 0;
    int  ms = 0;
-   utilstr time = incoming;
 
    // jhaley 20120914: check for milliseconds
    if(!(mode & withoutmillis))
    {
-      size_t dotpos = time.find_last_of(millichar);
-
-      if(dotpos != utilstr::npos)
+      for(size_t dotpos = len; dotpos > 0; dotpos--)
       {
-         ms = StringToInt(time.substr(dotpos+1));
-         time = time.substr(0, dotpos);
+         if(incoming[dotpos - 1] == millichar)
+         {
+            ms  = RangeToInt(incoming + dotpos, incoming + len);
+            len = dotpos - 1;
+            break;
+         }
       }
    }
 
    //take three chunks out
-   septhree (time, timechar, h, m, s);
+   septhree (incoming, len, timechar, h, m, s);
 
    //determine military time internally
    // guess whether they mean ampm or not by looking for a p, P, a, or A ...
-   if(time.find_first_of("pPaA") != utilstr::npos)
+   if(RangeHasAnyOf(incoming, len, "pPaA"))
       mode = ampm;
 
    if (!(mode & military))
    {
       h = h % 12;
-      if (time.find_first_of("pP") != utilstr::npos)
+      if (RangeHasAnyOf(incoming, len, "pP"))
          h += 12;
    }
 
@@ -1000,21 +1144,31 @@ bool Ptime::IsValidTime () const
 
 utilstr Ptime::OutTime (int mode) const
 {
-   utilstr answer = "";
-   
+   char buf[outtime_size];
+   return utilstr(buf, OutTime(buf, mode));
+}
+
+// Format into buf, which must hold outtime_size characters; returns the
+// length written, not counting the terminating NUL.
+size_t Ptime::OutTime (char *buf, int mode) const
+{
+   char *p     = buf;
+   int   width = (mode & left_zeros) ? 2 : 0;
+
    if(mode & military)
    {
-      if(mode & left_zeros)
-         answer = twodigit(hour);
-      else
-         answer = IntToString(hour);
-      
-      answer += timechar + twodigit(minute);
+      p = PutDigits(p, hour, width);
+      *p++ = timechar;
+      p = PutDigits(p, minute, 2);
       if(!(mode & withoutsec))
       {
-         answer += timechar + twodigit(second);
+         *p++ = timechar;
+         p = PutDigits(p, second, 2);
          if(!(mode & withoutmillis)) // jhaley 20120914
-            answer += millichar + threedigit(millisecond);
+         {
+            *p++ = millichar;
+            p = PutDigits(p, millisecond, 3);
+         }
       }
    }
    else
@@ -1028,20 +1182,26 @@ utilstr Ptime::OutTime (int mode) const
       }
       if(!h) 
          h = 12;
-      if(mode & left_zeros)
-         answer = twodigit(h);
-      else
-         answer = IntToString(h);
-      answer += timechar + twodigit(minute);
+      p = PutDigits(p, h, width);
+      *p++ = timechar;
+      p = PutDigits(p, minute, 2);
       if(!(mode & withoutsec))
       {
-         answer += timechar + twodigit(second);
+         *p++ = timechar;
+         p = PutDigits(p, second, 2);
          if (!(mode & withoutmillis)) // jhaley 20120914
-            answer += timechar + threedigit(millisecond);
+         {
+            *p++ = timechar;
+            p = PutDigits(p, millisecond, 3);
+         }
       }
-      answer += (pm) ? " pm" : " am";
+      *p++ = ' ';
+      *p++ = pm ? 'p' : 'a';
+      *p++ = 'm';
    }
-   return answer;
+
+   *p = '\0';
+   return p - buf;
 }
 
 bool Ptime::operator < (const Ptime & rhs) const
@@ -1149,8 +1309,7 @@ Ptime Ptime::operator -- (int)
 
 int Ptime::mod(int p_distance, int p_metric)
 {
-   int rolled = 0;
-   int ms_distance = p_distance;
+   long long ms_distance = p_distance;
 
    switch(p_metric)
    {
@@ -1169,6 +1328,24 @@ int Ptime::mod(int p_distance, int p_metric)
       break; // ???
    }
 
+   if(IsValidTime())
+   {
+      static const int msPerDay = 24 * 60 * 60 * 1000;
+
+      long long ms = ((hour * 60LL + minute) * 60 + second) * 1000 + millisecond + ms_distance;
+      int rolled   = FloorDiv(ms, msPerDay);
+      int msOfDay  = static_cast<int>(ms - static_cast<long long>(rolled) * msPerDay);
+
+      hour        = msOfDay / 3600000;
+      minute      = msOfDay / 60000 % 60;
+      second      = msOfDay / 1000 % 60;
+      millisecond = msOfDay % 1000;
+
+      return rolled;
+   }
+
+   // out-of-range times step a millisecond at a time, as they always have
+   int rolled = 0;
    int delta = 1, hourcap = 0, minutecap = 0, secondcap = 0, mscap = 0;
 
    if(ms_distance < 0)
@@ -1336,31 +1513,40 @@ Pstamp::Pstamp(utilcstr incoming, int mode)
 
 void Pstamp::InStamp(utilcstr incoming, int mode)
 {
-   unsigned int splitarea;
-   utilstr work_str = StripTrailing(StripLeading(incoming, " "), " ");
-   utilstr d = "";
-   utilstr t = "";
+   InStamp(incoming.data(), incoming.length(), mode);
+}
+
+void Pstamp::InStamp(const char *incoming, size_t len, int mode)
+{
+   const char *start = incoming;
+   const char *end   = incoming + len;
+
+   while(start < end && *start == ' ')
+      ++start;
+   while(end > start && end[-1] == ' ')
+      --end;
+
+   const char *splitarea;
 
    if(mode & datefirst)
    {
-      splitarea = work_str.find_first_of(" ", 0);
-      if(splitarea != utilstr::npos)
+      for(splitarea = start; splitarea < end && *splitarea != ' '; ++splitarea)
+         ;
+      if(splitarea < end)
       {
-         d = work_str.substr(0, splitarea);
-         t = work_str.substr(splitarea);
-         InDate (d, mode);
-         InTime (t, mode);
+         InDate (start, splitarea - start, mode);
+         InTime (splitarea, end - splitarea, mode);
       }
    }
    else
    {
-      splitarea = work_str.find_last_of(" ", work_str.length() - 1);
-      if(splitarea != utilstr::npos)
+      for(splitarea = end; splitarea > start && splitarea[-1] != ' '; --splitarea)
+         ;
+      if(splitarea > start)
       {
-         t = work_str.substr(0, splitarea);
-         d = work_str.substr(splitarea);
-         InDate (d, mode);
-         InTime (t, mode);
+         --splitarea;
+         InDate (splitarea, end - splitarea, mode);
+         InTime (start, splitarea - start, mode);
       }
    }
 }
@@ -1372,16 +1558,30 @@ bool Pstamp::IsValidStamp() const
 
 utilstr Pstamp::OutStamp(int mode) const
 {
-   utilstr d = OutDate(mode);
-   utilstr t = OutTime(mode);
-   utilstr answer = "";
+   char buf[outstamp_size];
+   return utilstr(buf, OutStamp(buf, mode));
+}
+
+// Format into buf, which must hold outstamp_size characters; returns the
+// length written, not counting the terminating NUL.
+size_t Pstamp::OutStamp(char *buf, int mode) const
+{
+   size_t len;
 
    if(mode & datefirst)
-      answer = d + utilstr(" ") + t;
+   {
+      len = OutDate(buf, mode);
+      buf[len++] = ' ';
+      len += OutTime(buf + len, mode);
+   }
    else
-      answer = t + utilstr(" ") + d;
+   {
+      len = OutTime(buf, mode);
+      buf[len++] = ' ';
+      len += OutDate(buf + len, mode);
+   }
 
-   return answer;
+   return len;
 }
 
 bool Pstamp::operator < (const Pstamp & rhs) const
@@ -3379,101 +3579,72 @@ bool DelimStringToVec(utilcstr raw_line, char quote_char, char delim_char, utilv
    return true;
 }
 //---------------------------------------------------------------------------
-// wrapper for DelimStringToVec
+// Load a delimited file with a header row into a vector of maps from field
+// name to value. Quoted fields may span lines; see CSVReader.
 bool CSVtoVecMap(utilcstr filename, char quote_char, char delim_char, utilvecmap &vecmap, utilstr &err_message, bool watch_doubles)
 {
-   utilvecstr   fields;
-   utilvecstr   datas;
-   utilmapstrs  field_data_map;
-   utilstr      raw_line;
-   bool         all_is_well = true;
-   std::fstream the_file;
-   unsigned int row = 0;
+   CSVReader reader(delim_char, quote_char, watch_doubles);
+   CSVRecord record;
 
    err_message = "";
 
    if(!FileExists(filename.c_str())) // FIXME
    {
       err_message = "Input file does not exist";
-      all_is_well = false;
+      return false;
    }
-   if(all_is_well)
+   if(!reader.open(filename.c_str()))
    {
-      try
-      { 
-         the_file.open(filename.c_str(), std::ios::in); 
-      }
-      catch(...) 
-      { 
-         all_is_well = false; 
-      }
+      err_message = reader.getError();
+      return false;
+   }
 
-      if(!the_file.is_open() || !all_is_well)
+   // first record should contain header row with field names
+   if(!reader.next(record))
+   {
+      err_message = reader.getError();
+      return err_message.empty();
+   }
+
+   // visit the fields in key order, so each row's map is built by appending;
+   // where a name repeats, the last column wins
+   utilvecstr          fields;
+   std::vector<size_t> order;
+
+   for(size_t i = 0; i < record.size(); i++)
+   {
+      fields.push_back(record.str(i));
+      order.push_back(i);
+   }
+   std::stable_sort(order.begin(), order.end(), [&fields] (size_t a, size_t b) {
+      return fields[a] < fields[b];
+   });
+   for(size_t i = 0; i + 1 < order.size(); )
+   {
+      if(fields[order[i]] == fields[order[i + 1]])
+         order.erase(order.begin() + i);
+      else
+         i++;
+   }
+
+   bool ok = reader.forEach([&] (const CSVRecord &row_record) -> bool {
+      if(row_record.size() < fields.size())
       {
-         err_message = "Could not open file";
-         all_is_well = false;
-      }
-      
-      try
-      { 
-         std::getline(the_file, raw_line, '\n'); 
-         row++; 
-      }
-      catch(...) 
-      { 
-         err_message = "Error reading from input file"; 
-         all_is_well = false; 
+         err_message = "Insufficient columns on row " + IntToString(static_cast<int>(reader.getLine())) +
+                       ":\n\n" + reader.getRawRecord();
+         return false;
       }
-      
-      if(raw_line.length() && raw_line[raw_line.length() - 1] == '\0')
-         raw_line = raw_line.substr(0, raw_line.length() - 1);
-      
-      // first line should contain header row with field names
-      if(all_is_well &&
-         DelimStringToVec(raw_line, quote_char, delim_char, fields, watch_doubles))
-      {
-         field_data_map.clear();
 
-         while(!the_file.eof() && all_is_well)
-         {
-            raw_line = "";
-            try
-            { 
-               getline(the_file, raw_line, '\n'); 
-               row++; 
-            }
-            catch(...)
-            { 
-               err_message = "Error reading from input file"; 
-               all_is_well = false; 
-            }
-            
-            // jhaley 20121128: bug: if length == 0, this would access the string at 4294967295
-            if(raw_line.length() && raw_line[raw_line.length() - 1] == '\0')
-               raw_line = raw_line.substr(0, raw_line.length() - 1);
-            
-            datas.clear();
-            if(all_is_well && raw_line.length() > 0 && 
-               DelimStringToVec(raw_line, quote_char, delim_char, datas, watch_doubles))
-            {
-               if(datas.size() >= fields.size())
-               {
-                  for (unsigned int i=0; i<fields.size(); i++)
-                     field_data_map[fields[i]] = datas[i];
-                  vecmap.push_back(field_data_map);
-               }
-               else
-               {
-                  err_message = "Insufficient columns on row " + IntToString(row) + ":\n\n" + raw_line;
-                  all_is_well = false;
-               }
-            }
-         }
-      }
-   }
+      utilmapstrs row;
+      for(size_t i = 0; i < order.size(); i++)
+         row.insert(row.end(), utilmapstrs::value_type(fields[order[i]], row_record.str(order[i])));
+      vecmap.push_back(std::move(row));
+      return true;
+   });
 
-   the_file.close();
-   return all_is_well;
+   if(err_message.empty())
+      err_message = reader.getError();
+   return ok && err_message.empty();
 }
 //---------------------------------------------------------------------------
 // Philip named this "in" because he's a dumbass
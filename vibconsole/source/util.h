@@ -128,6 +128,12 @@ enum pad_string_types
 #define millichar       '.' 
 #define y2kcut          1905
 
+// current - buffer sizes, NUL included, for the Out* forms that write into a
+//           caller's buffer; room for any field values, valid or not
+#define outdate_size    40
+#define outtime_size    56
+#define outstamp_size   96
+
 // current - used by Like() as meta characters for simple regular expressions.
 // notes   - corresponds to interbase/firebird's standard characters.
 #define match_any       '%'
@@ -147,9 +153,13 @@ public:
    Pdate(const time_t *time);   // jhaley 20120907
    bool IsValidDate () const;
    void InDate(utilcstr incoming, int mode);
+   void InDate(const char *incoming, size_t len, int mode);
    void InDate(const Pdate & incoming);
    void InDate(const time_t *time); // jhaley 20120907
+   void InDayNumber(int serial);
    utilstr OutDate (int mode) const;
+   size_t OutDate (char *buf, int mode) const;
+   int DayNumber() const;
    bool operator <  (const Pdate & rhs) const;
    bool operator <= (const Pdate & rhs) const;
    bool operator >  (const Pdate & rhs) const;
@@ -179,8 +189,10 @@ public:
    Ptime(utilcstr incoming, int mode);
    bool IsValidTime () const;
    void InTime(utilcstr incoming, int mode);
+   void InTime(const char *incoming, size_t len, int mode);
    void InTime(const Ptime & incoming);
    utilstr OutTime (int mode) const;
+   size_t OutTime (char *buf, int mode) const;
    bool operator <  (const Ptime & rhs) const;
    bool operator <= (const Ptime & rhs) const;
    bool operator >  (const Ptime & rhs) const;
@@ -201,7 +213,9 @@ public:
    Pstamp(utilcstr incoming, int mode);
    bool IsValidStamp() const;
    void InStamp(utilcstr incoming, int mode);
+   void InStamp(const char *incoming, size_t len, int mode);
    utilstr OutStamp (int mode) const;
+   size_t OutStamp (char *buf, int mode) const;
    bool operator <  (const Pstamp & rhs) const;
    bool operator <= (const Pstamp & rhs) const;
    bool operator >  (const Pstamp & rhs) const;
@@ -301,6 +315,7 @@ utilstr ConvertDate(utilcstr incoming, int y2kcutoff);
 utilstr ConvertStamp(utilcstr incoming, int y2kcutoff);
 utilstr ConvertBool(utilcstr incoming);
 void    septhree(utilcstr incoming, char separator, int &A, int&B, int&C);
+void    septhree(const char *incoming, size_t len, char separator, int &A, int&B, int&C);
 utilstr AddOptions(int searchOption, utilcstr field);
 utilstr PrettySSN(utilcstr incoming);
 utilstr PrettyDate(utilcstr incoming);
@@ -1,5 +1,26 @@
 //
-// Load other scripts
+// Scripts which define a single global are run the first time it is used;
+// see Core.lazyLoad. These come first, as the scripts below may use them.
+//
+
+// ECMAScript 6 Symbol
+Core.lazyLoad("Symbol", "jslib/symbolExtension.js");
+
+// ECMAScript 5.1 JSON object; only if the native one is missing
+Core.lazyLoad("JSON", "jslib/JSON.js");
+
+// JSONRequest module
+Core.lazyLoad("JSONRequest", "jslib/jsonRequest.js");
+
+// ECMAScript 6 Collections
+Core.lazyLoad("Map", "jslib/mapExtension.js");
+Core.lazyLoad("Set", "jslib/setExtension.js");
+
+// ECMAScript 6 Promise
+Core.lazyLoad("Promise", "jslib/promiseExtension.js");
+
+//
+// Scripts extending built-in objects are run now
 //
 
 // Extensions to Object
@@ -11,9 +32,6 @@ Core.loadScript("jslib/numberExtensions.js");
 // Extensions to Math
 Core.loadScript("jslib/mathExtensions.js");
 
-// ECMAScript 6 Symbol
-Core.loadScript("jslib/symbolExtension.js");
-
 // Extensions to Function
 Core.loadScript("jslib/functionExtensions.js");
 
@@ -29,15 +47,5 @@ Core.loadScript("jslib/regexpExtensions.js");
 // Extensions to JS Date class for Pdate/Pstamp support
 Core.loadScript("jslib/dateExtensions.js");
 
-// ECMAScript 5.1 JSON object
-Core.loadScript("jslib/JSON.js");
-
-// Load JSONRequest module
-Core.loadScript("jslib/jsonRequest.js");
-
-// ECMAScript 6 Collections
-Core.loadScript("jslib/mapExtension.js"); // Map
-Core.loadScript("jslib/setExtension.js"); // Set
-
 // EOF
 
@@ -1,6 +1,9 @@
 //
 // Polyfill for ECMAScript 5.1 JSON object
 //
+// The native JSON object (jsjson.cpp) normally resolves on the test below,
+// so this is only a fallback for builds without it.
+//
 
 if(!this.JSON) {
   Object.defineProperty(this, 'JSON', {
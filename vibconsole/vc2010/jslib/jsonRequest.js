@@ -26,7 +26,7 @@ if(!this.JSONRequest) {
           cf.open(url);
             
         this.responseText = cf.read().toUCString();
-        this.response = Core.evalUntrustedString('(' + this.responseText + ')');
+        this.response = JSON.parse(this.responseText);
       } catch(ex) {
         // TODO: some kind of error reporting.
       } finally {
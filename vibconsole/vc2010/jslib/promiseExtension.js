@@ -213,9 +213,11 @@
     });
   };
   
-  Promise._immediateFn = function (fn) {
-    fn();
-  };
+  // Reactions run as microtasks from the event loop where it is available;
+  // otherwise they still run synchronously.
+  Promise._immediateFn = (typeof queueMicrotask === 'function') ?
+    function (fn) { queueMicrotask(fn); } :
+    function (fn) { fn(); };
   
   Promise._unhandledRejectionFn = function _unhandledRejectionFn(err) {
     //Console.println('Possible unhandled promise rejection: ', err);
@@ -0,0 +1,34 @@
+//
+// A job for the batch server. Start a server in one console with
+//
+//   vibconsole -serve vibtest
+//
+// and submit from another with
+//
+//   vibconsole -submit vibtest jslib/tests/batchJobTest.js one "two words"
+//
+// Each submission should print the lines below, ending with "done", and exit
+// with code 3. The job count goes up on every run while the server is warm,
+// but a variable declared by the job is never left over from the last one.
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+var declaredByJob;
+check(declaredByJob === undefined, 'job globals are fresh');
+
+check(scriptFile === 'jslib/tests/batchJobTest.js', 'scriptFile');
+check(scriptArgs.length === 2 && scriptArgs[1] === 'two words', 'scriptArgs');
+
+declaredByJob = 1;
+
+// state kept on the main global survives between jobs
+var main = this.__parent__;
+main.batchJobRuns = (main.batchJobRuns || 0) + 1;
+Console.println('runs in this server: ' + main.batchJobRuns);
+
+Console.println('done');
+
+3; // the exit code
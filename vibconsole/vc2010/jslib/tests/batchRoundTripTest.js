@@ -0,0 +1,36 @@
+//
+// Time -submit round trips against a warm batch server. A client must hang
+// up as soon as it has the whole response, so each run should take little
+// more than the job itself, nowhere near the server's 10 second timeout.
+//
+// Usage: start a server from the vc2010 directory with
+//
+//   vibconsole -serve vibtest
+//
+// then, from the same directory in another console, run
+//
+//   vibconsole -noninteractive -file jslib/tests/batchRoundTripTest.js
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+var cmd  = 'vibconsole -submit vibtest jslib/tests/batchJobTest.js one "two words"';
+var runs = 5;
+var worst = 0;
+
+for(var i = 0; i < runs; i++) {
+  var start = Core.getMS();
+  var code  = Win.exec(null, cmd, false, true);
+  var ms    = Core.getMS() - start;
+
+  check(code === 3, 'run ' + (i + 1) + ' exit code');
+  worst = Math.max(worst, ms);
+}
+
+Console.println('slowest round trip: ' + worst + ' ms');
+check(worst < 2000, 'round trips finish well inside the server timeout');
+
+Console.println('done');
+Core.exit();
@@ -0,0 +1,61 @@
+//
+// Benchmark for loading rows through PrometheusBulkInserter.
+//
+// Inserts into a scratch table, once per commit interval, so the cost of
+// committing every row can be compared against batched commits. The table is
+// created if needed and emptied between passes.
+//
+// Usage: bulkInsertBench("ndw");
+//        bulkInsertBench("ndw", 50000, [1, 100, 1000, 0]);
+//
+
+bulkInsertBench = function (section, rows, intervals) {
+  var table = "BULK_INSERT_BENCH";
+  rows      = rows || 10000;
+  intervals = intervals || [1, 100, 1000, 0];
+
+  var db = new PrometheusDB();
+  if(!db.connect(section)) {
+    Console.println("Error: could not connect to database");
+    return;
+  }
+
+  try {
+    if(!db.getOneField("select rdb$relation_name from rdb$relations where rdb$relation_name = '" + table + "'")) {
+      db.executeStatement("create table " + table + " (id integer, name varchar(40), amount double precision)");
+    }
+
+    for(var i = 0; i < intervals.length; i++) {
+      db.executeStatement("delete from " + table);
+
+      var ins = db.bulkInserter(table, ["id", "name", "amount"], null, intervals[i]);
+      if(!ins) {
+        Console.println("Error: could not prepare insert");
+        break;
+      }
+
+      for(var r = 0; r < rows; r++) {
+        if(!ins.insert([r, "Row " + r, r * 1.5])) {
+          Console.println("Error: insert failed at row " + r);
+          ins.abort();
+          break;
+        }
+      }
+
+      if(ins.isOpen())
+        ins.finish();
+
+      var stats = ins.stats();
+      Console.println("Commit every " + (intervals[i] || "(end)") + ": " + stats.rows + " rows, " +
+                      stats.commits + " commits in " + stats.ms + " ms (" +
+                      Math.round(stats.rowsPerSecond) + " rows/sec)");
+    }
+
+    db.executeStatement("drop table " + table);
+  }
+  catch(err) {
+    Console.println("Caught exception during benchmark: " + err);
+  }
+
+  db.disconnect();
+};
@@ -0,0 +1,33 @@
+//
+// Benchmark for per-line console logging throughput.
+//
+// Run once with [console] buffered=0 in options.ini and once with the
+// default buffered output to compare. The final Console.flush() is timed
+// separately so that lines still queued at the end are accounted for.
+//
+// Usage: consoleLogBench();
+//        consoleLogBench(100000, "bench_echo.txt");
+//
+
+consoleLogBench = function (lines, echoFileName) {
+  lines = lines || 20000;
+
+  if(echoFileName)
+    Console.startEcho(echoFileName);
+
+  var start = Core.getMS();
+  for(var i = 0; i < lines; i++)
+    Console.println("Record " + i + ": the quick brown fox jumps over the lazy dog");
+  var logMS = Core.getMS() - start;
+
+  start = Core.getMS();
+  Console.flush();
+  var flushMS = Core.getMS() - start;
+
+  if(echoFileName)
+    Console.stopEcho();
+
+  var totalMS = logMS + flushMS;
+  Console.println(lines + " lines in " + logMS + " ms + " + flushMS + " ms flush (" +
+                  (totalMS > 0 ? Math.round(lines * 1000 / totalMS) : lines) + " lines/sec)");
+};
@@ -0,0 +1,73 @@
+//
+// Check LazyVecMap.FromCSV on the cases the old line-at-a-time parser got
+// wrong or never saw: quoted fields spanning lines, doubled quotes, blank
+// lines, other delimiters and malformed input. Then check that toCSV
+// writes what FromCSV reads.
+//
+// Usage: run from the vc2010 directory with -noninteractive
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+function writeFile(name, text) {
+  var f = new File(name, 'w');
+  f.puts(text);
+  f.close();
+}
+
+function loadError(name, delim) {
+  try {
+    LazyVecMap.FromCSV(name, delim);
+  } catch (e) {
+    return String(e);
+  }
+  return '';
+}
+
+var name = 'csvReaderTest.csv';
+
+writeFile(name,
+  'id,name,note\n' +
+  '1,"Smith, John","first line\nsecond line"\n' +
+  '\n' +
+  '2,Jones,"she said ""hi"""\n' +
+  '3,O"Brien,plain\n' +
+  '4,"",\n');
+
+var vm = LazyVecMap.FromCSV(name);
+check(vm.size() === 4, 'four rows, blank line skipped (' + vm.size() + ')');
+check(vm[0].name === 'Smith, John', 'delimiter inside quotes');
+check(vm[0].note === 'first line\nsecond line', 'quoted field spanning lines');
+check(vm[1].id === '2', 'record after a multi-line field');
+check(vm[1].note === 'she said "hi"', 'doubled quotes');
+check(vm[2].name === 'O"Brien', 'stray quote kept');
+check(vm[3].name === '' && vm[3].note === '', 'empty fields');
+
+writeFile(name, 'a;b\n"x;y";z\n');
+vm = LazyVecMap.FromCSV(name, ';');
+check(vm.size() === 1 && vm[0].a === 'x;y' && vm[0].b === 'z', 'semicolon delimiter');
+
+writeFile(name, 'a,b\n1,2\n"open,3\n4,5\n');
+check(loadError(name).indexOf('Unterminated') >= 0, 'unterminated quote reported');
+
+writeFile(name, 'a,b,c\n1,2,3\n4,5\n');
+check(loadError(name).indexOf('Insufficient columns on row 3') >= 0, 'short row reported');
+
+check(loadError('no_such_file.csv').indexOf('does not exist') >= 0, 'missing file reported');
+check(loadError(name, '').indexOf('delimiter must not be empty') >= 0, 'empty delimiter rejected');
+
+// toCSV writes what FromCSV reads
+writeFile(name, 'a,b\n"x, y",1\n"q""",2\n');
+vm = LazyVecMap.FromCSV(name);
+check(vm.toCSV({ quoting: 'needed' }) === 'a,b\n"x, y",1\n"q""",2\n', 'toCSV header, delimiters and quoting');
+check(vm.toCSV({ headers: false, delimiter: ';', quoting: 'none' }) === 'x, y;1\nq";2\n', 'toCSV options');
+check(vm.toCSV() === '"a","b"\n"x, y","1"\n"q""","2"\n', 'toCSV quotes everything by default');
+var bb = new ByteBuffer(64);
+check(vm.toCSV({ buffer: bb }) === bb && bb.toString() === vm.toCSV(), 'toCSV fills a ByteBuffer');
+vm.toCSV({ file: name });
+vm = LazyVecMap.FromCSV(name);
+check(vm.size() === 2 && vm[0].a === 'x, y' && vm[1].a === 'q"' && vm[1].b === '2', 'toCSV file read back');
+
+Console.println('done');
@@ -0,0 +1,51 @@
+//
+// Benchmark for CSV export through LazyVecMap.toCSV, which shares its
+// writer with DataSetToCSV: to a string, to a ByteBuffer and to a file,
+// with each quoting style. Loading the generated input with FromCSV is
+// timed too. Rates are in megabytes of CSV per second.
+//
+// Usage: csvWriteBench();
+//        csvWriteBench(500000);
+//
+
+csvWriteBench = function (rows) {
+  rows = rows || 200000;
+
+  var inName = 'csvWriteBench.csv', outName = 'csvWriteBench.out.csv';
+  var values = ['12345', 'Smith, John', '02/03/2001', 'some longer free text value here', '', 'she said "hi"'];
+
+  var out = new File(inName, 'w');
+  out.puts('id,name,visit,note,empty,quoted\n');
+  for (var i = 0; i < rows; i++) {
+    out.puts(i + ',"' + values[1] + '",' + values[2] + ',' + values[3] + ',,"she said ""hi"""\n');
+  }
+  out.close();
+
+  var start = Core.getMS();
+  var vm = LazyVecMap.FromCSV(inName);
+  Console.println('FromCSV: ' + vm.size() + ' rows in ' + (Core.getMS() - start) + ' ms');
+
+  var bytes = 0;
+  var rate = function (what, ms) {
+    Console.println(what + ': ' + (bytes / 1048576).toFixed(1) + ' MB in ' + ms + ' ms (' +
+                    (ms > 0 ? (bytes / 1048.576 / ms).toFixed(1) : '-') + ' MB/sec)');
+  };
+
+  var quotings = ['all', 'needed', 'none'];
+  for (var q = 0; q < quotings.length; q++) {
+    start = Core.getMS();
+    var text = vm.toCSV({ quoting: quotings[q] });
+    bytes = text.length;
+    rate('toCSV string, quoting ' + quotings[q], Core.getMS() - start);
+  }
+
+  var buffer = new ByteBuffer(1);
+  start = Core.getMS();
+  vm.toCSV({ buffer: buffer });
+  bytes = buffer.size;
+  rate('toCSV ByteBuffer', Core.getMS() - start);
+
+  start = Core.getMS();
+  vm.toCSV({ file: outName });
+  rate('toCSV file', Core.getMS() - start);
+};
@@ -0,0 +1,24 @@
+//
+// Test ordering of microtasks, immediates, timeouts and intervals.
+//
+// Run with -noninteractive (or call Core.setInteractive(false)); expected
+// order is: sync, microtask, immediate, timeout 10, tick 1..3, timeout 50.
+//
+
+Console.println('sync');
+
+queueMicrotask(function () { Console.println('microtask'); });
+setImmediate(function () { Console.println('immediate'); });
+
+setTimeout(function () { Console.println('timeout 50'); Core.exit(); }, 50);
+setTimeout(function (msg) { Console.println(msg); }, 10, 'timeout 10');
+
+var cleared = setTimeout(function () { Console.println('FAIL: cleared timeout ran'); }, 5);
+clearTimeout(cleared);
+
+var ticks = 0;
+var interval = setInterval(function () {
+  Console.println('tick ' + (++ticks));
+  if(ticks === 3)
+    clearInterval(interval);
+}, 12);
@@ -0,0 +1,54 @@
+//
+// Exercise the GC parameters and Core.gcStats: allocate a few hundred
+// thousand short-lived objects and report collections, pause times and the
+// arena count of each free list.
+//
+// Usage: run from the vc2010 directory with -noninteractive. Set longpause
+// in the [gc] section of options.ini to 1 to see every collection logged.
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+var oldMax = Core.getGCParameter('maxMallocBytes');
+Core.setGCParameter('maxMallocBytes', 8 * 1024 * 1024);
+check(Core.getGCParameter('maxMallocBytes') === 8 * 1024 * 1024, 'set maxMallocBytes');
+
+var threw = false;
+try {
+  Core.setGCParameter('noSuchParameter', 1);
+} catch (e) {
+  threw = true;
+}
+check(threw, 'unknown parameter throws');
+
+var before = Core.gcStats();
+var keep = [];
+for (var i = 0; i < 300000; i++) {
+  var o = { index: i, name: 'item' + i };
+  if (i % 1000 === 0)
+    keep.push(o);
+}
+Core.GC();
+var after = Core.gcStats();
+
+check(after.collections > before.collections, 'collections counted');
+check(after.totalPauseMS >= after.maxPauseMS, 'pause totals');
+// arenaSize stays 0 until js32.dll is rebuilt with JS_GetGCHeapStats
+if (after.arenaSize)
+  check(after.arenas > 0 && after.freeLists.length > 0, 'arena counts');
+else
+  Console.println('skipped: arena counts need a rebuilt js32.dll');
+
+Console.println('collections: ' + after.collections + ', max pause: ' + after.maxPauseMS +
+                ' ms, total: ' + after.totalPauseMS + ' ms');
+Console.println('heap: ' + after.bytes + ' of ' + after.maxBytes + ' bytes, ' +
+                after.arenas + ' arenas + ' + after.doubleArenas + ' double arenas');
+after.freeLists.forEach(function (list) {
+  if (list.arenas)
+    Console.println('  ' + list.thingSize + ' byte things: ' + list.arenas + ' arenas');
+});
+
+Core.setGCParameter('maxMallocBytes', oldMax);
+Console.println('done');
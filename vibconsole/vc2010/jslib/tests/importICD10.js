@@ -361,6 +361,9 @@ importICD10 = function () {
     return;
   }
 
+  // reserve code IDs a block at a time rather than one query per insert
+  db.setIdBlockSize("codes", 1000);
+
   // open transaction for insertions
   var tr = new PrometheusTransaction();  
   if(!tr.stdTransaction(db)) {
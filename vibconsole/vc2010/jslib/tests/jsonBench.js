@@ -0,0 +1,59 @@
+//
+// Benchmark comparing the native JSON.parse against evaluating the text in
+// an untrusted context, which is what the JSON.js polyfill does.
+//
+// The response is fetched once and then parsed repeatedly; large MediaWiki
+// API responses (several MB) make for a representative test.
+//
+// Usage: jsonBench("https://en.wikipedia.org/w/api.php?action=query&list=allpages&aplimit=500&format=json");
+//        jsonBench(url, 5);
+//
+
+jsonBench = function (url, passes) {
+  passes = passes || 3;
+
+  var text;
+  var cf = new CURLFile();
+  try {
+    cf.open(url);
+    text = cf.read().toUCString();
+  }
+  catch(err) {
+    Console.println("Error: could not fetch " + url + ": " + err);
+    return;
+  }
+  finally {
+    cf.close();
+  }
+
+  var mb   = text.length / (1024 * 1024);
+  var rate = function (ms) { return ms > 0 ? (mb * 1000 / ms).toFixed(2) : "-"; };
+
+  Console.println("Input: " + text.length + " characters");
+
+  try {
+    for(var pass = 1; pass <= passes; pass++) {
+      var start  = Core.getMS();
+      var native = JSON.parse(text);
+      var parseMS = Core.getMS() - start;
+
+      start = Core.getMS();
+      var evaled = Core.evalUntrustedString('(' + text + ')');
+      var evalMS = Core.getMS() - start;
+
+      start = Core.getMS();
+      var out = JSON.stringify(native);
+      var stringifyMS = Core.getMS() - start;
+
+      Console.println("Pass " + pass + ": parse " + parseMS + " ms (" + rate(parseMS) + " MB/sec), " +
+                      "eval " + evalMS + " ms (" + rate(evalMS) + " MB/sec), " +
+                      "stringify " + stringifyMS + " ms (" + out.length + " characters)");
+
+      native = evaled = out = null;
+      Core.GC();
+    }
+  }
+  catch(err) {
+    Console.println("Caught exception during benchmark: " + err);
+  }
+};
@@ -0,0 +1,35 @@
+//
+// Check that the jslib files registered with Core.lazyLoad in extensions.js
+// are only run once their global is used, that parented sandboxes share
+// the main global's copy rather than loading their own, and that bare
+// sandboxes, which never ran extensions.js, do not load them at all.
+//
+// Run from the vc2010 directory with -noninteractive -startupreport to see
+// the startup phases as well.
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+var lazy = Core.scriptCacheStats().lazyExtensions;
+check(!('Map' in lazy) && !('Promise' in lazy), 'Map and Promise not loaded at startup');
+
+var m = new Map();
+m.set('a', 1);
+check(m.get('a') === 1, 'Map works once touched');
+check('Map' in Core.scriptCacheStats().lazyExtensions, 'Map was loaded lazily');
+
+check(Core.evalSandbox('Map', true) === Map, 'parented sandbox shares the global Map');
+check(Core.evalSandbox('typeof Map', false) === 'undefined', 'bare sandbox loads nothing');
+check(Core.evalSandbox('typeof Map', false, true) === 'function', 'sandbox with extensions loads its own Map');
+
+check(typeof Promise === 'function', 'Promise loads on first use');
+
+var stats = Core.scriptCacheStats();
+Console.println('startup ' + stats.startupMS + ' ms: runtime ' + stats.runtimeMS +
+                ', extensions.js ' + stats.extensionsMS + ', autoexec.js ' + stats.autoexecMS);
+for (var name in stats.lazyExtensions)
+  Console.println('  lazy ' + name + ': ' + stats.lazyExtensions[name] + ' ms');
+
+Console.println('done');
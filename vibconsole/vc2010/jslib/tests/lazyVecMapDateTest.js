@@ -0,0 +1,99 @@
+//
+// Check LazyVecMap's date column kernels against the same work done a row
+// at a time with Pdate, over a generated CSV with a sprinkling of missing
+// and bad dates, and time both ways.
+//
+// Usage: run from the vc2010 directory with -noninteractive; pass a row
+//        count as the first script argument for a bigger run.
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+var rows = (typeof scriptArgs !== 'undefined' && scriptArgs.length) ? parseInt(scriptArgs[0], 10) : 20000;
+var csvName = 'lazyVecMapDateTest.csv';
+
+// id, birth date (mdy, some blank or bad), visit stamp
+var out = new File(csvName, 'w');
+check(out.isOpen(), 'opened ' + csvName);
+out.puts('id,birth,visit\n');
+for (var i = 0; i < rows; i++) {
+  var m = 1 + i % 12, d = 1 + (i * 7) % 28, y = 1920 + (i * 13) % 100;
+  var birth = (i % 97 === 0) ? '' : (i % 89 === 0) ? '13/45/2001' : m + '/' + d + '/' + y;
+  var visit = (1 + i % 12) + '/' + (1 + i % 28) + '/' + (2000 + i % 20) + ' 10:' + (10 + i % 50);
+  out.puts(i + ',"' + birth + '","' + visit + '"\n');
+}
+out.close();
+
+var vm = LazyVecMap.FromCSV(csvName);
+check(vm.size() === rows, 'loaded ' + vm.size() + ' rows');
+
+var asOf = new Pdate();
+asOf.year = 2015; asOf.month = 6; asOf.day = 30;
+
+// row at a time
+var start = Core.getMS();
+var want = { dayNumber: [], daysSince: [], age: [], year: [], month: [], dayOfWeek: [] };
+var wantRange = [];
+for (i = 0; i < rows; i++) {
+  var pd = new Pdate();
+  pd.inDate(vm[i].birth, DateTimeFlags.global_mode);
+  if (!pd.isValidDate()) {
+    for (var op in want)
+      want[op].push(null);
+    continue;
+  }
+  want.dayNumber.push(pd.dayNumber());
+  want.daysSince.push(pd.daysSince(asOf));
+  want.age.push(pd.calcAge(asOf));
+  want.year.push(pd.year);
+  want.month.push(pd.year * 100 + pd.month);
+  want.dayOfWeek.push(pd.dayOfWeek());
+  if (pd.year >= 1950 && pd.year <= 1979)
+    wantRange.push(i);
+}
+var rowMs = Core.getMS() - start;
+
+// whole columns
+start = Core.getMS();
+var got = {};
+for (op in want)
+  got[op] = vm.mapDateColumn('birth', op, asOf);
+var gotRange = vm.filterDateRange('birth', '1/1/1950', '12/31/1979');
+var columnMs = Core.getMS() - start;
+
+function sameArray(a, b) {
+  if (a.length !== b.length)
+    return false;
+  for (var k = 0; k < a.length; k++) {
+    if (a[k] !== b[k])
+      return false;
+  }
+  return true;
+}
+
+for (op in want)
+  check(sameArray(got[op], want[op]), 'mapDateColumn ' + op);
+check(sameArray(gotRange, wantRange), 'filterDateRange selected ' + gotRange.length + ' rows');
+
+// open ends, timestamps and errors
+check(vm.filterDateRange('birth', null, null).length === want.year.filter(function (v) { return v !== null; }).length,
+      'open range selects every valid date');
+check(sameArray(vm.filterDateRange('visit', '1/1/2019', null),
+                vm.mapDateColumn('visit', 'year').map(function (v, k) { return v === 2019 ? k : -1; })
+                  .filter(function (k) { return k >= 0; })),
+      'timestamp column filtered by its date part');
+check(vm.mapDateColumn('nosuchfield', 'year').every(function (v) { return v === null; }),
+      'missing field gives nulls');
+
+var threw = false;
+try { vm.mapDateColumn('birth', 'daysSince'); } catch (e) { threw = true; }
+check(threw, 'daysSince without a date throws');
+threw = false;
+try { vm.mapDateColumn('birth', 'fortnight'); } catch (e) { threw = true; }
+check(threw, 'unknown operation throws');
+
+Console.println('row at a time: ' + rowMs + ' ms; columns: ' + columnMs + ' ms');
+
+Console.println('done');
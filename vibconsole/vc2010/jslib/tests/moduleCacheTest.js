@@ -0,0 +1,43 @@
+//
+// Test the loadModule registry and the sandbox context pool: a module is
+// evaluated once and shared, reload and clearModuleCache re-evaluate it,
+// and repeated sandbox evaluation reuses pooled contexts without leaking
+// globals from one sandbox into the next.
+//
+// Run from the vc2010 directory with -noninteractive; expected output is
+// a list of "ok" lines followed by "done".
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+var a = Core.loadModule('jslib/tests/moduleTest.js');
+var b = Core.loadModule('jslib/tests/moduleTest.js');
+check(a === b, 'second load returns the same module');
+
+a.baz();
+check(b.baz() === 1, 'module state is shared');
+
+var c = Core.loadModule('jslib/tests/moduleTest.js', true);
+check(c !== a && c.baz() === 0, 'reload evaluates the module again');
+
+Core.clearModuleCache();
+check(Core.loadModule('jslib/tests/moduleTest.js') !== c, 'clearModuleCache forgets modules');
+
+var stats = Core.contextPoolStats();
+check(stats.moduleHits >= 1 && stats.moduleLoads >= 3, 'module statistics');
+
+// sandboxes must not see each other's globals
+Core.evalSandbox('var leaked = 1;', false);
+check(Core.evalSandbox('typeof leaked', false) === 'undefined', 'pooled sandbox globals are fresh');
+check(Core.evalUntrustedString('typeof Core') === 'undefined', 'restricted context has no natives');
+
+var before = Core.contextPoolStats();
+for (var i = 0; i < 1000; i++)
+  Core.evalSandbox('1 + 1');
+var after = Core.contextPoolStats();
+check(after.created === before.created && after.reused - before.reused === 1000,
+      'sandbox contexts are reused');
+
+Console.println('done');
@@ -0,0 +1,35 @@
+//
+// Switch on native call statistics, make a known number of native calls,
+// and check the counts, times and histogram that Core.nativeStats reports.
+//
+// Run from the vc2010 directory with -noninteractive. Add -nativestats to
+// see the table printed at exit as well.
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+var wasOn = Core.setNativeStats(true);
+Core.resetNativeStats();
+
+for (var i = 0; i < 5000; i++)
+  Core.contextPoolStats();
+
+var stats = Core.nativeStats();
+var s = stats['contextPoolStats'];
+
+check(s && s.calls === 5000, 'calls counted');
+check(s.totalMS >= 0 && s.meanUS <= s.maxUS + 1, 'times');
+check(s.p50US <= s.p99US && s.p99US <= Math.max(s.maxUS, 1), 'percentiles ordered');
+check(s.histogram.reduce(function (a, b) { return a + b; }, 0) === 5000, 'histogram sums to calls');
+
+Core.setNativeStats(false);
+Core.contextPoolStats();
+check(Core.nativeStats()['contextPoolStats'].calls === 5000, 'not counted when off');
+
+Core.resetNativeStats();
+check(!('contextPoolStats' in Core.nativeStats()), 'reset clears counts');
+
+Core.setNativeStats(wasOn);
+Console.println('done');
@@ -0,0 +1,205 @@
+//
+// Check the day-number arithmetic of Pdate, Ptime and Pstamp against the
+// step-at-a-time behavior it replaced, for every day from 1900 through 2100.
+// The reference dates are generated with increment(), which still steps one
+// day, and the month, year, age and time rules are ported from the old loops.
+//
+// Usage: run from the vc2010 directory with -noninteractive; takes a while.
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+function isLeapYear(y) {
+  if (y % 4) return false;
+  if (y < 1582) return true;
+  if (y % 100) return true;
+  return !(y % 400);
+}
+
+function lastDayOf(m, y) {
+  return [0, 31, isLeapYear(y) ? 29 : 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31][m];
+}
+
+function makeDate(d) {
+  var pd = new Pdate();
+  pd.year = d.year; pd.month = d.month; pd.day = d.day;
+  return pd;
+}
+
+function same(pd, d) {
+  return pd.year === d.year && pd.month === d.month && pd.day === d.day;
+}
+
+function key(d) {
+  return d.year * 10000 + d.month * 100 + d.day;
+}
+
+// old Pdate::mod for months and years
+function refMod(d, dist, metric) {
+  var r = { year: d.year, month: d.month, day: d.day };
+  for (; dist > 0; dist--) {
+    if (metric === DateTimeMod.in_years) r.year++;
+    else if (++r.month > 12) { r.month = 1; r.year++; }
+  }
+  for (; dist < 0; dist++) {
+    if (metric === DateTimeMod.in_years) r.year--;
+    else if (--r.month < 1) { r.month = 12; r.year--; }
+  }
+  if (r.day > lastDayOf(r.month, r.year))
+    r.day = lastDayOf(r.month, r.year);
+  return r;
+}
+
+// old CalcAge
+function refAge(a, b) {
+  if (key(a) > key(b)) { var t = a; a = b; b = t; }
+  var c = 0;
+  while (key(a) < key(b)) {
+    a = refMod(a, 1, DateTimeMod.in_years);
+    if (key(a) <= key(b))
+      c++;
+  }
+  return c;
+}
+
+// every day from 1900 through 2100
+var days = [];
+var walker = makeDate({ year: 1900, month: 1, day: 1 });
+while (walker.year <= 2100) {
+  days.push({ year: walker.year, month: walker.month, day: walker.day });
+  walker.increment();
+}
+var first = makeDate(days[0]);
+
+var failures = { number: 0, since: 0, dow: 0, add: 0, sub: 0, weeks: 0, months: 0, years: 0 };
+var offsets  = [1, 7, 30, 365, 366, 1000, 10000];
+var prevNumber, prevDow;
+
+for (var i = 0; i < days.length; i++) {
+  var d  = days[i];
+  var pd = makeDate(d);
+
+  var n = pd.dayNumber(), dow = pd.dayOfWeek();
+  if (i && n !== prevNumber + 1) failures.number++;
+  if (i && dow !== prevDow % 7 + 1) failures.dow++;
+  if (pd.daysSince(first) !== i || first.daysSince(pd) !== -i) failures.since++;
+  prevNumber = n;
+  prevDow    = dow;
+
+  for (var j = 0; j < offsets.length; j++) {
+    var k = offsets[j], t;
+    if (i + k < days.length) {
+      t = makeDate(d); t.addAssign(k);
+      if (!same(t, days[i + k])) failures.add++;
+      t = makeDate(d); t.subAssign(-k);
+      if (!same(t, days[i + k])) failures.sub++;
+    }
+    if (i - k >= 0) {
+      t = makeDate(d); t.addAssign(-k);
+      if (!same(t, days[i - k])) failures.add++;
+      t = makeDate(d); t.subAssign(k);
+      if (!same(t, days[i - k])) failures.sub++;
+    }
+  }
+
+  if (i + 70 < days.length && i >= 70) {
+    var w = makeDate(d); w.mod(10, DateTimeMod.in_weeks);
+    if (!same(w, days[i + 70])) failures.weeks++;
+    w = makeDate(d); w.mod(-10, DateTimeMod.in_weeks);
+    if (!same(w, days[i - 70])) failures.weeks++;
+  }
+
+  var dists = [1, -1, 11, -13, 25, -120];
+  for (j = 0; j < dists.length; j++) {
+    var m = makeDate(d); m.mod(dists[j], DateTimeMod.in_months);
+    if (!same(m, refMod(d, dists[j], DateTimeMod.in_months))) failures.months++;
+    var y = makeDate(d); y.mod(dists[j], DateTimeMod.in_years);
+    if (!same(y, refMod(d, dists[j], DateTimeMod.in_years))) failures.years++;
+  }
+}
+
+check(days.length === 73414, 'walked ' + days.length + ' days');
+for (var f in failures)
+  check(!failures[f], f + ' (' + failures[f] + ' mismatches)');
+
+// ages: every 7th birth date against a spread of later and earlier dates,
+// plus the leap-day edges
+var ageFailures = 0, ages = 0;
+for (i = 0; i < days.length; i += 7) {
+  var birth = makeDate(days[i]);
+  for (j = 3; j < days.length; j += 4391) {
+    if (birth.calcAge(makeDate(days[j])) !== refAge(days[i], days[j]))
+      ageFailures++;
+    ages++;
+  }
+}
+var edges = [[{ year: 1904, month: 2, day: 29 }, { year: 1905, month: 2, day: 28 }],
+             [{ year: 1904, month: 2, day: 29 }, { year: 1908, month: 2, day: 28 }],
+             [{ year: 1904, month: 2, day: 29 }, { year: 1908, month: 2, day: 29 }],
+             [{ year: 1904, month: 2, day: 29 }, { year: 1999, month: 3, day: 1 }],
+             [{ year: 1980, month: 11, day: 12 }, { year: 1981, month: 11, day: 11 }],
+             [{ year: 1980, month: 11, day: 12 }, { year: 1981, month: 11, day: 12 }]];
+for (i = 0; i < edges.length; i++) {
+  if (makeDate(edges[i][0]).calcAge(makeDate(edges[i][1])) !== refAge(edges[i][0], edges[i][1]) ||
+      makeDate(edges[i][1]).calcAge(makeDate(edges[i][0])) !== refAge(edges[i][0], edges[i][1]))
+    ageFailures++;
+  ages++;
+}
+check(!ageFailures, 'calcAge over ' + ages + ' pairs (' + ageFailures + ' mismatches)');
+
+// old Ptime::mod, a millisecond at a time
+function refTimeMod(t, ms) {
+  var r = { hour: t.hour, minute: t.minute, second: t.second, millisecond: t.millisecond, rolled: 0 };
+  var delta = ms < 0 ? -1 : 1;
+  for (; ms; ms -= delta) {
+    r.millisecond += delta;
+    if (r.millisecond >= 0 && r.millisecond <= 999) continue;
+    r.millisecond = delta < 0 ? 999 : 0;
+    r.second += delta;
+    if (r.second >= 0 && r.second <= 59) continue;
+    r.second = delta < 0 ? 59 : 0;
+    r.minute += delta;
+    if (r.minute >= 0 && r.minute <= 59) continue;
+    r.minute = delta < 0 ? 59 : 0;
+    r.hour += delta;
+    if (r.hour >= 0 && r.hour <= 23) continue;
+    r.hour = delta < 0 ? 23 : 0;
+    r.rolled += delta;
+  }
+  return r;
+}
+
+var timeFailures = 0, times = 0;
+var starts = [[0, 0, 0, 0], [0, 0, 0, 999], [12, 30, 30, 500], [23, 59, 59, 0], [23, 59, 59, 999]];
+var moves  = [[1, 'in_msec'], [-1, 'in_msec'], [1500, 'in_msec'], [-1500, 'in_msec'],
+              [61, 'in_seconds'], [-61, 'in_seconds'], [2, 'in_minutes'], [-2, 'in_minutes']];
+for (i = 0; i < starts.length; i++) {
+  for (j = 0; j < moves.length; j++) {
+    var s = new Pstamp();
+    s.year = 1999; s.month = 12; s.day = 31;
+    s.hour = starts[i][0]; s.minute = starts[i][1]; s.second = starts[i][2]; s.millisecond = starts[i][3];
+
+    var scale = { in_msec: 1, in_seconds: 1000, in_minutes: 60000 }[moves[j][1]];
+    var want  = refTimeMod(s, moves[j][0] * scale);
+    var date  = { year: 1999, month: 12, day: 31 + want.rolled };
+    if (date.day > 31) date = { year: 2000, month: 1, day: 1 };
+
+    s.mod(moves[j][0], DateTimeMod[moves[j][1]]);
+    if (s.hour !== want.hour || s.minute !== want.minute || s.second !== want.second ||
+        s.millisecond !== want.millisecond || !same(s, date))
+      timeFailures++;
+    times++;
+  }
+}
+check(!timeFailures, 'Pstamp.mod over ' + times + ' cases (' + timeFailures + ' mismatches)');
+
+// dates that are not valid still step one day at a time
+var bad = makeDate({ year: 2001, month: 2, day: 30 });
+bad.addAssign(2);
+check(bad.year === 2001 && bad.month === 3 && bad.day === 2, 'invalid date steps as before');
+check(bad.dayNumber() > 0 && makeDate({ year: 2001, month: 2, day: 30 }).dayNumber() === 0,
+      'dayNumber is 0 for an invalid date');
+
+Console.println('done');
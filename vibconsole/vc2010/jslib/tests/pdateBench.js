@@ -0,0 +1,62 @@
+//
+// Benchmark for Pdate arithmetic over spans typical of visit histories:
+// moving dates by years' worth of days, day differences, ages and month
+// steps. With the old one-day-at-a-time loops these scaled with the span;
+// they should now cost about the same as a property read.
+//
+// Usage: pdateBench();
+//        pdateBench(200000, 3650);
+//
+
+pdateBench = function (iterations, spanDays) {
+  iterations = iterations || 100000;
+  spanDays   = spanDays   || 365 * 40;
+
+  var base = new Pdate();
+  base.year = 1950; base.month = 6; base.day = 15;
+  var later = new Pdate(base);
+  later.addAssign(spanDays);
+
+  var report = function (what, ms) {
+    Console.println(what + ": " + iterations + " in " + ms + " ms (" +
+                    (ms > 0 ? Math.round(iterations * 1000 / ms) : iterations) + "/sec)");
+  };
+
+  var d = new Pdate(base), i, start, sum = 0;
+
+  start = Core.getMS();
+  for(i = 0; i < iterations; i++) {
+    d.addAssign(spanDays);
+    d.subAssign(spanDays);
+  }
+  report("addAssign/subAssign " + spanDays + " days", Core.getMS() - start);
+
+  start = Core.getMS();
+  for(i = 0; i < iterations; i++)
+    sum += later.daysSince(base);
+  report("daysSince", Core.getMS() - start);
+
+  start = Core.getMS();
+  for(i = 0; i < iterations; i++)
+    sum += base.calcAge(later);
+  report("calcAge", Core.getMS() - start);
+
+  start = Core.getMS();
+  for(i = 0; i < iterations; i++) {
+    d.mod(spanDays, DateTimeMod.in_months);
+    d.mod(-spanDays, DateTimeMod.in_months);
+  }
+  report("mod " + spanDays + " months", Core.getMS() - start);
+
+  var s = new Pstamp();
+  s.year = 1950; s.month = 6; s.day = 15;
+  start = Core.getMS();
+  for(i = 0; i < iterations; i++) {
+    s.mod(48, DateTimeMod.in_hours);
+    s.mod(-48, DateTimeMod.in_hours);
+  }
+  report("Pstamp mod 48 hours", Core.getMS() - start);
+
+  if(!d.equalTo(base) || sum < 0)
+    Console.println("Error: round trips did not return to the start date");
+};
@@ -0,0 +1,56 @@
+//
+// Profile a short script that mixes script work and native calls,
+// then check the split of time reported by Core.stopProfiler and that the
+// collapsed stacks were written.
+//
+// Run from the vc2010 directory with -noninteractive. The profile written to
+// profilerTest.folded can be passed to flamegraph.pl.
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+function busy(n) {
+  var s = 0;
+  for (var i = 0; i < n; i++)
+    s += Math.sqrt(i);
+  return s;
+}
+
+function natives(n) {
+  for (var i = 0; i < n; i++)
+    Core.contextPoolStats();
+}
+
+check(Core.startProfiler(1) === undefined, 'profiler started');
+
+var threw = false;
+try {
+  Core.startProfiler();
+} catch (e) {
+  threw = true;
+}
+check(threw, 'second start throws');
+
+busy(2000000);
+natives(20000);
+
+var r = Core.stopProfiler('profilerTest.folded');
+check(r.totalMS > 0, 'total time');
+check(r.samples > 0 && r.jsMS > 0, 'script samples');
+check(r.natives['contextPoolStats'] && r.natives['contextPoolStats'].calls === 20000,
+      'native calls counted');
+check(r.jsMS + r.nativeMS + r.waitMS <= r.totalMS + 1, 'time is not double counted');
+
+threw = false;
+try {
+  Core.stopProfiler();
+} catch (e) {
+  threw = true;
+}
+check(threw, 'stop without start throws');
+
+Console.println('total ' + r.totalMS + ' ms: ' + r.jsMS + ' script, ' + r.nativeMS +
+                ' native, ' + r.waitMS + ' waiting');
+Console.println('done');
@@ -0,0 +1,84 @@
+//
+// Check PrometheusCursor against sqlToVecMap on the same query, a row at a
+// time and in chunks, on a PrometheusDB and on a PrometheusTransaction.
+// Finally drop cursors together with what they were opened on and collect
+// them all at once, which must not disturb the connection.
+//
+// Usage: prometheusCursorTest("ndw");
+//
+
+prometheusCursorTest = function (section) {
+  var check = function (cond, what) {
+    Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+  };
+  var sql = "select rdb$relation_name as name from rdb$relations order by rdb$relation_name";
+
+  var db = new PrometheusDB();
+  if(!db.connect(section)) {
+    Console.println("Error: could not connect to database");
+    return;
+  }
+
+  var all = db.sqlToVecMap(sql);
+  check(all && all.size() > 2, 'reference query returned ' + (all ? all.size() : 0) + ' rows');
+
+  // a row at a time
+  var c = db.cursor(sql), row, n = 0, same = true;
+  check(c !== null && c.isOpen() && !c.atEnd(), 'cursor opened on database');
+  while((row = c.next()) !== null) {
+    same = same && row.name === all[n].name;
+    n++;
+  }
+  check(same && n === all.size(), 'next() read every row in order');
+  check(c.atEnd() && c.rowCount() === n, 'atEnd and rowCount');
+  check(c.next() === null, 'next() stays null at end');
+  c.close();
+  check(!c.isOpen(), 'closed');
+
+  // in chunks; each chunk holds only its own rows
+  c = db.cursor(sql);
+  var chunk, sizes = [], total = 0;
+  same = true;
+  while((chunk = c.fetch(2)) !== null) {
+    sizes.push(chunk.size());
+    for(var i = 0; i < chunk.size(); i++)
+      same = same && chunk[i].name === all[total + i].name;
+    total += chunk.size();
+  }
+  check(same && total === all.size(), 'fetch() read every row in order');
+  check(sizes.every(function (s) { return s >= 1 && s <= 2; }), 'fetch() chunks no larger than asked');
+  c.close();
+
+  // on a transaction the cursor did not start: left active
+  var tr = new PrometheusTransaction();
+  check(tr.stdTransaction(db), 'transaction started');
+  c = tr.cursor(sql);
+  check(c !== null && c.next() !== null, 'cursor opened on transaction');
+  c.close();
+  check(tr.isActive(), 'caller\'s transaction left active');
+  check(tr.commit(), 'caller\'s transaction committed');
+
+  // on one it did: committed at close
+  c = tr.cursor(sql);
+  check(c !== null && tr.isActive(), 'cursor started inactive transaction');
+  c.close();
+  check(!tr.isActive(), 'cursor committed the transaction it started');
+
+  check(db.cursor("select no_such_column from rdb$database") === null, 'bad query gives null');
+
+  // finalized in whatever order the GC likes
+  for(i = 0; i < 20; i++) {
+    var tdb = new PrometheusDB();
+    tdb.connect(section);
+    var ttr = new PrometheusTransaction();
+    ttr.stdTransaction(tdb);
+    tdb.cursor(sql).next();
+    ttr.cursor(sql).next();
+  }
+  tdb = ttr = null;
+  Core.GC();
+  check(db.getOneField("select count(*) from rdb$relations") == all.size(), 'survived collecting open cursors');
+
+  db.disconnect();
+  Console.println('done');
+};
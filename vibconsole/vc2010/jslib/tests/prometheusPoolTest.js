@@ -0,0 +1,89 @@
+//
+// Check PrometheusPool checkout, reuse and exhaustion, and that a pooled
+// connection stays with the cursors and transactions opened on it after
+// its PrometheusDB lets go, rather than going back to the pool under them.
+// Finally check that idle connections time out.
+//
+// Usage: prometheusPoolTest("ndw");
+//
+
+prometheusPoolTest = function (section) {
+  var check = function (cond, what) {
+    Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+  };
+  var sql = "select rdb$relation_name from rdb$relations";
+
+  var pool = new PrometheusPool();
+  if(!pool.open(section, 1, 2, 0)) {
+    Console.println("Error: could not open pool");
+    return;
+  }
+
+  try {
+    var s = pool.stats();
+    check(s.open === 1 && s.idle === 1 && s.inUse === 0, 'minimum connection opened');
+
+    var a = pool.acquire(), b = pool.acquire();
+    check(a && b && a.isPooled() && b.isPooled(), 'two connections checked out');
+    check(pool.acquire() === null && pool.stats().exhausted === 1, 'third checkout refused at maximum');
+
+    a.release();
+    s = pool.stats();
+    check(!a.isPooled() && s.idle === 1 && s.inUse === 1, 'released connection returned');
+
+    a = pool.acquire();
+    check(a && pool.stats().reused === 1, 'idle connection reused');
+
+    // a cursor keeps its connection checked out past the lease
+    var cursor = a.cursor(sql);
+    check(cursor !== null, 'cursor opened on pooled connection');
+    a.release();
+    check(pool.stats().inUse === 2, 'connection held by open cursor');
+    check(cursor.next() !== null, 'cursor reads after release');
+    cursor.close();
+    check(pool.stats().inUse === 1 && pool.stats().idle === 1, 'connection returned when cursor closed');
+
+    // and so does a transaction, until it is collected
+    a = pool.acquire();
+    var tr = new PrometheusTransaction();
+    check(tr.stdTransaction(a), 'transaction started on pooled connection');
+    a.release();
+    a = null;
+    Core.GC();
+    check(tr.getOneField("select count(*) from rdb$relations") > 0, 'transaction usable after release');
+    check(tr.commit(), 'transaction committed');
+    tr = null;
+    Core.GC();
+    check(pool.stats().inUse === 1, 'connection returned when transaction collected');
+
+    b.release();
+    check(pool.withConnection(function (db) { return db.getOneField("select 1 from rdb$database"); }) == 1,
+          'withConnection');
+    s = pool.stats();
+    check(s.inUse === 0 && s.open === 2, 'withConnection released its connection');
+  } finally {
+    pool.close();
+  }
+
+  check(!pool.isOpen() && pool.stats().open === 0, 'pool closed');
+  check(pool.acquire() === null, 'closed pool refuses checkout');
+
+  // idle connections beyond the minimum go at the next checkout or return,
+  // without any timer having to fire
+  if(pool.open(section, 0, 2, 50)) {
+    var c1 = pool.acquire(), c2 = pool.acquire();
+    c1.release();
+    c2.release();
+    s = pool.stats();
+    check(s.idle === 2, 'two connections idle');
+    var evicted = s.evicted;
+    for(var until = Core.getMS() + 100; Core.getMS() < until; ) {}
+    c1 = pool.acquire();
+    s = pool.stats();
+    check(c1 && s.evicted === evicted + 2 && s.open === 1, 'idle connections evicted at checkout');
+    c1.release();
+    pool.close();
+  }
+
+  Console.println('done');
+};
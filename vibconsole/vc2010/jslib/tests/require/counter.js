@@ -0,0 +1,3 @@
+// Counts how many times this module body runs, in requireLoads on the
+// global object
+exports.count = ++requireLoads;
@@ -0,0 +1,4 @@
+// Half of a circular dependency; see requireNativeTest.js
+exports.name = 'a';
+exports.partner = require('./cycleB').name;
+exports.done = true;
@@ -0,0 +1,4 @@
+// Half of a circular dependency; see requireNativeTest.js
+var a = require('./cycleA');
+exports.name = 'b';
+exports.sawPartial = (a.name === 'a' && !a.done);
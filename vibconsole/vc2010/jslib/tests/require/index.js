@@ -0,0 +1,6 @@
+// Diamond dependency: both sides require the same counter module
+var counter = require('./counter');
+module.exports = {
+  left:  require('./cycleA'),
+  count: counter.count
+};
@@ -0,0 +1,50 @@
+//
+// Test the native require: path resolution relative to the requiring
+// module, the module cache, circular dependencies, sandboxing of module
+// globals, and per-module timings. Uses the modules in jslib/tests/require
+// and requireTest.js.
+//
+// Run from the vc2010 directory with -noninteractive; expected output is
+// a list of "ok" lines followed by "done".
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+var requireLoads = 0;
+
+var f = require('./jslib/tests/requireTest');
+check(typeof f === 'function' && f() === 1 && f() === 2, 'module.exports replaced by a function');
+check(require('./jslib/tests/requireTest.js') === f, 'cached by resolved path');
+check(typeof x === 'undefined', 'module variables stay in the module');
+
+var dir = require('./jslib/tests/require');
+check(dir.left.name === 'a', 'directory resolves to index.js');
+check(dir.left.partner === 'b' && dir.left.done, 'circular require completes');
+check(require('./jslib/tests/require/cycleB').sawPartial, 'circular require sees partial exports');
+check(require('./jslib/tests/require/counter').count === 1, 'module body runs once');
+check(require('tests/require/counter') === require('./jslib/tests/require/counter.js'),
+      'bare ids are found in jslib');
+
+var threw = false;
+try {
+  require('./jslib/tests/require/missing');
+} catch (e) {
+  threw = true;
+}
+check(threw, 'missing module throws');
+
+var path = require.resolve('./jslib/tests/require/cycleA');
+var stats = require.stats();
+var found = null;
+for (var p in stats) {
+  if (p.toLowerCase() === path.toLowerCase())
+    found = stats[p];
+}
+check(found && found.hits >= 1 && typeof found.compileMS === 'number', 'per-module statistics');
+
+Core.clearModuleCache();
+check(require('./jslib/tests/requireTest')() === 1, 'clearModuleCache reloads modules');
+
+Console.println('done');
@@ -0,0 +1,48 @@
+//
+// Benchmark for materializing wide result sets through sqlToVecMap.
+//
+// Run against builds before and after a change to sqlLib's row handling to
+// compare; each pass is timed separately so warm-up is visible.
+//
+// Usage: sqlToVecMapBench("ndw");
+//        sqlToVecMapBench("ndw", "select * from some_wide_table", 5);
+//
+
+sqlToVecMapBench = function (section, sql, passes) {
+  // default query: a self-join of the field metadata is wide and always present
+  sql = sql || "select f1.*, f2.* from rdb$relation_fields f1, rdb$relation_fields f2 " +
+               "where f1.rdb$relation_name = f2.rdb$relation_name";
+  passes = passes || 3;
+
+  var db = new PrometheusDB();
+  if(!db.connect(section)) {
+    Console.println("Error: could not connect to database");
+    return;
+  }
+
+  try {
+    for(var pass = 1; pass <= passes; pass++) {
+      var start = Core.getMS();
+      var vm    = db.sqlToVecMap(sql);
+      var ms    = Core.getMS() - start;
+      var rows  = vm ? vm.size() : 0;
+      var cols  = 0;
+
+      if(rows > 0) {
+        for(var key in vm[0])
+          ++cols;
+      }
+
+      Console.println("Pass " + pass + ": " + rows + " rows x " + cols + " columns in " +
+                      ms + " ms (" + (ms > 0 ? Math.round(rows * 1000 / ms) : rows) + " rows/sec)");
+
+      vm = null;
+      Core.GC();
+    }
+  }
+  catch(err) {
+    Console.println("Caught exception during benchmark: " + err);
+  }
+
+  db.disconnect();
+};
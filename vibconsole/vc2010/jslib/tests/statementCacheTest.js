@@ -0,0 +1,47 @@
+//
+// Check that repeated single-row selects on a PrometheusDB are served by its
+// statement cache rather than prepared afresh each time, including across an
+// executeStatement in between, and that clearing the cache starts over.
+//
+// Usage: statementCacheTest("ndw");
+//
+
+statementCacheTest = function (section) {
+  var check = function (cond, what) {
+    Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+  };
+  var one = "select count(*) from rdb$relations";
+
+  var db = new PrometheusDB();
+  if(!db.connect(section)) {
+    Console.println("Error: could not connect to database");
+    return;
+  }
+  db.clearStatementCache();
+
+  var start = db.statementCacheStats();
+  var count = db.getOneField(one);
+  check(count > 0, 'getOneField returned ' + count);
+  var first = db.statementCacheStats();
+  check(first.misses === start.misses + 1, 'first getOneField prepares');
+
+  for(var i = 0; i < 5; i++)
+    db.getOneField(one);
+  var repeated = db.statementCacheStats();
+  check(repeated.hits === first.hits + 5, 'repeated getOneField hits the cache');
+  check(repeated.misses === first.misses, 'repeated getOneField prepares nothing');
+
+  // a write through the cache's other transaction leaves the selects prepared
+  check(db.executeStatement("execute block as begin end"), 'executeStatement');
+  var before = db.statementCacheStats();
+  db.getOneField(one);
+  check(db.statementCacheStats().hits === before.hits + 1, 'getOneField still hits after executeStatement');
+
+  db.clearStatementCache();
+  before = db.statementCacheStats();
+  db.getOneField(one);
+  check(db.statementCacheStats().misses === before.misses + 1, 'getOneField prepares again after clearing');
+
+  db.disconnect();
+  Console.println('done');
+};
@@ -0,0 +1,64 @@
+//
+// Test Worker message passing: strings, JSON values and ByteBuffer transfer
+// in both directions, onmessage dispatch from the event loop, errors, and
+// terminate. Uses workerTestChild.js as the worker script.
+//
+// Run from the vc2010 directory with -noninteractive; expected output is
+// a list of "ok" lines followed by "done".
+//
+
+function check(cond, what) {
+  Console.println((cond ? 'ok: ' : 'FAIL: ') + what);
+}
+
+// blocking receive
+var w = new Worker('jslib/tests/workerTestChild.js');
+
+check(w.receive(5000) === 'ready', 'worker started');
+
+w.postMessage('echo');
+check(w.receive(5000) === 'echo', 'string round trip');
+
+w.postMessage({ op: 'sum', values: [1, 2, 3, 4] });
+check(w.receive(5000) === 10, 'JSON round trip');
+
+var buf = new ByteBuffer(4);
+buf.fromString('abcd');
+w.postMessage(buf);
+check(buf.size === 0, 'ByteBuffer transferred away from sender');
+var back = w.receive(5000);
+check(back instanceof ByteBuffer && back.toString() === 'dcba', 'ByteBuffer round trip');
+
+w.postMessage({ op: 'close' });
+check(w.join(5000) && !w.isRunning(), 'worker closed');
+
+// event loop dispatch
+var pending = 2;
+function finished() {
+  if(--pending === 0) {
+    Console.println('done');
+    Core.exit();
+  }
+}
+
+var e = new Worker('jslib/tests/workerTestChild.js');
+e.onmessage = function (evt) {
+  if(evt.data === 'ready')
+    e.postMessage({ op: 'throw' });
+};
+e.onerror = function (evt) {
+  check(/worker failure/.test(evt.message), 'error passed to onerror');
+  e.terminate();
+  finished();
+};
+
+var spin = new Worker('jslib/tests/workerTestChild.js');
+spin.onmessage = function (evt) {
+  if(evt.data === 'ready') {
+    spin.postMessage({ op: 'spin' });
+    check(!spin.join(100), 'busy worker keeps running');
+    spin.terminate();
+    check(spin.join(5000), 'terminate stops a busy worker');
+    finished();
+  }
+};
@@ -0,0 +1,25 @@
+//
+// Worker script for workerTest.js
+//
+
+onmessage = function (evt) {
+  var msg = evt.data;
+
+  if(typeof msg === 'string')
+    postMessage(msg);
+  else if(typeof msg.fromString === 'function') { // ByteBuffer
+    var out = new ByteBuffer(msg.size);
+    out.fromString(msg.toString().split('').reverse().join(''));
+    postMessage(out);
+  }
+  else if(msg.op === 'sum')
+    postMessage(msg.values.reduce(function (a, b) { return a + b; }, 0));
+  else if(msg.op === 'throw')
+    throw new Error('worker failure');
+  else if(msg.op === 'spin')
+    for(;;) {}
+  else if(msg.op === 'close')
+    close();
+};
+
+postMessage('ready');